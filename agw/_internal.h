@@ -0,0 +1,186 @@
+/*
+ *  Project: ax25c - File: _internal.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AGW__INTERNAL_H_
+#define AGW__INTERNAL_H_
+
+#include "../runtime/primbuffer.h"
+#include "../runtime/dls.h"
+#include "agw.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define MODULE_NAME "AGW"
+
+/* Size of the read buffer, holds at least one frame of max. size */
+#define S_RX_BUF (2 * (AGW_HEAD + AGW_DATA_MAX))
+
+/* Size of an address text, callsign and digipeaters */
+#define S_ADDR 96
+
+/* Size of a monitor text */
+#define S_MON 512
+
+/* Callsigns a client can register with 'X' */
+#define AGW_CALLS 4
+
+/* Link states of a connection */
+enum agw_link_state {
+	LINK_DISCONNECTED,
+	LINK_SETUP,
+	LINK_CONNECTED,
+	LINK_DISC_REQUEST
+};
+
+/*
+ * A connection is a session of the peer DLS, clientHandle of the prims
+ * is the connection index. Every client owns a slot of connections, the
+ * index is slot * connections + the connection number of the client.
+ * Connections are owned by the reactor thread, the peer only queues.
+ */
+struct agw_conn {
+	enum agw_link_state state;
+	uint16_t            server_handle;
+	uint8_t             port;
+	char                mycall[AGW_CALL];
+	char                remote[AGW_CALL];
+};
+
+/* A frame waiting in the output queue of a client */
+struct agw_out {
+	struct agw_out *next;
+	size_t          len;
+	size_t          off;     /* Already sent */
+	uint8_t         data[0];
+};
+
+/* A socket connection */
+struct agw_client {
+	struct instance_handle *instance;
+	unsigned int            slot;
+	unsigned int            base;    /* Index of connection 0 of the slot */
+	int                     fd;
+	uint32_t                events;  /* Registered with epoll */
+	bool                    blocked; /* Output waits for EPOLLOUT */
+	bool                    monitor; /* 'm', monitor frames */
+	bool                    raw;     /* 'k', raw frames */
+	char                    calls[AGW_CALLS][AGW_CALL];
+	/* Output queue */
+	struct agw_out         *out_head;
+	struct agw_out        **out_tail;
+	size_t                  out_size; /* Queued octets */
+	unsigned long           mon_drops;
+	/* Input */
+	size_t                  rx_off;  /* Received, not yet handled */
+	size_t                  rx_len;
+	uint8_t                 rx_buf[S_RX_BUF];
+};
+
+/* A primitive seen by the monitor listener */
+struct agw_mon {
+	primitive_t *prim;
+	const char  *service;
+	bool         tx;
+};
+
+struct plugin_handle {
+	const char  *name;
+};
+
+struct instance_handle {
+	const char         *name;
+	/* Settings */
+	const char         *host;
+	const char         *port;
+	const char         *peer;
+	unsigned int        clients;
+	unsigned int        connections;
+	size_t              queue_max;
+	unsigned int        mon_queue;
+	/* State */
+	int                 listen_fd;
+	int                 epfd;
+	int                 event_fd;
+	bool                wakeup;     /* event_fd was written, atomic */
+	struct agw_client **client;     /* Per slot, NULL when free */
+	pthread_t           thread;
+	bool                thread_running;
+	volatile bool       alive;
+	/* Bridge */
+	dls_t               dls;
+	struct primbuffer   rx;         /* From the peer */
+	struct agw_conn    *conn;       /* n_conns */
+	unsigned int        n_conns;
+	/*
+	 * Monitor, a ring of referenced prims filled by the listener under
+	 * mon_lock. The listener must not sleep, formatting is done by the
+	 * reactor once per frame for all clients.
+	 */
+	void               *mon_handle;
+	unsigned int        n_monitor;  /* Clients with 'm' or 'k', atomic */
+	pthread_spinlock_t  mon_lock;
+	struct agw_mon     *mon_ring;   /* mon_queue */
+	unsigned int        mon_head;
+	unsigned int        mon_tail;
+	unsigned long       mon_drops;
+	unsigned long       data_drops; /* Links lost, client not reading */
+};
+
+/* Output queue above this drops monitor frames */
+static inline bool agw_mon_full(struct agw_client *client)
+{
+	return client->out_size > client->instance->queue_max / 2;
+}
+
+/* Output queue above this stops reading the client */
+static inline bool agw_full(struct agw_client *client)
+{
+	return client->out_size > client->instance->queue_max;
+}
+
+/*
+ * Output queue above this takes no more data of the peer, the link is
+ * disconnected. Reading the client stopped long before at agw_full.
+ */
+static inline bool agw_stuck(struct agw_client *client)
+{
+	return client->out_size > 2 * client->instance->queue_max;
+}
+
+/* server.c */
+extern bool server_start(struct instance_handle *instance,
+		struct exception *ex);
+extern void *server_worker(void *id);
+extern void server_stop(struct instance_handle *instance);
+extern void agw_send(struct agw_client *client, const struct agw_head *head,
+		const uint8_t *data, bool monitor);
+
+/* session.c */
+extern bool sessions_start(struct instance_handle *instance,
+		struct exception *ex);
+extern void sessions_stop(struct instance_handle *instance);
+extern void sessions_wake(struct instance_handle *instance);
+extern void sessions_woken(struct instance_handle *instance);
+extern void sessions_attach(struct agw_client *client);
+extern void sessions_detach(struct agw_client *client);
+extern void sessions_receive(struct instance_handle *instance);
+extern void agw_on_frame(struct agw_client *client,
+		const struct agw_head *head, const uint8_t *data);
+
+#endif /* AGW__INTERNAL_H_ */
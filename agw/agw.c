@@ -0,0 +1,114 @@
+/*
+ *  Project: ax25c - File: agw.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "agw.h"
+
+#include <string.h>
+#include <assert.h>
+
+static void get_call(const uint8_t *p, char *call)
+{
+	memcpy(call, p, AGW_CALL);
+	call[AGW_CALL] = '\0';
+}
+
+void agw_head_decode(const uint8_t *p, struct agw_head *h)
+{
+	assert(p);
+	assert(h);
+	h->port = p[0];
+	h->kind = p[4];
+	h->pid  = p[6];
+	get_call(&p[8], h->call_from);
+	get_call(&p[18], h->call_to);
+	h->len  = agw_get32(&p[28]);
+	h->user = agw_get32(&p[32]);
+}
+
+void agw_head_encode(const struct agw_head *h, uint8_t *p)
+{
+	assert(h);
+	assert(p);
+	memset(p, 0x00, AGW_HEAD);
+	p[0] = h->port;
+	p[4] = h->kind;
+	p[6] = h->pid;
+	strncpy((char*)&p[8], h->call_from, AGW_CALL);
+	strncpy((char*)&p[18], h->call_to, AGW_CALL);
+	agw_put32(&p[28], h->len);
+	agw_put32(&p[32], h->user);
+}
+
+void agw_set_call(char *field, const char *call)
+{
+	size_t n = strlen(call);
+
+	if (n > AGW_CALL - 1)
+		n = AGW_CALL - 1;
+	memcpy(field, call, n);
+	field[n] = '\0';
+}
+
+void agw_ax25_call(const uint8_t *addr, char *pb)
+{
+	unsigned int i, ssid;
+	char c;
+
+	for (i = 0; i < 6; ++i) {
+		c = (char)(addr[i] >> 1);
+		if (c == ' ')
+			break;
+		*pb++ = c;
+	} /* end for */
+	ssid = (addr[6] >> 1) & 0x0f;
+	if (ssid) {
+		*pb++ = '-';
+		if (ssid >= 10)
+			*pb++ = '1';
+		*pb++ = (char)('0' + ssid % 10);
+	}
+	*pb = '\0';
+}
+
+bool agw_ax25_parse(const uint8_t *p, size_t n, struct agw_ax25 *f)
+{
+	size_t i;
+
+	assert(p);
+	assert(f);
+	memset(f, 0x00, sizeof(struct agw_ax25));
+	/* Destination and source, then up to 8 digipeaters */
+	if (n < 15)
+		return false;
+	agw_ax25_call(&p[0], f->dst);
+	agw_ax25_call(&p[7], f->src);
+	for (i = 14; !(p[i - 1] & 0x01); i += 7) {
+		if ((f->n_digi == 8) || (i + 7 >= n))
+			return false;
+		agw_ax25_call(&p[i], f->digi[f->n_digi++]);
+	} /* end for */
+	f->ctrl = p[i++];
+	/* UI and I frames carry a PID */
+	if (((f->ctrl & 0xef) == 0x03) || !(f->ctrl & 0x01)) {
+		if (i >= n)
+			return false;
+		f->pid = p[i++];
+		f->info = &p[i];
+		f->n_info = n - i;
+	}
+	return true;
+}
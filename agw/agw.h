@@ -0,0 +1,128 @@
+/*
+ *  Project: ax25c - File: agw.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file agw.h
+ * @brief AGWPE framing: Header codec and AX.25 address helpers.
+ *
+ * Every AGWPE frame is a 36 octet header followed by DataLen octets of
+ * data. Numbers are little endian, the callsigns are NUL padded text.
+ */
+#ifndef AGW_AGW_H_
+#define AGW_AGW_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Size of the frame header */
+#define AGW_HEAD 36
+
+/* Size of a callsign field, including the NUL */
+#define AGW_CALL 10
+
+/* Max. data length of a received frame */
+#define AGW_DATA_MAX 4096
+
+/* Version reported by 'R' */
+#define AGW_VERSION_MAJOR 2005
+#define AGW_VERSION_MINOR 127
+
+/**
+ * @brief Decoded frame header.
+ */
+struct agw_head {
+	uint8_t  port;                  /**< Radio port, 0 is the first.  */
+	uint8_t  kind;                  /**< DataKind, 'C', 'D', ...      */
+	uint8_t  pid;                   /**< PID of the frame.            */
+	char     call_from[AGW_CALL+1]; /**< CallFrom, NUL terminated.    */
+	char     call_to[AGW_CALL+1];   /**< CallTo, NUL terminated.      */
+	uint32_t len;                   /**< DataLen.                     */
+	uint32_t user;                  /**< User, reserved.              */
+};
+
+static inline uint32_t agw_get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+			((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void agw_put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+/**
+ * @brief Decode a frame header.
+ * @param p AGW_HEAD octets.
+ */
+extern void agw_head_decode(const uint8_t *p, struct agw_head *h);
+
+/**
+ * @brief Encode a frame header.
+ * @param p Receives AGW_HEAD octets.
+ */
+extern void agw_head_encode(const struct agw_head *h, uint8_t *p);
+
+/**
+ * @brief Copy a callsign into a header field, truncated to AGW_CALL - 1
+ *        characters.
+ */
+extern void agw_set_call(char *field, const char *call);
+
+/**
+ * @brief Convert an AX.25 address of 7 octets to text, "CALL-SSID".
+ * @param pb Receives at least AGW_CALL octets.
+ */
+extern void agw_ax25_call(const uint8_t *addr, char *pb);
+
+/**
+ * @brief Parsed AX.25 frame without CRC.
+ */
+struct agw_ax25 {
+	char           dst[AGW_CALL];
+	char           src[AGW_CALL];
+	char           digi[8][AGW_CALL];
+	unsigned int   n_digi;
+	uint8_t        ctrl;
+	const uint8_t *info;   /**< Info after the PID, UI and I frames. */
+	size_t         n_info;
+	uint8_t        pid;
+};
+
+/**
+ * @brief Parse the address field and control octet of an AX.25 frame.
+ * @param p Frame, no flags and no CRC.
+ * @param n Length of the frame.
+ * @return false when the frame is malformed.
+ */
+extern bool agw_ax25_parse(const uint8_t *p, size_t n, struct agw_ax25 *f);
+
+/**
+ * @brief Monitor kind of an AX.25 control octet, 'I', 'S' or 'U'.
+ */
+static inline uint8_t agw_ax25_kind(uint8_t ctrl)
+{
+	if (!(ctrl & 0x01))
+		return 'I';
+	return ((ctrl & 0x03) == 0x01) ? 'S' : 'U';
+}
+
+#endif /* AGW_AGW_H_ */
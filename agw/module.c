@@ -0,0 +1,168 @@
+/*
+ *  Project: ax25c - File: module.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../config/configuration.h"
+#include "../runtime/runtime.h"
+
+#include "_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+struct plugin_handle plugin;
+
+static struct  setting_descriptor plugin_settings_descriptor[] = {
+		{ NULL }
+};
+
+static struct setting_descriptor instance_settings_descriptor[] = {
+		{ "host",        CSTR_T,  offsetof(struct instance_handle, host),        "localhost" },
+		{ "port",        CSTR_T,  offsetof(struct instance_handle, port),        "8000"      },
+		{ "peer",        CSTR_T,  offsetof(struct instance_handle, peer),        "AX25"      },
+		{ "clients",     UINT_T,  offsetof(struct instance_handle, clients),     "16"        },
+		{ "connections", UINT_T,  offsetof(struct instance_handle, connections), "8"         },
+		{ "queue_max",   NSIZE_T, offsetof(struct instance_handle, queue_max),   "65536"     },
+		{ "mon_queue",   UINT_T,  offsetof(struct instance_handle, mon_queue),   "256"       },
+		{ NULL }
+};
+
+static void *get_plugin(const char *name,
+		configurator_func configurator, void *context, struct exception *ex)
+{
+	assert(name);
+	assert(configurator);
+	memset(&plugin, 0x00, sizeof(struct plugin_handle));
+	plugin.name = name;
+	if (!configurator(&plugin, plugin_settings_descriptor, context, ex)) {
+		return NULL;
+	}
+	return &plugin;
+}
+
+static bool start_plugin(struct plugin_handle *plugin, struct exception *ex) {
+	assert(plugin);
+	DBG_DEBUG("agw start", plugin->name);
+	return true;
+}
+
+static bool stop_plugin(struct plugin_handle *plugin, struct exception *ex) {
+	assert(plugin);
+	DBG_DEBUG("agw stop", plugin->name);
+	return true;
+}
+
+static void *get_instance(const char *name,
+		configurator_func configurator, void *context, struct exception *ex)
+{
+	struct instance_handle *instance;
+	assert(name);
+	assert(configurator);
+	DBG_DEBUG("agw instance create", name);
+	instance = (struct instance_handle*)malloc(sizeof(struct instance_handle));
+	assert(instance);
+	memset(instance, 0x00, sizeof(struct instance_handle));
+	instance->name = name;
+	if (!configurator(instance, instance_settings_descriptor, context, ex)) {
+		free(instance);
+		return NULL;
+	}
+	instance->name = name;
+	instance->listen_fd = -1;
+	instance->epfd = -1;
+	instance->event_fd = -1;
+	return instance;
+}
+
+static bool start_instance(struct instance_handle *instance, exception_t *ex)
+{
+	pthread_attr_t thread_args;
+	int erc;
+
+	assert(instance);
+	DBG_DEBUG("agw instance start", instance->name);
+	/* The connection index is the client handle of the prims */
+	if ((instance->clients < 1) || (instance->connections < 1) ||
+			(instance->clients * instance->connections > UINT16_MAX)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "start_instance",
+				"Invalid clients or connections", instance->name);
+		return false;
+	}
+	if ((instance->mon_queue < 2) ||
+			(instance->queue_max < AGW_HEAD + AGW_DATA_MAX)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "start_instance",
+				"Invalid mon_queue or queue_max", instance->name);
+		return false;
+	}
+	instance->client = calloc(instance->clients, sizeof(struct agw_client*));
+	if (!instance->client) {
+		exception_fill(ex, ENOMEM, MODULE_NAME, "start_instance",
+				"Out of memory", instance->name);
+		return false;
+	}
+
+	instance->alive = true;
+	if (!sessions_start(instance, ex))
+		goto fail_sessions;
+	if (!server_start(instance, ex))
+		goto fail_server;
+	pthread_attr_init(&thread_args);
+	pthread_attr_setdetachstate(&thread_args, PTHREAD_CREATE_JOINABLE);
+	erc = pthread_create(&instance->thread, &thread_args, server_worker,
+			instance);
+	pthread_attr_destroy(&thread_args);
+	if (erc != 0) {
+		exception_fill(ex, erc, MODULE_NAME, "start_instance",
+				"Error creating thread", instance->name);
+		server_stop(instance);
+		goto fail_server;
+	}
+	instance->thread_running = true;
+	return true;
+
+fail_server:
+	sessions_stop(instance);
+fail_sessions:
+	instance->alive = false;
+	free(instance->client);
+	instance->client = NULL;
+	return false;
+}
+
+static bool stop_instance(struct instance_handle *instance, exception_t *ex) {
+	assert(instance);
+	DBG_DEBUG("agw instance stop", instance->name);
+
+	instance->alive = false;
+	if (!instance->thread_running)
+		return true;
+	sessions_wake(instance);
+	pthread_join(instance->thread, NULL);
+	instance->thread_running = false;
+	/* Clients first, their links are taken down through the peer */
+	server_stop(instance);
+	sessions_stop(instance);
+	free(instance->client);
+	instance->client = NULL;
+	return true;
+}
+
+struct plugin_descriptor plugin_descriptor = {
+		get_plugin,	  (start_func)start_plugin,   (stop_func)stop_plugin,
+		get_instance, (start_func)start_instance, (stop_func)stop_instance
+};
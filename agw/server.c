@@ -0,0 +1,442 @@
+/*
+ *  Project: ax25c - File: server.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* accept4 */
+#endif
+
+#include "../config/configuration.h"
+#include "../runtime/runtime.h"
+
+#include "_internal.h"
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+/* Max. number of events of one epoll_wait() */
+#define MAX_EVENTS 64
+
+/* Max. number of frames of one vectored send */
+#define MAX_IOV 64
+
+/* Timeout of epoll_wait() to look for a stop, in ms */
+#define POLL_MS 1000
+
+/*
+ * Listener
+ */
+
+static int listen_tcp(struct instance_handle *instance, struct exception *ex)
+{
+	struct addrinfo hints, *addrinfo, *rp;
+	int fd = -1, one = 1, erc;
+
+	memset(&hints, 0x00, sizeof(hints));
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags    = AI_PASSIVE;
+	erc = getaddrinfo(instance->host, instance->port, &hints, &addrinfo);
+	if (erc != 0) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "listen_tcp",
+				gai_strerror(erc), instance->host);
+		return -1;
+	}
+	for (rp = addrinfo; rp != NULL; rp = rp->ai_next) {
+		fd = socket(rp->ai_family, rp->ai_socktype | SOCK_NONBLOCK |
+				SOCK_CLOEXEC, rp->ai_protocol);
+		if (fd == -1)
+			continue;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (bind(fd, rp->ai_addr, rp->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	} /* end for */
+	freeaddrinfo(addrinfo);
+	if (fd == -1)
+		exception_fill(ex, errno, MODULE_NAME, "listen_tcp",
+				"Unable to bind", instance->port);
+	return fd;
+}
+
+static bool epoll_add(struct instance_handle *instance, int fd, void *ptr)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0x00, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = ptr;
+	return epoll_ctl(instance->epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+bool server_start(struct instance_handle *instance, struct exception *ex)
+{
+	instance->epfd = -1;
+	instance->listen_fd = listen_tcp(instance, ex);
+	if (instance->listen_fd == -1)
+		return false;
+	if (listen(instance->listen_fd, SOMAXCONN) == -1) {
+		exception_fill(ex, errno, MODULE_NAME, "server_start",
+				"Unable to listen", instance->name);
+		goto fail;
+	}
+	instance->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (instance->epfd == -1) {
+		exception_fill(ex, errno, MODULE_NAME, "server_start",
+				"Unable to create epoll", instance->name);
+		goto fail;
+	}
+	/* NULL marks the listener, the instance the wakeup */
+	if (!epoll_add(instance, instance->listen_fd, NULL) ||
+			!epoll_add(instance, instance->event_fd, instance)) {
+		exception_fill(ex, errno, MODULE_NAME, "server_start",
+				"Unable to add to epoll", instance->name);
+		goto fail;
+	}
+	if (configuration.loglevel >= DEBUG_LEVEL_INFO)
+		ax25c_log(DEBUG_LEVEL_INFO, MODULE_NAME ":%s: Listening on %s",
+				instance->name, instance->port);
+	return true;
+
+fail:
+	if (instance->epfd != -1)
+		close(instance->epfd);
+	close(instance->listen_fd);
+	instance->epfd = -1;
+	instance->listen_fd = -1;
+	return false;
+}
+
+/*
+ * Output queue
+ */
+
+void agw_send(struct agw_client *client, const struct agw_head *head,
+		const uint8_t *data, bool monitor)
+{
+	struct agw_out *out;
+
+	/* Monitor frames go first when the client does not keep up */
+	if (monitor && agw_mon_full(client)) {
+		++client->mon_drops;
+		return;
+	}
+	out = malloc(sizeof(struct agw_out) + AGW_HEAD + head->len);
+	if (!out) {
+		DBG_ERROR("AGW:agw_send", "Out of memory");
+		return;
+	}
+	out->next = NULL;
+	out->len = AGW_HEAD + head->len;
+	out->off = 0;
+	agw_head_encode(head, out->data);
+	if (head->len)
+		memcpy(&out->data[AGW_HEAD], data, head->len);
+	*client->out_tail = out;
+	client->out_tail = &out->next;
+	client->out_size += out->len;
+}
+
+static void out_drop(struct agw_client *client)
+{
+	struct agw_out *out;
+
+	while ((out = client->out_head)) {
+		client->out_head = out->next;
+		free(out);
+	} /* end while */
+	client->out_tail = &client->out_head;
+	client->out_size = 0;
+}
+
+/* Send as much of the queue as the socket takes, false on error */
+static bool out_flush(struct agw_client *client)
+{
+	struct iovec iov[MAX_IOV];
+	struct msghdr msg;
+	struct agw_out *out;
+	ssize_t n;
+	int i;
+
+	while (client->out_head) {
+		for (i = 0, out = client->out_head; out && (i < MAX_IOV);
+				++i, out = out->next) {
+			iov[i].iov_base = &out->data[out->off];
+			iov[i].iov_len = out->len - out->off;
+		} /* end for */
+		memset(&msg, 0x00, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = i;
+		n = sendmsg(client->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				return false;
+			client->blocked = true;
+			return true;
+		}
+		client->out_size -= n;
+		while (n > 0) {
+			out = client->out_head;
+			if ((size_t)n < out->len - out->off) {
+				out->off += n;
+				break;
+			}
+			n -= out->len - out->off;
+			client->out_head = out->next;
+			free(out);
+		} /* end while */
+	} /* end while */
+	client->out_tail = &client->out_head;
+	client->blocked = false;
+	return true;
+}
+
+/*
+ * Clients
+ */
+
+/* Read unless the queue is full, wait for room while output blocks */
+static void client_events(struct instance_handle *instance,
+		struct agw_client *client)
+{
+	struct epoll_event ev;
+	uint32_t events = EPOLLRDHUP;
+
+	if (!agw_full(client))
+		events |= EPOLLIN;
+	if (client->blocked)
+		events |= EPOLLOUT;
+	if (events == client->events)
+		return;
+	client->events = events;
+	memset(&ev, 0x00, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = client;
+	epoll_ctl(instance->epfd, EPOLL_CTL_MOD, client->fd, &ev);
+}
+
+static void client_close(struct instance_handle *instance,
+		struct agw_client *client)
+{
+	epoll_ctl(instance->epfd, EPOLL_CTL_DEL, client->fd, NULL);
+	close(client->fd);
+	sessions_detach(client);
+	out_drop(client);
+	instance->client[client->slot] = NULL;
+	if (configuration.loglevel >= DEBUG_LEVEL_INFO)
+		ax25c_log(DEBUG_LEVEL_INFO,
+				MODULE_NAME ":%s: Client %u closed, %lu monitor frames dropped",
+				instance->name, client->slot, client->mon_drops);
+	free(client);
+}
+
+static void on_accept(struct instance_handle *instance)
+{
+	struct agw_client *client;
+	struct epoll_event ev;
+	unsigned int slot;
+	int fd, one = 1;
+
+	for (;;) {
+		fd = accept4(instance->listen_fd, NULL, NULL,
+				SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd == -1) {
+			if ((errno != EAGAIN) && (errno != EINTR) &&
+					(configuration.loglevel >= DEBUG_LEVEL_ERROR))
+				ax25c_log(DEBUG_LEVEL_ERROR, MODULE_NAME ":%s:accept: %s",
+						instance->name, strerror(errno));
+			return;
+		}
+		for (slot = 0; slot < instance->clients; ++slot)
+			if (!instance->client[slot])
+				break;
+		client = (slot < instance->clients) ?
+				calloc(1, sizeof(struct agw_client)) : NULL;
+		if (!client) {
+			if (configuration.loglevel >= DEBUG_LEVEL_WARNING)
+				ax25c_log(DEBUG_LEVEL_WARNING,
+						MODULE_NAME ":%s: Client rejected, no free slot",
+						instance->name);
+			close(fd);
+			continue;
+		}
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		client->instance = instance;
+		client->slot = slot;
+		client->fd = fd;
+		client->events = EPOLLIN | EPOLLRDHUP;
+		client->out_tail = &client->out_head;
+		memset(&ev, 0x00, sizeof(ev));
+		ev.events = client->events;
+		ev.data.ptr = client;
+		if (epoll_ctl(instance->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+			close(fd);
+			free(client);
+			continue;
+		}
+		instance->client[slot] = client;
+		sessions_attach(client);
+		if (configuration.loglevel >= DEBUG_LEVEL_INFO)
+			ax25c_log(DEBUG_LEVEL_INFO,
+					MODULE_NAME ":%s: Client %u connected", instance->name,
+					slot);
+	} /* end for */
+}
+
+/* Handle the frames received, stops while the output queue is full */
+static bool client_process(struct agw_client *client)
+{
+	struct agw_head head;
+	size_t n;
+
+	while (!agw_full(client)) {
+		n = client->rx_len - client->rx_off;
+		if (n < AGW_HEAD)
+			break;
+		agw_head_decode(&client->rx_buf[client->rx_off], &head);
+		if (head.len > AGW_DATA_MAX) {
+			if (configuration.loglevel >= DEBUG_LEVEL_WARNING)
+				ax25c_log(DEBUG_LEVEL_WARNING,
+						MODULE_NAME ":%s: Client %u frame too long (%u)",
+						client->instance->name, client->slot, head.len);
+			return false;
+		}
+		if (n < AGW_HEAD + head.len)
+			break;
+		agw_on_frame(client, &head,
+				&client->rx_buf[client->rx_off + AGW_HEAD]);
+		client->rx_off += AGW_HEAD + head.len;
+	} /* end while */
+	/* Keep a partial frame at the start of the buffer */
+	if (client->rx_off) {
+		memmove(client->rx_buf, &client->rx_buf[client->rx_off],
+				client->rx_len - client->rx_off);
+		client->rx_len -= client->rx_off;
+		client->rx_off = 0;
+	}
+	return true;
+}
+
+/* Returns false when the client is gone */
+static bool on_client(struct instance_handle *instance,
+		struct agw_client *client, uint32_t events)
+{
+	ssize_t n;
+
+	if (events & (EPOLLERR | EPOLLHUP))
+		return false;
+	if (events & EPOLLOUT) {
+		if (!out_flush(client))
+			return false;
+		/* Room again, go on with what was held back */
+		if (!client_process(client))
+			return false;
+	}
+	if (!(events & (EPOLLIN | EPOLLRDHUP)) || agw_full(client))
+		return true;
+	n = recv(client->fd, &client->rx_buf[client->rx_len],
+			S_RX_BUF - client->rx_len, 0);
+	if (n < 0)
+		return (errno == EAGAIN) || (errno == EINTR);
+	if (n == 0)
+		return false;
+	client->rx_len += n;
+	return client_process(client);
+}
+
+/* Write what the round queued, one vectored send per client */
+static void clients_flush(struct instance_handle *instance)
+{
+	struct agw_client *client;
+	unsigned int slot;
+
+	for (slot = 0; slot < instance->clients; ++slot) {
+		client = instance->client[slot];
+		if (!client)
+			continue;
+		if (client->out_head && !client->blocked && !out_flush(client)) {
+			client_close(instance, client);
+			continue;
+		}
+		/* Go on with frames held back while the queue was full */
+		if ((client->rx_len > 0) && !agw_full(client) &&
+				(!client_process(client) || (client->out_head &&
+				!client->blocked && !out_flush(client)))) {
+			client_close(instance, client);
+			continue;
+		}
+		client_events(instance, client);
+	} /* end for */
+}
+
+void *server_worker(void *id)
+{
+	struct instance_handle *instance = id;
+	struct epoll_event events[MAX_EVENTS];
+	void *ptr;
+	int i, n;
+
+	assert(instance);
+	while (instance->alive) {
+		n = epoll_wait(instance->epfd, events, MAX_EVENTS, POLL_MS);
+		if (n < 0) {
+			if ((errno != EINTR) &&
+					(configuration.loglevel >= DEBUG_LEVEL_ERROR))
+				ax25c_log(DEBUG_LEVEL_ERROR,
+						MODULE_NAME ":server_worker:epoll_wait: %s",
+						strerror(errno));
+			continue;
+		}
+		for (i = 0; i < n; ++i) {
+			ptr = events[i].data.ptr;
+			if (!ptr)
+				on_accept(instance);
+			else if (ptr == instance)
+				sessions_woken(instance);
+			else if (!on_client(instance, ptr, events[i].events))
+				client_close(instance, ptr);
+		} /* end for */
+		/* Prims of the peer and the monitor, then all output at once */
+		sessions_receive(instance);
+		clients_flush(instance);
+	} /* end while */
+	return NULL;
+}
+
+void server_stop(struct instance_handle *instance)
+{
+	unsigned int slot;
+
+	for (slot = 0; slot < instance->clients; ++slot)
+		if (instance->client[slot])
+			client_close(instance, instance->client[slot]);
+	close(instance->listen_fd);
+	close(instance->epfd);
+	instance->listen_fd = -1;
+	instance->epfd = -1;
+}
@@ -0,0 +1,869 @@
+/*
+ *  Project: ax25c - File: session.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../config/configuration.h"
+#include "../runtime/runtime.h"
+#include "../runtime/dlsap.h"
+#include "../runtime/dl_prim.h"
+#include "../runtime/primslice.h"
+
+#include "_internal.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <assert.h>
+
+/* Max. number of monitor prims taken from the ring at once */
+#define MON_BATCH 32
+
+/* Answer to a connect when all connections of the client are in use */
+#define NO_CONN "*** DISCONNECTED RETRYOUT\r"
+
+static void log_ex(const char *func, struct exception *ex)
+{
+	ax25c_log(DEBUG_LEVEL_ERROR,
+			MODULE_NAME ":%s: Error no %i[%s] in %s:%s: %s[%s]",
+			func, ex->erc, strerror(ex->erc),
+			STRING_C(ex->module), STRING_C(ex->function),
+			STRING_C(ex->message), STRING_C(ex->param));
+}
+
+static void drain(struct primbuffer *pb)
+{
+	primitive_t *prim;
+
+	while ((prim = primbuffer_read_nonblock(pb, NULL)))
+		del_prim(prim);
+}
+
+static inline struct agw_client *conn_client(struct instance_handle *instance,
+		unsigned int i)
+{
+	return instance->client[i / instance->connections];
+}
+
+/* Send a frame to a client, the calls of the header are copied */
+static void put_frame(struct agw_client *client, uint8_t kind, uint8_t port,
+		uint8_t pid, const char *call_from, const char *call_to,
+		const void *data, size_t len, bool monitor)
+{
+	struct agw_head head;
+
+	memset(&head, 0x00, sizeof(head));
+	head.port = port;
+	head.kind = kind;
+	head.pid = pid;
+	agw_set_call(head.call_from, call_from);
+	agw_set_call(head.call_to, call_to);
+	head.len = (uint32_t)len;
+	agw_send(client, &head, data, monitor);
+}
+
+/* Status texts of a connection, callsigns as the AGWPE does it */
+static void put_status(struct agw_client *client, struct agw_conn *conn,
+		uint8_t kind, bool incoming, const char *fmt)
+{
+	char text[64];
+	int n;
+
+	n = snprintf(text, sizeof(text), fmt, conn->remote);
+	if (incoming || (kind != 'C'))
+		put_frame(client, kind, conn->port, 0, conn->remote, conn->mycall,
+				text, n, false);
+	else
+		put_frame(client, kind, conn->port, 0, conn->mycall, conn->remote,
+				text, n, false);
+}
+
+/* First callsign of an address text */
+static void first_call(const char *addr, char *call)
+{
+	size_t n = strcspn(addr, " ,");
+
+	if (n > AGW_CALL - 1)
+		n = AGW_CALL - 1;
+	memcpy(call, addr, n);
+	call[n] = '\0';
+}
+
+static void send_disconnect(struct instance_handle *instance,
+		unsigned int i, uint16_t server_handle)
+{
+	primitive_t *prim;
+	EXCEPTION(ex);
+
+	prim = new_DL_DISCONNECT_Request(i, server_handle, &ex);
+	if (!prim || !dlsap_write_owned(instance->dls.peer, prim, false, &ex))
+		log_ex("send_disconnect", &ex);
+}
+
+/*
+ * Wakeup of the reactor, the peer and the monitor listener queue
+ */
+
+/* Called from any thread, one write until the reactor took notice */
+void sessions_wake(struct instance_handle *instance)
+{
+	uint64_t one = 1;
+
+	if (__atomic_exchange_n(&instance->wakeup, true, __ATOMIC_SEQ_CST))
+		return;
+	if (write(instance->event_fd, &one, sizeof(one)) < 0)
+		DBG_ERROR("AGW:sessions_wake", "Unable to wake up reactor");
+}
+
+void sessions_woken(struct instance_handle *instance)
+{
+	uint64_t n;
+
+	/* Clear first, whatever is queued after this wakes again */
+	__atomic_store_n(&instance->wakeup, false, __ATOMIC_SEQ_CST);
+	if (read(instance->event_fd, &n, sizeof(n)) < 0)
+		return;
+}
+
+/*
+ * From the peer. The peer thread only queues, the prims are handled on
+ * the reactor, which owns the connections and the clients.
+ */
+
+static bool peer_write(dls_t *dls, primitive_t *prim, bool expedited,
+		bool owned, struct exception *ex)
+{
+	struct instance_handle *instance;
+
+	assert(dls);
+	assert(prim);
+	instance = dls->session;
+	if (!instance->alive) {
+		exception_fill(ex, EPIPE, MODULE_NAME, "on_write",
+				"Instance not running", instance->name);
+		return false;
+	}
+	if (prim->protocol != DL) {
+		if (owned)
+			del_prim(prim);
+		return true;
+	}
+	if (!owned)
+		use_prim(prim);
+	primbuffer_push_owned(&instance->rx, prim, expedited);
+	sessions_wake(instance);
+	return true;
+}
+
+static bool on_write(dls_t *dls, primitive_t *prim, bool expedited,
+		struct exception *ex)
+{
+	return peer_write(dls, prim, expedited, false, ex);
+}
+
+static bool on_write_owned(dls_t *dls, primitive_t *prim, bool expedited,
+		struct exception *ex)
+{
+	if (peer_write(dls, prim, expedited, true, ex))
+		return true;
+	del_prim(prim);
+	return false;
+}
+
+/* A client that registered the call, with a free connection */
+static struct agw_conn *accept_conn(struct instance_handle *instance,
+		const char *call)
+{
+	struct agw_client *client;
+	struct agw_conn *conn;
+	unsigned int slot, i, k;
+
+	for (slot = 0; slot < instance->clients; ++slot) {
+		client = instance->client[slot];
+		if (!client)
+			continue;
+		for (k = 0; k < AGW_CALLS; ++k)
+			if (strcasecmp(client->calls[k], call) == 0)
+				break;
+		if (k == AGW_CALLS)
+			continue;
+		for (i = 0; i < instance->connections; ++i) {
+			conn = &instance->conn[client->base + i];
+			if (conn->state == LINK_DISCONNECTED)
+				return conn;
+		} /* end for */
+	} /* end for */
+	return NULL;
+}
+
+/*
+ * The connection of a prim. Prims of links the peer accepted carry its
+ * handle only, so look for the server handle when the client handle
+ * does not fit.
+ */
+static struct agw_conn *find_conn(struct instance_handle *instance,
+		primitive_t *prim)
+{
+	struct agw_conn *conn;
+	unsigned int i;
+
+	if (prim->clientHandle < instance->n_conns) {
+		conn = &instance->conn[prim->clientHandle];
+		/* A confirm answers a request, maybe of a client gone since */
+		if ((prim->cmd == DL_CONNECT_CONFIRM) ||
+				(conn->state == LINK_SETUP) ||
+				(conn->state == LINK_DISC_REQUEST) ||
+				(conn->server_handle == prim->serverHandle))
+			return conn;
+	}
+	for (i = 0; i < instance->n_conns; ++i) {
+		conn = &instance->conn[i];
+		if ((conn->state != LINK_DISCONNECTED) &&
+				(conn->state != LINK_SETUP) &&
+				(conn->server_handle == prim->serverHandle))
+			return conn;
+	} /* end for */
+	return NULL;
+}
+
+static void on_connect_indication(struct instance_handle *instance,
+		primitive_t *prim)
+{
+	struct agw_conn *conn;
+	char addr[S_ADDR];
+	char call[AGW_CALL];
+
+	if (get_DL_dst_cstr(prim, addr, sizeof(addr), NULL) < 0)
+		addr[0] = '\0';
+	first_call(addr, call);
+	conn = accept_conn(instance, call);
+	if (!conn) {
+		DBG_INFO("No client registered for", call);
+		send_disconnect(instance, 0, prim->serverHandle);
+		return;
+	}
+	if (get_DL_src_cstr(prim, addr, sizeof(addr), NULL) < 0)
+		strcpy(addr, "?");
+	conn->state = LINK_CONNECTED;
+	conn->server_handle = prim->serverHandle;
+	conn->port = 0;
+	strcpy(conn->mycall, call);
+	first_call(addr, conn->remote);
+	put_status(conn_client(instance, conn - instance->conn), conn, 'C', true,
+			"*** CONNECTED With Station %s\r");
+}
+
+static void on_monitor_prim(struct instance_handle *instance,
+		primitive_t *prim, const char *service, bool tx);
+
+static void on_peer_prim(struct instance_handle *instance, primitive_t *prim)
+{
+	struct agw_client *client;
+	struct agw_conn *conn;
+	prim_param_t *param;
+
+	switch (prim->cmd) {
+	case DL_CONNECT_INDICATION:
+		on_connect_indication(instance, prim);
+		return;
+	case DL_UNIT_DATA_INDICATION:
+		/* Unproto is monitor traffic for an AGWPE client */
+		if (__atomic_load_n(&instance->n_monitor, __ATOMIC_RELAXED))
+			on_monitor_prim(instance, prim, instance->peer, false);
+		return;
+	default:
+		break;
+	} /* end switch */
+	conn = find_conn(instance, prim);
+	if (!conn)
+		return;
+	client = conn_client(instance, conn - instance->conn);
+	switch (prim->cmd) {
+	case DL_CONNECT_CONFIRM:
+		if (conn->state != LINK_SETUP) {
+			/* d or the client left while the link was set up */
+			send_disconnect(instance, conn - instance->conn,
+					prim->serverHandle);
+			return;
+		}
+		conn->state = LINK_CONNECTED;
+		conn->server_handle = prim->serverHandle;
+		put_status(client, conn, 'C', false,
+				"*** CONNECTED With Station %s\r");
+		break;
+	case DL_DISCONNECT_INDICATION:
+	case DL_DISCONNECT_CONFIRM:
+		if (conn->state == LINK_DISCONNECTED)
+			return;
+		conn->state = LINK_DISCONNECTED;
+		if (client)
+			put_status(client, conn, 'd', false,
+					"*** DISCONNECTED From Station %s\r");
+		break;
+	case DL_DATA_INDICATION:
+		if ((conn->state != LINK_CONNECTED) || !client)
+			return;
+		/* A client that does not read any more loses the link */
+		if (agw_stuck(client)) {
+			send_disconnect(instance, conn - instance->conn,
+					conn->server_handle);
+			conn->state = LINK_DISC_REQUEST;
+			++instance->data_drops;
+			if (configuration.loglevel >= DEBUG_LEVEL_WARNING)
+				ax25c_log(DEBUG_LEVEL_WARNING,
+						MODULE_NAME ":%s: Client %u not reading, link to %s "
+						"disconnected", instance->name, client->slot,
+						conn->remote);
+			return;
+		}
+		param = get_DL_data_param(prim);
+		put_frame(client, 'D', conn->port, 0xf0, conn->remote, conn->mycall,
+				get_prim_param_data(param), get_prim_param_size(param),
+				false);
+		break;
+	default:
+		break;
+	} /* end switch */
+}
+
+/*
+ * Monitor. The listener runs on the thread of whoever transmits and
+ * must not sleep, it only takes a reference to the prim.
+ */
+
+static void monitor_listener(struct primitive *prim, const char *service,
+		bool tx, void *data)
+{
+	struct instance_handle *instance = data;
+	struct agw_mon *mon;
+	unsigned int next;
+
+	if (!__atomic_load_n(&instance->n_monitor, __ATOMIC_RELAXED))
+		return;
+	pthread_spin_lock(&instance->mon_lock); /*---------------------------v*/
+	next = (instance->mon_head + 1) % instance->mon_queue;
+	if (next == instance->mon_tail) {
+		++instance->mon_drops;
+		pthread_spin_unlock(&instance->mon_lock); /*---------------------^*/
+		return;
+	}
+	mon = &instance->mon_ring[instance->mon_head];
+	use_prim(prim);
+	mon->prim = prim;
+	mon->service = service;
+	mon->tx = tx;
+	instance->mon_head = next;
+	pthread_spin_unlock(&instance->mon_lock); /*-------------------------^*/
+	sessions_wake(instance);
+}
+
+/* Format a prim once and hand it to every client that monitors */
+static void on_monitor_prim(struct instance_handle *instance,
+		primitive_t *prim, const char *service, bool tx)
+{
+	struct agw_client *client;
+	struct agw_ax25 frame;
+	primitive_t *flat = NULL;
+	char text[S_MON];
+	char from[S_ADDR], to[S_ADDR];
+	char call_from[AGW_CALL], call_to[AGW_CALL];
+	uint8_t raw[1 + AGW_DATA_MAX];
+	size_t n_raw = 0;
+	unsigned int slot;
+	uint8_t kind = 'U';
+	int n, m;
+
+	n = snprintf(text, sizeof(text), " 1:[%.32s] ", service);
+	m = monitor(prim, &text[n], sizeof(text) - n - 1, NULL);
+	if (m < 0)
+		return;
+	n += m;
+	text[n++] = '\r';
+	call_from[0] = call_to[0] = '\0';
+	if (prim->protocol == AX25) {
+		if (prim->flags & PRIM_FLAG_SEGMENTED) {
+			flat = prim_sg_flatten(prim, NULL);
+			if (!flat)
+				return;
+			prim = flat;
+		}
+		/* The frame without CRC, behind the port for 'K' */
+		if ((prim->size > 2) && (prim->size - 2 <= AGW_DATA_MAX) &&
+				agw_ax25_parse(prim->payload, prim->size - 2, &frame)) {
+			kind = agw_ax25_kind(frame.ctrl);
+			strcpy(call_from, frame.src);
+			strcpy(call_to, frame.dst);
+			raw[0] = 0;
+			memcpy(&raw[1], prim->payload, prim->size - 2);
+			n_raw = prim->size - 1;
+		}
+	} else if (prim->protocol == DL) {
+		if (get_DL_src_cstr(prim, from, sizeof(from), NULL) >= 0)
+			first_call(from, call_from);
+		if (get_DL_dst_cstr(prim, to, sizeof(to), NULL) >= 0)
+			first_call(to, call_to);
+	}
+	if (tx)
+		kind = 'T';
+	for (slot = 0; slot < instance->clients; ++slot) {
+		client = instance->client[slot];
+		if (!client)
+			continue;
+		if (client->monitor)
+			put_frame(client, kind, 0, 0, call_from, call_to, text, n, true);
+		if (client->raw && n_raw)
+			put_frame(client, 'K', 0, 0, call_from, call_to, raw, n_raw,
+					true);
+	} /* end for */
+	del_prim(flat);
+}
+
+static void monitor_receive(struct instance_handle *instance)
+{
+	struct agw_mon batch[MON_BATCH];
+	unsigned int i, n;
+
+	do {
+		n = 0;
+		pthread_spin_lock(&instance->mon_lock); /*-----------------------v*/
+		while ((n < MON_BATCH) && (instance->mon_tail != instance->mon_head)) {
+			batch[n++] = instance->mon_ring[instance->mon_tail];
+			instance->mon_tail = (instance->mon_tail + 1) %
+					instance->mon_queue;
+		} /* end while */
+		pthread_spin_unlock(&instance->mon_lock); /*---------------------^*/
+		for (i = 0; i < n; ++i) {
+			on_monitor_prim(instance, batch[i].prim, batch[i].service,
+					batch[i].tx);
+			del_prim(batch[i].prim);
+		} /* end for */
+	} while (n == MON_BATCH);
+}
+
+void sessions_receive(struct instance_handle *instance)
+{
+	primitive_t *prim;
+
+	while ((prim = primbuffer_read_nonblock(&instance->rx, NULL))) {
+		on_peer_prim(instance, prim);
+		del_prim(prim);
+	} /* end while */
+	monitor_receive(instance);
+}
+
+/*
+ * Frames of the client, run on the reactor
+ */
+
+static struct agw_conn *client_conn(struct agw_client *client,
+		const struct agw_head *head)
+{
+	struct instance_handle *instance = client->instance;
+	struct agw_conn *conn;
+	unsigned int i;
+
+	for (i = 0; i < instance->connections; ++i) {
+		conn = &instance->conn[client->base + i];
+		if ((conn->state != LINK_DISCONNECTED) &&
+				(conn->port == head->port) &&
+				(strcasecmp(conn->mycall, head->call_from) == 0) &&
+				(strcasecmp(conn->remote, head->call_to) == 0))
+			return conn;
+	} /* end for */
+	return NULL;
+}
+
+/* Destination text of 'v' and 'V', "CALL DIGI1 DIGI2 ..." */
+static size_t via_addr(const struct agw_head *head, const uint8_t *data,
+		char *addr)
+{
+	char call[AGW_CALL + 1];
+	unsigned int i, n;
+	size_t len;
+
+	strcpy(addr, head->call_to);
+	len = strlen(addr);
+	n = head->len ? data[0] : 0;
+	if ((n > 8) || (1 + n * AGW_CALL > head->len))
+		return 0;
+	for (i = 0; i < n; ++i) {
+		memcpy(call, &data[1 + i * AGW_CALL], AGW_CALL);
+		call[AGW_CALL] = '\0';
+		len += snprintf(&addr[len], S_ADDR - len, " %.9s", call);
+	} /* end for */
+	return 1 + n * AGW_CALL;
+}
+
+static void on_connect(struct agw_client *client,
+		const struct agw_head *head, const char *addr)
+{
+	struct instance_handle *instance = client->instance;
+	struct agw_conn *conn = NULL;
+	primitive_t *prim;
+	unsigned int i;
+	EXCEPTION(ex);
+
+	if (client_conn(client, head))
+		return; /* Already there */
+	for (i = 0; i < instance->connections; ++i) {
+		if (instance->conn[client->base + i].state == LINK_DISCONNECTED) {
+			conn = &instance->conn[client->base + i];
+			break;
+		}
+	} /* end for */
+	if (!conn) {
+		put_frame(client, 'd', head->port, 0, head->call_to,
+				head->call_from, NO_CONN, strlen(NO_CONN), false);
+		return;
+	}
+	conn->port = head->port;
+	agw_set_call(conn->mycall, head->call_from);
+	agw_set_call(conn->remote, head->call_to);
+	prim = new_DL_CONNECT_Request(conn - instance->conn,
+			(const uint8_t*)addr, strlen(addr),
+			(const uint8_t*)conn->mycall, strlen(conn->mycall), &ex);
+	if (!prim || !dlsap_write_owned(instance->dls.peer, prim, false, &ex)) {
+		log_ex("on_connect", &ex);
+		put_status(client, conn, 'd', false,
+				"*** DISCONNECTED RETRYOUT With %s\r");
+		return;
+	}
+	conn->state = LINK_SETUP;
+}
+
+static void on_disconnect(struct agw_client *client,
+		const struct agw_head *head)
+{
+	struct agw_conn *conn = client_conn(client, head);
+
+	if (!conn)
+		return;
+	/* During link setup the confirm brings the server handle */
+	if (conn->state == LINK_CONNECTED)
+		send_disconnect(client->instance, conn - client->instance->conn,
+				conn->server_handle);
+	conn->state = LINK_DISC_REQUEST;
+}
+
+static void on_data(struct agw_client *client, const struct agw_head *head,
+		const uint8_t *data)
+{
+	struct instance_handle *instance = client->instance;
+	struct agw_conn *conn = client_conn(client, head);
+	primitive_t *prim;
+	EXCEPTION(ex);
+
+	if (!conn || (conn->state != LINK_CONNECTED) || (head->len > UINT16_MAX))
+		return;
+	prim = new_DL_DATA_Request(conn - instance->conn, conn->server_handle,
+			data, head->len, &ex);
+	if (!prim || !dlsap_write_owned(instance->dls.peer, prim, false, &ex))
+		log_ex("on_data", &ex);
+}
+
+static void send_unproto(struct agw_client *client, const char *dst,
+		const char *src, const uint8_t *data, size_t len)
+{
+	primitive_t *prim;
+	EXCEPTION(ex);
+
+	prim = new_DL_UNIT_DATA_Request(client->base,
+			(const uint8_t*)dst, strlen(dst),
+			(const uint8_t*)src, strlen(src), data, len, &ex);
+	if (!prim || !dlsap_write_owned(client->instance->dls.peer, prim,
+			false, &ex))
+		log_ex("send_unproto", &ex);
+}
+
+/* 'K', only UI frames map onto a DL primitive */
+static void on_raw(struct agw_client *client, const struct agw_head *head,
+		const uint8_t *data)
+{
+	struct agw_ax25 frame;
+	char addr[S_ADDR];
+	unsigned int i;
+	size_t len;
+
+	if ((head->len < 1) || !agw_ax25_parse(&data[1], head->len - 1, &frame))
+		return;
+	if ((frame.ctrl & 0xef) != 0x03) {
+		DBG_INFO("AGW: Raw frame dropped, not UI from", frame.src);
+		return;
+	}
+	len = snprintf(addr, sizeof(addr), "%s", frame.dst);
+	for (i = 0; i < frame.n_digi; ++i)
+		len += snprintf(&addr[len], sizeof(addr) - len, " %s",
+				frame.digi[i]);
+	send_unproto(client, addr, frame.src, frame.info, frame.n_info);
+}
+
+static void set_monitor(struct agw_client *client, bool monitor, bool raw)
+{
+	bool was = client->monitor || client->raw;
+	bool is = monitor || raw;
+
+	client->monitor = monitor;
+	client->raw = raw;
+	if (is && !was)
+		__atomic_add_fetch(&client->instance->n_monitor, 1, __ATOMIC_RELAXED);
+	else if (was && !is)
+		__atomic_sub_fetch(&client->instance->n_monitor, 1, __ATOMIC_RELAXED);
+}
+
+static void on_register(struct agw_client *client,
+		const struct agw_head *head)
+{
+	uint8_t ok = 0;
+	unsigned int k;
+
+	for (k = 0; k < AGW_CALLS; ++k)
+		if (strcasecmp(client->calls[k], head->call_from) == 0)
+			break;
+	if (k == AGW_CALLS)
+		for (k = 0; k < AGW_CALLS; ++k)
+			if (!client->calls[k][0])
+				break;
+	if ((k < AGW_CALLS) && head->call_from[0]) {
+		agw_set_call(client->calls[k], head->call_from);
+		ok = 1;
+	}
+	put_frame(client, 'X', 0, 0, head->call_from, "", &ok, 1, false);
+}
+
+static void on_unregister(struct agw_client *client,
+		const struct agw_head *head)
+{
+	unsigned int k;
+
+	for (k = 0; k < AGW_CALLS; ++k)
+		if (strcasecmp(client->calls[k], head->call_from) == 0)
+			client->calls[k][0] = '\0';
+}
+
+static void on_outstanding(struct agw_client *client,
+		const struct agw_head *head)
+{
+	dls_t *peer = client->instance->dls.peer;
+	dls_stats_t stats;
+	uint8_t n[4];
+
+	/* The link does not report frames per connection */
+	memset(&stats, 0x00, sizeof(stats));
+	if ((head->kind == 'y') && peer->get_queue_stats)
+		peer->get_queue_stats(peer, &stats);
+	agw_put32(n, (uint32_t)stats.queue_size);
+	put_frame(client, head->kind, head->port, 0, head->call_from,
+			head->call_to, n, sizeof(n), false);
+}
+
+void agw_on_frame(struct agw_client *client, const struct agw_head *head,
+		const uint8_t *data)
+{
+	struct instance_handle *instance = client->instance;
+	char addr[S_ADDR];
+	uint8_t version[8];
+	char text[S_ADDR];
+	size_t off;
+	int n;
+
+	switch (head->kind) {
+	case 'R':
+		agw_put32(&version[0], AGW_VERSION_MAJOR);
+		agw_put32(&version[4], AGW_VERSION_MINOR);
+		put_frame(client, 'R', 0, 0, "", "", version, sizeof(version), false);
+		break;
+	case 'G':
+		n = snprintf(text, sizeof(text), "1;Port1 %s;", instance->peer);
+		put_frame(client, 'G', 0, 0, "", "", text, n + 1, false);
+		break;
+	case 'X':
+		on_register(client, head);
+		break;
+	case 'x':
+		on_unregister(client, head);
+		break;
+	case 'm':
+		set_monitor(client, !client->monitor, client->raw);
+		break;
+	case 'k':
+		set_monitor(client, client->monitor, !client->raw);
+		break;
+	case 'C':
+	case 'c':
+		on_connect(client, head, head->call_to);
+		break;
+	case 'v':
+		if (via_addr(head, data, addr))
+			on_connect(client, head, addr);
+		break;
+	case 'D':
+		on_data(client, head, data);
+		break;
+	case 'd':
+		on_disconnect(client, head);
+		break;
+	case 'M':
+		send_unproto(client, head->call_to, head->call_from, data, head->len);
+		break;
+	case 'V':
+		off = via_addr(head, data, addr);
+		if (off)
+			send_unproto(client, addr, head->call_from, &data[off],
+					head->len - off);
+		break;
+	case 'K':
+		on_raw(client, head, data);
+		break;
+	case 'y':
+	case 'Y':
+		on_outstanding(client, head);
+		break;
+	default:
+		if (configuration.loglevel >= DEBUG_LEVEL_DEBUG)
+			ax25c_log(DEBUG_LEVEL_DEBUG,
+					MODULE_NAME ":%s: Client %u frame '%c' ignored",
+					instance->name, client->slot, head->kind);
+		break;
+	} /* end switch */
+}
+
+/*
+ * Instance
+ */
+
+bool sessions_start(struct instance_handle *instance, struct exception *ex)
+{
+	int erc;
+
+	instance->dls.peer = dlsap_lookup_dls(instance->peer);
+	if (!instance->dls.peer) {
+		exception_fill(ex, ENOENT, MODULE_NAME, "sessions_start",
+				"SAP not found", instance->peer);
+		return false;
+	}
+	instance->dls.name = instance->name;
+	instance->dls.on_write = on_write;
+	instance->dls.on_write_owned = on_write_owned;
+	instance->dls.session = instance;
+	instance->n_conns = instance->clients * instance->connections;
+	instance->wakeup = false;
+	instance->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (instance->event_fd == -1) {
+		instance->dls.peer = NULL;
+		exception_fill(ex, errno, MODULE_NAME, "sessions_start",
+				"Unable to create eventfd", instance->name);
+		return false;
+	}
+	instance->conn = calloc(instance->n_conns, sizeof(struct agw_conn));
+	instance->mon_ring = calloc(instance->mon_queue, sizeof(struct agw_mon));
+	if (!instance->conn || !instance->mon_ring) {
+		free(instance->conn);
+		free(instance->mon_ring);
+		instance->conn = NULL;
+		instance->mon_ring = NULL;
+		instance->dls.peer = NULL;
+		close(instance->event_fd);
+		instance->event_fd = -1;
+		exception_fill(ex, ENOMEM, MODULE_NAME, "sessions_start",
+				"Out of memory", instance->name);
+		return false;
+	}
+	erc = pthread_spin_init(&instance->mon_lock, PTHREAD_PROCESS_PRIVATE);
+	assert(erc == 0);
+	instance->mon_head = instance->mon_tail = 0;
+	instance->n_monitor = 0;
+	primbuffer_init(&instance->rx);
+	if (!dlsap_open(instance->dls.peer, &instance->dls, ex)) {
+		instance->dls.peer = NULL;
+		sessions_stop(instance);
+		return false;
+	}
+	instance->mon_handle = register_monitor_listener(monitor_listener,
+			instance);
+	if (!instance->mon_handle) {
+		exception_fill(ex, ENOMEM, MODULE_NAME, "sessions_start",
+				"Unable to register monitor listener", instance->name);
+		sessions_stop(instance);
+		return false;
+	}
+	return true;
+}
+
+void sessions_stop(struct instance_handle *instance)
+{
+	if (!instance->conn)
+		return;
+	/* No listener call is running once this returns */
+	if (instance->mon_handle) {
+		unregister_monitor_listener(instance->mon_handle);
+		instance->mon_handle = NULL;
+	}
+	if (instance->dls.peer) {
+		dlsap_close(instance->dls.peer);
+		instance->dls.peer = NULL;
+	}
+	drain(&instance->rx);
+	primbuffer_destroy(&instance->rx);
+	while (instance->mon_tail != instance->mon_head) {
+		del_prim(instance->mon_ring[instance->mon_tail].prim);
+		instance->mon_tail = (instance->mon_tail + 1) % instance->mon_queue;
+	} /* end while */
+	if (instance->mon_drops && (configuration.loglevel >= DEBUG_LEVEL_INFO))
+		ax25c_log(DEBUG_LEVEL_INFO,
+				MODULE_NAME ":%s: %lu monitor frames lost, queue full",
+				instance->name, instance->mon_drops);
+	if (instance->data_drops && (configuration.loglevel >= DEBUG_LEVEL_INFO))
+		ax25c_log(DEBUG_LEVEL_INFO,
+				MODULE_NAME ":%s: %lu links disconnected, client not reading",
+				instance->name, instance->data_drops);
+	pthread_spin_destroy(&instance->mon_lock);
+	/* Nobody left to wake the reactor */
+	close(instance->event_fd);
+	instance->event_fd = -1;
+	free(instance->conn);
+	free(instance->mon_ring);
+	instance->conn = NULL;
+	instance->mon_ring = NULL;
+}
+
+void sessions_attach(struct agw_client *client)
+{
+	struct instance_handle *instance = client->instance;
+	unsigned int i;
+
+	client->base = client->slot * instance->connections;
+	for (i = 0; i < instance->connections; ++i)
+		instance->conn[client->base + i].state = LINK_DISCONNECTED;
+}
+
+void sessions_detach(struct agw_client *client)
+{
+	struct instance_handle *instance = client->instance;
+	struct agw_conn *conn;
+	unsigned int i;
+
+	set_monitor(client, false, false);
+	/* Links in setup are taken down when their confirm arrives */
+	for (i = 0; i < instance->connections; ++i) {
+		conn = &instance->conn[client->base + i];
+		if (conn->state == LINK_CONNECTED)
+			send_disconnect(instance, client->base + i, conn->server_handle);
+		conn->state = LINK_DISCONNECTED;
+	} /* end for */
+}
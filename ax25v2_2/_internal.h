@@ -23,6 +23,7 @@
 #include "callsign.h"
 
 #include "../runtime/primbuffer.h"
+#include "../runtime/runtime.h"
 
 #include <uki/list.h>
 #include <stdbool.h>
@@ -31,15 +32,53 @@
 struct exception;
 struct session;
 
+/**
+ * @brief Work categories drained by the tick handler.
+ */
+enum tick_class {
+	TICK_RX,     /**< Received primitives.   */
+	TICK_TX,     /**< Primitives to transmit. */
+	TICK_TIMER,  /**< Elapsed timers.         */
+	TICK_CLASSES
+};
+
+/**
+ * @brief Tick handler statistics for one work category.
+ */
+struct tick_class_stats {
+	unsigned long items;     /**< Total items processed.               */
+	size_t        last;      /**< Items processed in the last tick.    */
+	size_t        peak;      /**< Max. items processed in one tick.    */
+	unsigned long exhausted; /**< Ticks that ran out of budget.        */
+	unsigned long wait_sum;  /**< Sum of waiting times in jiffies.     */
+	unsigned long wait_max;  /**< Max. waiting time in jiffies.        */
+};
+
+/**
+ * @brief Tick handler statistics.
+ */
+struct tick_stats {
+	unsigned long           ticks;              /**< Number of ticks. */
+	struct tick_class_stats cls[TICK_CLASSES];  /**< Per category.    */
+};
+
 struct plugin_handle {
 	const char        *name;
 	addressField_t     default_addr;
 	const char        *peer;
 	size_t             n_sessions;
+	size_t             n1;
 	pthread_spinlock_t session_lock;
 	struct session    *sessions;
 	primbuffer_t       rx_buffer;
 	primbuffer_t       tx_buffer;
+	size_t             rx_budget;
+	size_t             tx_budget;
+	size_t             timer_budget;
+	size_t             tick_batch;
+	unsigned int       tick_rotor;
+	struct tick_stats  tick_stats;
+	struct mem_stats   mem_stats;
 };
 
 extern struct plugin_handle plugin;
@@ -71,8 +71,10 @@ void ax25c_timer_destroy(ax25c_timer_t *timer)
 	assert(timer);
 	pthread_spin_lock(&timer->lock);
 	del_timer(&timer->timer);
-	list_del(&timer->node);
+	pthread_spin_lock(&elapsed_timer_list_lock);
+	list_del_init(&timer->node);
 	timer->state = TIMER_DESTROYED;
+	pthread_spin_unlock(&elapsed_timer_list_lock);
 	pthread_spin_unlock(&timer->lock);
 	pthread_spin_destroy(&timer->lock);
 }
@@ -43,6 +43,9 @@ static void client_dls_close(dls_t *_dls);
 static bool on_client_write(dls_t *_dls, primitive_t *prim, bool expedited,
 		struct exception *ex);
 
+static bool on_client_write_owned(dls_t *_dls, primitive_t *prim,
+		bool expedited, struct exception *ex);
+
 static void client_dls_queue_stats(dls_t *_dls, dls_stats_t *stats);
 
 static bool on_server_write(dls_t *_dls, primitive_t *prim, bool expedited,
@@ -54,8 +57,10 @@ static dls_t client_dls = {
 		.open                    = client_dls_open,
 		.close                   = client_dls_close,
 		.on_write                = on_client_write,
+		.on_write_owned          = on_client_write_owned,
 		.get_queue_stats         = client_dls_queue_stats,
-		.peer                    = NULL
+		.peer                    = NULL,
+		.binary_addr             = true
 };
 
 static dls_t server_dls = {
@@ -148,6 +153,7 @@ static bool on_write_dl_connect_request(dls_t *_dls, primitive_t *prim,
 		struct exception *ex)
 {
 	struct session *session;
+	addressField_t af;
 	int i, erc;
 
 	assert(&client_dls == _dls);
@@ -157,6 +163,8 @@ static bool on_write_dl_connect_request(dls_t *_dls, primitive_t *prim,
 		return false;
 	}
 	assert(prim);
+	if (!addressFieldFromDL(prim, &af, ex))
+		return false;
 	session = NULL;
 	erc = pthread_spin_lock(&plugin.session_lock); /* ===v */
 	assert(erc == 0);
@@ -176,6 +184,7 @@ static bool on_write_dl_connect_request(dls_t *_dls, primitive_t *prim,
 		return false;
 	}
 	session->client_id = prim->clientHandle;
+	addressFieldCopy(&session->af, &af);
 	prim->serverHandle = session->server_id;
 	return true;
 }
@@ -194,8 +203,8 @@ static bool on_write_dl(dls_t *_dls, primitive_t *prim, struct exception *ex)
 	return res;
 }
 
-static bool on_client_write(dls_t *_dls, primitive_t *prim, bool expedited,
-		struct exception *ex)
+static bool client_write(dls_t *_dls, primitive_t *prim, bool expedited,
+		bool owned, struct exception *ex)
 {
 	if (_dls != &client_dls) {
 		exception_fill(ex, EINVAL, MODULE_NAME,
@@ -220,10 +229,28 @@ static bool on_client_write(dls_t *_dls, primitive_t *prim, bool expedited,
 	} /* end switch */
 
 	monitor_put(prim, _dls->name, true);
-	primbuffer_write_nonblock(&plugin.tx_buffer, prim, expedited);
+	if (owned)
+		primbuffer_push_owned(&plugin.tx_buffer, prim, expedited);
+	else
+		primbuffer_write_nonblock(&plugin.tx_buffer, prim, expedited);
 	return true;
 }
 
+static bool on_client_write(dls_t *_dls, primitive_t *prim, bool expedited,
+		struct exception *ex)
+{
+	return client_write(_dls, prim, expedited, false, ex);
+}
+
+static bool on_client_write_owned(dls_t *_dls, primitive_t *prim,
+		bool expedited, struct exception *ex)
+{
+	if (client_write(_dls, prim, expedited, true, ex))
+		return true;
+	del_prim(prim);
+	return false;
+}
+
 static void client_dls_queue_stats(dls_t *_dls, dls_stats_t *stats)
 {
 	if (_dls != &client_dls)
@@ -25,6 +25,7 @@
 
 struct exception;
 struct addressField;
+struct ax25_segment;
 
 /**
  * @brief AX25 commands.
@@ -84,6 +85,28 @@ extern primitive_t *new_AX25_I(
 		const uint8_t *data, size_t size,
 		struct exception *ex);
 
+/**
+ * @brief Create a AX25 I frame with PID 0x08 from a segment. The segment
+ *        data is copied once, directly from the segmented primitive into
+ *        the frame.
+ * @param cH Client Handle.
+ * @param sH Server Handle.
+ * @param modulo128 Use modulo 128.
+ * @param af AddressField.
+ * @param nr N(R) variable.
+ * @param ns N(S) variable.
+ * @param seg The segment.
+ * @param ex Exception structure.
+ * @return New primitive containing a AX25 frame in payload.
+ */
+extern primitive_t *new_AX25_I_segment(
+		uint16_t cH, uint16_t sH,
+		bool modulo128,
+		struct addressField *af,
+		uint8_t nr, uint8_t ns,
+		const struct ax25_segment *seg,
+		struct exception *ex);
+
 /**
  * @brief Create a AX25 UI frame.
  * @param cH Client Handle.
@@ -20,6 +20,7 @@
 
 #include "ax25v2_2.h"
 #include "callsign.h"
+#include "segment.h"
 
 #include <errno.h>
 #include <assert.h>
@@ -85,6 +86,55 @@ primitive_t *new_AX25_I(
 	return prim;
 }
 
+primitive_t *new_AX25_I_segment(
+		uint16_t cH, uint16_t sH,
+		bool modulo128,
+		struct addressField *af,
+		uint8_t nr, uint8_t ns,
+		const struct ax25_segment *seg,
+		struct exception *ex)
+{
+	size_t frame_size;
+	size_t i = 0;
+	primitive_t *prim;
+	uint16_t crc;
+
+	assert(af);
+	assert(seg);
+	frame_size =
+			getFrameAddressLength(af) /* Adress Field   */
+			+ (modulo128 ? 2 : 1)     /* Control field  */
+			+ 1                       /* PID            */
+			+ 1                       /* Segment header */
+			+ (seg->first ? 1 : 0)    /* Original PID   */
+			+ seg->size               /* Data field     */
+			+ 2;                      /* CRC            */
+	prim = new_prim(frame_size, AX25, AX25_I, cH, sH, ex);
+	if (!prim)
+		return NULL;
+	i += putFrameAddress(af, &prim->payload[i]);
+	if (modulo128) {
+		prim->payload[i++] = (nr << 1) | 0x01;
+		prim->payload[i++] = ns << 1;
+	} else {
+		assert(nr < 8);
+		assert(ns < 8);
+		prim->payload[i++] = (nr << 5) | (ns << 1) | 0x10;
+	}
+	prim->payload[i++] = L3_SEGF;
+	prim->payload[i++] = seg->header;
+	if (seg->first)
+		prim->payload[i++] = seg->pid;
+	memcpy(&prim->payload[i], seg->data, seg->size);
+	i += seg->size;
+	crc = crc16(prim->payload, i);
+	prim->payload[i++] = crc % 0x0100;
+	prim->payload[i++] = crc / 0x0100;
+	assert(i == frame_size);
+	mem_chck(prim);
+	return prim;
+}
+
 primitive_t *new_AX25_UI(
 		uint16_t cH, uint16_t sH,
 		enum L3_PROTOCOL pid,
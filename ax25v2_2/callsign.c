@@ -16,6 +16,7 @@
  */
 
 #include "../runtime/exception.h"
+#include "../runtime/dl_prim.h"
 
 #include "callsign.h"
 #include "_internal.h"
@@ -26,16 +27,6 @@
 #include <ctype.h>
 #include <assert.h>
 
-static uint8_t getOctetOfChar(char ch)
-{
-
-	if ((ch >= 'a') && (ch <= 'z'))
-		ch -= 0x20;
-	if ( ((ch >= '0') && (ch <= '9')) || ((ch >= 'A') && (ch <= 'Z')) )
-		return ch << 1;
-	return 0;
-}
-
 static const char *__skipWhitespace(const char *str)
 {
 	while ((*str) && isspace(*str))
@@ -43,69 +34,6 @@ static const char *__skipWhitespace(const char *str)
 	return str;
 }
 
-callsign callsignFromString(const char *str, const char **next,
-							struct exception *ex)
-{
-	size_t i = 0;
-	uint8_t octet;
-	long int _ssid;
-	char *_call;
-	const char *_str = str;
-	union _callsign c;
-	bool with_uuid = false;
-
-	assert(str);
-	c.encoded = 0;
-	while (*str != '\0') {
-		if (isspace(*str)) {
-			break;
-		}
-		if (*str == '-') {
-			++str;
-			with_uuid = true;
-			break;
-		}
-		if (i > 5) {
-			exception_fill(ex, EXIT_FAILURE, MODULE_NAME, "callsignFromString",
-					"Callsign too long (max. 6 characters)", _str);
-			return 0;
-		}
-		octet = getOctetOfChar(*str);
-		if (octet == 0) {
-			exception_fill(ex, EXIT_FAILURE, MODULE_NAME, "callsignFromString",
-					"Invalid callsign character", _str);
-			return 0;
-		}
-		c.octets[i] = octet;
-		++str;
-		++i;
-	} /* end while */
-	if (i == 0) {
-		exception_fill(ex, EXIT_FAILURE, MODULE_NAME, "callsignFromString",
-				"Callsign too short (min. 1 character)", _str);
-		return 0;
-	}
-	while (i < 6) {
-		c.octets[i] = 0x40;
-		++i;
-	} /* end while */
-	if (with_uuid) {
-		_ssid = strtol(str, &_call, 0);
-		if ((_ssid < 0) || (_ssid >= 16)) {
-			exception_fill(ex, EXIT_FAILURE, MODULE_NAME, "callsignFromString",
-					"SSID is out of range (0..15)", _str);
-			return 0;
-		}
-	} else {
-		_call = (char*)str;
-		_ssid = 0;
-	}
-	c.octets[6] = 0x60 | (_ssid << 1);
-	if (next)
-		*next = __skipWhitespace(_call);
-	return c.encoded;
-}
-
 static int __tooShort(const char *func, struct exception *ex)
 {
 	assert(func);
@@ -113,47 +41,6 @@ static int __tooShort(const char *func, struct exception *ex)
 	return -1;
 }
 
-int callsignToString(callsign call, char *pb, size_t cb, struct exception *ex)
-{
-	union _callsign c;
-	char ch;
-	size_t i, cb1;
-	int ssid;
-
-	if (!call) {
-		if (cb < 7)
-			return __tooShort("callsignToString", ex);
-		strcpy(pb, "<NULL>");
-		return 6;
-	}
-	assert(call);
-	assert(pb);
-	assert(cb);
-	cb1 = cb;
-	c.encoded = call;
-	for (i = 0; i < 6; ++i) {
-		ch = (c.octets[i] & 0xfe) >> 1;
-		if (ch != ' ') {
-			if (cb-- == 0)
-				return __tooShort("callsignToString", ex);
-			*pb++ = ch;
-		}
-	} /* end for */
-	if (cb-- == 0)
-		return __tooShort("callsignToString", ex);
-	*pb++ = '-';
-	ssid = (c.octets[6] & 0x1e) >> 1;
-	i = snprintf(pb, cb, "%i", ssid);
-	if (i >= cb)
-		return __tooShort("callsignToString", ex);
-	cb -= i;
-	pb += i;
-	if (cb-- == 0)
-		return __tooShort("callsignToString", ex);
-	*pb++ = '\0';
-	return cb1 - cb - 1;
-}
-
 bool addressFieldFromString(callsign source, const char *dest,
 							struct addressField *af, struct exception *ex)
 {
@@ -267,6 +154,39 @@ bool addressFieldToString(const struct addressField *af,
 	return true;
 }
 
+bool addressFieldFromDL(struct primitive *prim, struct addressField *af,
+		struct exception *ex)
+{
+	callsign path[3];
+	int n;
+
+	assert(prim);
+	assert(af);
+	memset(af, 0x00, sizeof(struct addressField));
+	af->source = get_DL_src_callsign(prim, ex);
+	if (!af->source)
+		return false;
+	n = get_DL_dst_path(prim, path, 3, ex);
+	if (n < 0)
+		return false;
+	af->destination = path[0];
+	switch (n) {
+	case 1:
+		setXBit(&af->source, true);
+		break;
+	case 2:
+		af->repeaters[0] = path[1];
+		setXBit(&af->repeaters[0], true);
+		break;
+	default:
+		af->repeaters[0] = path[1];
+		af->repeaters[1] = path[2];
+		setXBit(&af->repeaters[1], true);
+		break;
+	} /* end switch */
+	return true;
+}
+
 size_t putFrameAddress(struct addressField *af, uint8_t *pframe)
 {
 	size_t res = 14;
@@ -22,6 +22,8 @@
 #ifndef AX25V2_2_CALLSIGN_H_
 #define AX25V2_2_CALLSIGN_H_
 
+#include "../runtime/callsign.h"
+
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
@@ -29,11 +31,7 @@
 #include <assert.h>
 
 struct exception;
-
-/**
- * @brief Internal representation of callsigns.
- */
-typedef uint64_t callsign;
+struct primitive;
 
 struct addressField {
 	callsign destination;
@@ -41,49 +39,8 @@ struct addressField {
 	callsign repeaters[2];
 };
 
-union _callsign {
-	callsign encoded;
-	uint8_t octets[7];
-};
-
 typedef struct addressField addressField_t;
 
-/**
- * @brief Encode a callsign from string notation.
- * @param str String notation to encode into a callsign.
- * @param next Pointer to next char after the callsign. May be NULL.
- * @param ex Exception struct, optional.
- * @return Encoded callsign or 0, in the case of an error. Param ex will
- *         contain detailed information about the problem otherwise.
- */
-extern callsign callsignFromString(const char *str, const char **next,
-		struct exception *ex);
-
-/**
- * @brief Get a callsign from a frame.
- * @param frame Pointer into a frame.
- * @return Callsign.
- */
-static inline callsign callsignFromFrame(const uint8_t *frame)
-{
-	union _callsign c;
-	c.encoded = 0;
-	memcpy(c.octets, frame, 7);
-	return c.encoded;
-}
-
-/**
- * @brief Decode a callsign to a string buffer.
- * @param call Internal callsign representation to decode.
- * @param pb Pointer to target char buffer.
- * @param cb Size of the target char buffer.
- * @param ex Exception struct, optional.
- * @return Number of bytes used from buffer. When -1, an error happened.
- *         Param ex will contain detailed Information about the problem.
- */
-extern int callsignToString(callsign call, char *pb, size_t cb,
-								struct exception *ex);
-
 /**
  * @brief Encode an addressField from string notation.
  * @param source Source callsign.
@@ -109,6 +66,18 @@ extern bool addressFieldToString(const struct addressField *af,
 									char *pb, size_t cb,
 									struct exception *ex);
 
+/**
+ * @brief Get the addressField of a DL primitive. Primitives with binary
+ *        addresses are taken over without any text parsing.
+ * @param prim DL primitive to investigate.
+ * @param af Pointer to addressField to encode to.
+ * @param ex Exception struct, optional.
+ * @return True when encoding was successful. Param ex will
+ *         contain detailed information about the problem otherwise.
+ */
+extern bool addressFieldFromDL(struct primitive *prim,
+		struct addressField *af, struct exception *ex);
+
 /**
  * @brief Copy addressField.
  * @param dst Pointer to destination addressField.
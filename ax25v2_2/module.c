@@ -30,73 +30,209 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <errno.h>
 
 struct plugin_handle plugin;
 
 static struct setting_descriptor plugin_settings_descriptor[] = {
-		{ "peer",       CSTR_T,  offsetof(struct plugin_handle, peer),       "ROUTER" },
-		{ "n_sessions", NSIZE_T, offsetof(struct plugin_handle, n_sessions), "1"      },
+		{ "peer",         CSTR_T,  offsetof(struct plugin_handle, peer),         "ROUTER" },
+		{ "n_sessions",   NSIZE_T, offsetof(struct plugin_handle, n_sessions),   "1"      },
+		{ "n1",           NSIZE_T, offsetof(struct plugin_handle, n1),           "256"    },
+		{ "rx_budget",    NSIZE_T, offsetof(struct plugin_handle, rx_budget),    "64"     },
+		{ "tx_budget",    NSIZE_T, offsetof(struct plugin_handle, tx_budget),    "64"     },
+		{ "timer_budget", NSIZE_T, offsetof(struct plugin_handle, timer_budget), "64"     },
+		{ "tick_batch",   NSIZE_T, offsetof(struct plugin_handle, tick_batch),   "8"      },
 		{ NULL }
 };
 
-static bool onTick(void *user_data, struct exception *ex)
+/* Max. number of timers taken from the elapsed list in one go */
+#define TIMER_BATCH 32
+
+static const char *tick_class_name[TICK_CLASSES] = { "rx", "tx", "timer" };
+
+static inline void account_wait(struct tick_class_stats *stats,
+		unsigned long wait)
 {
-	int erc;
+	stats->wait_sum += wait;
+	if (wait > stats->wait_max)
+		stats->wait_max = wait;
+}
 
-	assert(user_data == &plugin);
-	while (true) {
-		/* Handle RX */
-		{
-			bool expedited;
-			struct primitive *prim = primbuffer_read_nonblock(&plugin.rx_buffer, &expedited);
-			if (prim) {
-				if (prim->clientHandle < plugin.n_sessions) {
-					if (!session_rx(&plugin.sessions[prim->clientHandle], prim, ex))
-							return false;
-				}
-				del_prim(prim);
-				continue;
-			}
-		}
-		/* Handle TX */
-		{
-			bool expedited;
-			struct primitive *prim = primbuffer_read_nonblock(&plugin.tx_buffer, &expedited);
-			if (prim) {
-				if (prim->serverHandle < plugin.n_sessions) {
-					if (!session_tx(&plugin.sessions[prim->serverHandle], prim, ex))
-							return false;
-				}
-				del_prim(prim);
-				continue;
+static bool drain_prims(enum tick_class cls, size_t max, size_t *done,
+		struct exception *ex)
+{
+	LIST_HEAD(batch);
+	struct tick_class_stats *stats = &plugin.tick_stats.cls[cls];
+	struct primitive *prim;
+	bool res = true;
+
+	assert((cls == TICK_RX) || (cls == TICK_TX));
+	*done = primbuffer_read_batch(
+			(cls == TICK_RX) ? &plugin.rx_buffer : &plugin.tx_buffer,
+			&batch, max, NULL);
+	while (!list_empty(&batch)) {
+		prim = list_first_entry(&batch, struct primitive, node);
+		list_del_init(&prim->node);
+		account_wait(stats, (uint32_t)jiffies - prim->stamp);
+		/* After an error the rest of the batch is only released */
+		if (res) {
+			if (cls == TICK_RX) {
+				if (prim->clientHandle < plugin.n_sessions)
+					res = session_rx(&plugin.sessions[prim->clientHandle],
+							prim, ex);
+			} else {
+				if (prim->serverHandle < plugin.n_sessions)
+					res = session_tx(&plugin.sessions[prim->serverHandle],
+							prim, ex);
 			}
 		}
-		/* Handle Timer */
-		{
-			struct ax25c_timer *timer;
-
-			erc = pthread_spin_lock(&elapsed_timer_list_lock); /* ===v */
-			assert(erc == 0);
-			timer = list_first_entry_or_null(&elapsed_timer_list,
-					struct ax25c_timer, node);
-			if (timer)
-				list_del_init(&timer->node);
-			erc = pthread_spin_unlock(&elapsed_timer_list_lock); /* =^ */
-			assert(erc == 0);
-			if (timer) {
-				assert(timer->state == TIMER_ELAPSED);
-				timer->state = TIMER_IDLE;
-				assert(timer->function);
-				timer->function(timer->data);
+		del_prim(prim);
+	} /* end while */
+	return res;
+}
+
+/* What is needed to fire a timer, taken while it is on the list */
+struct timer_fire {
+	void (*function)(unsigned long);
+	unsigned long data;
+	unsigned long expires;
+};
+
+static size_t drain_timers(size_t max)
+{
+	struct timer_fire batch[TIMER_BATCH];
+	struct tick_class_stats *stats = &plugin.tick_stats.cls[TICK_TIMER];
+	struct ax25c_timer *timer;
+	size_t i, n = 0;
+	int erc;
+
+	if (max > TIMER_BATCH)
+		max = TIMER_BATCH;
+	erc = pthread_spin_lock(&elapsed_timer_list_lock); /* ===v */
+	assert(erc == 0);
+	while (n < max) {
+		timer = list_first_entry_or_null(&elapsed_timer_list,
+				struct ax25c_timer, node);
+		if (!timer)
+			break;
+		list_del_init(&timer->node);
+		/* Restarted or stopped meanwhile, the timer is not touched after
+		 * it left the list, it may be destroyed then */
+		if (timer->state != TIMER_ELAPSED)
+			continue;
+		timer->state = TIMER_IDLE;
+		assert(timer->function);
+		batch[n].function = timer->function;
+		batch[n].data = timer->data;
+		batch[n].expires = timer->timer.expires;
+		++n;
+	} /* end while */
+	erc = pthread_spin_unlock(&elapsed_timer_list_lock); /* =^ */
+	assert(erc == 0);
+	for (i = 0; i < n; ++i) {
+		account_wait(stats, jiffies - batch[i].expires);
+		batch[i].function(batch[i].data);
+	} /* end for */
+	return n;
+}
+
+static bool onTick(void *user_data, struct exception *ex)
+{
+	struct tick_stats *stats = &plugin.tick_stats;
+	struct tick_class_stats *cs;
+	size_t budget[TICK_CLASSES], step, max, done;
+	bool idle[TICK_CLASSES], busy;
+	int i, cls;
+
+	assert(user_data == &plugin);
+	budget[TICK_RX]    = plugin.rx_budget    ? plugin.rx_budget    : SIZE_MAX;
+	budget[TICK_TX]    = plugin.tx_budget    ? plugin.tx_budget    : SIZE_MAX;
+	budget[TICK_TIMER] = plugin.timer_budget ? plugin.timer_budget : SIZE_MAX;
+	step = plugin.tick_batch ? plugin.tick_batch : SIZE_MAX;
+	for (cls = 0; cls < TICK_CLASSES; ++cls) {
+		idle[cls] = false;
+		stats->cls[cls].last = 0;
+	} /* end for */
+	/*
+	 * Serve the categories round robin in batches of tick_batch, starting
+	 * with a different one every tick, until each of them is either empty
+	 * or has used up its budget for this tick.
+	 */
+	do {
+		busy = false;
+		for (i = 0; i < TICK_CLASSES; ++i) {
+			cls = (plugin.tick_rotor + i) % TICK_CLASSES;
+			if (idle[cls] || (budget[cls] == 0))
 				continue;
+			max = (step < budget[cls]) ? step : budget[cls];
+			if (cls == TICK_TIMER) {
+				if (max > TIMER_BATCH)
+					max = TIMER_BATCH;
+				done = drain_timers(max);
+			} else if (!drain_prims(cls, max, &done, ex)) {
+				return false;
 			}
+			budget[cls] -= done;
+			stats->cls[cls].last += done;
+			if (done < max)
+				idle[cls] = true;
+			else
+				busy = true;
+		} /* end for */
+	} while (busy);
+	plugin.tick_rotor = (plugin.tick_rotor + 1) % TICK_CLASSES;
+
+	stats->ticks++;
+	for (cls = 0; cls < TICK_CLASSES; ++cls) {
+		cs = &stats->cls[cls];
+		cs->items += cs->last;
+		if (cs->last > cs->peak)
+			cs->peak = cs->last;
+		if (!idle[cls] && (budget[cls] == 0)) {
+			cs->exhausted++;
+			if (configuration.loglevel >= DEBUG_LEVEL_DEBUG)
+				ax25c_log(DEBUG_LEVEL_DEBUG,
+						"AX25V2_2:onTick: %s budget exhausted after %zu",
+						tick_class_name[cls], cs->last);
 		}
-		break;
-	} /* end while */
+	} /* end for */
 	return true;
 }
 
+static void log_tick_stats(void)
+{
+	struct tick_class_stats *cs;
+	struct mem_stats ms;
+	unsigned long items = 0;
+	int cls;
+
+	if (configuration.loglevel < DEBUG_LEVEL_INFO)
+		return;
+	for (cls = 0; cls < TICK_CLASSES; ++cls) {
+		cs = &plugin.tick_stats.cls[cls];
+		items += cs->items;
+		ax25c_log(DEBUG_LEVEL_INFO,
+				"AX25V2_2:%s: %lu items in %lu ticks, peak %zu/tick, "
+				"%lu exhausted, wait avg %lu max %lu jiffies",
+				tick_class_name[cls], cs->items, plugin.tick_stats.ticks,
+				cs->peak, cs->exhausted,
+				cs->items ? cs->wait_sum / cs->items : 0, cs->wait_max);
+	} /* end for */
+	/* Memory manager calls of the whole process while running */
+	mem_get_stats(&ms);
+	ms.n_alloc -= plugin.mem_stats.n_alloc;
+	ms.n_lock  -= plugin.mem_stats.n_lock;
+	ms.n_free  -= plugin.mem_stats.n_free;
+	ax25c_log(DEBUG_LEVEL_INFO,
+			"AX25V2_2: %lu mem_alloc, %lu mem_lock, %lu mem_free "
+			"for %lu items (%lu.%02lu calls/item)",
+			ms.n_alloc, ms.n_lock, ms.n_free, items,
+			items ? (ms.n_alloc + ms.n_lock + ms.n_free) / items : 0,
+			items ? (ms.n_alloc + ms.n_lock + ms.n_free) * 100 / items % 100
+					: 0);
+}
+
 static struct tick_listener tick_listener = {
 		.onTick    = onTick,
 		.user_data = NULL
@@ -121,7 +257,15 @@ static bool start_plugin(struct plugin_handle *plugin, struct exception *ex) {
 
 	assert(plugin);
 	DBG_DEBUG("Start", plugin->name);
+	if (plugin->n1 < 3) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "start_plugin",
+				"Invalid value for n1", plugin->name);
+		return false;
+	}
+	if (!ax25_segment_selfcheck(plugin->n1, ex))
+		return false;
 	init_ax25c_timer();
+	mem_get_stats(&plugin->mem_stats);
 	plugin->sessions = malloc(sizeof(struct session) * plugin->n_sessions);
 	if (!plugin->sessions) {
 		exception_fill(ex, ENOMEM, MODULE_NAME, "start_plugin",
@@ -149,6 +293,7 @@ static bool stop_plugin(struct plugin_handle *plugin, struct exception *ex) {
 	assert(ex);
 	DBG_DEBUG("Stop", plugin->name);
 	unregisterTickListener(&tick_listener);
+	log_tick_stats();
 	ax25v2_2_stop(plugin, ex);
 	ax25v2_2_monitor_dest(ex);
 	for (i = 0; i < plugin->n_sessions; ++i)
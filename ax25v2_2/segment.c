@@ -0,0 +1,262 @@
+/*
+ *  Project: ax25c - File: segment.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "segment.h"
+#include "_internal.h"
+
+#include "../runtime/dl_prim.h"
+#include "../runtime/memory.h"
+#include "../runtime/exception.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+bool ax25_segmenter_init(struct ax25_segmenter *seg, primitive_t *prim,
+		const uint8_t *data, size_t size, enum L3_PROTOCOL pid, size_t n1,
+		struct exception *ex)
+{
+	size_t n;
+
+	assert(seg);
+	assert(prim);
+	assert(data || !size);
+	if (n1 < 3) {
+		exception_fill(ex, EINVAL, MODULE_NAME,
+				"ax25_segmenter_init", "N1 too small for segmentation", "");
+		return false;
+	}
+	/* First segment has header and PID, all others only the header: */
+	n = (size <= n1 - 2) ? 1 : 1 + size / (n1 - 1);
+	if (n > SEG_MAX) {
+		exception_fill(ex, EMSGSIZE, MODULE_NAME,
+				"ax25_segmenter_init", "Data unit too large", "");
+		return false;
+	}
+	use_prim(prim);
+	seg->prim = prim;
+	seg->data = data;
+	seg->size = size;
+	seg->offset = 0;
+	seg->n1 = n1;
+	seg->pid = (uint8_t)pid;
+	seg->remaining = (int)n - 1;
+	return true;
+}
+
+bool ax25_segmenter_next(struct ax25_segmenter *seg,
+		struct ax25_segment *out)
+{
+	size_t room;
+
+	assert(seg);
+	assert(out);
+	if (seg->remaining < 0)
+		return false;
+	out->first = (seg->offset == 0);
+	out->header = (uint8_t)(seg->remaining & SEG_REM);
+	if (out->first)
+		out->header |= SEG_FIRST;
+	out->pid = seg->pid;
+	room = seg->n1 - (out->first ? 2 : 1);
+	out->data = &seg->data[seg->offset];
+	out->size = seg->size - seg->offset;
+	if (out->size > room)
+		out->size = room;
+	seg->offset += out->size;
+	seg->remaining -= 1;
+	assert((seg->remaining >= 0) || (seg->offset == seg->size));
+	return true;
+}
+
+void ax25_segmenter_reset(struct ax25_segmenter *seg)
+{
+	assert(seg);
+	del_prim(seg->prim);
+	seg->prim = NULL;
+	seg->data = NULL;
+	seg->size = 0;
+	seg->offset = 0;
+	seg->remaining = -1;
+}
+
+void ax25_reassembler_init(struct ax25_reassembler *rasm)
+{
+	assert(rasm);
+	rasm->prim = NULL;
+	rasm->data = NULL;
+	rasm->size = 0;
+	rasm->capacity = 0;
+	rasm->pid = 0;
+	rasm->remaining = -1;
+}
+
+void ax25_reassembler_reset(struct ax25_reassembler *rasm)
+{
+	assert(rasm);
+	del_prim(rasm->prim);
+	ax25_reassembler_init(rasm);
+}
+
+static bool rasm_fail(struct ax25_reassembler *rasm, int erc,
+		const char *msg, struct exception *ex)
+{
+	ax25_reassembler_reset(rasm);
+	exception_fill(ex, erc, MODULE_NAME, "ax25_reassembler_put", msg, "");
+	return false;
+}
+
+bool ax25_reassembler_put(struct ax25_reassembler *rasm,
+		uint16_t clientHandle, uint16_t serverHandle,
+		const uint8_t *pb, size_t cb, size_t n1,
+		primitive_t **complete, uint8_t *pid, struct exception *ex)
+{
+	uint8_t header;
+	int remaining;
+
+	assert(rasm);
+	assert(pb || !cb);
+	assert(complete);
+	*complete = NULL;
+	if (cb < 1)
+		return rasm_fail(rasm, EPROTO, "Empty segment", ex);
+	header = *pb++; --cb;
+	remaining = header & SEG_REM;
+	if (header & SEG_FIRST) {
+		size_t capacity;
+
+		if (cb < 1)
+			return rasm_fail(rasm, EPROTO, "First segment without PID", ex);
+		/* A new first segment drops any partial data unit: */
+		ax25_reassembler_reset(rasm);
+		capacity = (size_t)(remaining + 1) * (n1 > 1 ? n1 - 1 : 1);
+		if (capacity > MAX_PAYLOAD_SIZE - sizeof(struct prim_index)
+				- PRIM_PARAM_ALIGN)
+			capacity = MAX_PAYLOAD_SIZE - sizeof(struct prim_index)
+				- PRIM_PARAM_ALIGN;
+		rasm->prim = new_DL_DATA_Indication(clientHandle, serverHandle,
+				NULL, capacity, ex);
+		if (!rasm->prim)
+			return rasm_fail(rasm, ENOMEM, "Out of memory", ex);
+		rasm->data = get_prim_param_wdata(rasm->prim, 0);
+		rasm->capacity = capacity;
+		rasm->pid = *pb++; --cb;
+	} else {
+		if (rasm->remaining < 0)
+			return rasm_fail(rasm, EPROTO, "Segment out of sequence", ex);
+		if (remaining != rasm->remaining - 1)
+			return rasm_fail(rasm, EPROTO, "Segment lost", ex);
+	}
+	if (rasm->size + cb > rasm->capacity)
+		return rasm_fail(rasm, EMSGSIZE, "Data unit too large", ex);
+	memcpy(&rasm->data[rasm->size], pb, cb);
+	rasm->size += cb;
+	rasm->remaining = remaining;
+	if (remaining > 0)
+		return true;
+	/* Last segment, trim the indication to what was received: */
+	trim_prim_param(rasm->prim, rasm->size);
+	mem_chck(rasm->prim);
+	*complete = rasm->prim;
+	if (pid)
+		*pid = rasm->pid;
+	rasm->prim = NULL;
+	ax25_reassembler_reset(rasm);
+	return true;
+}
+
+/* Round trip of one data unit, the I-fields are built as on the air */
+static bool selfcheck_unit(size_t size, size_t n1, uint8_t *field,
+		struct exception *ex)
+{
+	struct ax25_segmenter seg;
+	struct ax25_reassembler rasm;
+	struct ax25_segment out;
+	primitive_t *prim, *complete = NULL;
+	prim_param_t *param;
+	uint8_t pid = 0;
+	size_t i, cb;
+	bool res = false;
+
+	prim = new_prim(size, DL, DL_DATA_REQUEST, 0, 0, ex);
+	if (!prim)
+		return false;
+	for (i = 0; i < size; ++i)
+		prim->payload[i] = (uint8_t)(i * 7 + size);
+	seg.prim = NULL;
+	ax25_segmenter_reset(&seg);
+	ax25_reassembler_init(&rasm);
+	if (!ax25_segmenter_init(&seg, prim, prim->payload, size, L3_NPROT, n1,
+			ex))
+		goto done;
+	while (ax25_segmenter_next(&seg, &out)) {
+		cb = 0;
+		field[cb++] = out.header;
+		if (out.first)
+			field[cb++] = out.pid;
+		memcpy(&field[cb], out.data, out.size);
+		cb += out.size;
+		if (cb > n1) {
+			exception_fill(ex, EPROTO, MODULE_NAME, "ax25_segment_selfcheck",
+					"Segment exceeds N1", "");
+			goto done;
+		}
+		if (!ax25_reassembler_put(&rasm, 0, 0, field, cb, n1, &complete,
+				&pid, ex))
+			goto done;
+	} /* end while */
+	param = complete ? get_DL_data_param(complete) : NULL;
+	if (!param || (pid != L3_NPROT) ||
+			(get_prim_param_size(param) != size) ||
+			memcmp(get_prim_param_data(param), prim->payload, size)) {
+		exception_fill(ex, EPROTO, MODULE_NAME, "ax25_segment_selfcheck",
+				"Reassembled data differs", "");
+		goto done;
+	}
+	res = true;
+done:
+	del_prim(complete);
+	ax25_segmenter_reset(&seg);
+	ax25_reassembler_reset(&rasm);
+	del_prim(prim);
+	return res;
+}
+
+bool ax25_segment_selfcheck(size_t n1, struct exception *ex)
+{
+	size_t sizes[] = { 0, 1, n1 - 2, n1 - 1, n1, 2 * n1, 5 * n1 + 3 };
+	uint8_t *field;
+	bool res = true;
+	size_t i;
+
+	assert(n1 >= 3);
+	field = malloc(n1);
+	if (!field) {
+		exception_fill(ex, ENOMEM, MODULE_NAME, "ax25_segment_selfcheck",
+				"Out of memory", "");
+		return false;
+	}
+	for (i = 0; res && (i < sizeof(sizes) / sizeof(sizes[0])); ++i) {
+		/* Only what still fits into one indication */
+		if (sizes[i] + 64 > MAX_PAYLOAD_SIZE)
+			continue;
+		res = selfcheck_unit(sizes[i], n1, field, ex);
+	} /* end for */
+	free(field);
+	return res;
+}
@@ -0,0 +1,181 @@
+/*
+ *  Project: ax25c - File: segment.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file segment.h
+ * @brief Segmentation and reassembly of large I-fields (PID 0x08).
+ */
+#ifndef AX25V2_2_SEGMENT_H_
+#define AX25V2_2_SEGMENT_H_
+
+#include "../runtime/primitive.h"
+#include "../l3.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct exception;
+
+/**
+ * @brief First segment flag in the segment header octet.
+ */
+#define SEG_FIRST 0x80
+
+/**
+ * @brief Mask for the number of remaining segments in the header octet.
+ */
+#define SEG_REM   0x7f
+
+/**
+ * @brief Max. number of segments for one data unit.
+ */
+#define SEG_MAX   128
+
+/**
+ * @brief One segment. Refers to a slice of the segmented primitive, the
+ *        data is not copied.
+ */
+struct ax25_segment {
+	uint8_t        header;   /**< Segment header octet.              */
+	bool           first;    /**< First segment, carries the PID.    */
+	uint8_t        pid;      /**< PID of the segmented data unit.    */
+	const uint8_t *data;     /**< Slice of the segmented data.       */
+	size_t         size;     /**< Size of the slice.                 */
+};
+
+/**
+ * @brief Segmenter state for one data unit.
+ */
+struct ax25_segmenter {
+	primitive_t   *prim;     /**< Segmented primitive (locked).      */
+	const uint8_t *data;     /**< Data to segment.                   */
+	size_t         size;     /**< Size of data to segment.           */
+	size_t         offset;   /**< Offset of the next segment.        */
+	size_t         n1;       /**< Max. size of an I-field.           */
+	uint8_t        pid;      /**< PID of the data unit.              */
+	int            remaining;/**< Segments left, -1 when idle.       */
+};
+
+/**
+ * @brief Reassembler state for one data unit.
+ */
+struct ax25_reassembler {
+	primitive_t   *prim;     /**< DL_DATA_Indication being filled.   */
+	uint8_t       *data;     /**< Data area of prim.                 */
+	size_t         size;     /**< Octets reassembled so far.         */
+	size_t         capacity; /**< Size of the data area.             */
+	uint8_t        pid;      /**< PID of the data unit.              */
+	int            remaining;/**< Segments expected, -1 when idle.   */
+};
+
+/**
+ * @brief Check if a data unit must be segmented.
+ * @param size Size of the data unit.
+ * @param n1 Max. size of an I-field.
+ * @return True, when the data unit does not fit into one I-field.
+ */
+static inline bool ax25_segmentation_required(size_t size, size_t n1)
+{
+	return (size > n1);
+}
+
+/**
+ * @brief Start segmentation of a data unit. The primitive is locked until
+ *        ax25_segmenter_reset is called.
+ * @param seg Segmenter state.
+ * @param prim Primitive holding the data.
+ * @param data Pointer to the data inside of prim.
+ * @param size Size of the data.
+ * @param pid PID of the data unit.
+ * @param n1 Max. size of an I-field.
+ * @param ex Exception struct, optional.
+ * @return True, when the data unit can be segmented.
+ */
+extern bool ax25_segmenter_init(struct ax25_segmenter *seg, primitive_t *prim,
+		const uint8_t *data, size_t size, enum L3_PROTOCOL pid, size_t n1,
+		struct exception *ex);
+
+/**
+ * @brief Get the next segment.
+ * @param seg Segmenter state.
+ * @param out Segment to fill in.
+ * @return True, when a segment was returned, false when done.
+ */
+extern bool ax25_segmenter_next(struct ax25_segmenter *seg,
+		struct ax25_segment *out);
+
+/**
+ * @brief Release the segmented primitive and reset the state.
+ * @param seg Segmenter state.
+ */
+extern void ax25_segmenter_reset(struct ax25_segmenter *seg);
+
+/**
+ * @brief Check if the segmenter has segments left.
+ * @param seg Segmenter state.
+ * @return True, when segmentation is in progress.
+ */
+static inline bool ax25_segmenter_active(const struct ax25_segmenter *seg)
+{
+	return (seg->remaining >= 0);
+}
+
+/**
+ * @brief Initialize a reassembler.
+ * @param rasm Reassembler state.
+ */
+extern void ax25_reassembler_init(struct ax25_reassembler *rasm);
+
+/**
+ * @brief Drop a partial data unit and reset the state.
+ * @param rasm Reassembler state.
+ */
+extern void ax25_reassembler_reset(struct ax25_reassembler *rasm);
+
+/**
+ * @brief Put the I-field of a received PID 0x08 frame into the reassembler.
+ *        The first segment allocates a DL_DATA_Indication that is big
+ *        enough for all announced segments, the following segments are
+ *        copied right into it.
+ * @param rasm Reassembler state.
+ * @param clientHandle Client handle for the indication.
+ * @param serverHandle Server handle for the indication.
+ * @param pb Pointer to the I-field.
+ * @param cb Size of the I-field.
+ * @param n1 Max. size of an I-field.
+ * @param complete Receives the indication when the last segment arrived,
+ *        NULL otherwise.
+ * @param pid Receives the PID of a completed data unit. Optional.
+ * @param ex Exception struct, optional.
+ * @return False on a sequence error. The partial data unit is dropped then.
+ */
+extern bool ax25_reassembler_put(struct ax25_reassembler *rasm,
+		uint16_t clientHandle, uint16_t serverHandle,
+		const uint8_t *pb, size_t cb, size_t n1,
+		primitive_t **complete, uint8_t *pid, struct exception *ex);
+
+/**
+ * @brief Run data units of the sizes around the segment boundaries
+ *        through segmenter and reassembler and compare the result.
+ * @param n1 Max. size of an I-field.
+ * @param ex Exception struct, optional.
+ * @return False, when a round trip does not reproduce the data unit.
+ */
+extern bool ax25_segment_selfcheck(size_t n1, struct exception *ex);
+
+#endif /* AX25V2_2_SEGMENT_H_ */
@@ -27,6 +27,9 @@ bool init_session(struct session *session, struct exception *ex)
 {
 	assert(session);
 	session->is_active = false;
+	session->segmenter.prim = NULL;
+	ax25_segmenter_reset(&session->segmenter);
+	ax25_reassembler_init(&session->reassembler);
 	return true;
 }
 
@@ -34,6 +37,8 @@ void term_session(struct session *session)
 {
 	assert(session);
 	session->is_active = false;
+	ax25_segmenter_reset(&session->segmenter);
+	ax25_reassembler_reset(&session->reassembler);
 }
 
 bool session_tx(struct session *session, struct primitive *prim, struct exception *ex)
@@ -18,6 +18,9 @@
 #ifndef AX25V2_2_SESSION_H_
 #define AX25V2_2_SESSION_H_
 
+#include "segment.h"
+#include "callsign.h"
+
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -28,6 +31,9 @@ struct session {
 	uint16_t server_id;
 	uint16_t client_id;
 	bool     is_active;
+	addressField_t af;
+	struct ax25_segmenter segmenter;
+	struct ax25_reassembler reassembler;
 };
 
 extern bool init_session(struct session *session, struct exception *ex);
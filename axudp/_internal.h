@@ -19,29 +19,68 @@
 #define AXUDP__INTERNAL_H_
 
 #include "../runtime/dlsap.h"
+#include "peer.h"
+#include "pacing.h"
 
 #include <sys/types.h>
 
-#ifdef __MINGW32__
-#include <windows.h>
-#include <winsock2.h>
-#include <winsock.h>
-#include <ws2tcpip.h>
-#define AI_ADDRCONFIG 0x00000400
-#else
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netdb.h>
-#endif
 
 #include <pthread.h>
+#include <time.h>
+
+#include <uki/list.h>
 
 #define MODULE_NAME "AXUDP"
 
+/* Max. number of datagrams per recvmmsg/sendmmsg call */
+#define AXUDP_BATCH_MAX 64
+
+/* Max. number of slices of a frame to send */
+#define AXUDP_IOV_MAX 16
+
 struct primbuffer;
+struct reactor;
+struct tx_batch;
+struct axudp_uring;
+struct instance_handle;
 
 struct plugin_handle {
 	const char  *name;
+	/***/
+	unsigned int            reactor_threads;
+	/***/
+	struct reactor         *reactor;
+	unsigned int            next_reactor;
+};
+
+/* Max. number of SO_REUSEPORT sockets of a server instance */
+#define AXUDP_SHARD_MAX 32
+
+struct axudp_shard;
+
+/* Reactor mode: epoll user data of an instance fd, shard is NULL for tx */
+struct axudp_event {
+	struct instance_handle *instance;
+	struct axudp_shard     *shard;
+};
+
+/*
+ * One receiving socket with its own rx path. Shard 0 is the instance
+ * socket, further shards share its port with SO_REUSEPORT.
+ */
+struct axudp_shard {
+	struct instance_handle *instance;
+	int                     sockfd;
+	primitive_t            *rx_slot[AXUDP_BATCH_MAX];
+	bool                    rx_thread_running;
+	pthread_t               rx_thread;
+	struct reactor         *reactor;
+	struct axudp_event      rx_event;
+	struct list_head        pending_node;
 };
 
 struct instance_handle {
@@ -51,21 +90,169 @@ struct instance_handle {
 	const char             *host;
 	const char             *port;
 	size_t                  rx_buf_size;
+	size_t                  rx_prim_size;
+	unsigned int            rx_pool_size;
+	unsigned int            batch_size;
+	unsigned int            max_peers;
+	unsigned int            peer_timeout;
+	unsigned int            shards;
+	unsigned int            tx_queue_max;
+	unsigned int            tx_rate;
+	unsigned int            tx_burst;
+	const char             *tx_pacing;
 	const char             *mode;
 	const char             *ip_version;
+	const char             *io;
 	/***/
 	volatile bool           alive;
 	struct primbuffer       primbuffer;
-	uint8_t                *rx_buf;
-	bool                    rx_thread_running;
-	pthread_t               rx_thread;
+	/* Pool of preallocated rx prims, refilled by the pool thread */
+	primitive_t           **rx_pool;
+	unsigned int            rx_pool_n;
+	pthread_spinlock_t      rx_pool_lock;
+	pthread_mutex_t         rx_pool_cond_lock;
+	pthread_cond_t          rx_pool_cond;
+	bool                    pool_thread_running;
+	pthread_t               pool_thread;
 	bool                    tx_thread_running;
 	pthread_t               tx_thread;
 	int                     sockfd;
 	bool                    server_mode;
-	/* Server mode: Only support one client! */
-	struct sockaddr_storage peer_addr;
-	socklen_t               peer_addr_len;
+	struct axudp_shard      shard[AXUDP_SHARD_MAX];
+	unsigned int            n_shards;
+	/* Reactor mode: Served by a shared thread instead of rx/tx threads */
+	struct reactor         *reactor;
+	struct list_head        reactor_node;
+	int                     evfd;
+	struct axudp_event      tx_event;
+	/* io_uring transport */
+	bool                    use_uring;
+	struct axudp_uring     *uring;
+	time_t                  last_sweep;
+	/* Server mode: One entry per AXUDP neighbour */
+	struct peer_table       peers;
+	/* Transmit pacing, only touched by the sending thread */
+	struct pacing           pacing;
+	/* Traffic counters, updated atomically from every thread */
+	struct dls_stats        stats;
 };
 
+extern struct plugin_handle plugin;
+
+/**
+ * @brief Get a prim with a header that only the tx path sees, so that the
+ *        route can be put into it: serverHandle holds the peer index and
+ *        clientHandle the generation of the peer. An owned prim that nobody
+ *        else references is returned as it is, other prims are shared
+ *        with prim_sg_share().
+ * @param owned The reference of the caller goes to the result, when it
+ *        is not NULL.
+ * @return Prim to tag and queue or NULL when out of memory.
+ */
+extern primitive_t *axudp_own(primitive_t *prim, bool owned,
+		struct exception *ex);
+
+/**
+ * @brief Queue a prim for transmission, taking over the reference.
+ */
+extern void axudp_enqueue(struct instance_handle *instance,
+		primitive_t *prim, bool expedited);
+
+/**
+ * @brief Add to a traffic counter of an instance.
+ */
+static inline void axudp_count(unsigned long *counter, unsigned long n)
+{
+	__atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Account a dropped frame.
+ */
+static inline void axudp_drop(struct instance_handle *instance,
+		enum dls_drop reason)
+{
+	axudp_count(&instance->stats.drops[reason], 1);
+}
+
+/**
+ * @brief Account a completed send of prim.
+ * @param res Number of octets sent, negative when the send failed.
+ */
+extern void axudp_sent(struct instance_handle *instance, primitive_t *prim,
+		long res);
+
+/**
+ * @brief Take a prim with rx_prim_size payload from the rx pool. Falls
+ *        back to the allocator when the pool is empty.
+ */
+extern primitive_t *axudp_pool_get(struct instance_handle *instance,
+		struct exception *ex);
+
+/**
+ * @brief Hand a received datagram over to the upper layer.
+ * @return true when the prim was consumed, false when the caller keeps it
+ *         for the next receive.
+ */
+extern bool axudp_rx_deliver(struct instance_handle *instance,
+		primitive_t *prim, unsigned int len, struct sockaddr_storage *addr,
+		socklen_t addr_len, time_t now);
+
+/**
+ * @brief Receives the datagrams of a prim to send, one call per
+ *        destination. addr is NULL on a connected socket.
+ */
+typedef void (*axudp_sink)(struct instance_handle *instance, void *ctx,
+		primitive_t *prim, const struct iovec *iov, int iovlen,
+		const struct sockaddr_storage *addr, socklen_t addr_len);
+
+/**
+ * @brief Check a prim to send, map it to an iovec and pass it to the sink
+ *        for every destination. Releases the prim.
+ * @param expedited The prim came from the expedited queue, it is not paced.
+ */
+extern void axudp_tx_prim(struct instance_handle *instance,
+		primitive_t *prim, bool expedited, axudp_sink sink, void *ctx);
+
+/**
+ * @brief Pass the held frames that are due to the sink.
+ * @return Nanoseconds until the next held frame is due, -1 when nothing
+ *         is held.
+ */
+extern int64_t axudp_tx_paced(struct instance_handle *instance,
+		axudp_sink sink, void *ctx);
+
+/**
+ * @brief One recvmmsg() round into the rx slots of a shard.
+ * @return Number of datagrams or -1, see errno.
+ */
+extern int axudp_rx_round(struct axudp_shard *shard, int flags);
+
+/**
+ * @brief Send everything that is queued for the instance.
+ */
+extern void axudp_tx_drain(struct instance_handle *instance,
+		struct tx_batch *tx);
+
+/**
+ * @brief Send the held frames that are due, see axudp_tx_paced.
+ */
+extern int64_t axudp_tx_release(struct instance_handle *instance,
+		struct tx_batch *tx);
+
+/**
+ * @brief Allocate a tx batch for a sending thread.
+ */
+extern struct tx_batch *axudp_tx_batch_new(void);
+
+/**
+ * @brief Reactor mode: Refill the rx pool and expire idle peers.
+ */
+extern void axudp_housekeeping(struct instance_handle *instance, time_t now);
+
+/**
+ * @brief Monotonic time in seconds.
+ */
+extern time_t axudp_now(void);
+
 #endif /* AXUDP__INTERNAL_H_ */
@@ -15,24 +15,37 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* recvmmsg, sendmmsg */
+#endif
+
 #include "../config/configuration.h"
 #include "../runtime/primbuffer.h"
 #include "../runtime/runtime.h"
 #include "../runtime/dlsap.h"
+#include "../runtime/primslice.h"
 
 #include "_internal.h"
+#include "reactor.h"
+#include "uring.h"
 
 #include <errno.h>
 #include <signal.h>
+#include <fcntl.h>
 #include <assert.h>
 
-#ifndef __MINGW32__
-#define closesocket(sock) close(sock)
-#endif
+#include <uki/jiffies.h>
+
+#include <sys/eventfd.h>
+
+/* Max. time the tx thread sleeps, so that it sees a stop in any case */
+#define TX_IDLE_WAIT 1000000000LL
+
 
 struct plugin_handle plugin;
 
 static struct setting_descriptor plugin_settings_descriptor[] = {
+		{ "reactor_threads", UINT_T, offsetof(struct plugin_handle, reactor_threads), "0" },
 		{ NULL }
 };
 
@@ -40,157 +53,579 @@ static struct setting_descriptor instance_settings_descriptor[] = {
 		{ "host",        CSTR_T, offsetof(struct instance_handle, host),        "localhost" },
 		{ "port",        CSTR_T, offsetof(struct instance_handle, port),        "9300"      },
 		{ "rx_buf_size", UINT_T, offsetof(struct instance_handle, rx_buf_size), "1024"      },
+		{ "rx_pool_size",UINT_T, offsetof(struct instance_handle, rx_pool_size),"32"        },
+		{ "batch_size",  UINT_T, offsetof(struct instance_handle, batch_size),  "16"        },
+		{ "max_peers",   UINT_T, offsetof(struct instance_handle, max_peers),   "256"       },
+		{ "peer_timeout",UINT_T, offsetof(struct instance_handle, peer_timeout),"600"       },
+		{ "shards",      UINT_T, offsetof(struct instance_handle, shards),      "1"         },
+		{ "tx_queue_max",UINT_T, offsetof(struct instance_handle, tx_queue_max),"0"         },
+		{ "tx_rate",     UINT_T, offsetof(struct instance_handle, tx_rate),     "0"         },
+		{ "tx_burst",    UINT_T, offsetof(struct instance_handle, tx_burst),    "512"       },
+		{ "tx_pacing",   CSTR_T, offsetof(struct instance_handle, tx_pacing),   "peer"      },
 		{ "mode",        CSTR_T, offsetof(struct instance_handle, mode),        "client"    },
 		{ "ip_version",  CSTR_T, offsetof(struct instance_handle, ip_version),  "ax_v4"     },
+		{ "io",          CSTR_T, offsetof(struct instance_handle, io),          "socket"    },
 		{ NULL }
 };
 
-static void *rx_worker(void *id)
+static inline void pool_signal(struct instance_handle *instance)
 {
-	int n;
+	pthread_mutex_lock(&instance->rx_pool_cond_lock);
+	pthread_cond_signal(&instance->rx_pool_cond);
+	pthread_mutex_unlock(&instance->rx_pool_cond_lock);
+}
+
+primitive_t *axudp_pool_get(struct instance_handle *instance,
+		struct exception *ex)
+{
+	primitive_t *prim = NULL;
+	int erc;
+
+	erc = pthread_spin_lock(&instance->rx_pool_lock); /*-----------------v*/
+	assert(erc == 0);
+	if (instance->rx_pool_n)
+		prim = instance->rx_pool[--instance->rx_pool_n];
+	erc = pthread_spin_unlock(&instance->rx_pool_lock); /*---------------^*/
+	assert(erc == 0);
+	if (prim) {
+		if (!instance->reactor)
+			pool_signal(instance);
+		return prim;
+	}
+	prim = new_prim(instance->rx_prim_size, AX25, -1, 0, 0, ex);
+	if (!prim)
+		axudp_drop(instance, DLS_DROP_NO_MEM);
+	return prim;
+}
+
+static void *pool_worker(void *id)
+{
+	struct instance_handle *instance = id;
 	primitive_t *prim;
+	unsigned int n;
+	int erc;
 	EXCEPTION(ex);
 
-	struct instance_handle *instance = id;
 	assert(instance);
 	while (instance->alive) {
-		if (instance->server_mode) {
-			instance->peer_addr_len = sizeof(struct sockaddr_storage);
-			n = recvfrom(instance->sockfd, (char*)instance->rx_buf,
-					instance->rx_buf_size, 0,
-					(struct sockaddr*) &instance->peer_addr,
-					&instance->peer_addr_len);
-			if (!instance->alive)
-				break;
-			if (n < 0) {
-				if (configuration.loglevel >= DEBUG_LEVEL_ERROR)
-					ax25c_log(DEBUG_LEVEL_ERROR,
-							"AXUDP:rx_worker:recvfrom() error %i:%s",
-							n, gai_strerror(n));
-				continue;
-			}
-			if (configuration.loglevel >= DEBUG_LEVEL_INFO) {
-				char host[NI_MAXHOST], service[NI_MAXSERV];
-				int s = getnameinfo((struct sockaddr*) &instance->peer_addr,
-                        instance->peer_addr_len, host, NI_MAXHOST, service,
-						NI_MAXSERV, NI_NUMERICSERV);
-				if (s == 0) {
-					ax25c_log(DEBUG_LEVEL_INFO,
-							"AXUDP:rx_worker Got %i octets from %s:%s",
-							s, host, service);
-				} else if (configuration.loglevel >= DEBUG_LEVEL_ERROR) {
-					ax25c_log(DEBUG_LEVEL_ERROR,
-							"AXUDP:rx_worker:getnameinfo() error %i:%s",
-							s, gai_strerror(s));
-					continue;
-				}
-			}
-		} else {
-			n = recv(instance->sockfd, (char*)instance->rx_buf,
-					instance->rx_buf_size, 0);
-			if (!instance->alive)
-				break;
-			if (n < 0) {
-				if (configuration.loglevel >= DEBUG_LEVEL_ERROR)
-					ax25c_log(DEBUG_LEVEL_ERROR,
-							"AXUDP:rx_worker:read() error %i:%s",
-							-n, strerror(-n));
-				continue;
-			}
-		}
-		if (configuration.loglevel >= DEBUG_LEVEL_DEBUG) {
-			ax25c_log(DEBUG_LEVEL_DEBUG, "Received UDP packet on %s",
-					instance->name);
-			dump(DEBUG_LEVEL_DEBUG, instance->rx_buf, (uint16_t)n);
-		}
-		if (!instance->dls.peer)
+		n = __atomic_load_n(&instance->rx_pool_n, __ATOMIC_RELAXED);
+		if (n >= instance->rx_pool_size) {
+			pthread_mutex_lock(&instance->rx_pool_cond_lock);
+			if (instance->alive && (__atomic_load_n(&instance->rx_pool_n,
+					__ATOMIC_RELAXED) >= instance->rx_pool_size))
+				pthread_cond_wait(&instance->rx_pool_cond,
+						&instance->rx_pool_cond_lock);
+			pthread_mutex_unlock(&instance->rx_pool_cond_lock);
 			continue;
-		prim = new_prim(n, AX25, -1, 0, 0, &ex);
+		}
+		prim = new_prim(instance->rx_prim_size, AX25, -1, 0, 0, &ex);
 		if (!prim) {
 			if (configuration.loglevel >= DEBUG_LEVEL_ERROR)
 				ax25c_log(DEBUG_LEVEL_ERROR,
-						"AXUDP:rx_worker:new_prim: Error no %i[%s] in %s:%s: %s[%s]",
+						"AXUDP:pool_worker:new_prim: Error no %i[%s] in %s:%s: %s[%s]",
 						ex.erc, strerror(ex.erc),
 						STRING_C(ex.module), STRING_C(ex.function),
 						STRING_C(ex.message), STRING_C(ex.param));
+			sleep(1);
 			continue;
 		}
-		memcpy(prim->payload, instance->rx_buf, prim->size);
-		if (!dlsap_write(instance->dls.peer, prim, false, &ex)) {
+		erc = pthread_spin_lock(&instance->rx_pool_lock); /*-------------v*/
+		assert(erc == 0);
+		if (instance->rx_pool_n < instance->rx_pool_size) {
+			instance->rx_pool[instance->rx_pool_n++] = prim;
+			prim = NULL;
+		}
+		erc = pthread_spin_unlock(&instance->rx_pool_lock); /*-----------^*/
+		assert(erc == 0);
+		del_prim(prim);
+	} /* end while */
+	return NULL;
+}
+
+static void pool_destroy(struct instance_handle *instance)
+{
+	if (!instance->rx_pool)
+		return;
+	while (instance->rx_pool_n)
+		del_prim(instance->rx_pool[--instance->rx_pool_n]);
+	free(instance->rx_pool);
+	instance->rx_pool = NULL;
+	pthread_cond_destroy(&instance->rx_pool_cond);
+	pthread_mutex_destroy(&instance->rx_pool_cond_lock);
+	pthread_spin_destroy(&instance->rx_pool_lock);
+}
+
+bool axudp_rx_deliver(struct instance_handle *instance, primitive_t *prim,
+		unsigned int len, struct sockaddr_storage *addr, socklen_t addr_len,
+		time_t now)
+{
+	struct axudp_peer *peer = NULL;
+	dls_t *receiver = instance->dls.peer;
+	EXCEPTION(ex);
+
+	axudp_count(&instance->stats.rx_frames, 1);
+	axudp_count(&instance->stats.rx_bytes, len);
+	if (instance->server_mode) {
+		peer = peer_get(instance, addr, addr_len, now, &ex);
+		if (!peer) {
+			if (configuration.loglevel >= DEBUG_LEVEL_ERROR)
+				ax25c_log(DEBUG_LEVEL_ERROR, "AXUDP:rx_worker: %s: %s",
+						STRING_C(ex.message), STRING_C(ex.param));
+			axudp_drop(instance, DLS_DROP_NO_PEER);
+			return false;
+		}
+		if (peer->dls.peer)
+			receiver = peer->dls.peer;
+		if (configuration.loglevel >= DEBUG_LEVEL_INFO)
+			ax25c_log(DEBUG_LEVEL_INFO,
+					"AXUDP:rx_worker Got %u octets from %s:%s",
+					len, peer->host, peer->service);
+	}
+	if (configuration.loglevel >= DEBUG_LEVEL_DEBUG) {
+		ax25c_log(DEBUG_LEVEL_DEBUG, "Received UDP packet on %s",
+				instance->name);
+		dump(DEBUG_LEVEL_DEBUG, prim->payload, (uint16_t)len);
+	}
+	if (!receiver) {
+		axudp_drop(instance, DLS_DROP_NO_PEER);
+		return false;
+	}
+	prim->size = (uint16_t)len;
+	prim->clientHandle = peer ? peer->i : 0;
+	if (!dlsap_write_owned(receiver, prim, false, &ex))
+		ax25c_log(DEBUG_LEVEL_ERROR,
+				"AXUDP:rx_worker:dlsap_write: Error no %i[%s] in %s:%s: %s[%s]",
+				ex.erc, strerror(ex.erc),
+				STRING_C(ex.module), STRING_C(ex.function),
+				STRING_C(ex.message), STRING_C(ex.param));
+	return true;
+}
+
+time_t axudp_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+int axudp_rx_round(struct axudp_shard *shard, int flags)
+{
+	struct instance_handle *instance = shard->instance;
+	struct mmsghdr msgs[AXUDP_BATCH_MAX];
+	struct iovec iov[AXUDP_BATCH_MAX];
+	struct sockaddr_storage addr[AXUDP_BATCH_MAX];
+	primitive_t **slot = shard->rx_slot;
+	unsigned int i;
+	time_t now;
+	int n;
+	EXCEPTION(ex);
+
+	assert(instance->batch_size <= AXUDP_BATCH_MAX);
+	/* Receive straight into pooled prims, one slot per datagram */
+	for (i = 0; i < instance->batch_size; ++i) {
+		if (!slot[i]) {
+			slot[i] = axudp_pool_get(instance, &ex);
+			if (!slot[i])
+				break;
+		}
+		iov[i].iov_base = slot[i]->payload;
+		iov[i].iov_len  = instance->rx_buf_size;
+		memset(&msgs[i], 0x00, sizeof(struct mmsghdr));
+		msgs[i].msg_hdr.msg_iov    = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		if (instance->server_mode) {
+			msgs[i].msg_hdr.msg_name    = &addr[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		}
+	} /* end for */
+	if (i == 0) {
+		if (configuration.loglevel >= DEBUG_LEVEL_ERROR)
 			ax25c_log(DEBUG_LEVEL_ERROR,
-					"AXUDP:rx_worker:dlsap_write: Error no %i[%s] in %s:%s: %s[%s]",
+					"AXUDP:rx_worker:new_prim: Error no %i[%s] in %s:%s: %s[%s]",
 					ex.erc, strerror(ex.erc),
 					STRING_C(ex.module), STRING_C(ex.function),
 					STRING_C(ex.message), STRING_C(ex.param));
+		errno = ENOMEM;
+		return -1;
+	}
+	n = recvmmsg(shard->sockfd, msgs, i, flags, NULL);
+	if (!instance->alive)
+		return -1;
+	if (n < 0) {
+		if ((errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+				(errno != EINTR) &&
+				(configuration.loglevel >= DEBUG_LEVEL_ERROR))
+			ax25c_log(DEBUG_LEVEL_ERROR,
+					"AXUDP:rx_worker:recvmmsg() error %i:%s",
+					errno, strerror(errno));
+		return -1;
+	}
+	now = axudp_now();
+	for (i = 0; i < (unsigned int)n; ++i) {
+		if (axudp_rx_deliver(instance, slot[i], msgs[i].msg_len, &addr[i],
+				msgs[i].msg_hdr.msg_namelen, now))
+			slot[i] = NULL;
+	} /* end for */
+	return n;
+}
+
+static void rx_slots_free(struct axudp_shard *shard)
+{
+	unsigned int i;
+
+	for (i = 0; i < AXUDP_BATCH_MAX; ++i) {
+		del_prim(shard->rx_slot[i]);
+		shard->rx_slot[i] = NULL;
+	}
+}
+
+static void rx_sweep(struct instance_handle *instance, time_t now)
+{
+	if (!instance->server_mode || (now == instance->last_sweep))
+		return;
+	peer_expire(instance, now, instance->peer_timeout);
+	instance->last_sweep = now;
+}
+
+static void *rx_worker(void *id)
+{
+	struct axudp_shard *shard = id;
+	struct instance_handle *instance;
+
+	assert(shard);
+	instance = shard->instance;
+	instance->last_sweep = axudp_now();
+	while (instance->alive) {
+		if ((axudp_rx_round(shard, MSG_WAITFORONE) < 0) &&
+				(errno == ENOMEM))
+			sleep(1);
+		/* One shard expires the peers of all */
+		if (shard == &instance->shard[0])
+			rx_sweep(instance, axudp_now());
+	} /* end while */
+	rx_slots_free(shard);
+	return NULL;
+}
+
+void axudp_housekeeping(struct instance_handle *instance, time_t now)
+{
+	primitive_t *prim;
+	int erc;
+	EXCEPTION(ex);
+
+	/* No pool thread in reactor mode, refill between the events */
+	while (instance->rx_pool_n < instance->rx_pool_size) {
+		prim = new_prim(instance->rx_prim_size, AX25, -1, 0, 0, &ex);
+		if (!prim)
+			break;
+		erc = pthread_spin_lock(&instance->rx_pool_lock); /*-------------v*/
+		assert(erc == 0);
+		instance->rx_pool[instance->rx_pool_n++] = prim;
+		erc = pthread_spin_unlock(&instance->rx_pool_lock); /*-----------^*/
+		assert(erc == 0);
+	} /* end while */
+	rx_sweep(instance, now);
+}
+
+/*
+ * Outgoing datagrams of the tx worker. Every message holds its own
+ * reference to the prim, a broadcast prim is referenced once per peer.
+ */
+struct tx_batch {
+	unsigned int            n;
+	struct mmsghdr          msgs[AXUDP_BATCH_MAX];
+	struct iovec            iov[AXUDP_BATCH_MAX][AXUDP_IOV_MAX];
+	struct sockaddr_storage addr[AXUDP_BATCH_MAX];
+	primitive_t            *prims[AXUDP_BATCH_MAX];
+};
+
+void axudp_sent(struct instance_handle *instance, primitive_t *prim,
+		long res)
+{
+	size_t len = prim_length(prim);
+	uint32_t wait;
+	unsigned int bucket = 0;
+
+	if ((res < 0) || ((size_t)res != len)) {
+		axudp_drop(instance, DLS_DROP_SEND);
+		return;
+	}
+	axudp_count(&instance->stats.tx_frames, 1);
+	axudp_count(&instance->stats.tx_bytes, len);
+	/* The stamp was set when the prim was queued */
+	wait = (uint32_t)jiffies - prim->stamp;
+	while (wait && (bucket < DLS_LATENCY_BUCKETS - 1)) {
+		wait >>= 1;
+		++bucket;
+	} /* end while */
+	axudp_count(&instance->stats.latency[bucket], 1);
+}
+
+static void tx_flush(struct instance_handle *instance, struct tx_batch *tx)
+{
+	unsigned int i = 0;
+	int n;
+
+	while (i < tx->n) {
+		n = sendmmsg(instance->sockfd, &tx->msgs[i], tx->n - i, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (configuration.loglevel >= DEBUG_LEVEL_ERROR)
+				ax25c_log(DEBUG_LEVEL_ERROR,
+						"AXUDP:tx_worker:sendmmsg() error %i:%s",
+						errno, strerror(errno));
+			/* Skip the failing datagram, it may be this peer only */
+			axudp_sent(instance, tx->prims[i], -1);
+			n = 1;
+		} else {
+			for (; n > 0; --n, ++i) {
+				if ((tx->msgs[i].msg_len != prim_length(tx->prims[i])) &&
+						(configuration.loglevel >= DEBUG_LEVEL_ERROR))
+					ax25c_log(DEBUG_LEVEL_ERROR,
+							"AXUDP:tx_worker:sendmmsg(): partial:%zu <> %u",
+							prim_length(tx->prims[i]), tx->msgs[i].msg_len);
+				axudp_sent(instance, tx->prims[i], tx->msgs[i].msg_len);
+			} /* end for */
 			continue;
 		}
+		i += n;
 	} /* end while */
-	return NULL;
+	for (i = 0; i < tx->n; ++i)
+		del_prim(tx->prims[i]);
+	tx->n = 0;
+}
+
+static void tx_queue(struct instance_handle *instance, void *ctx,
+		primitive_t *prim, const struct iovec *iov, int iovlen,
+		const struct sockaddr_storage *addr, socklen_t addr_len)
+{
+	struct tx_batch *tx = ctx;
+	struct mmsghdr *msg;
+
+	if (tx->n == instance->batch_size)
+		tx_flush(instance, tx);
+	msg = &tx->msgs[tx->n];
+	memset(msg, 0x00, sizeof(struct mmsghdr));
+	memcpy(tx->iov[tx->n], iov, iovlen * sizeof(struct iovec));
+	msg->msg_hdr.msg_iov    = tx->iov[tx->n];
+	msg->msg_hdr.msg_iovlen = iovlen;
+	if (addr) {
+		memcpy(&tx->addr[tx->n], addr, addr_len);
+		msg->msg_hdr.msg_name    = &tx->addr[tx->n];
+		msg->msg_hdr.msg_namelen = addr_len;
+	}
+	use_prim(prim);
+	tx->prims[tx->n++] = prim;
+}
+
+static void tx_route(struct instance_handle *instance, primitive_t *prim,
+		bool expedited, const struct iovec *iov, int iovlen, axudp_sink sink,
+		void *ctx)
+{
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+	uint32_t i;
+	uint16_t gen;
+
+	if (!instance->server_mode) {
+		if (pacing_admit(instance, prim, 0, PEER_GEN_ANY, expedited))
+			sink(instance, ctx, prim, iov, iovlen, NULL, 0);
+		return;
+	}
+	if (prim->serverHandle != PEER_BROADCAST) {
+		gen = prim->clientHandle;
+		if (!peer_addr(instance, prim->serverHandle, &gen, &addr, &addr_len))
+			axudp_drop(instance, DLS_DROP_NO_PEER);
+		else if (pacing_admit(instance, prim, prim->serverHandle, gen,
+				expedited))
+			sink(instance, ctx, prim, iov, iovlen, &addr, addr_len);
+		return;
+	}
+	for (i = 0; i < instance->peers.max_peers; ++i) {
+		gen = PEER_GEN_ANY;
+		if (peer_addr(instance, i, &gen, &addr, &addr_len) &&
+				pacing_admit(instance, prim, i, gen, expedited))
+			sink(instance, ctx, prim, iov, iovlen, &addr, addr_len);
+	} /* end for */
+}
+
+int64_t axudp_tx_paced(struct instance_handle *instance, axudp_sink sink,
+		void *ctx)
+{
+	struct iovec iov[AXUDP_IOV_MAX];
+	struct sockaddr_storage addr;
+	socklen_t addr_len = 0;
+	primitive_t *prim;
+	uint16_t handle, gen;
+	int64_t wait;
+	int n;
+
+	while ((prim = pacing_next(instance, &handle, &gen, &wait))) {
+		/* The peer may have gone while the frame was held */
+		if (instance->server_mode &&
+				!peer_addr(instance, handle, &gen, &addr, &addr_len)) {
+			axudp_drop(instance, DLS_DROP_NO_PEER);
+		} else {
+			n = prim_to_iovec(prim, iov, AXUDP_IOV_MAX);
+			assert(n >= 0);
+			sink(instance, ctx, prim, iov, n,
+					instance->server_mode ? &addr : NULL, addr_len);
+		}
+		del_prim(prim);
+	} /* end while */
+	return wait;
+}
+
+void axudp_tx_prim(struct instance_handle *instance, primitive_t *prim,
+		bool expedited, axudp_sink sink, void *ctx)
+{
+	struct iovec iov[AXUDP_IOV_MAX];
+	int n;
+
+	if (prim->protocol != AX25) {
+		DBG_ERROR("AXUDP:tx_worker", "Protocol != AX.25");
+		del_prim(prim);
+		return;
+	}
+	if ((configuration.loglevel >= DEBUG_LEVEL_DEBUG)
+			&& !(prim->flags & PRIM_FLAG_SEGMENTED)) {
+		ax25c_log(DEBUG_LEVEL_DEBUG, "Send UDP packet on %s",
+				instance->name);
+		dump(DEBUG_LEVEL_DEBUG, prim->payload, prim->size);
+	}
+	n = prim_to_iovec(prim, iov, AXUDP_IOV_MAX);
+	if (n < 0) {
+		DBG_ERROR("AXUDP:tx_worker", "Too many slices");
+		axudp_drop(instance, DLS_DROP_SEND);
+		del_prim(prim);
+		return;
+	}
+	tx_route(instance, prim, expedited, iov, n, sink, ctx);
+	del_prim(prim);
+}
+
+/*
+ * Send a list of prims, releases them. The first n_expedited of them
+ * came from the expedited queue.
+ */
+static void tx_list(struct instance_handle *instance, struct tx_batch *tx,
+		struct list_head *list, size_t n_expedited)
+{
+	primitive_t *prim, *next;
+
+	list_for_each_entry_safe(prim, next, list, node) {
+		list_del_init(&prim->node);
+		axudp_tx_prim(instance, prim, n_expedited > 0, tx_queue, tx);
+		if (n_expedited)
+			--n_expedited;
+	} /* end list_for_each_entry_safe */
+	tx_flush(instance, tx);
+}
+
+int64_t axudp_tx_release(struct instance_handle *instance,
+		struct tx_batch *tx)
+{
+	int64_t wait = axudp_tx_paced(instance, tx_queue, tx);
+
+	tx_flush(instance, tx);
+	return wait;
+}
+
+struct tx_batch *axudp_tx_batch_new(void)
+{
+	struct tx_batch *tx = malloc(sizeof(struct tx_batch));
+
+	if (tx)
+		tx->n = 0;
+	return tx;
+}
+
+void axudp_tx_drain(struct instance_handle *instance, struct tx_batch *tx)
+{
+	LIST_HEAD(list);
+	size_t n_expedited;
+
+	while (primbuffer_read_batch(&instance->primbuffer, &list,
+			instance->batch_size, &n_expedited))
+		tx_list(instance, tx, &list, n_expedited);
 }
 
 static void *tx_worker(void *id)
 {
 	struct instance_handle *instance = id;
+	struct tx_batch *tx;
+	struct list_head list;
 	primitive_t *prim;
-	int n;
+	size_t n_expedited;
+	bool expedited;
+	int64_t wait;
 
 	assert(instance);
+	tx = axudp_tx_batch_new();
+	assert(tx);
 	while (instance->alive) {
-		prim = primbuffer_read_block(&instance->primbuffer, NULL);
-		if (!(prim && instance->alive))
-			continue;
-		if (prim->protocol != AX25) {
-			DBG_ERROR("AXUDP:tx_worker", "Protocol != AX.25");
+		/* Held frames set the timeout, new prims wake up earlier */
+		wait = axudp_tx_release(instance, tx);
+		if ((wait < 0) || (wait > TX_IDLE_WAIT))
+			wait = TX_IDLE_WAIT;
+		prim = primbuffer_read_timed(&instance->primbuffer, &expedited,
+				wait);
+		if (!(prim && instance->alive)) {
+			del_prim(prim);
 			continue;
 		}
-		if (configuration.loglevel >= DEBUG_LEVEL_DEBUG) {
-			ax25c_log(DEBUG_LEVEL_DEBUG, "Send UDP packet on %s",
-					instance->name);
-			dump(DEBUG_LEVEL_DEBUG, prim->payload, prim->size);
-		}
-		if (instance->server_mode) {
-			n = sendto(instance->sockfd, (const char*)prim->payload,
-					prim->size, 0,
-			        (struct sockaddr*) &instance->peer_addr,
-			        instance->peer_addr_len);
-			if ((n < 0) &&
-					(configuration.loglevel >= DEBUG_LEVEL_ERROR))
-			{
-				ax25c_log(DEBUG_LEVEL_ERROR,
-						"AXUDP:tx_worker:sendto() error %i:%s",
-						n, gai_strerror(n));
-			} else if ((n != prim->size) &&
-					(configuration.loglevel >= DEBUG_LEVEL_ERROR))
-			{
-				ax25c_log(DEBUG_LEVEL_ERROR,
-						"AXUDP:tx_worker:sendto(): partial:%i <> %i",
-						prim->size, n);
-			}
-		} else {
-			n = send(instance->sockfd, (const char*)prim->payload, prim->size, 0);
-			if ((n < 0) &&
-					(configuration.loglevel >= DEBUG_LEVEL_ERROR))
-			{
-				ax25c_log(DEBUG_LEVEL_ERROR,
-						"AXUDP:tx_worker:write() error %i:%s",
-						errno, strerror(errno));
-			} else if ((n != prim->size) &&
-					(configuration.loglevel >= DEBUG_LEVEL_ERROR))
-			{
-				ax25c_log(DEBUG_LEVEL_ERROR,
-						"AXUDP:tx_worker:write(): partial:%i <> %i",
-						prim->size, n);
-			}
-		}
-		del_prim(prim);
+		axudp_tx_prim(instance, prim, expedited, tx_queue, tx);
+		/* Take whatever else is queued in one go */
+		INIT_LIST_HEAD(&list);
+		primbuffer_read_batch(&instance->primbuffer, &list,
+				instance->batch_size - 1, &n_expedited);
+		tx_list(instance, tx, &list, n_expedited);
 	} /* end while */
+	free(tx);
 	return NULL;
 }
 
+primitive_t *axudp_own(primitive_t *prim, bool owned, struct exception *ex)
+{
+	primitive_t *share;
+
+	if (owned && (mem_refs(prim) == 1))
+		return prim;
+	/* Somebody else sees the header, share the payload only */
+	share = prim_sg_share(prim, ex);
+	if (share && owned)
+		del_prim(prim);
+	return share;
+}
+
+void axudp_enqueue(struct instance_handle *instance, primitive_t *prim,
+		bool expedited)
+{
+	uint64_t one = 1;
+
+	/* Expedited prims bypass the limit and the pacing */
+	if (instance->tx_queue_max && !expedited &&
+			(primbuffer_size(&instance->primbuffer) >=
+					instance->tx_queue_max)) {
+		axudp_drop(instance, DLS_DROP_QUEUE_FULL);
+		del_prim(prim);
+		return;
+	}
+	primbuffer_push_owned(&instance->primbuffer, prim, expedited);
+	if ((instance->evfd != -1) &&
+			(write(instance->evfd, &one, sizeof(one)) < 0) &&
+			(errno != EAGAIN))
+		DBG_ERROR("AXUDP:enqueue", "Unable to signal reactor");
+}
+
 static bool dls_open(dls_t *_dls, dls_t *receiver, struct exception *ex);
 static void dls_close(dls_t *_dls);
 static bool on_write(dls_t *_dls, primitive_t *prim, bool expedited,
 		struct exception *ex);
+static bool on_write_owned(dls_t *_dls, primitive_t *prim, bool expedited,
+		struct exception *ex);
 static void dls_queue_stats(dls_t *_dls, dls_stats_t *stats);
 
 static dls_t dls_template = {
@@ -199,6 +634,7 @@ static dls_t dls_template = {
 		.open                    = dls_open,
 		.close                   = dls_close,
 		.on_write                = on_write,
+		.on_write_owned          = on_write_owned,
 		.get_queue_stats         = dls_queue_stats,
 		.peer                    = NULL,
 		.session                 = NULL,
@@ -236,8 +672,8 @@ static void dls_close(dls_t *dls)
 	instance->dls.peer = NULL;
 }
 
-static bool on_write(dls_t *dls, primitive_t *prim, bool expedited,
-		struct exception *ex)
+static bool dls_write(dls_t *dls, primitive_t *prim, bool expedited,
+		bool owned, struct exception *ex)
 {
 	if (!dls) {
 		exception_fill(ex, EINVAL, MODULE_NAME,
@@ -250,10 +686,87 @@ static bool on_write(dls_t *dls, primitive_t *prim, bool expedited,
 				"");
 		return false;
 	}
-	primbuffer_write_nonblock(&instance->primbuffer, prim, expedited);
+	if (instance->server_mode) {
+		/* The route goes into the header */
+		prim = axudp_own(prim, owned, ex);
+		if (!prim) {
+			axudp_drop(instance, DLS_DROP_NO_MEM);
+			return false;
+		}
+		prim->serverHandle = PEER_BROADCAST;
+	} else if (!owned) {
+		use_prim(prim);
+	}
+	axudp_enqueue(instance, prim, expedited);
 	return true;
 }
 
+static bool on_write(dls_t *dls, primitive_t *prim, bool expedited,
+		struct exception *ex)
+{
+	return dls_write(dls, prim, expedited, false, ex);
+}
+
+static bool on_write_owned(dls_t *dls, primitive_t *prim, bool expedited,
+		struct exception *ex)
+{
+	if (dls_write(dls, prim, expedited, true, ex))
+		return true;
+	del_prim(prim);
+	return false;
+}
+
+/* Snapshot of the counters, each one read atomically */
+static void stats_read(struct instance_handle *instance, dls_stats_t *stats)
+{
+	unsigned int i;
+
+	stats->queue_size = primbuffer_size(&instance->primbuffer);
+	if (!instance->tx_queue_max)
+		stats->queue_free = SIZE_MAX;
+	else if (stats->queue_size < instance->tx_queue_max)
+		stats->queue_free = instance->tx_queue_max - stats->queue_size;
+	else
+		stats->queue_free = 0;
+	stats->rx_frames = __atomic_load_n(&instance->stats.rx_frames,
+			__ATOMIC_RELAXED);
+	stats->rx_bytes  = __atomic_load_n(&instance->stats.rx_bytes,
+			__ATOMIC_RELAXED);
+	stats->tx_frames = __atomic_load_n(&instance->stats.tx_frames,
+			__ATOMIC_RELAXED);
+	stats->tx_bytes  = __atomic_load_n(&instance->stats.tx_bytes,
+			__ATOMIC_RELAXED);
+	for (i = 0; i < DLS_DROPS; ++i)
+		stats->drops[i] = __atomic_load_n(&instance->stats.drops[i],
+				__ATOMIC_RELAXED);
+	for (i = 0; i < DLS_LATENCY_BUCKETS; ++i)
+		stats->latency[i] = __atomic_load_n(&instance->stats.latency[i],
+				__ATOMIC_RELAXED);
+}
+
+static void log_stats(struct instance_handle *instance)
+{
+	dls_stats_t stats;
+	char hist[DLS_LATENCY_BUCKETS * 12];
+	unsigned int i, n = 0;
+
+	if (configuration.loglevel < DEBUG_LEVEL_INFO)
+		return;
+	stats_read(instance, &stats);
+	ax25c_log(DEBUG_LEVEL_INFO,
+			"AXUDP:%s: rx %lu/%lu tx %lu/%lu frames/octets, "
+			"drops no peer %lu no mem %lu send %lu queue full %lu",
+			instance->name, stats.rx_frames, stats.rx_bytes,
+			stats.tx_frames, stats.tx_bytes,
+			stats.drops[DLS_DROP_NO_PEER], stats.drops[DLS_DROP_NO_MEM],
+			stats.drops[DLS_DROP_SEND], stats.drops[DLS_DROP_QUEUE_FULL]);
+	hist[0] = '\0';
+	for (i = 0; i < DLS_LATENCY_BUCKETS; ++i)
+		n += snprintf(&hist[n], sizeof(hist) - n, " %lu", stats.latency[i]);
+	ax25c_log(DEBUG_LEVEL_INFO,
+			"AXUDP:%s: queue latency log2(jiffies):%s", instance->name, hist);
+}
+
 static void dls_queue_stats(dls_t *dls, dls_stats_t *stats)
 {
 	if (!dls)
@@ -261,6 +774,7 @@ static void dls_queue_stats(dls_t *dls, dls_stats_t *stats)
 	struct instance_handle *instance = dls->session;
 	if (!instance)
 		return;
+	stats_read(instance, stats);
 }
 
 static void *get_plugin(const char *name,
@@ -279,24 +793,40 @@ static void *get_plugin(const char *name,
 static bool start_plugin(struct plugin_handle *plugin, struct exception *ex) {
 	assert(plugin);
 	DBG_DEBUG("axudp start", plugin->name);
-#ifdef __MINGW32__
-	WSADATA wsadata;
-	int erc = WSAStartup(0x0202, &wsadata);
-	if (erc) {
-		exception_fill(ex, erc, MODULE_NAME, "start_plugin:WSAStartup",
-				strerror(erc), NULL);
-		return false;
+	/* Reactor mode: A fixed number of threads serves all instances */
+	if (plugin->reactor_threads) {
+		unsigned int i;
+		plugin->reactor = calloc(plugin->reactor_threads,
+				sizeof(struct reactor));
+		if (!plugin->reactor) {
+			exception_fill(ex, ENOMEM, MODULE_NAME, "start_plugin",
+					"Unable to allocate reactors", plugin->name);
+			return false;
+		}
+		for (i = 0; i < plugin->reactor_threads; ++i) {
+			if (!reactor_start(&plugin->reactor[i], ex)) {
+				while (i--)
+					reactor_stop(&plugin->reactor[i]);
+				free(plugin->reactor);
+				plugin->reactor = NULL;
+				return false;
+			}
+		} /* end for */
 	}
-#endif
 	return true;
 }
 
 static bool stop_plugin(struct plugin_handle *plugin, struct exception *ex) {
+	unsigned int i;
+
 	assert(plugin);
 	DBG_DEBUG("axudp stop", plugin->name);
-#ifdef __MINGW32__
-	WSACleanup();
-#endif
+	if (plugin->reactor) {
+		for (i = 0; i < plugin->reactor_threads; ++i)
+			reactor_stop(&plugin->reactor[i]);
+		free(plugin->reactor);
+		plugin->reactor = NULL;
+	}
 	return true;
 }
 
@@ -319,31 +849,111 @@ static void *get_instance(const char *name,
 	memcpy(&instance->dls, &dls_template, sizeof(struct dls));
 	instance->dls.name = name;
 	instance->dls.session = instance;
+	instance->sockfd = -1;
+	instance->evfd = -1;
 	DBG_INFO("Register Service Access Point", instance->name);
 	if (!dlsap_register_dls(&instance->dls, ex))
 		return false;
 	return instance;
 }
 
+static bool set_reuseport(int sockfd)
+{
+#ifdef SO_REUSEPORT
+	int one = 1;
+
+	return setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT,
+			(const char*)&one, sizeof(one)) == 0;
+#else
+	errno = ENOTSUP;
+	return false;
+#endif
+}
+
+static void close_shards(struct instance_handle *instance)
+{
+	unsigned int i;
+
+	for (i = 0; i < instance->n_shards; ++i) {
+		if (instance->shard[i].sockfd != -1)
+			close(instance->shard[i].sockfd);
+		instance->shard[i].sockfd = -1;
+	} /* end for */
+	instance->n_shards = 0;
+	instance->sockfd = -1;
+}
+
+/* Stop the threads first, they use everything that is freed here */
+static void teardown(struct instance_handle *instance)
+{
+	struct axudp_shard *shard;
+	primitive_t *wake;
+	unsigned int i;
+	EXCEPTION(ex);
+
+	instance->alive = false;
+	/* A shut down socket returns from recvmmsg at once */
+	for (i = 0; i < instance->n_shards; ++i) {
+		if (instance->shard[i].rx_thread_running)
+			shutdown(instance->shard[i].sockfd, SHUT_RDWR);
+	} /* end for */
+	for (i = 0; i < instance->n_shards; ++i) {
+		shard = &instance->shard[i];
+		if (shard->rx_thread_running) {
+			pthread_join(shard->rx_thread, NULL);
+			shard->rx_thread_running = false;
+		}
+		if (shard->reactor) {
+			reactor_remove_shard(shard->reactor, shard);
+			rx_slots_free(shard);
+		}
+	} /* end for */
+	if (instance->reactor) {
+		reactor_remove(instance->reactor, instance);
+		instance->reactor = NULL;
+	}
+	if (instance->evfd != -1) {
+		close(instance->evfd);
+		instance->evfd = -1;
+	}
+	if (instance->tx_thread_running) {
+		/* Any prim wakes up the tx thread, it drops it when not alive */
+		wake = new_prim(0, AX25, -1, 0, 0, &ex);
+		if (wake)
+			primbuffer_push_owned(&instance->primbuffer, wake, true);
+		pthread_join(instance->tx_thread, NULL);
+		instance->tx_thread_running = false;
+	}
+	if (instance->pool_thread_running) {
+		pool_signal(instance);
+		pthread_join(instance->pool_thread, NULL);
+		instance->pool_thread_running = false;
+	}
+	pacing_destroy(instance);
+	peer_table_destroy(instance);
+	close_shards(instance);
+	pool_destroy(instance);
+	primbuffer_destroy(&instance->primbuffer);
+}
+
 static bool start_instance(struct instance_handle *instance, exception_t *ex)
 {
 	pthread_attr_t thread_args;
+	unsigned int n = 0;
 	int erc, ip_v;
 	struct addrinfo  hints;
 	struct addrinfo *addrinfo, *rp;
 
 	DBG_DEBUG("axudp instance start", instance->name);
 
-	instance->rx_thread_running = false;
 	instance->tx_thread_running = false;
+	instance->n_shards = 0;
 
 	/* Determine mode */
 	if (strcmp(instance->mode, "client") == 0) {
 		instance->server_mode = false;
 	} else if (strcmp(instance->mode, "server") == 0) {
 		instance->server_mode = true;
-		DBG_WARNING("Server mode is partially implemented only!", "");
-		instance->peer_addr_len = 0;
 	} else {
 		exception_fill(ex, EINVAL, MODULE_NAME, "start_instance",
 				"Invalid mode (server|client)", instance->mode);
@@ -363,15 +973,64 @@ static bool start_instance(struct instance_handle *instance, exception_t *ex)
 		return false;
 	}
 
-	/* Allocate buffers */
+	/* Determine io */
+	if (strcmp(instance->io, "socket") == 0) {
+		instance->use_uring = false;
+	} else if (strcmp(instance->io, "uring") == 0) {
+		instance->use_uring = true;
+		if (!uring_available()) {
+			exception_fill(ex, ENOTSUP, MODULE_NAME, "start_instance",
+					"Built without io_uring support", instance->name);
+			return false;
+		}
+		if (instance->shards != 1) {
+			exception_fill(ex, EINVAL, MODULE_NAME, "start_instance",
+					"io uring needs shards 1", instance->name);
+			return false;
+		}
+	} else {
+		exception_fill(ex, EINVAL, MODULE_NAME, "start_instance",
+				"Invalid io (socket|uring)", instance->io);
+		return false;
+	}
+
+	if ((instance->shards < 1) || (instance->shards > AXUDP_SHARD_MAX) ||
+			((instance->shards > 1) && !instance->server_mode)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "start_instance",
+				"Invalid shards (1..32, server mode only)", instance->name);
+		return false;
+	}
+
+	if ((instance->batch_size < 1) || (instance->batch_size > AXUDP_BATCH_MAX)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "start_instance",
+				"Invalid batch_size (1..64)", instance->name);
+		return false;
+	}
+
+	/* Allocate buffers, multishot recvmsg puts a header in front */
+	instance->rx_prim_size = instance->rx_buf_size;
+	if (instance->use_uring && instance->server_mode)
+		instance->rx_prim_size += URING_RECVMSG_ROOM;
+	if (instance->rx_prim_size > MAX_PAYLOAD_SIZE) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "start_instance",
+				"rx_buf_size exceeds max. payload size", instance->name);
+		return false;
+	}
 	primbuffer_init(&instance->primbuffer);
-	instance->rx_buf = malloc(instance->rx_buf_size);
-	if (!instance->rx_buf) {
+	instance->rx_pool = calloc(instance->rx_pool_size + 1,
+			sizeof(primitive_t*));
+	if (!instance->rx_pool) {
 		exception_fill(ex, ENOMEM, MODULE_NAME, "start_instance",
-				"Unable to allocate rx buffer", "");
-		primbuffer_destroy(&instance->primbuffer);
-		return false;
+				"Unable to allocate rx pool", "");
+		goto fail;
 	}
+	instance->rx_pool_n = 0;
+	erc = pthread_spin_init(&instance->rx_pool_lock, PTHREAD_PROCESS_PRIVATE);
+	assert(erc == 0);
+	erc = pthread_mutex_init(&instance->rx_pool_cond_lock, NULL);
+	assert(erc == 0);
+	erc = pthread_cond_init(&instance->rx_pool_cond, NULL);
+	assert(erc == 0);
 
 	/* Open connection */
 	if (configuration.loglevel >= DEBUG_LEVEL_DEBUG)
@@ -398,7 +1057,7 @@ static bool start_instance(struct instance_handle *instance, exception_t *ex)
 	if (erc != 0) {
 		exception_fill(ex, erc, MODULE_NAME, "start_instance:getaddrinfo",
 				gai_strerror(erc), instance->host);
-		return false;
+		goto fail;
 	}
 	for (rp = addrinfo; rp != NULL; rp = rp->ai_next) {
 		instance->sockfd = socket(rp->ai_family, rp->ai_socktype,
@@ -406,18 +1065,21 @@ static bool start_instance(struct instance_handle *instance, exception_t *ex)
 		if (instance->sockfd == -1)
 			continue;
 		if (instance->server_mode) {
-			if (bind(instance->sockfd, rp->ai_addr, rp->ai_addrlen) == 0)
+			if (((instance->shards == 1) || set_reuseport(instance->sockfd))
+					&& (bind(instance->sockfd, rp->ai_addr, rp->ai_addrlen) == 0))
 				break; /* Success */
 		} else {
 			if (connect(instance->sockfd, rp->ai_addr, rp->ai_addrlen) != -1)
 				break; /* Success */
 		}
-		closesocket(instance->sockfd);
+		close(instance->sockfd);
 	} /* end for */
 	if (!rp) {
 		exception_fill(ex, ENOENT, MODULE_NAME, "start_instance",
 				instance->server_mode ? "bind" : "connect", instance->host);
-		return false;
+		freeaddrinfo(addrinfo);
+		instance->sockfd = -1;
+		goto fail;
 	}
 	if (configuration.loglevel >= DEBUG_LEVEL_DEBUG)
 		ax25c_log(DEBUG_LEVEL_DEBUG, "Host \"%s:%s\" resolved to %s %s \"%s\"",
@@ -425,52 +1087,129 @@ static bool start_instance(struct instance_handle *instance, exception_t *ex)
 				(instance->server_mode ? "server" : "client"),
 				((rp->ai_family == AF_INET6) ? "AF_INET6" : "AF_INET"),
 				rp->ai_canonname);
+
+	/* Shards: More sockets on the same port, the kernel spreads the peers */
+	memset(instance->shard, 0x00, sizeof(instance->shard));
+	instance->shard[0].instance = instance;
+	instance->shard[0].sockfd = instance->sockfd;
+	for (instance->n_shards = 1; instance->n_shards < instance->shards;
+			++instance->n_shards) {
+		struct axudp_shard *shard = &instance->shard[instance->n_shards];
+		shard->instance = instance;
+		shard->sockfd = socket(rp->ai_family, rp->ai_socktype,
+				rp->ai_protocol);
+		if ((shard->sockfd == -1) || !set_reuseport(shard->sockfd) ||
+				(bind(shard->sockfd, rp->ai_addr, rp->ai_addrlen) != 0)) {
+			exception_fill(ex, errno, MODULE_NAME, "start_instance:shard",
+					strerror(errno), instance->name);
+			if (shard->sockfd != -1)
+				close(shard->sockfd);
+			freeaddrinfo(addrinfo);
+			goto fail;
+		}
+	} /* end for */
 	freeaddrinfo(addrinfo);
 
+	/* Server mode: peer table, wake up every second for the expiry */
+	if (instance->server_mode) {
+		struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+		unsigned int i;
+		if (!peer_table_init(instance, instance->max_peers, ex))
+			goto fail;
+		for (i = 0; i < instance->n_shards; ++i)
+			setsockopt(instance->shard[i].sockfd, SOL_SOCKET, SO_RCVTIMEO,
+					(const char*)&tv, sizeof(tv));
+	}
+	if (!pacing_init(instance, ex))
+		goto fail;
+
+	/* io_uring: One thread per instance does it all */
+	if (instance->use_uring) {
+		instance->last_sweep = axudp_now();
+		instance->alive = true;
+		if (!uring_start(instance, ex))
+			goto fail;
+		return true;
+	}
+
+	/* Reactor mode: Nonblocking sockets, eventfd signals queued prims */
+	if (plugin.reactor) {
+		unsigned int k = plugin.next_reactor++, i;
+		instance->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (instance->evfd == -1) {
+			exception_fill(ex, errno, MODULE_NAME, "start_instance",
+					"eventfd", strerror(errno));
+			goto fail;
+		}
+		instance->last_sweep = axudp_now();
+		instance->alive = true;
+		if (!reactor_add(&plugin.reactor[k % plugin.reactor_threads],
+				instance, ex))
+			goto fail;
+		/* Spread the shards over the reactors */
+		for (i = 0; i < instance->n_shards; ++i) {
+			struct axudp_shard *shard = &instance->shard[i];
+			int flags = fcntl(shard->sockfd, F_GETFL, 0);
+			if ((flags == -1) ||
+					(fcntl(shard->sockfd, F_SETFL, flags | O_NONBLOCK) == -1)) {
+				exception_fill(ex, errno, MODULE_NAME, "start_instance",
+						"fcntl", strerror(errno));
+				goto fail;
+			}
+			if (!reactor_add_shard(
+					&plugin.reactor[(k + i) % plugin.reactor_threads],
+					shard, ex))
+				goto fail;
+		} /* end for */
+		return true;
+	}
+
 	/* Start threads */
 	instance->alive = true;
 	pthread_attr_init(&thread_args);
 	pthread_attr_setdetachstate(&thread_args, PTHREAD_CREATE_JOINABLE);
-	erc = pthread_create(&instance->rx_thread, &thread_args, rx_worker, instance);
+	erc = pthread_create(&instance->pool_thread, &thread_args, pool_worker,
+			instance);
 	if (erc != 0) {
 		exception_fill(ex, erc, MODULE_NAME, "start_instance",
-				"Error creating rx_thread", instance->name);
-		instance->rx_thread_running = true;
-		instance->alive = false;
+				"Error creating pool_thread", instance->name);
+		goto fail_threads;
 	}
+	instance->pool_thread_running = true;
+	for (n = 0; n < instance->n_shards; ++n) {
+		struct axudp_shard *shard = &instance->shard[n];
+		erc = pthread_create(&shard->rx_thread, &thread_args, rx_worker, shard);
+		if (erc != 0) {
+			exception_fill(ex, erc, MODULE_NAME, "start_instance",
+					"Error creating rx_thread", instance->name);
+			goto fail_threads;
+		}
+		shard->rx_thread_running = true;
+	} /* end for */
 	erc = pthread_create(&instance->tx_thread, &thread_args, tx_worker, instance);
 	if (erc != 0) {
 		exception_fill(ex, erc, MODULE_NAME, "start_instance",
 				"Error creating tx_thread", instance->name);
-		instance->tx_thread_running = true;
-		instance->alive = false;
+		goto fail_threads;
 	}
+	instance->tx_thread_running = true;
 	pthread_attr_destroy(&thread_args);
-	return instance->alive;
+	return true;
+
+fail_threads:
+	pthread_attr_destroy(&thread_args);
+fail:
+	teardown(instance);
+	return false;
 }
 
 static bool stop_instance(struct instance_handle *instance, exception_t *ex) {
 	assert(instance);
 
 	DBG_DEBUG("axudp instance stop", instance->name);
-	instance->alive = false;
-	if (instance->rx_thread_running) {
-		pthread_kill(instance->rx_thread, SIGINT);
-		instance->rx_thread_running = false;
-	}
-	if (instance->tx_thread_running) {
-		pthread_kill(instance->tx_thread, SIGINT);
-		instance->rx_thread_running = false;
-	}
-	primbuffer_destroy(&instance->primbuffer);
-	if (instance->rx_buf) {
-		free(instance->rx_buf);
-		instance->rx_buf = NULL;
-	}
-	if (instance->sockfd != -1) {
-		closesocket(instance->sockfd);
-		instance->sockfd = -1;
-	}
+	log_stats(instance);
+	uring_stop(instance);
+	teardown(instance);
 	return true;
 }
 
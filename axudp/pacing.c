@@ -0,0 +1,200 @@
+/*
+ *  Project: ax25c - File: pacing.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../config/configuration.h"
+#include "../runtime/primbuffer.h"
+#include "../runtime/runtime.h"
+#include "../runtime/primslice.h"
+
+#include "_internal.h"
+#include "pacing.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#define NS_PER_SEC 1000000000LL
+
+/* Limits that keep the bit nanosecond arithmetic within 63 bits */
+#define PACING_RATE_MAX  1000000000u
+#define PACING_BURST_MAX 1000000u
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static inline int64_t cost(primitive_t *prim)
+{
+	return (int64_t)prim_length(prim) * 8 * NS_PER_SEC;
+}
+
+static void refill(struct pacing *p, struct pacing_bucket *b, uint64_t now)
+{
+	uint64_t elapsed = now - b->stamp;
+	int64_t need = p->burst - b->credit;
+
+	b->stamp = now;
+	if (need <= 0)
+		return;
+	/* Compare times first, the product of a long gap would overflow */
+	if (elapsed >= (uint64_t)need / p->rate)
+		b->credit = p->burst;
+	else
+		b->credit += (int64_t)(elapsed * p->rate);
+}
+
+bool pacing_init(struct instance_handle *instance, struct exception *ex)
+{
+	struct pacing *p = &instance->pacing;
+	unsigned int i;
+	uint64_t now;
+
+	memset(p, 0x00, sizeof(struct pacing));
+	p->wait = -1;
+	if (!instance->tx_rate)
+		return true;
+	if ((instance->tx_rate > PACING_RATE_MAX) ||
+			(instance->tx_burst < 1) ||
+			(instance->tx_burst > PACING_BURST_MAX)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "pacing_init",
+				"Invalid tx_rate or tx_burst", instance->name);
+		return false;
+	}
+	if (strcmp(instance->tx_pacing, "instance") == 0) {
+		p->n_buckets = 1;
+	} else if (strcmp(instance->tx_pacing, "peer") == 0) {
+		p->n_buckets = instance->server_mode ? instance->max_peers : 1;
+	} else {
+		exception_fill(ex, EINVAL, MODULE_NAME, "pacing_init",
+				"Invalid tx_pacing (instance|peer)", instance->tx_pacing);
+		return false;
+	}
+	p->bucket = calloc(p->n_buckets, sizeof(struct pacing_bucket));
+	if (!p->bucket) {
+		exception_fill(ex, ENOMEM, MODULE_NAME, "pacing_init",
+				"Unable to allocate buckets", instance->name);
+		return false;
+	}
+	p->rate  = instance->tx_rate;
+	p->burst = (int64_t)instance->tx_burst * 8 * NS_PER_SEC;
+	now = now_ns();
+	for (i = 0; i < p->n_buckets; ++i) {
+		p->bucket[i].credit = p->burst;
+		p->bucket[i].stamp  = now;
+	} /* end for */
+	return true;
+}
+
+void pacing_destroy(struct instance_handle *instance)
+{
+	struct pacing *p = &instance->pacing;
+	struct pacing_bucket *b;
+	unsigned int i;
+
+	if (!p->bucket)
+		return;
+	for (i = 0; i < p->n_buckets; ++i) {
+		b = &p->bucket[i];
+		for (; b->n; --b->n) {
+			del_prim(b->held[b->head].prim);
+			b->head = (b->head + 1) % PACING_HOLD;
+		} /* end for */
+		free(b->held);
+	} /* end for */
+	free(p->bucket);
+	memset(p, 0x00, sizeof(struct pacing));
+	p->wait = -1;
+}
+
+bool pacing_admit(struct instance_handle *instance, primitive_t *prim,
+		uint16_t handle, uint16_t gen, bool expedited)
+{
+	struct pacing *p = &instance->pacing;
+	struct pacing_bucket *b;
+	struct pacing_entry *e;
+
+	if (!p->rate || expedited)
+		return true;
+	b = &p->bucket[(p->n_buckets > 1) ? handle : 0];
+	/* Nothing may overtake the frames already held */
+	if (!b->n) {
+		refill(p, b, now_ns());
+		if (b->credit >= 0) {
+			b->credit -= cost(prim);
+			return true;
+		}
+	}
+	if (!b->held) {
+		b->held = malloc(PACING_HOLD * sizeof(struct pacing_entry));
+		if (!b->held) {
+			axudp_drop(instance, DLS_DROP_NO_MEM);
+			return false;
+		}
+	}
+	if (b->n == PACING_HOLD) {
+		axudp_drop(instance, DLS_DROP_QUEUE_FULL);
+		return false;
+	}
+	e = &b->held[(b->head + b->n) % PACING_HOLD];
+	use_prim(prim);
+	e->prim = prim;
+	e->handle = handle;
+	e->gen = gen;
+	if (!b->n++)
+		++p->n_held;
+	return false;
+}
+
+primitive_t *pacing_next(struct instance_handle *instance, uint16_t *handle,
+		uint16_t *gen, int64_t *wait)
+{
+	struct pacing *p = &instance->pacing;
+	struct pacing_bucket *b;
+	struct pacing_entry *e;
+	uint64_t now;
+	int64_t w;
+
+	now = p->n_held ? now_ns() : 0;
+	for (; p->n_held && (p->cursor < p->n_buckets); ++p->cursor) {
+		b = &p->bucket[p->cursor];
+		if (!b->n)
+			continue;
+		refill(p, b, now);
+		if (b->credit >= 0) {
+			e = &b->held[b->head];
+			b->head = (b->head + 1) % PACING_HOLD;
+			if (!--b->n)
+				--p->n_held;
+			b->credit -= cost(e->prim);
+			*handle = e->handle;
+			*gen = e->gen;
+			return e->prim;
+		}
+		w = (-b->credit + (int64_t)p->rate - 1) / (int64_t)p->rate;
+		if ((p->wait < 0) || (w < p->wait))
+			p->wait = w;
+	} /* end for */
+	*wait = p->n_held ? p->wait : -1;
+	p->cursor = 0;
+	p->wait = -1;
+	return NULL;
+}
@@ -0,0 +1,111 @@
+/*
+ *  Project: ax25c - File: pacing.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file pacing.h
+ * @brief AXUDP token bucket transmit pacing.
+ *
+ * A bucket fills with tx_rate bits per second up to tx_burst octets. A
+ * frame may go while its bucket is not in debt and takes its length
+ * from it. Frames that find the bucket in debt are held and released by
+ * the tx path once the bucket has refilled, the tx path computes its
+ * wait timeout from the next release. Expedited prims are not paced.
+ */
+#ifndef AXUDP_PACING_H_
+#define AXUDP_PACING_H_
+
+#include "../runtime/primitive.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct exception;
+struct instance_handle;
+
+/**
+ * @brief Max. number of frames held per bucket.
+ */
+#define PACING_HOLD 256
+
+/**
+ * @brief A held frame and its destination.
+ */
+struct pacing_entry {
+	primitive_t *prim;   /**< Held prim, referenced.                 */
+	uint16_t     handle; /**< Peer index, 0 in client mode.          */
+	uint16_t     gen;    /**< Generation of the peer.                */
+};
+
+/**
+ * @brief One token bucket.
+ */
+struct pacing_bucket {
+	int64_t              credit; /**< Bit nanoseconds, < 0 in debt.  */
+	uint64_t             stamp;  /**< Time of the last refill in ns. */
+	struct pacing_entry *held;   /**< Ring of held frames.           */
+	unsigned int         head;   /**< First held frame.              */
+	unsigned int         n;      /**< Number of held frames.         */
+};
+
+/**
+ * @brief Pacing state of an instance.
+ */
+struct pacing {
+	uint64_t              rate;      /**< Bits per second, 0 is off.   */
+	int64_t               burst;     /**< Bucket size in bit ns.       */
+	struct pacing_bucket *bucket;    /**< One or one per peer.         */
+	unsigned int          n_buckets; /**< Number of buckets.           */
+	unsigned int          n_held;    /**< Buckets with held frames.    */
+	unsigned int          cursor;    /**< Bucket of the current round. */
+	int64_t               wait;      /**< Min. wait of the round.      */
+};
+
+/**
+ * @brief Set up pacing from the instance settings.
+ */
+extern bool pacing_init(struct instance_handle *instance,
+		struct exception *ex);
+
+/**
+ * @brief Release the buckets and the held frames.
+ */
+extern void pacing_destroy(struct instance_handle *instance);
+
+/**
+ * @brief Decide if a frame to a destination may be sent now.
+ * @param handle Peer index, 0 in client mode.
+ * @param gen Generation of the peer, see peer_addr.
+ * @param expedited Expedited frames are not paced.
+ * @return true when the caller shall send it now, false when it was held
+ *         or dropped. The reference of the caller is not taken over.
+ */
+extern bool pacing_admit(struct instance_handle *instance, primitive_t *prim,
+		uint16_t handle, uint16_t gen, bool expedited);
+
+/**
+ * @brief Take the next held frame that is due. Call it until it returns
+ *        NULL, one round visits every bucket once.
+ * @param handle Set to the destination of the frame.
+ * @param gen Set to the generation of the destination.
+ * @param wait Set to the nanoseconds until the next frame is due or to -1
+ *        when nothing is held, when NULL is returned.
+ * @return Prim, the reference goes to the caller, or NULL.
+ */
+extern primitive_t *pacing_next(struct instance_handle *instance,
+		uint16_t *handle, uint16_t *gen, int64_t *wait);
+
+#endif /* AXUDP_PACING_H_ */
@@ -0,0 +1,457 @@
+/*
+ *  Project: ax25c - File: peer.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../config/configuration.h"
+#include "../runtime/primbuffer.h"
+#include "../runtime/runtime.h"
+#include "../runtime/dlsap.h"
+
+#include "_internal.h"
+#include "peer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#define IDX_EMPTY 0xffff
+#define IDX_DEAD  0xfffe
+
+static inline uint32_t fnv1a(uint32_t h, const void *p, size_t n)
+{
+	const uint8_t *b = p;
+
+	while (n--)
+		h = (h ^ *b++) * 16777619u;
+	return h;
+}
+
+static uint32_t addr_hash(const struct sockaddr_storage *addr)
+{
+	uint32_t h = 2166136261u;
+
+	switch (addr->ss_family) {
+	case AF_INET: {
+		const struct sockaddr_in *a = (const struct sockaddr_in*)addr;
+		h = fnv1a(h, &a->sin_port, sizeof(a->sin_port));
+		h = fnv1a(h, &a->sin_addr, sizeof(a->sin_addr));
+		break;
+	}
+	case AF_INET6: {
+		const struct sockaddr_in6 *a = (const struct sockaddr_in6*)addr;
+		h = fnv1a(h, &a->sin6_port, sizeof(a->sin6_port));
+		h = fnv1a(h, &a->sin6_addr, sizeof(a->sin6_addr));
+		h = fnv1a(h, &a->sin6_scope_id, sizeof(a->sin6_scope_id));
+		break;
+	}
+	default:
+		h = fnv1a(h, &addr->ss_family, sizeof(addr->ss_family));
+		break;
+	} /* end switch */
+	return h;
+}
+
+static bool addr_equal(const struct sockaddr_storage *a,
+		const struct sockaddr_storage *b)
+{
+	if (a->ss_family != b->ss_family)
+		return false;
+	switch (a->ss_family) {
+	case AF_INET: {
+		const struct sockaddr_in *a4 = (const struct sockaddr_in*)a;
+		const struct sockaddr_in *b4 = (const struct sockaddr_in*)b;
+		return (a4->sin_port == b4->sin_port) &&
+				(a4->sin_addr.s_addr == b4->sin_addr.s_addr);
+	}
+	case AF_INET6: {
+		const struct sockaddr_in6 *a6 = (const struct sockaddr_in6*)a;
+		const struct sockaddr_in6 *b6 = (const struct sockaddr_in6*)b;
+		return (a6->sin6_port == b6->sin6_port) &&
+				(a6->sin6_scope_id == b6->sin6_scope_id) &&
+				(memcmp(&a6->sin6_addr, &b6->sin6_addr,
+						sizeof(a6->sin6_addr)) == 0);
+	}
+	default:
+		return false;
+	} /* end switch */
+}
+
+/*
+ * Peer endpoint
+ */
+
+static bool peer_open(dls_t *dls, dls_t *receiver, struct exception *ex)
+{
+	struct axudp_peer *peer = dls->session;
+
+	if (receiver && dls->peer) {
+		exception_fill(ex, EEXIST, MODULE_NAME,
+				"peer_open", "Peer already connected", dls->name);
+		return false;
+	}
+	if (!peer->used) {
+		exception_fill(ex, ENOENT, MODULE_NAME,
+				"peer_open", "Peer expired", dls->name);
+		return false;
+	}
+	dls->peer = receiver;
+	return true;
+}
+
+static void peer_close(dls_t *dls)
+{
+	if (!dls)
+		return;
+	dls->peer = NULL;
+}
+
+static bool peer_write(dls_t *dls, primitive_t *prim, bool expedited,
+		bool owned, struct exception *ex)
+{
+	struct axudp_peer *peer = dls->session;
+	uint16_t gen = __atomic_load_n(&peer->gen, __ATOMIC_ACQUIRE);
+	primitive_t *tagged;
+
+	/* A peer that expires from now on has got another generation */
+	if (!peer->used) {
+		exception_fill(ex, ENOENT, MODULE_NAME,
+				"peer_write", "Peer expired", dls->name);
+		if (owned)
+			del_prim(prim);
+		return false;
+	}
+	/* The route goes into the header */
+	tagged = axudp_own(prim, owned, ex);
+	if (!tagged) {
+		axudp_drop(peer->instance, DLS_DROP_NO_MEM);
+		if (owned)
+			del_prim(prim);
+		return false;
+	}
+	tagged->serverHandle = peer->i;
+	tagged->clientHandle = gen;
+	axudp_enqueue(peer->instance, tagged, expedited);
+	return true;
+}
+
+static bool on_peer_write(dls_t *dls, primitive_t *prim, bool expedited,
+		struct exception *ex)
+{
+	return peer_write(dls, prim, expedited, false, ex);
+}
+
+static bool on_peer_write_owned(dls_t *dls, primitive_t *prim,
+		bool expedited, struct exception *ex)
+{
+	return peer_write(dls, prim, expedited, true, ex);
+}
+
+static const dls_t peer_dls_template = {
+		.set_default_local_addr  = NULL,
+		.set_default_remote_addr = NULL,
+		.open                    = peer_open,
+		.close                   = peer_close,
+		.on_write                = on_peer_write,
+		.on_write_owned          = on_peer_write_owned,
+		.get_queue_stats         = NULL,
+		.peer                    = NULL,
+		.session                 = NULL,
+};
+
+/*
+ * Hash table of peer indices, call with the lock held
+ */
+
+static struct axudp_peer *_lookup(struct peer_table *t,
+		const struct sockaddr_storage *addr, uint32_t hash)
+{
+	struct axudp_peer *peer;
+	uint32_t pos;
+	uint16_t i;
+
+	for (pos = hash & t->mask; ; pos = (pos + 1) & t->mask) {
+		i = t->index[pos];
+		if (i == IDX_EMPTY)
+			return NULL;
+		if (i == IDX_DEAD)
+			continue;
+		peer = &t->peer[i];
+		if ((peer->hash == hash) && addr_equal(&peer->addr, addr))
+			return peer;
+	} /* end for */
+}
+
+static void _insert(struct peer_table *t, uint32_t hash, uint16_t i)
+{
+	uint32_t pos;
+
+	for (pos = hash & t->mask; t->index[pos] < IDX_DEAD;
+			pos = (pos + 1) & t->mask)
+		;
+	if (t->index[pos] == IDX_DEAD)
+		--t->n_dead;
+	t->index[pos] = i;
+}
+
+static void _remove(struct peer_table *t, struct axudp_peer *peer)
+{
+	uint32_t pos;
+
+	for (pos = peer->hash & t->mask; t->index[pos] != peer->i;
+			pos = (pos + 1) & t->mask)
+		assert(t->index[pos] != IDX_EMPTY);
+	t->index[pos] = IDX_DEAD;
+	++t->n_dead;
+}
+
+static void _rebuild(struct peer_table *t)
+{
+	uint32_t i;
+
+	memset(t->index, 0xff, (t->mask + 1) * sizeof(uint16_t));
+	t->n_dead = 0;
+	for (i = 0; i < t->max_peers; ++i)
+		if (t->peer[i].used)
+			_insert(t, t->peer[i].hash, i);
+}
+
+static inline bool _crowded(struct peer_table *t)
+{
+	return (t->n_used + t->n_dead) > (((t->mask + 1) / 4) * 3);
+}
+
+/*
+ * Peer table
+ */
+
+bool peer_table_init(struct instance_handle *instance,
+		unsigned int max_peers, struct exception *ex)
+{
+	struct peer_table *t = &instance->peers;
+	uint32_t size = 4, i;
+	int erc;
+
+	if ((max_peers < 1) || (max_peers > PEER_MAX)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "peer_table_init",
+				"Invalid max_peers", instance->name);
+		return false;
+	}
+	while (size < 2 * max_peers)
+		size <<= 1;
+	t->peer  = calloc(max_peers, sizeof(struct axudp_peer));
+	t->index = malloc(size * sizeof(uint16_t));
+	t->free  = malloc(max_peers * sizeof(uint16_t));
+	if (!(t->peer && t->index && t->free)) {
+		free(t->peer);
+		free(t->index);
+		free(t->free);
+		t->peer = NULL;
+		exception_fill(ex, ENOMEM, MODULE_NAME, "peer_table_init",
+				"Unable to allocate peer table", instance->name);
+		return false;
+	}
+	memset(t->index, 0xff, size * sizeof(uint16_t));
+	for (i = 0; i < max_peers; ++i) {
+		t->peer[i].i = i;
+		t->peer[i].instance = instance;
+		t->free[i] = max_peers - 1 - i;
+	} /* end for */
+	t->mask = size - 1;
+	t->n_used = 0;
+	t->n_dead = 0;
+	t->max_peers = max_peers;
+	erc = pthread_spin_init(&t->lock, PTHREAD_PROCESS_PRIVATE);
+	assert(erc == 0);
+	return true;
+}
+
+static void peer_release(struct axudp_peer *peer)
+{
+	EXCEPTION(ex);
+
+	if (peer->dls.name) {
+		if (!dlsap_unregister_dls(&peer->dls, &ex) &&
+				(configuration.loglevel >= DEBUG_LEVEL_WARNING))
+			ax25c_log(DEBUG_LEVEL_WARNING,
+					"AXUDP:peer_release: %s: %s",
+					STRING_C(ex.message), STRING_C(ex.param));
+		peer->dls.name = NULL;
+	}
+	free(peer->host);
+	peer->host = NULL;
+}
+
+void peer_table_destroy(struct instance_handle *instance)
+{
+	struct peer_table *t = &instance->peers;
+	uint32_t i;
+
+	if (!t->peer)
+		return;
+	for (i = 0; i < t->max_peers; ++i) {
+		if (t->peer[i].used) {
+			t->peer[i].used = false;
+			peer_release(&t->peer[i]);
+		}
+	} /* end for */
+	free(t->peer);
+	free(t->index);
+	free(t->free);
+	t->peer = NULL;
+	pthread_spin_destroy(&t->lock);
+}
+
+struct axudp_peer *peer_get(struct instance_handle *instance,
+		const struct sockaddr_storage *addr, socklen_t addr_len, time_t now,
+		struct exception *ex)
+{
+	struct peer_table *t = &instance->peers;
+	struct axudp_peer *peer;
+	char host[NI_MAXHOST];
+	uint32_t hash = addr_hash(addr);
+	uint16_t i;
+	int erc;
+
+	erc = pthread_spin_lock(&t->lock); /*--------------------------------v*/
+	assert(erc == 0);
+	peer = _lookup(t, addr, hash);
+	if (peer) {
+		peer->last_seen = now;
+		goto exit;
+	}
+	if (t->n_used >= t->max_peers) {
+		exception_fill(ex, ENOSPC, MODULE_NAME, "peer_get",
+				"Peer table full", instance->name);
+		goto exit;
+	}
+	i = t->free[t->max_peers - 1 - t->n_used++];
+	peer = &t->peer[i];
+	memcpy(&peer->addr, addr, addr_len);
+	peer->addr_len = addr_len;
+	peer->hash = hash;
+	peer->last_seen = now;
+	peer->used = true;
+	_insert(t, hash, i);
+	if (_crowded(t))
+		_rebuild(t);
+	erc = pthread_spin_unlock(&t->lock); /*------------------------------^*/
+	assert(erc == 0);
+
+	/* New peer. Names belong to the rx path that added it, resolve them once */
+	erc = getnameinfo((struct sockaddr*)&peer->addr, peer->addr_len,
+			host, sizeof(host), peer->service, sizeof(peer->service),
+			NI_NUMERICHOST | NI_NUMERICSERV);
+	if (erc != 0) {
+		strcpy(host, "?");
+		strcpy(peer->service, "?");
+	}
+	snprintf(peer->name, PEER_NAME_SIZE, "%s/%s/%s",
+			instance->name, host, peer->service);
+	if (configuration.loglevel >= DEBUG_LEVEL_INFO) {
+		char fqdn[NI_MAXHOST];
+		if (getnameinfo((struct sockaddr*)&peer->addr, peer->addr_len,
+				fqdn, sizeof(fqdn), NULL, 0, 0) == 0)
+			peer->host = strdup(fqdn);
+	}
+	if (!peer->host)
+		peer->host = strdup(host);
+	memcpy(&peer->dls, &peer_dls_template, sizeof(struct dls));
+	peer->dls.name = peer->name;
+	peer->dls.session = peer;
+	if (!dlsap_register_dls(&peer->dls, ex)) {
+		if (configuration.loglevel >= DEBUG_LEVEL_WARNING)
+			ax25c_log(DEBUG_LEVEL_WARNING,
+					"AXUDP:peer_get: No endpoint for %s: %s",
+					peer->name, STRING_C(ex->message));
+		peer->dls.name = NULL;
+	}
+	if (configuration.loglevel >= DEBUG_LEVEL_INFO)
+		ax25c_log(DEBUG_LEVEL_INFO, "AXUDP: New peer %s (%s)",
+				peer->name, peer->host ? peer->host : "?");
+	return peer;
+
+exit:
+	erc = pthread_spin_unlock(&t->lock); /*------------------------------^*/
+	assert(erc == 0);
+	return peer;
+}
+
+bool peer_addr(struct instance_handle *instance, uint16_t i,
+		uint16_t *gen, struct sockaddr_storage *addr, socklen_t *addr_len)
+{
+	struct peer_table *t = &instance->peers;
+	bool res = false;
+	int erc;
+
+	erc = pthread_spin_lock(&t->lock); /*--------------------------------v*/
+	assert(erc == 0);
+	if ((i < t->max_peers) && t->peer[i].used &&
+			((*gen == PEER_GEN_ANY) || (*gen == t->peer[i].gen))) {
+		memcpy(addr, &t->peer[i].addr, t->peer[i].addr_len);
+		*addr_len = t->peer[i].addr_len;
+		*gen = t->peer[i].gen;
+		res = true;
+	}
+	erc = pthread_spin_unlock(&t->lock); /*------------------------------^*/
+	assert(erc == 0);
+	return res;
+}
+
+unsigned int peer_expire(struct instance_handle *instance, time_t now,
+		unsigned int timeout)
+{
+	struct peer_table *t = &instance->peers;
+	struct axudp_peer *peer;
+	unsigned int n = 0;
+	uint32_t i;
+	bool expired;
+	int erc;
+
+	for (i = 0; i < t->max_peers; ++i) {
+		peer = &t->peer[i];
+		erc = pthread_spin_lock(&t->lock); /*----------------------------v*/
+		assert(erc == 0);
+		expired = peer->used && !peer->dls.peer &&
+				(now - peer->last_seen >= (time_t)timeout);
+		if (expired) {
+			peer->used = false;
+			/* Frames still queued for it must not go to the next one */
+			if (__atomic_add_fetch(&peer->gen, 1, __ATOMIC_RELEASE)
+					== PEER_GEN_ANY)
+				__atomic_store_n(&peer->gen, 0, __ATOMIC_RELEASE);
+			_remove(t, peer);
+			if (_crowded(t))
+				_rebuild(t);
+		}
+		erc = pthread_spin_unlock(&t->lock); /*--------------------------^*/
+		assert(erc == 0);
+		if (!expired)
+			continue;
+		if (configuration.loglevel >= DEBUG_LEVEL_INFO)
+			ax25c_log(DEBUG_LEVEL_INFO, "AXUDP: Peer %s expired",
+					peer->name);
+		peer_release(peer);
+		/* Reusable only now, another shard may pick it up at once */
+		erc = pthread_spin_lock(&t->lock); /*----------------------------v*/
+		assert(erc == 0);
+		t->free[t->max_peers - t->n_used--] = peer->i;
+		erc = pthread_spin_unlock(&t->lock); /*--------------------------^*/
+		assert(erc == 0);
+		++n;
+	} /* end for */
+	return n;
+}
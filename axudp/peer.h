@@ -0,0 +1,149 @@
+/*
+ *  Project: ax25c - File: peer.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file peer.h
+ * @brief AXUDP server mode peer table.
+ *
+ * Peers are kept in a fixed array, so a peer and its DLS endpoint never
+ * move while the instance is running. An open addressing hash table of
+ * peer indices, keyed by the socket address, finds them on receive.
+ */
+#ifndef AXUDP_PEER_H_
+#define AXUDP_PEER_H_
+
+#include "../runtime/dls.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <sys/socket.h>
+
+#include <pthread.h>
+
+struct exception;
+struct instance_handle;
+
+/**
+ * @brief serverHandle of a prim that goes to all peers.
+ */
+#define PEER_BROADCAST 0xffff
+
+/**
+ * @brief Generation that matches any peer in a slot, see peer_addr.
+ */
+#define PEER_GEN_ANY   0xffff
+
+/**
+ * @brief Max. number of peers per instance.
+ */
+#define PEER_MAX       0xfff0
+
+/**
+ * @brief Size of a peer DLS name.
+ */
+#define PEER_NAME_SIZE 96
+
+/**
+ * @brief One AXUDP neighbour.
+ */
+struct axudp_peer {
+	dls_t                   dls;       /**< Endpoint of this peer.        */
+	struct instance_handle *instance;  /**< Owning instance.              */
+	struct sockaddr_storage addr;      /**< Address of the peer.          */
+	socklen_t               addr_len;  /**< Size of the address.          */
+	uint32_t                hash;      /**< Hash of the address.          */
+	uint16_t                i;         /**< Index of the peer.            */
+	uint16_t                gen;       /**< Bumped when the slot expires. */
+	bool                    used;      /**< Slot is in use.               */
+	time_t                  last_seen; /**< Last datagram received.       */
+	char                   *host;      /**< Cached reverse lookup.        */
+	char                    service[16]; /**< Port of the peer.           */
+	char                    name[PEER_NAME_SIZE]; /**< DLS name.          */
+};
+
+/**
+ * @brief Peer table of a server mode instance.
+ */
+struct peer_table {
+	struct axudp_peer  *peer;      /**< max_peers peers.                  */
+	uint16_t           *index;     /**< Hash table of peer indices.       */
+	uint16_t           *free;      /**< Stack of free peer indices.       */
+	uint32_t            mask;      /**< Hash table size - 1.              */
+	uint32_t            n_used;    /**< Number of peers in use.           */
+	uint32_t            n_dead;    /**< Number of deleted index entries.  */
+	uint32_t            max_peers; /**< Capacity of the peer array.       */
+	pthread_spinlock_t  lock;      /**< Protects the table.               */
+};
+
+/**
+ * @brief Initialize a peer table.
+ * @param instance Instance that owns the table.
+ * @param max_peers Max. number of peers.
+ * @param ex Exception structure.
+ * @return Success indicator.
+ */
+extern bool peer_table_init(struct instance_handle *instance,
+		unsigned int max_peers, struct exception *ex);
+
+/**
+ * @brief Destroy the peer table, unregisters all peer endpoints.
+ * @param instance Instance that owns the table.
+ */
+extern void peer_table_destroy(struct instance_handle *instance);
+
+/**
+ * @brief Find the peer for a source address, add it when it is new.
+ *        The names of a new peer are set up by the calling rx path.
+ * @param instance Instance that owns the table.
+ * @param addr Source address.
+ * @param addr_len Size of addr.
+ * @param now Current time.
+ * @param ex Exception structure.
+ * @return Peer or NULL when the table is full.
+ */
+extern struct axudp_peer *peer_get(struct instance_handle *instance,
+		const struct sockaddr_storage *addr, socklen_t addr_len, time_t now,
+		struct exception *ex);
+
+/**
+ * @brief Copy the address of a peer. A slot is reused after its peer has
+ *        expired, the generation tells the peers of a slot apart.
+ * @param instance Instance that owns the table.
+ * @param i Index of the peer.
+ * @param gen Generation of the peer a frame was queued for or
+ *        PEER_GEN_ANY. Receives the generation of the peer in the slot.
+ * @param addr Receives the address.
+ * @param addr_len Receives the size of the address.
+ * @return false when there is no such peer (any more).
+ */
+extern bool peer_addr(struct instance_handle *instance, uint16_t i,
+		uint16_t *gen, struct sockaddr_storage *addr, socklen_t *addr_len);
+
+/**
+ * @brief Remove peers that were idle for timeout seconds. Peers with an
+ *        open endpoint are kept. Only called from one rx path.
+ * @param instance Instance that owns the table.
+ * @param now Current time.
+ * @param timeout Idle timeout in seconds.
+ * @return Number of removed peers.
+ */
+extern unsigned int peer_expire(struct instance_handle *instance, time_t now,
+		unsigned int timeout);
+
+#endif /* AXUDP_PEER_H_ */
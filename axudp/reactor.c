@@ -0,0 +1,256 @@
+/*
+ *  Project: ax25c - File: reactor.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../config/configuration.h"
+#include "../runtime/primbuffer.h"
+#include "../runtime/runtime.h"
+
+#include "_internal.h"
+#include "reactor.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+/* Max. number of events per epoll_wait */
+#define REACTOR_EVENTS 64
+
+/* epoll_wait timeout, drives the housekeeping */
+#define REACTOR_TIMEOUT_MS 1000
+
+/* Call with the lock held */
+static void reactor_rx(struct reactor *r, struct axudp_shard *shard)
+{
+	int n;
+
+	/* Edge triggered: read until the socket is empty */
+	while ((n = axudp_rx_round(shard, MSG_DONTWAIT)) > 0)
+		;
+	list_del_init(&shard->pending_node);
+	if ((n < 0) && (errno == ENOMEM))
+		list_add_tail(&shard->pending_node, &r->pending);
+}
+
+static void *reactor_worker(void *id)
+{
+	struct reactor *r = id;
+	struct epoll_event events[REACTOR_EVENTS];
+	struct instance_handle *instance;
+	struct axudp_shard *shard, *next;
+	struct axudp_event *ev;
+	int timeout = REACTOR_TIMEOUT_MS;
+	int64_t wait;
+	uint64_t cnt;
+	time_t now;
+	int i, n;
+
+	assert(r);
+	while (r->alive) {
+		n = epoll_wait(r->epfd, events, REACTOR_EVENTS, timeout);
+		if (n < 0) {
+			if ((errno != EINTR) &&
+					(configuration.loglevel >= DEBUG_LEVEL_ERROR))
+				ax25c_log(DEBUG_LEVEL_ERROR,
+						"AXUDP:reactor:epoll_wait() error %i:%s",
+						errno, strerror(errno));
+			n = 0;
+		}
+		pthread_mutex_lock(&r->lock); /*---------------------------------v*/
+		for (i = 0; i < n; ++i) {
+			ev = events[i].data.ptr;
+			if (!ev)
+				continue; /* wakefd, only used to stop the reactor */
+			instance = ev->instance;
+			if (!instance->alive)
+				continue;
+			if (!ev->shard) {
+				if (read(instance->evfd, &cnt, sizeof(cnt)) < 0)
+					continue;
+				axudp_tx_drain(instance, r->tx);
+			} else {
+				reactor_rx(r, ev->shard);
+			}
+		} /* end for */
+		now = axudp_now();
+		timeout = REACTOR_TIMEOUT_MS;
+		list_for_each_entry(instance, &r->instances, reactor_node) {
+			axudp_housekeeping(instance, now);
+			/* Wake up again when the next paced frame is due */
+			wait = axudp_tx_release(instance, r->tx);
+			if ((wait >= 0) && (wait < (int64_t)timeout * 1000000))
+				timeout = (int)((wait + 999999) / 1000000);
+		} /* end list_for_each_entry */
+		/* Out of rx prims last time, there will be no new edge */
+		list_for_each_entry_safe(shard, next, &r->pending, pending_node)
+			if (shard->instance->alive)
+				reactor_rx(r, shard);
+		pthread_mutex_unlock(&r->lock); /*-------------------------------^*/
+	} /* end while */
+	return NULL;
+}
+
+bool reactor_start(struct reactor *r, struct exception *ex)
+{
+	struct epoll_event ev;
+	int erc;
+
+	assert(r);
+	memset(r, 0x00, sizeof(struct reactor));
+	INIT_LIST_HEAD(&r->instances);
+	INIT_LIST_HEAD(&r->pending);
+	r->epfd = -1;
+	r->wakefd = -1;
+	r->tx = axudp_tx_batch_new();
+	if (!r->tx) {
+		exception_fill(ex, ENOMEM, MODULE_NAME, "reactor_start",
+				"Unable to allocate tx batch", "");
+		return false;
+	}
+	r->epfd = epoll_create1(EPOLL_CLOEXEC);
+	r->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if ((r->epfd == -1) || (r->wakefd == -1)) {
+		exception_fill(ex, errno, MODULE_NAME, "reactor_start",
+				"epoll_create1/eventfd", strerror(errno));
+		goto error;
+	}
+	memset(&ev, 0x00, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->wakefd, &ev) == -1) {
+		exception_fill(ex, errno, MODULE_NAME, "reactor_start",
+				"epoll_ctl", strerror(errno));
+		goto error;
+	}
+	erc = pthread_mutex_init(&r->lock, NULL);
+	assert(erc == 0);
+	r->alive = true;
+	erc = pthread_create(&r->thread, NULL, reactor_worker, r);
+	if (erc != 0) {
+		exception_fill(ex, erc, MODULE_NAME, "reactor_start",
+				"Error creating reactor thread", "");
+		pthread_mutex_destroy(&r->lock);
+		goto error;
+	}
+	r->running = true;
+	return true;
+
+error:
+	r->alive = false;
+	if (r->epfd != -1)
+		close(r->epfd);
+	if (r->wakefd != -1)
+		close(r->wakefd);
+	free(r->tx);
+	r->tx = NULL;
+	return false;
+}
+
+void reactor_stop(struct reactor *r)
+{
+	uint64_t one = 1;
+
+	if (!(r && r->running))
+		return;
+	r->alive = false;
+	if (write(r->wakefd, &one, sizeof(one)) < 0)
+		DBG_ERROR("AXUDP:reactor_stop", "Unable to wake up reactor");
+	pthread_join(r->thread, NULL);
+	r->running = false;
+	pthread_mutex_destroy(&r->lock);
+	close(r->epfd);
+	close(r->wakefd);
+	free(r->tx);
+	r->tx = NULL;
+}
+
+bool reactor_add(struct reactor *r, struct instance_handle *instance,
+		struct exception *ex)
+{
+	struct epoll_event ev;
+
+	assert(r);
+	assert(instance);
+	instance->tx_event.instance = instance;
+	instance->tx_event.shard = NULL;
+	pthread_mutex_lock(&r->lock); /*-------------------------------------v*/
+	memset(&ev, 0x00, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.ptr = &instance->tx_event;
+	if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, instance->evfd, &ev) == -1) {
+		exception_fill(ex, errno, MODULE_NAME, "reactor_add", "epoll_ctl",
+				strerror(errno));
+		pthread_mutex_unlock(&r->lock); /*-------------------------------^*/
+		return false;
+	}
+	list_add_tail(&instance->reactor_node, &r->instances);
+	instance->reactor = r;
+	pthread_mutex_unlock(&r->lock); /*-----------------------------------^*/
+	return true;
+}
+
+void reactor_remove(struct reactor *r, struct instance_handle *instance)
+{
+	assert(r);
+	assert(instance);
+	pthread_mutex_lock(&r->lock); /*-------------------------------------v*/
+	instance->alive = false;
+	epoll_ctl(r->epfd, EPOLL_CTL_DEL, instance->evfd, NULL);
+	list_del_init(&instance->reactor_node);
+	pthread_mutex_unlock(&r->lock); /*-----------------------------------^*/
+}
+
+bool reactor_add_shard(struct reactor *r, struct axudp_shard *shard,
+		struct exception *ex)
+{
+	struct epoll_event ev;
+	bool res = true;
+
+	assert(r);
+	assert(shard);
+	shard->rx_event.instance = shard->instance;
+	shard->rx_event.shard = shard;
+	pthread_mutex_lock(&r->lock); /*-------------------------------------v*/
+	INIT_LIST_HEAD(&shard->pending_node);
+	memset(&ev, 0x00, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.ptr = &shard->rx_event;
+	if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, shard->sockfd, &ev) == -1) {
+		exception_fill(ex, errno, MODULE_NAME, "reactor_add_shard",
+				"epoll_ctl", strerror(errno));
+		res = false;
+	} else {
+		shard->reactor = r;
+	}
+	pthread_mutex_unlock(&r->lock); /*-----------------------------------^*/
+	return res;
+}
+
+void reactor_remove_shard(struct reactor *r, struct axudp_shard *shard)
+{
+	assert(r);
+	assert(shard);
+	pthread_mutex_lock(&r->lock); /*-------------------------------------v*/
+	epoll_ctl(r->epfd, EPOLL_CTL_DEL, shard->sockfd, NULL);
+	list_del_init(&shard->pending_node);
+	shard->reactor = NULL;
+	pthread_mutex_unlock(&r->lock); /*-----------------------------------^*/
+}
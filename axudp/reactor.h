@@ -0,0 +1,105 @@
+/*
+ *  Project: ax25c - File: reactor.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file reactor.h
+ * @brief epoll reactor that serves the sockets of several AXUDP instances
+ *        from one thread.
+ */
+#ifndef AXUDP_REACTOR_H_
+#define AXUDP_REACTOR_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <uki/list.h>
+
+struct exception;
+struct instance_handle;
+struct axudp_shard;
+struct tx_batch;
+
+/**
+ * @brief One reactor thread with its epoll set.
+ */
+struct reactor {
+	pthread_t           thread;     /**< Reactor thread.                  */
+	bool                running;    /**< Thread has been started.         */
+	volatile bool       alive;      /**< Cleared to stop the thread.      */
+	int                 epfd;       /**< epoll set.                       */
+	int                 wakefd;     /**< eventfd to wake up the thread.   */
+	pthread_mutex_t     lock;       /**< Held while serving events.       */
+	struct list_head    instances;  /**< Instances served.                */
+	struct list_head    pending;    /**< Shards with datagrams left.      */
+	struct tx_batch    *tx;         /**< Send batch of this thread.       */
+};
+
+/**
+ * @brief Create the epoll set and start the reactor thread.
+ * @param r Reactor.
+ * @param ex Exception structure.
+ * @return Success indicator.
+ */
+extern bool reactor_start(struct reactor *r, struct exception *ex);
+
+/**
+ * @brief Stop the reactor thread and release its resources.
+ * @param r Reactor.
+ */
+extern void reactor_stop(struct reactor *r);
+
+/**
+ * @brief Add the tx eventfd of an instance, edge triggered. The reactor
+ *        also does the housekeeping of the instance.
+ * @param r Reactor.
+ * @param instance Instance.
+ * @param ex Exception structure.
+ * @return Success indicator.
+ */
+extern bool reactor_add(struct reactor *r, struct instance_handle *instance,
+		struct exception *ex);
+
+/**
+ * @brief Remove an instance. When this returns the reactor does not
+ *        touch the instance any more.
+ * @param r Reactor.
+ * @param instance Instance.
+ */
+extern void reactor_remove(struct reactor *r,
+		struct instance_handle *instance);
+
+/**
+ * @brief Add the socket of a shard, edge triggered. A shard that stops
+ *        with datagrams left, because no rx prims were available, gets no
+ *        new edge for them; the reactor retries it after the housekeeping.
+ * @param r Reactor, need not be the one of the instance.
+ * @param shard Shard, sockfd must be nonblocking.
+ * @param ex Exception structure.
+ * @return Success indicator.
+ */
+extern bool reactor_add_shard(struct reactor *r, struct axudp_shard *shard,
+		struct exception *ex);
+
+/**
+ * @brief Remove the socket of a shard.
+ * @param r Reactor.
+ * @param shard Shard.
+ */
+extern void reactor_remove_shard(struct reactor *r,
+		struct axudp_shard *shard);
+
+#endif /* AXUDP_REACTOR_H_ */
@@ -0,0 +1,449 @@
+/*
+ *  Project: ax25c - File: uring.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../config/configuration.h"
+#include "../runtime/primbuffer.h"
+#include "../runtime/runtime.h"
+#include "../runtime/primslice.h"
+
+#include "_internal.h"
+#include "uring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+#ifndef AXUDP_URING
+
+bool uring_available(void)
+{
+	return false;
+}
+
+bool uring_start(struct instance_handle *instance, struct exception *ex)
+{
+	exception_fill(ex, ENOTSUP, MODULE_NAME, "uring_start",
+			"Built without io_uring support (AXUDP_URING)", instance->name);
+	return false;
+}
+
+void uring_stop(struct instance_handle *instance)
+{
+}
+
+#else
+
+#include <liburing.h>
+#include <sys/eventfd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/* Submission queue entries */
+#define URING_ENTRIES 256
+
+/* Max. number of sendmsg in flight */
+#define URING_SENDS   128
+
+/* Buffer group of the rx buffers */
+#define URING_BGID    0
+
+/* user_data of the receive and the eventfd read, others are sends */
+#define UD_RECV       1
+#define UD_EVENT      2
+
+/* One sendmsg in flight, holds a reference to the prim */
+struct uring_send {
+	struct msghdr           msg;
+	struct iovec            iov[AXUDP_IOV_MAX];
+	struct sockaddr_storage addr;
+	primitive_t            *prim;
+	struct uring_send      *next;
+};
+
+struct axudp_uring {
+	struct instance_handle   *instance;
+	struct io_uring           ring;
+	bool                      ring_ok;
+	struct io_uring_buf_ring *br;
+	primitive_t             **buf;       /* Prim behind each buffer id */
+	unsigned int              n_bufs;
+	unsigned int              n_empty;   /* Buffer ids without a prim */
+	struct msghdr             rx_msg;    /* Layout of multishot recvmsg */
+	bool                      recv_armed;
+	bool                      event_armed;
+	uint64_t                  event_cnt;
+	struct uring_send        *send;
+	struct uring_send        *free_send;
+	unsigned int              n_free_send;
+	pthread_t                 thread;
+	bool                      running;
+};
+
+bool uring_available(void)
+{
+	return true;
+}
+
+/* Post a rx prim as buffer bid, the kernel receives straight into it */
+static bool buf_fill(struct axudp_uring *u, unsigned int bid,
+		primitive_t *prim)
+{
+	EXCEPTION(ex);
+
+	if (!prim)
+		prim = axudp_pool_get(u->instance, &ex);
+	u->buf[bid] = prim;
+	if (!prim) {
+		++u->n_empty;
+		return false;
+	}
+	io_uring_buf_ring_add(u->br, prim->payload, u->instance->rx_prim_size,
+			bid, io_uring_buf_ring_mask(u->n_bufs), 0);
+	io_uring_buf_ring_advance(u->br, 1);
+	return true;
+}
+
+static void buf_refill(struct axudp_uring *u)
+{
+	unsigned int bid;
+
+	for (bid = 0; u->n_empty && (bid < u->n_bufs); ++bid) {
+		if (u->buf[bid])
+			continue;
+		--u->n_empty;
+		if (!buf_fill(u, bid, NULL))
+			break;
+	} /* end for */
+}
+
+static void arm_recv(struct axudp_uring *u)
+{
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&u->ring);
+
+	if (!sqe)
+		return;
+	if (u->instance->server_mode)
+		io_uring_prep_recvmsg_multishot(sqe, u->instance->sockfd,
+				&u->rx_msg, 0);
+	else
+		io_uring_prep_recv_multishot(sqe, u->instance->sockfd, NULL, 0, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BGID;
+	io_uring_sqe_set_data64(sqe, UD_RECV);
+	u->recv_armed = true;
+}
+
+static void arm_event(struct axudp_uring *u)
+{
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&u->ring);
+
+	if (!sqe)
+		return;
+	io_uring_prep_read(sqe, u->instance->evfd, &u->event_cnt,
+			sizeof(u->event_cnt), 0);
+	io_uring_sqe_set_data64(sqe, UD_EVENT);
+	u->event_armed = true;
+}
+
+static void on_recv(struct axudp_uring *u, struct io_uring_cqe *cqe,
+		time_t now)
+{
+	struct instance_handle *instance = u->instance;
+	struct io_uring_recvmsg_out *out;
+	struct sockaddr_storage addr;
+	socklen_t addr_len = 0;
+	primitive_t *prim;
+	unsigned int bid, len;
+
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+		u->recv_armed = false;
+	if (cqe->res < 0) {
+		/* -ENOBUFS: All buffers taken, rearmed after the refill */
+		if ((cqe->res != -ENOBUFS) &&
+				(configuration.loglevel >= DEBUG_LEVEL_ERROR))
+			ax25c_log(DEBUG_LEVEL_ERROR,
+					"AXUDP:uring:recv error %i:%s",
+					-cqe->res, strerror(-cqe->res));
+		return;
+	}
+	if (!(cqe->flags & IORING_CQE_F_BUFFER))
+		return;
+	bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+	prim = u->buf[bid];
+	assert(prim);
+	len = cqe->res;
+	if (instance->server_mode) {
+		/* Header and source address come first, the payload follows */
+		out = io_uring_recvmsg_validate(prim->payload, cqe->res, &u->rx_msg);
+		if (!out || (out->namelen > sizeof(addr))) {
+			buf_fill(u, bid, prim);
+			return;
+		}
+		addr_len = out->namelen;
+		memcpy(&addr, io_uring_recvmsg_name(out), addr_len);
+		len = io_uring_recvmsg_payload_length(out, cqe->res, &u->rx_msg);
+		memmove(prim->payload, io_uring_recvmsg_payload(out, &u->rx_msg),
+				len);
+	}
+	u->buf[bid] = NULL;
+	if (axudp_rx_deliver(instance, prim, len, &addr, addr_len, now))
+		prim = NULL;
+	buf_fill(u, bid, prim);
+}
+
+static void send_done(struct axudp_uring *u, struct uring_send *s, int res)
+{
+	axudp_sent(u->instance, s->prim, res);
+	if (res < 0) {
+		if (configuration.loglevel >= DEBUG_LEVEL_ERROR)
+			ax25c_log(DEBUG_LEVEL_ERROR,
+					"AXUDP:uring:sendmsg error %i:%s",
+					-res, strerror(-res));
+	} else if (((size_t)res != prim_length(s->prim)) &&
+			(configuration.loglevel >= DEBUG_LEVEL_ERROR)) {
+		ax25c_log(DEBUG_LEVEL_ERROR,
+				"AXUDP:uring:sendmsg: partial:%zu <> %i",
+				prim_length(s->prim), res);
+	}
+	del_prim(s->prim);
+	s->prim = NULL;
+	s->next = u->free_send;
+	u->free_send = s;
+	++u->n_free_send;
+}
+
+static void uring_sink(struct instance_handle *instance, void *ctx,
+		primitive_t *prim, const struct iovec *iov, int iovlen,
+		const struct sockaddr_storage *addr, socklen_t addr_len)
+{
+	struct axudp_uring *u = ctx;
+	struct io_uring_sqe *sqe;
+	struct uring_send *s = u->free_send;
+
+	if (!s) {
+		DBG_ERROR("AXUDP:uring", "Send queue full");
+		axudp_drop(instance, DLS_DROP_QUEUE_FULL);
+		return;
+	}
+	sqe = io_uring_get_sqe(&u->ring);
+	if (!sqe) {
+		io_uring_submit(&u->ring);
+		sqe = io_uring_get_sqe(&u->ring);
+		if (!sqe) {
+			DBG_ERROR("AXUDP:uring", "Submission queue full");
+			axudp_drop(instance, DLS_DROP_QUEUE_FULL);
+			return;
+		}
+	}
+	u->free_send = s->next;
+	--u->n_free_send;
+	memset(&s->msg, 0x00, sizeof(s->msg));
+	memcpy(s->iov, iov, iovlen * sizeof(struct iovec));
+	s->msg.msg_iov = s->iov;
+	s->msg.msg_iovlen = iovlen;
+	if (addr) {
+		memcpy(&s->addr, addr, addr_len);
+		s->msg.msg_name = &s->addr;
+		s->msg.msg_namelen = addr_len;
+	}
+	use_prim(prim);
+	s->prim = prim;
+	io_uring_prep_sendmsg(sqe, instance->sockfd, &s->msg, 0);
+	io_uring_sqe_set_data64(sqe, (uint64_t)(uintptr_t)s);
+}
+
+/* Queue sends for as many prims as there are free send slots */
+static void uring_tx(struct axudp_uring *u)
+{
+	struct instance_handle *instance = u->instance;
+	primitive_t *prim, *next;
+	LIST_HEAD(list);
+	size_t max, n_expedited;
+
+	for (;;) {
+		max = (instance->batch_size < u->n_free_send) ?
+				instance->batch_size : u->n_free_send;
+		if (!max || !primbuffer_read_batch(&instance->primbuffer, &list, max,
+				&n_expedited))
+			break;
+		/* Expedited prims come first */
+		list_for_each_entry_safe(prim, next, &list, node) {
+			list_del_init(&prim->node);
+			axudp_tx_prim(instance, prim, n_expedited > 0, uring_sink, u);
+			if (n_expedited)
+				--n_expedited;
+		} /* end list_for_each_entry_safe */
+	} /* end for */
+}
+
+static void *uring_worker(void *id)
+{
+	struct axudp_uring *u = id;
+	struct instance_handle *instance = u->instance;
+	struct __kernel_timespec ts = { .tv_sec = 1, .tv_nsec = 0 };
+	struct io_uring_cqe *cqe;
+	unsigned int head, n;
+	int64_t wait;
+	uint64_t ud;
+	time_t now;
+	int erc;
+
+	while (instance->alive) {
+		if (!u->recv_armed && (u->n_empty < u->n_bufs))
+			arm_recv(u);
+		if (!u->event_armed)
+			arm_event(u);
+		/* One syscall submits the queued sends and waits */
+		erc = io_uring_submit_and_wait_timeout(&u->ring, &cqe, 1, &ts, NULL);
+		if ((erc < 0) && (erc != -ETIME) && (erc != -EINTR) &&
+				(configuration.loglevel >= DEBUG_LEVEL_ERROR))
+			ax25c_log(DEBUG_LEVEL_ERROR,
+					"AXUDP:uring:submit_and_wait error %i:%s",
+					-erc, strerror(-erc));
+		if (!instance->alive)
+			break;
+		now = axudp_now();
+		n = 0;
+		io_uring_for_each_cqe(&u->ring, head, cqe) {
+			ud = io_uring_cqe_get_data64(cqe);
+			if (ud == UD_RECV)
+				on_recv(u, cqe, now);
+			else if (ud == UD_EVENT)
+				u->event_armed = false;
+			else
+				send_done(u, (struct uring_send*)(uintptr_t)ud, cqe->res);
+			++n;
+		} /* end io_uring_for_each_cqe */
+		io_uring_cq_advance(&u->ring, n);
+		uring_tx(u);
+		/* Wait no longer than until the next paced frame is due */
+		wait = axudp_tx_paced(instance, uring_sink, u);
+		ts.tv_sec  = ((wait >= 0) && (wait < 1000000000)) ? 0 : 1;
+		ts.tv_nsec = ((wait >= 0) && (wait < 1000000000)) ? wait : 0;
+		axudp_housekeeping(instance, now);
+		buf_refill(u);
+	} /* end while */
+	return NULL;
+}
+
+static void uring_free(struct axudp_uring *u)
+{
+	unsigned int i;
+
+	/* Exiting the ring cancels everything that is still posted */
+	if (u->ring_ok) {
+		if (u->br)
+			io_uring_free_buf_ring(&u->ring, u->br, u->n_bufs, URING_BGID);
+		io_uring_queue_exit(&u->ring);
+	}
+	if (u->buf) {
+		for (i = 0; i < u->n_bufs; ++i)
+			del_prim(u->buf[i]);
+		free(u->buf);
+	}
+	if (u->send) {
+		for (i = 0; i < URING_SENDS; ++i)
+			del_prim(u->send[i].prim);
+		free(u->send);
+	}
+	free(u);
+}
+
+bool uring_start(struct instance_handle *instance, struct exception *ex)
+{
+	struct axudp_uring *u;
+	unsigned int i;
+	int erc;
+
+	u = calloc(1, sizeof(struct axudp_uring));
+	if (!u) {
+		exception_fill(ex, ENOMEM, MODULE_NAME, "uring_start",
+				"Unable to allocate ring", instance->name);
+		return false;
+	}
+	u->instance = instance;
+	for (u->n_bufs = 8; (u->n_bufs < instance->rx_pool_size) &&
+			(u->n_bufs < 32768); u->n_bufs <<= 1)
+		;
+	erc = io_uring_queue_init(URING_ENTRIES, &u->ring, 0);
+	if (erc < 0) {
+		exception_fill(ex, -erc, MODULE_NAME, "uring_start",
+				"io_uring_queue_init", strerror(-erc));
+		goto error;
+	}
+	u->ring_ok = true;
+	u->br = io_uring_setup_buf_ring(&u->ring, u->n_bufs, URING_BGID, 0, &erc);
+	u->buf = calloc(u->n_bufs, sizeof(primitive_t*));
+	u->send = calloc(URING_SENDS, sizeof(struct uring_send));
+	if (!(u->br && u->buf && u->send)) {
+		exception_fill(ex, u->br ? ENOMEM : -erc, MODULE_NAME, "uring_start",
+				"Unable to set up buffers", instance->name);
+		goto error;
+	}
+	for (i = 0; i < URING_SENDS; ++i) {
+		u->send[i].next = u->free_send;
+		u->free_send = &u->send[i];
+	} /* end for */
+	u->n_free_send = URING_SENDS;
+	for (i = 0; i < u->n_bufs; ++i)
+		buf_fill(u, i, NULL);
+	u->rx_msg.msg_namelen = sizeof(struct sockaddr_storage);
+	instance->evfd = eventfd(0, EFD_CLOEXEC);
+	if (instance->evfd == -1) {
+		exception_fill(ex, errno, MODULE_NAME, "uring_start",
+				"eventfd", strerror(errno));
+		goto error;
+	}
+	instance->uring = u;
+	erc = pthread_create(&u->thread, NULL, uring_worker, u);
+	if (erc != 0) {
+		exception_fill(ex, erc, MODULE_NAME, "uring_start",
+				"Error creating uring thread", instance->name);
+		instance->uring = NULL;
+		close(instance->evfd);
+		instance->evfd = -1;
+		goto error;
+	}
+	u->running = true;
+	return true;
+
+error:
+	uring_free(u);
+	return false;
+}
+
+void uring_stop(struct instance_handle *instance)
+{
+	struct axudp_uring *u = instance->uring;
+	uint64_t one = 1;
+
+	if (!u)
+		return;
+	instance->alive = false;
+	if (u->running) {
+		if (write(instance->evfd, &one, sizeof(one)) < 0)
+			DBG_ERROR("AXUDP:uring_stop", "Unable to wake up uring thread");
+		pthread_join(u->thread, NULL);
+	}
+	instance->uring = NULL;
+	close(instance->evfd);
+	instance->evfd = -1;
+	uring_free(u);
+}
+
+#endif /* AXUDP_URING */
@@ -0,0 +1,58 @@
+/*
+ *  Project: ax25c - File: uring.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file uring.h
+ * @brief io_uring transport of an AXUDP instance. Only available when
+ *        built with AXUDP_URING.
+ */
+#ifndef AXUDP_URING_H_
+#define AXUDP_URING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct exception;
+struct instance_handle;
+
+/**
+ * @brief Room in front of the payload for io_uring_recvmsg_out and the
+ *        source address of multishot recvmsg.
+ */
+#define URING_RECVMSG_ROOM 256
+
+/**
+ * @brief Check whether io_uring support is compiled in.
+ */
+extern bool uring_available(void);
+
+/**
+ * @brief Set up the ring, post the receives and start the uring thread.
+ * @param instance Instance with an open socket.
+ * @param ex Exception structure.
+ * @return Success indicator.
+ */
+extern bool uring_start(struct instance_handle *instance,
+		struct exception *ex);
+
+/**
+ * @brief Stop the uring thread and release the ring.
+ * @param instance Instance.
+ */
+extern void uring_stop(struct instance_handle *instance);
+
+#endif /* AXUDP_URING_H_ */
@@ -18,29 +18,150 @@
 #ifndef HOSTMODESERVER__INTERNAL_H_
 #define HOSTMODESERVER__INTERNAL_H_
 
+#include "../runtime/primbuffer.h"
+#include "../runtime/dls.h"
 #include "../serial/serial.h"
+#include "hostmode.h"
 
+#include <stdint.h>
+#include <stdbool.h>
 #include <pthread.h>
 
 #define MODULE_NAME "HOSTMODESERVER"
 
-#define S_SIO_BUF 257
+/* Size of the read buffer */
+#define S_RX_BUF 4096
+
+/* Size of an address text, callsign and digipeaters */
+#define S_ADDR 96
+
+/* Extended hostmode: G on this channel lists the channels with data */
+#define HM_POLL_CHANNEL 255
+
+/* Bits of a word of the readiness bitmaps */
+#define HM_WORD_BITS (8 * sizeof(unsigned long))
+
+/* Link states as reported by the L command */
+enum hm_link_state {
+	LINK_DISCONNECTED  = 0,
+	LINK_SETUP         = 1,
+	LINK_DISC_REQUEST  = 3,
+	LINK_INFO_TRANSFER = 4
+};
+
+/*
+ * A hostmode channel is a session of the peer DLS, clientHandle of the
+ * prims is the channel index. Every client owns a slot of channels + 1
+ * channels, the index is slot * (channels + 1) + the channel number of
+ * the client. Channel 0 of a slot is unproto.
+ */
+struct hm_channel {
+	unsigned int       i;
+	/* Under the instance lock */
+	bool               active;       /* The slot has a client */
+	enum hm_link_state state;
+	uint16_t           server_handle;
+	char               remote[S_ADDR];
+	/* Worker only */
+	char               mycall[S_ADDR];
+	primitive_t       *rx_cur;       /* Partly returned by G */
+	uint16_t           rx_off;
+	/* Queues, rx from the peer, tx from the client */
+	struct primbuffer  rx;
+	struct primbuffer  tx;
+	unsigned int       n_status;     /* Status prims in rx, atomic */
+};
+
+/* A hostmode client, the serial port or a socket connection */
+struct hm_client {
+	struct instance_handle *instance;
+	unsigned int            slot;
+	unsigned int            base;    /* Index of channel 0 of the slot */
+	int                     fd;      /* Socket, -1 for the serial port */
+	bool                    busy;    /* Waits for output to drain */
+	uint8_t                 rx_buf[S_RX_BUF];
+	size_t                  rx_off;  /* Received, not yet decoded */
+	size_t                  rx_len;
+	struct hm_decoder       decoder;
+	struct hm_writer        writer;
+};
 
 struct plugin_handle {
 	const char  *name;
 };
 
 struct instance_handle {
-	const char   *name;
+	const char        *name;
 	/* Settings */
-	const char   *comport;
-	unsigned int  baudrate;
-	unsigned int  channels;
+	const char        *transport;
+	const char        *comport;
+	unsigned int       baudrate;
+	const char        *host;
+	const char        *port;
+	const char        *path;
+	unsigned int       clients;
+	unsigned int       channels;
+	const char        *peer;
+	const char        *mycall;
 	/* State */
-	HANDLE        serial;
-	char          sio_buf[S_SIO_BUF];
-	pthread_t     thread;
-	volatile bool alive;
+	HANDLE             serial;
+	int                listen_fd;
+	int                epfd;
+	struct hm_client **client;  /* Per slot, NULL when free */
+	pthread_t          thread;
+	bool               thread_running;
+	volatile bool      alive;
+	/* Bridge */
+	dls_t              dls;
+	pthread_spinlock_t lock;
+	struct hm_channel *channel; /* n_channels */
+	unsigned int       n_channels;
+	/*
+	 * Bit per channel with something for G, set by the peer and cleared
+	 * by the worker with atomic ops, and bit per channel with data for
+	 * the peer, worker only. A poll costs work for ready channels only.
+	 */
+	unsigned long     *rx_ready;
+	unsigned long     *tx_ready;
+	unsigned int       n_words;
 };
 
+/* Channel number of the client */
+static inline unsigned int hm_local(struct instance_handle *instance,
+		unsigned int i)
+{
+	return i % (instance->channels + 1);
+}
+
+/* module.c */
+extern bool hm_on_frame(void *ctx, int channel, int cmd, char *body,
+		int len);
+
+/* channel.c */
+extern bool channels_start(struct instance_handle *instance,
+		struct exception *ex);
+extern void channels_stop(struct instance_handle *instance);
+extern void channels_attach(struct hm_client *client);
+extern void channels_detach(struct hm_client *client);
+extern void channel_connect(struct hm_client *client,
+		unsigned int channel, const char *addr);
+extern void channel_disconnect(struct hm_client *client,
+		unsigned int channel);
+extern void channel_mycall(struct hm_client *client,
+		unsigned int channel, const char *call);
+extern void channel_send(struct hm_client *client,
+		unsigned int channel, const char *data, int len);
+extern void channel_poll(struct hm_client *client,
+		unsigned int channel);
+extern void channels_poll(struct hm_client *client);
+extern void channel_status(struct hm_client *client,
+		unsigned int channel);
+extern void channels_transmit(struct instance_handle *instance);
+
+/* server.c */
+extern bool server_start(struct instance_handle *instance,
+		struct exception *ex);
+extern void *server_worker(void *id);
+extern void server_stop(struct instance_handle *instance);
+
 #endif /* HOSTMODESERVER__INTERNAL_H_ */
@@ -0,0 +1,672 @@
+/*
+ *  Project: ax25c - File: channel.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../config/configuration.h"
+#include "../runtime/runtime.h"
+#include "../runtime/dlsap.h"
+#include "../runtime/dl_prim.h"
+
+#include "_internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+static inline void lock(struct instance_handle *instance)
+{
+	int erc = pthread_spin_lock(&instance->lock);
+	assert(erc == 0);
+}
+
+static inline void unlock(struct instance_handle *instance)
+{
+	int erc = pthread_spin_unlock(&instance->lock);
+	assert(erc == 0);
+}
+
+static inline void set_ready(unsigned long *map, unsigned int i)
+{
+	__atomic_fetch_or(&map[i / HM_WORD_BITS], 1UL << (i % HM_WORD_BITS),
+			__ATOMIC_SEQ_CST);
+}
+
+static inline void clear_ready(unsigned long *map, unsigned int i)
+{
+	__atomic_fetch_and(&map[i / HM_WORD_BITS], ~(1UL << (i % HM_WORD_BITS)),
+			__ATOMIC_SEQ_CST);
+}
+
+/* Clear the rx bit of an empty channel, the peer may just have pushed */
+static inline void rx_idle(struct instance_handle *instance,
+		struct hm_channel *ch)
+{
+	if (ch->rx_cur || primbuffer_size(&ch->rx))
+		return;
+	clear_ready(instance->rx_ready, ch->i);
+	if (primbuffer_size(&ch->rx))
+		set_ready(instance->rx_ready, ch->i);
+}
+
+static void log_ex(const char *func, struct exception *ex)
+{
+	ax25c_log(DEBUG_LEVEL_ERROR,
+			MODULE_NAME ":%s: Error no %i[%s] in %s:%s: %s[%s]",
+			func, ex->erc, strerror(ex->erc),
+			STRING_C(ex->module), STRING_C(ex->function),
+			STRING_C(ex->message), STRING_C(ex->param));
+}
+
+static void drain(struct primbuffer *pb)
+{
+	primitive_t *prim;
+
+	while ((prim = primbuffer_read_nonblock(pb, NULL)))
+		del_prim(prim);
+}
+
+/*
+ * From the peer, runs on the thread of the peer
+ */
+
+static void send_disconnect(struct instance_handle *instance,
+		unsigned int channel, uint16_t server_handle)
+{
+	primitive_t *prim;
+	EXCEPTION(ex);
+
+	prim = new_DL_DISCONNECT_Request(channel, server_handle, &ex);
+	if (!prim || !dlsap_write_owned(instance->dls.peer, prim, false, &ex))
+		log_ex("send_disconnect", &ex);
+}
+
+/* Returns the channel to queue prim on or NULL */
+static struct hm_channel *on_peer_prim(struct instance_handle *instance,
+		primitive_t *prim)
+{
+	struct hm_channel *ch = NULL;
+	char addr[S_ADDR];
+	unsigned int i;
+
+	if (prim->cmd == DL_CONNECT_INDICATION) {
+		if (get_DL_src_cstr(prim, addr, sizeof(addr), NULL) < 0)
+			strcpy(addr, "?");
+		lock(instance); /*-----------------------------------------------v*/
+		for (i = 0; i < instance->n_channels; ++i) {
+			if (instance->channel[i].active && hm_local(instance, i) &&
+					(instance->channel[i].state == LINK_DISCONNECTED)) {
+				ch = &instance->channel[i];
+				ch->state = LINK_INFO_TRANSFER;
+				ch->server_handle = prim->serverHandle;
+				strcpy(ch->remote, addr);
+				break;
+			}
+		} /* end for */
+		unlock(instance); /*---------------------------------------------^*/
+		if (!ch) {
+			DBG_INFO("No free channel for", addr);
+			send_disconnect(instance, 0, prim->serverHandle);
+		}
+		return ch;
+	}
+	if ((prim->clientHandle >= instance->n_channels) ||
+			!hm_local(instance, prim->clientHandle))
+		return NULL;
+	ch = &instance->channel[prim->clientHandle];
+	switch (prim->cmd) {
+	case DL_CONNECT_CONFIRM:
+		lock(instance); /*-----------------------------------------------v*/
+		if (!ch->active || (ch->state == LINK_DISC_REQUEST)) {
+			/* D or the client left while the link was set up */
+			unlock(instance); /*-----------------------------------------^*/
+			send_disconnect(instance, ch->i, prim->serverHandle);
+			return NULL;
+		}
+		ch->state = LINK_INFO_TRANSFER;
+		ch->server_handle = prim->serverHandle;
+		unlock(instance); /*---------------------------------------------^*/
+		return ch;
+	case DL_DISCONNECT_INDICATION:
+	case DL_DISCONNECT_CONFIRM:
+		lock(instance); /*-----------------------------------------------v*/
+		ch->state = LINK_DISCONNECTED;
+		if (!ch->active)
+			ch = NULL;
+		unlock(instance); /*---------------------------------------------^*/
+		return ch;
+	case DL_DATA_INDICATION:
+		/* The flag is checked without the lock, a frame that slips
+		 * through is drained when the slot is attached again */
+		return ch->active ? ch : NULL;
+	default:
+		return NULL;
+	} /* end switch */
+}
+
+static bool peer_write(dls_t *dls, primitive_t *prim, bool expedited,
+		bool owned, struct exception *ex)
+{
+	struct instance_handle *instance;
+	struct hm_channel *ch;
+
+	assert(dls);
+	assert(prim);
+	instance = dls->session;
+	if (!instance->alive) {
+		exception_fill(ex, EPIPE, MODULE_NAME, "on_write",
+				"Instance not running", instance->name);
+		return false;
+	}
+	ch = (prim->protocol == DL) ? on_peer_prim(instance, prim) : NULL;
+	if (!ch) {
+		if (owned)
+			del_prim(prim);
+		return true;
+	}
+	if (!owned)
+		use_prim(prim);
+	/* Count first, so that L never sees more status than prims */
+	if (prim->cmd != DL_DATA_INDICATION)
+		__atomic_add_fetch(&ch->n_status, 1, __ATOMIC_RELAXED);
+	primbuffer_push_owned(&ch->rx, prim, false);
+	set_ready(instance->rx_ready, ch->i);
+	return true;
+}
+
+static bool on_write(dls_t *dls, primitive_t *prim, bool expedited,
+		struct exception *ex)
+{
+	return peer_write(dls, prim, expedited, false, ex);
+}
+
+static bool on_write_owned(dls_t *dls, primitive_t *prim, bool expedited,
+		struct exception *ex)
+{
+	if (peer_write(dls, prim, expedited, true, ex))
+		return true;
+	del_prim(prim);
+	return false;
+}
+
+/*
+ * Commands of the client, run on the worker
+ */
+
+void channel_connect(struct hm_client *client, unsigned int channel,
+		const char *addr)
+{
+	struct instance_handle *instance = client->instance;
+	struct hm_channel *ch = &instance->channel[client->base + channel];
+	enum hm_link_state state;
+	primitive_t *prim;
+	EXCEPTION(ex);
+
+	while (*addr == ' ')
+		++addr;
+	if (strlen(addr) >= S_ADDR) {
+		hm_put_cstr(&client->writer, channel, HM_ERROR, "INVALID CALLSIGN");
+		return;
+	}
+	lock(instance); /*---------------------------------------------------v*/
+	state = ch->state;
+	if (!*addr) {
+		unlock(instance); /*---------------------------------------------^*/
+		if ((channel == 0) || (state != LINK_DISCONNECTED))
+			hm_put_cstr(&client->writer, channel, HM_OK_TEXT, ch->remote);
+		else
+			hm_put_cstr(&client->writer, channel, HM_OK_TEXT,
+					"CHANNEL NOT CONNECTED");
+		return;
+	}
+	if (channel == 0) {
+		/* Destination of unproto frames */
+		strcpy(ch->remote, addr);
+		unlock(instance); /*---------------------------------------------^*/
+		hm_put_ok(&client->writer, channel);
+		return;
+	}
+	if (state == LINK_DISCONNECTED) {
+		ch->state = LINK_SETUP;
+		strcpy(ch->remote, addr);
+	}
+	unlock(instance); /*-------------------------------------------------^*/
+	if (state != LINK_DISCONNECTED) {
+		hm_put_cstr(&client->writer, channel, HM_ERROR,
+				"CHANNEL ALREADY CONNECTED");
+		return;
+	}
+	drain(&ch->tx);
+	prim = new_DL_CONNECT_Request(ch->i,
+			(const uint8_t*)addr, strlen(addr),
+			(const uint8_t*)ch->mycall, strlen(ch->mycall), &ex);
+	if (!prim || !dlsap_write_owned(instance->dls.peer, prim, false, &ex)) {
+		lock(instance); /*-----------------------------------------------v*/
+		ch->state = LINK_DISCONNECTED;
+		unlock(instance); /*---------------------------------------------^*/
+		hm_put_cstr(&client->writer, channel, HM_ERROR,
+				STRING_C(ex.message));
+		return;
+	}
+	hm_put_ok(&client->writer, channel);
+}
+
+void channel_disconnect(struct hm_client *client, unsigned int channel)
+{
+	struct instance_handle *instance = client->instance;
+	struct hm_channel *ch = &instance->channel[client->base + channel];
+	enum hm_link_state state;
+	uint16_t server_handle;
+
+	lock(instance); /*---------------------------------------------------v*/
+	state = ch->state;
+	server_handle = ch->server_handle;
+	if ((state == LINK_SETUP) || (state == LINK_INFO_TRANSFER))
+		ch->state = LINK_DISC_REQUEST;
+	unlock(instance); /*-------------------------------------------------^*/
+	if ((channel == 0) || (state == LINK_DISCONNECTED)) {
+		hm_put_cstr(&client->writer, channel, HM_ERROR,
+				"CHANNEL NOT CONNECTED");
+		return;
+	}
+	/* During link setup the confirm brings the server handle */
+	if (state == LINK_INFO_TRANSFER)
+		send_disconnect(instance, ch->i, server_handle);
+	hm_put_ok(&client->writer, channel);
+}
+
+void channel_mycall(struct hm_client *client, unsigned int channel,
+		const char *call)
+{
+	struct hm_channel *ch = &client->instance->channel[client->base + channel];
+
+	while (*call == ' ')
+		++call;
+	if (!*call) {
+		hm_put_cstr(&client->writer, channel, HM_OK_TEXT, ch->mycall);
+		return;
+	}
+	if (strlen(call) >= S_ADDR) {
+		hm_put_cstr(&client->writer, channel, HM_ERROR, "INVALID CALLSIGN");
+		return;
+	}
+	strcpy(ch->mycall, call);
+	hm_put_ok(&client->writer, channel);
+}
+
+void channel_send(struct hm_client *client, unsigned int channel,
+		const char *data, int len)
+{
+	struct instance_handle *instance = client->instance;
+	struct hm_channel *ch = &instance->channel[client->base + channel];
+	enum hm_link_state state;
+	primitive_t *prim;
+	EXCEPTION(ex);
+
+	lock(instance); /*---------------------------------------------------v*/
+	state = ch->state;
+	unlock(instance); /*-------------------------------------------------^*/
+	if (channel == 0) {
+		prim = new_DL_UNIT_DATA_Request(ch->i,
+				(const uint8_t*)ch->remote, strlen(ch->remote),
+				(const uint8_t*)ch->mycall, strlen(ch->mycall),
+				(const uint8_t*)data, len, &ex);
+	} else if ((state == LINK_SETUP) || (state == LINK_INFO_TRANSFER)) {
+		/* The server handle is filled in when it goes out */
+		prim = new_DL_DATA_Request(ch->i, 0, (const uint8_t*)data, len, &ex);
+	} else {
+		hm_put_cstr(&client->writer, channel, HM_ERROR,
+				"CHANNEL NOT CONNECTED");
+		return;
+	}
+	if (!prim) {
+		hm_put_cstr(&client->writer, channel, HM_ERROR,
+				STRING_C(ex.message));
+		return;
+	}
+	primbuffer_push_owned(&ch->tx, prim, false);
+	set_ready(instance->tx_ready, ch->i);
+	hm_put_ok(&client->writer, channel);
+}
+
+/* Next prim of rx, the current one stays until it is returned */
+static inline primitive_t *rx_peek(struct hm_channel *ch)
+{
+	if (!ch->rx_cur) {
+		ch->rx_cur = primbuffer_read_nonblock(&ch->rx, NULL);
+		ch->rx_off = 0;
+	}
+	return ch->rx_cur;
+}
+
+static inline void rx_done(struct hm_channel *ch)
+{
+	del_prim(ch->rx_cur);
+	ch->rx_cur = NULL;
+	ch->rx_off = 0;
+}
+
+static void put_status(struct hm_client *client, struct hm_channel *ch,
+		primitive_t *prim)
+{
+	struct instance_handle *instance = client->instance;
+	unsigned int channel = hm_local(instance, ch->i);
+	char addr[S_ADDR];
+	char text[S_ADDR + 32];
+
+	lock(instance); /*---------------------------------------------------v*/
+	strcpy(addr, ch->remote);
+	unlock(instance); /*-------------------------------------------------^*/
+	switch (prim->cmd) {
+	case DL_CONNECT_CONFIRM:
+		snprintf(text, sizeof(text), "(%u) CONNECTED to %s", channel, addr);
+		break;
+	case DL_CONNECT_INDICATION:
+		if (get_DL_src_cstr(prim, addr, sizeof(addr), NULL) < 0)
+			strcpy(addr, "?");
+		snprintf(text, sizeof(text), "(%u) CONNECTED fm %s", channel, addr);
+		break;
+	default:
+		snprintf(text, sizeof(text), "(%u) DISCONNECTED fm %s", channel, addr);
+		break;
+	} /* end switch */
+	hm_put_cstr(&client->writer, channel, HM_LINK, text);
+}
+
+void channel_poll(struct hm_client *client, unsigned int channel)
+{
+	struct instance_handle *instance = client->instance;
+	struct hm_channel *ch = &instance->channel[client->base + channel];
+	uint8_t buf[HM_BODY_MAX];
+	primitive_t *prim;
+	prim_param_t *param;
+	size_t n = 0, m, size;
+
+	/* Fill one info response with as much queued data as fits */
+	while (n < HM_BODY_MAX) {
+		prim = rx_peek(ch);
+		if (!prim)
+			break;
+		if (prim->cmd != DL_DATA_INDICATION) {
+			if (n)
+				break; /* Next G */
+			put_status(client, ch, prim);
+			rx_done(ch);
+			__atomic_sub_fetch(&ch->n_status, 1, __ATOMIC_RELAXED);
+			rx_idle(instance, ch);
+			return;
+		}
+		param = get_DL_data_param(prim);
+		size = get_prim_param_size(param);
+		m = size - ch->rx_off;
+		if (m > HM_BODY_MAX - n)
+			m = HM_BODY_MAX - n;
+		memcpy(&buf[n], get_prim_param_data(param) + ch->rx_off, m);
+		n += m;
+		ch->rx_off += m;
+		if (ch->rx_off >= size)
+			rx_done(ch);
+	} /* end while */
+	rx_idle(instance, ch);
+	if (n)
+		hm_put_data(&client->writer, channel, HM_DATA, buf, n);
+	else
+		hm_put_ok(&client->writer, channel);
+}
+
+/* List the channels of the client with something for G, channel + 1 each */
+void channels_poll(struct hm_client *client)
+{
+	struct instance_handle *instance = client->instance;
+	unsigned int first = client->base;
+	unsigned int last = client->base + instance->channels;
+	char list[HM_BODY_MAX + 1];
+	unsigned long word;
+	unsigned int w, i, n = 0;
+
+	for (w = first / HM_WORD_BITS; w <= last / HM_WORD_BITS; ++w) {
+		word = __atomic_load_n(&instance->rx_ready[w], __ATOMIC_SEQ_CST);
+		while (word) {
+			i = w * HM_WORD_BITS + __builtin_ctzl(word);
+			word &= word - 1;
+			if ((i >= first) && (i <= last))
+				list[n++] = (char)(i - first + 1);
+		} /* end while */
+	} /* end for */
+	list[n] = '\0';
+	hm_put_cstr(&client->writer, HM_POLL_CHANNEL, HM_OK_TEXT, list);
+}
+
+void channel_status(struct hm_client *client, unsigned int channel)
+{
+	struct instance_handle *instance = client->instance;
+	struct hm_channel *ch = &instance->channel[client->base + channel];
+	unsigned int status, frames;
+	enum hm_link_state state;
+	char text[64];
+
+	status = __atomic_load_n(&ch->n_status, __ATOMIC_RELAXED);
+	frames = primbuffer_size(&ch->rx) + (ch->rx_cur ? 1 : 0);
+	frames = (frames > status) ? frames - status : 0;
+	if (channel == 0) {
+		snprintf(text, sizeof(text), "%u %u", status, frames);
+	} else {
+		lock(instance); /*-----------------------------------------------v*/
+		state = ch->state;
+		unlock(instance); /*---------------------------------------------^*/
+		/* Status, received, not yet sent, unacked, tries, link state */
+		snprintf(text, sizeof(text), "%u %u %zu 0 0 %u", status, frames,
+				primbuffer_size(&ch->tx), (unsigned int)state);
+	}
+	hm_put_cstr(&client->writer, channel, HM_OK_TEXT, text);
+}
+
+/* Hand the queued data of the client to the peer */
+void channels_transmit(struct instance_handle *instance)
+{
+	struct hm_channel *ch;
+	enum hm_link_state state;
+	uint16_t server_handle;
+	primitive_t *prim;
+	unsigned long word;
+	unsigned int w, i;
+	EXCEPTION(ex);
+
+	for (w = 0; w < instance->n_words; ++w) {
+		word = instance->tx_ready[w];
+		while (word) {
+			i = w * HM_WORD_BITS + __builtin_ctzl(word);
+			word &= word - 1;
+			ch = &instance->channel[i];
+			lock(instance); /*-------------------------------------------v*/
+			state = ch->state;
+			server_handle = ch->server_handle;
+			unlock(instance); /*-----------------------------------------^*/
+			if (hm_local(instance, i) && (state != LINK_INFO_TRANSFER)) {
+				/* Held during link setup, dropped after a disconnect */
+				if (state != LINK_SETUP) {
+					drain(&ch->tx);
+					clear_ready(instance->tx_ready, i);
+				}
+				continue;
+			}
+			while ((prim = primbuffer_read_nonblock(&ch->tx, NULL))) {
+				prim->serverHandle = server_handle;
+				if (!dlsap_write_owned(instance->dls.peer, prim, false, &ex)) {
+					log_ex("channels_transmit", &ex);
+					EXCEPTION_RESET(ex);
+				}
+			} /* end while */
+			clear_ready(instance->tx_ready, i);
+		} /* end while */
+	} /* end for */
+}
+
+/*
+ * Instance
+ */
+
+bool channels_start(struct instance_handle *instance, struct exception *ex)
+{
+	struct hm_channel *ch;
+	unsigned int i;
+	int erc;
+
+	if (strlen(instance->mycall) >= S_ADDR) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "channels_start",
+				"Invalid mycall", instance->name);
+		return false;
+	}
+	instance->dls.peer = dlsap_lookup_dls(instance->peer);
+	if (!instance->dls.peer) {
+		exception_fill(ex, ENOENT, MODULE_NAME, "channels_start",
+				"SAP not found", instance->peer);
+		return false;
+	}
+	instance->dls.name = instance->name;
+	instance->dls.on_write = on_write;
+	instance->dls.on_write_owned = on_write_owned;
+	instance->dls.session = instance;
+	instance->n_channels = instance->clients * (instance->channels + 1);
+	instance->n_words = (instance->n_channels + HM_WORD_BITS - 1) /
+			HM_WORD_BITS;
+	instance->channel = calloc(instance->n_channels,
+			sizeof(struct hm_channel));
+	instance->rx_ready = calloc(instance->n_words, sizeof(unsigned long));
+	instance->tx_ready = calloc(instance->n_words, sizeof(unsigned long));
+	if (!instance->channel || !instance->rx_ready || !instance->tx_ready) {
+		free(instance->channel);
+		free(instance->rx_ready);
+		free(instance->tx_ready);
+		instance->channel = NULL;
+		instance->rx_ready = NULL;
+		instance->tx_ready = NULL;
+		exception_fill(ex, ENOMEM, MODULE_NAME, "channels_start",
+				"Out of memory", instance->name);
+		return false;
+	}
+	erc = pthread_spin_init(&instance->lock, PTHREAD_PROCESS_PRIVATE);
+	assert(erc == 0);
+	for (i = 0; i < instance->n_channels; ++i) {
+		ch = &instance->channel[i];
+		ch->i = i;
+		ch->active = false;
+		ch->state = LINK_DISCONNECTED;
+		primbuffer_init(&ch->rx);
+		primbuffer_init(&ch->tx);
+	} /* end for */
+	if (!dlsap_open(instance->dls.peer, &instance->dls, ex)) {
+		instance->dls.peer = NULL;
+		channels_stop(instance);
+		return false;
+	}
+	return true;
+}
+
+void channels_stop(struct instance_handle *instance)
+{
+	struct hm_channel *ch;
+	unsigned int i;
+
+	if (!instance->channel)
+		return;
+	if (instance->dls.peer) {
+		dlsap_close(instance->dls.peer);
+		instance->dls.peer = NULL;
+	}
+	for (i = 0; i < instance->n_channels; ++i) {
+		ch = &instance->channel[i];
+		del_prim(ch->rx_cur);
+		drain(&ch->rx);
+		drain(&ch->tx);
+		primbuffer_destroy(&ch->rx);
+		primbuffer_destroy(&ch->tx);
+	} /* end for */
+	pthread_spin_destroy(&instance->lock);
+	free(instance->channel);
+	free(instance->rx_ready);
+	free(instance->tx_ready);
+	instance->channel = NULL;
+	instance->rx_ready = NULL;
+	instance->tx_ready = NULL;
+}
+
+/* Forget whatever a previous client of the slot left */
+static void reset_slot(struct hm_client *client)
+{
+	struct instance_handle *instance = client->instance;
+	struct hm_channel *ch;
+	unsigned int i;
+
+	for (i = 0; i <= instance->channels; ++i) {
+		ch = &instance->channel[client->base + i];
+		del_prim(ch->rx_cur);
+		ch->rx_cur = NULL;
+		ch->rx_off = 0;
+		drain(&ch->rx);
+		drain(&ch->tx);
+		__atomic_store_n(&ch->n_status, 0, __ATOMIC_RELAXED);
+		clear_ready(instance->rx_ready, ch->i);
+		clear_ready(instance->tx_ready, ch->i);
+	} /* end for */
+}
+
+void channels_attach(struct hm_client *client)
+{
+	struct instance_handle *instance = client->instance;
+	struct hm_channel *ch;
+	unsigned int i;
+
+	client->base = client->slot * (instance->channels + 1);
+	reset_slot(client);
+	for (i = 0; i <= instance->channels; ++i) {
+		ch = &instance->channel[client->base + i];
+		strcpy(ch->mycall, instance->mycall);
+		strcpy(ch->remote, i ? "" : "CQ");
+	} /* end for */
+	lock(instance); /*---------------------------------------------------v*/
+	for (i = 0; i <= instance->channels; ++i) {
+		ch = &instance->channel[client->base + i];
+		ch->active = true;
+		ch->state = LINK_DISCONNECTED;
+	} /* end for */
+	unlock(instance); /*-------------------------------------------------^*/
+}
+
+void channels_detach(struct hm_client *client)
+{
+	struct instance_handle *instance = client->instance;
+	enum hm_link_state state[HM_POLL_CHANNEL];
+	uint16_t server_handle[HM_POLL_CHANNEL];
+	struct hm_channel *ch;
+	unsigned int i;
+
+	lock(instance); /*---------------------------------------------------v*/
+	for (i = 0; i <= instance->channels; ++i) {
+		ch = &instance->channel[client->base + i];
+		ch->active = false;
+		state[i] = ch->state;
+		server_handle[i] = ch->server_handle;
+		ch->state = LINK_DISCONNECTED;
+	} /* end for */
+	unlock(instance); /*-------------------------------------------------^*/
+	/* Links in setup are taken down when their confirm arrives */
+	for (i = 1; i <= instance->channels; ++i)
+		if (state[i] == LINK_INFO_TRANSFER)
+			send_disconnect(instance, client->base + i, server_handle[i]);
+	reset_slot(client);
+}
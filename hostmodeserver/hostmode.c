@@ -0,0 +1,167 @@
+/*
+ *  Project: ax25c - File: hostmode.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hostmode.h"
+
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+/*
+ * Decoder
+ */
+
+void hm_decoder_reset(struct hm_decoder *d)
+{
+	assert(d);
+	d->n_head = 0;
+	d->n_body = 0;
+}
+
+size_t hm_decode(struct hm_decoder *d, const uint8_t *p, size_t n,
+		hm_frame_func f, void *ctx)
+{
+	const uint8_t *start = p;
+	const uint8_t *end = p + n;
+	bool more;
+	size_t want, m;
+
+	assert(d);
+	assert(f);
+	while (p < end) {
+		if (d->n_head < sizeof(d->head)) {
+			m = sizeof(d->head) - d->n_head;
+			if (m > (size_t)(end - p))
+				m = end - p;
+			memcpy(&d->head[d->n_head], p, m);
+			d->n_head += m;
+			p += m;
+			continue;
+		}
+		want = (size_t)d->head[2] + 1 - d->n_body;
+		m = ((size_t)(end - p) < want) ? (size_t)(end - p) : want;
+		memcpy(&d->body[d->n_body], p, m);
+		d->n_body += m;
+		p += m;
+		if (m < want)
+			break;
+		d->body[d->n_body] = '\0';
+		more = f(ctx, d->head[0], d->head[1], d->body, d->n_body);
+		hm_decoder_reset(d);
+		if (!more)
+			break;
+	} /* end while */
+	return p - start;
+}
+
+/*
+ * Writer
+ */
+
+void hm_writer_init(struct hm_writer *w, hm_write_func out, void *ctx)
+{
+	assert(w);
+	assert(out);
+	w->out = out;
+	w->ctx = ctx;
+	w->len = 0;
+	w->error = 0;
+}
+
+int hm_flush(struct hm_writer *w)
+{
+	size_t done = 0;
+	int n, erc;
+
+	assert(w);
+	while (!w->error && (done < w->len)) {
+		n = w->out(w->ctx, &w->buf[done], w->len - done);
+		if (n == -EAGAIN) {
+			/* Keep the rest for the next flush */
+			memmove(w->buf, &w->buf[done], w->len - done);
+			w->len -= done;
+			return -EAGAIN;
+		}
+		if (n < 0) {
+			if (n != -EINTR)
+				w->error = n;
+			continue;
+		}
+		done += n;
+	} /* end while */
+	w->len = 0;
+	erc = w->error;
+	w->error = 0;
+	return erc;
+}
+
+/* Make room for n octets */
+static inline uint8_t *reserve(struct hm_writer *w, size_t n)
+{
+	uint8_t *p;
+
+	assert(n <= HM_RESPONSE_MAX);
+	if (w->len + n > HM_OUT_SIZE) {
+		/* Keep the error for the flush of the cycle. A non-blocking
+		 * output checks hm_room() before each command instead. */
+		int erc = hm_flush(w);
+		if (erc == -EAGAIN)
+			erc = -ENOBUFS;
+		if (erc)
+			w->error = erc;
+		if (w->len + n > HM_OUT_SIZE)
+			w->len = 0; /* Lost, error reported */
+	}
+	p = &w->buf[w->len];
+	w->len += n;
+	return p;
+}
+
+void hm_put_ok(struct hm_writer *w, int channel)
+{
+	uint8_t *p = reserve(w, 2);
+
+	p[0] = (uint8_t)channel;
+	p[1] = HM_OK;
+}
+
+void hm_put_cstr(struct hm_writer *w, int channel, int code, const char *s)
+{
+	size_t l;
+	uint8_t *p;
+
+	assert(s);
+	l = strlen(s);
+	assert(l <= HM_BODY_MAX);
+	p = reserve(w, l + 3);
+	p[0] = (uint8_t)channel;
+	p[1] = (uint8_t)code;
+	memcpy(&p[2], s, l + 1);
+}
+
+void hm_put_data(struct hm_writer *w, int channel, int code,
+		const void *data, size_t n)
+{
+	uint8_t *p;
+
+	assert((n >= 1) && (n <= HM_BODY_MAX));
+	p = reserve(w, n + 3);
+	p[0] = (uint8_t)channel;
+	p[1] = (uint8_t)code;
+	p[2] = (uint8_t)(n - 1);
+	memcpy(&p[3], data, n);
+}
@@ -0,0 +1,151 @@
+/*
+ *  Project: ax25c - File: hostmode.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file hostmode.h
+ * @brief WA8DED hostmode framing: Incremental decoder and buffered
+ *        response writer.
+ *
+ * A host frame is channel, code, length - 1 and the body. The decoder
+ * cuts frames out of whatever a read returned, the writer collects the
+ * responses of one poll cycle and writes them at once.
+ */
+#ifndef HOSTMODESERVER_HOSTMODE_H_
+#define HOSTMODESERVER_HOSTMODE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Max. body length of a host frame */
+#define HM_BODY_MAX 256
+
+/* Max. size of one response */
+#define HM_RESPONSE_MAX (HM_BODY_MAX + 3)
+
+/* Size of the response buffer */
+#define HM_OUT_SIZE 4096
+
+/**
+ * @brief Response codes.
+ */
+enum hm_code {
+	HM_OK        = 0, /**< Success, no text.             */
+	HM_OK_TEXT   = 1, /**< Success, text follows.        */
+	HM_ERROR     = 2, /**< Error, text follows.          */
+	HM_LINK      = 3, /**< Link status, text follows.    */
+	HM_MON_HEAD  = 4, /**< Monitor header, no info.      */
+	HM_MON_INFO  = 5, /**< Monitor header, info follows. */
+	HM_MON_DATA  = 6, /**< Monitor info.                 */
+	HM_DATA      = 7  /**< Connected info.               */
+};
+
+/**
+ * @brief Receives a decoded host frame. The body is NUL terminated.
+ * @param cmd 0 for data, 1 for a command.
+ * @return false to stop decoding after this frame.
+ */
+typedef bool (*hm_frame_func)(void *ctx, int channel, int cmd, char *body,
+		int len);
+
+/**
+ * @brief Writes a buffer, returns the number of octets written or
+ *        -errno. A non-blocking output returns -EAGAIN when it is full.
+ */
+typedef int (*hm_write_func)(void *ctx, const uint8_t *p, size_t n);
+
+/**
+ * @brief Decoder state, survives between reads.
+ */
+struct hm_decoder {
+	uint8_t      head[3];               /**< Header collected so far. */
+	unsigned int n_head;                /**< Octets in head.          */
+	char         body[HM_BODY_MAX + 1]; /**< Body collected so far.   */
+	unsigned int n_body;                /**< Octets in body.          */
+};
+
+/**
+ * @brief Response writer state.
+ */
+struct hm_writer {
+	hm_write_func out;              /**< Output function. */
+	void         *ctx;              /**< Its context.     */
+	uint8_t       buf[HM_OUT_SIZE]; /**< Pending output.  */
+	size_t        len;              /**< Octets in buf.   */
+	int           error;            /**< First -errno.    */
+};
+
+/**
+ * @brief Initialize or reset a decoder.
+ */
+extern void hm_decoder_reset(struct hm_decoder *d);
+
+/**
+ * @brief Decode a chunk of received octets. Calls f for every complete
+ *        host frame.
+ * @return Octets consumed, less than n when f stopped the decoder.
+ */
+extern size_t hm_decode(struct hm_decoder *d, const uint8_t *p, size_t n,
+		hm_frame_func f, void *ctx);
+
+/**
+ * @brief Initialize a writer.
+ */
+extern void hm_writer_init(struct hm_writer *w, hm_write_func out, void *ctx);
+
+/**
+ * @brief Append a response without text.
+ */
+extern void hm_put_ok(struct hm_writer *w, int channel);
+
+/**
+ * @brief Append a response with a NUL terminated text.
+ */
+extern void hm_put_cstr(struct hm_writer *w, int channel, int code,
+		const char *s);
+
+/**
+ * @brief Append a response with data of 1..HM_BODY_MAX octets.
+ */
+extern void hm_put_data(struct hm_writer *w, int channel, int code,
+		const void *p, size_t n);
+
+/**
+ * @brief Write everything appended.
+ * @return 0, -EAGAIN when output is left over for the next flush or
+ *         the first -errno since the last flush.
+ */
+extern int hm_flush(struct hm_writer *w);
+
+/**
+ * @brief Check if one more response fits without a flush.
+ */
+static inline bool hm_room(const struct hm_writer *w)
+{
+	return w->len + HM_RESPONSE_MAX <= HM_OUT_SIZE;
+}
+
+/**
+ * @brief Check if output is left over.
+ */
+static inline bool hm_pending(const struct hm_writer *w)
+{
+	return w->len != 0;
+}
+
+#endif /* HOSTMODESERVER_HOSTMODE_H_ */
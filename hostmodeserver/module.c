@@ -23,7 +23,7 @@
 #include "_internal.h"
 
 #include <unistd.h>
-#include <signal.h>
+#include <errno.h>
 #include <assert.h>
 
 #undef DEBUG_POLLS
@@ -35,307 +35,286 @@ static struct  setting_descriptor plugin_settings_descriptor[] = {
 };
 
 static struct setting_descriptor instance_settings_descriptor[] = {
-		{ "comport",  CSTR_T, offsetof(struct instance_handle, comport),  "COM1"   },
-		{ "baudrate", UINT_T, offsetof(struct instance_handle, baudrate), "9600"   },
-		{ "channels", UINT_T, offsetof(struct instance_handle, channels), "4"      },
+		{ "transport", CSTR_T, offsetof(struct instance_handle, transport), "serial"    },
+		{ "comport",   CSTR_T, offsetof(struct instance_handle, comport),   "COM1"      },
+		{ "baudrate",  UINT_T, offsetof(struct instance_handle, baudrate),  "9600"      },
+		{ "host",      CSTR_T, offsetof(struct instance_handle, host),      "localhost" },
+		{ "port",      CSTR_T, offsetof(struct instance_handle, port),      "8010"      },
+		{ "path",      CSTR_T, offsetof(struct instance_handle, path),      "/tmp/ax25c_hostmode" },
+		{ "clients",   UINT_T, offsetof(struct instance_handle, clients),   "16"        },
+		{ "channels",  UINT_T, offsetof(struct instance_handle, channels),  "4"         },
+		{ "peer",      CSTR_T, offsetof(struct instance_handle, peer),      "AX25"      },
+		{ "mycall",    CSTR_T, offsetof(struct instance_handle, mycall),    "NOCALL"    },
 		{ NULL }
 };
 
-static int read_n(HANDLE h, char *pb, int cb)
+static int serial_write(void *ctx, const uint8_t *p, size_t n)
 {
-	int l = 0, n;
-	while (l < cb) {
-		n = readFromSerialPort(h, &pb[l], cb - l);
-		if (n < 0)
-			return n;
-		l += n;
-	} /* end while */
-	return l;
-}
+	struct instance_handle *instance = ctx;
 
-static int write_n(HANDLE h, char *pb, int cb)
-{
-	int l = 0, n;
-	while (l < cb) {
-		n = writeToSerialPort(h, &pb[l], cb - l);
-		if (n < 0)
-			return n;
-		l += n;
-	} /* end while */
-	return l;
+	return writeToSerialPort(instance->serial, (char*)p, (int)n);
 }
 
-static inline int write_cstr(struct instance_handle *instance,
+static inline void write_cstr(struct hm_client *client,
 		int channel, int code, const char *s)
 {
-	assert(instance);
+	assert(client);
 	assert(s);
-	int l = strlen(s);
-	assert(l < S_SIO_BUF - 3);
-	instance->sio_buf[0] = channel;
-	instance->sio_buf[1] = code;
-	memcpy(&instance->sio_buf[2], s, l+1);
 #ifdef DEBUG_POLLS
 	ax25c_log(DEBUG_LEVEL_DEBUG,
 			MODULE_NAME ":worker:response [%i,%i] \"%s\"",
 			channel, code, s);
 #endif
-	return write_n(instance->serial, instance->sio_buf, l+3);
+	hm_put_cstr(&client->writer, channel, code, s);
 }
 
-static inline int write_ok(struct instance_handle *instance,
+static inline void write_ok(struct hm_client *client,
 		int channel)
 {
-	assert(instance);
-	instance->sio_buf[0] = channel;
-	instance->sio_buf[1] = 0;
+	assert(client);
 #ifdef DEBUG_POLLS
 	ax25c_log(DEBUG_LEVEL_DEBUG,
 			MODULE_NAME ":worker:response [%i,OK]",
 			channel);
 #endif
-	return write_n(instance->serial, instance->sio_buf, 2);
+	hm_put_ok(&client->writer, channel);
 }
 
-static void *worker(void *id)
+static void on_command(struct hm_client *client, int channel, int cmd,
+		char *body, int len)
 {
-	struct instance_handle *instance = id;
-	int n, channel, cmd, len;
-
-	assert(instance);
-	//configuration.loglevel = DEBUG_LEVEL_DEBUG;
-	while (instance->alive) {
-		n = read_n(instance->serial, instance->sio_buf, 3);
-		if (!instance->alive)
-			return NULL;
-		if (n < 0) {
-			ax25c_log(DEBUG_LEVEL_ERROR,
-					MODULE_NAME ":worker:read_n(cmd) error %i:%s",
-					-n, strerror(-n));
-			continue;
-		}
-		assert (n == 3);
-		channel = instance->sio_buf[0];
-		cmd = instance->sio_buf[1];
-		len = instance->sio_buf[2] + 1;
-		assert(len <= 256);
-		/*
-		ax25c_log(DEBUG_LEVEL_DEBUG,
-				MODULE_NAME ":worker: channel %i [%s] %i bytes",
-				channel, cmd ? "cmd" : "data", len);
-		*/
-		n = read_n(instance->serial, instance->sio_buf, len);
-		if (!instance->alive)
-			return NULL;
-		if (n < 0) {
-			ax25c_log(DEBUG_LEVEL_ERROR,
-					MODULE_NAME ":worker:read_n(data) error %i:%s",
-					-n, strerror(-n));
-			continue;
-		}
-		assert(n == len);
-		instance->sio_buf[len] = '\0';
-
-		if ((channel < 0) || (channel > instance->channels)) {
-			n = write_cstr(instance, channel, 2, "INVALID CHANNEL NUMBER");
-			continue;
-		}
+	if ((channel == HM_POLL_CHANNEL) && cmd && (body[0] == 'G')) {
+		channels_poll(client);
+		return;
+	}
+	if ((channel < 0) || (channel > client->instance->channels)) {
+		write_cstr(client, channel, 2, "INVALID CHANNEL NUMBER");
+		return;
+	}
 
-		if (cmd) {
-			/* Handle command */
+	if (cmd) {
+		/* Handle command */
 #ifdef DEBUG_POLLS
-			ax25c_log(DEBUG_LEVEL_DEBUG,
-					MODULE_NAME ":worker:command [%i]: \"%s\"",
-					channel, instance->sio_buf);
+		ax25c_log(DEBUG_LEVEL_DEBUG,
+				MODULE_NAME ":worker:command [%i]: \"%s\"",
+				channel, body);
 #endif
-			char c = instance->sio_buf[0];
-			if (c >= 0x20) {
-				switch (c) {
-				case 'A':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": AUTO LINEFEED [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'B':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": TERMINAL BAUDRATE [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'C':
-					if (len == 1) {
-						n = write_cstr(instance, channel, 1, "CHANNEL NOT CONNECTED");
-					} else {
-						ax25c_log(DEBUG_LEVEL_INFO,
-								MODULE_NAME ": CONNECT REQUEST [%i] %s",
-								channel, instance->sio_buf);
-						n = write_ok(instance, channel);
-					}
-					break;
-				case 'D':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": DISCONNECT [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'E':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": ECHO INPUT [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'F':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": FRAME ACKNOWLEDGE [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'G':
-					n = write_ok(instance, channel);
-					break;
-				case 'H':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": HDLC BAUDRATE [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'I':
-					n = write_ok(instance, channel);
-					break;
-				case 'J':
-					if (strcmp(instance->sio_buf, "JHOST1") == 0)
-						ax25c_log(DEBUG_LEVEL_INFO,
-								MODULE_NAME ": HOSTMODE ENTER");
-					else
-						ax25c_log(DEBUG_LEVEL_INFO,
-								MODULE_NAME ": HOSTMODE EXIT");
-					n = write_ok(instance, channel);
-					break;
-				case 'K':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": CALIBRATE [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'L':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": L POLL [%i] %s",
-							channel, instance->sio_buf);
-					if (channel == 0)
-						n = write_cstr(instance, channel, 1, "0 0");
-					else
-						n = write_cstr(instance, channel, 1, "0 0 0 0 0 1");
-					break;
-				case 'M':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": MONITOR CONFIG [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'O':
+		char c = body[0];
+		if (c >= 0x20) {
+			switch (c) {
+			case 'A':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": AUTO LINEFEED [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'B':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": TERMINAL BAUDRATE [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'C':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": CONNECT REQUEST [%i] %s",
+						channel, body);
+				channel_connect(client, channel, &body[1]);
+				break;
+			case 'D':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": DISCONNECT [%i] %s",
+						channel, body);
+				channel_disconnect(client, channel);
+				break;
+			case 'E':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": ECHO INPUT [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'F':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": FRAME ACKNOWLEDGE [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'G':
+				channel_poll(client, channel);
+				break;
+			case 'H':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": HDLC BAUDRATE [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'I':
+				channel_mycall(client, channel, &body[1]);
+				break;
+			case 'J':
+				if (strcmp(body, "JHOST1") == 0)
 					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": OUTSTANDING I FRAMES [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'P':
+							MODULE_NAME ": HOSTMODE ENTER");
+				else
 					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": PERM COMMAND [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'Q':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": RESTART FIRMWARE [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'R':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": REPEATER ENABLE [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'S':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": SELECT CHANNEL [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'T':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": TRANSMITTER DELAY [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'U':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": UNATTENDED MODE [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'V':
-					n = write_cstr(instance, channel, 1, "2");
-					break;
-				case 'W':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": TRANSMITTER WAIT [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'X':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": PTT ENABLE [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'Y':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": MAXIMUM CONNECTIONS [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case 'Z':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": FLOW CONTROL [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case '@':
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": BUFFERS [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				case '#':
-					n = write_cstr(instance, channel, 1, "CHANNEL NOT CONNECTD");
-					break;
-				default:
-					ax25c_log(DEBUG_LEVEL_INFO,
-							MODULE_NAME ": UNIDENTIFIED COMMAND [%i] %s",
-							channel, instance->sio_buf);
-					n = write_ok(instance, channel);
-					break;
-				} /* end switch */
-			} else {
-				n = write_cstr(instance, channel, 2, "INVALID COMMAND");
-			}
+							MODULE_NAME ": HOSTMODE EXIT");
+				write_ok(client, channel);
+				break;
+			case 'K':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": CALIBRATE [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'L':
+				channel_status(client, channel);
+				break;
+			case 'M':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": MONITOR CONFIG [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'O':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": OUTSTANDING I FRAMES [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'P':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": PERM COMMAND [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'Q':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": RESTART FIRMWARE [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'R':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": REPEATER ENABLE [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'S':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": SELECT CHANNEL [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'T':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": TRANSMITTER DELAY [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'U':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": UNATTENDED MODE [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'V':
+				write_cstr(client, channel, 1, "2");
+				break;
+			case 'W':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": TRANSMITTER WAIT [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'X':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": PTT ENABLE [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'Y':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": MAXIMUM CONNECTIONS [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case 'Z':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": FLOW CONTROL [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case '@':
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": BUFFERS [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			case '#':
+				write_cstr(client, channel, 1, "CHANNEL NOT CONNECTD");
+				break;
+			default:
+				ax25c_log(DEBUG_LEVEL_INFO,
+						MODULE_NAME ": UNIDENTIFIED COMMAND [%i] %s",
+						channel, body);
+				write_ok(client, channel);
+				break;
+			} /* end switch */
 		} else {
-			/* Handle data */
+			write_cstr(client, channel, 2, "INVALID COMMAND");
+		}
+	} else {
+		/* Handle data */
 #ifdef DEBUG_POLLS
-			ax25c_log(DEBUG_LEVEL_DEBUG,
-					MODULE_NAME ":worker:data [%i]: \"%s\"",
-					channel, instance->sio_buf);
+		ax25c_log(DEBUG_LEVEL_DEBUG,
+				MODULE_NAME ":worker:data [%i]: \"%s\"",
+				channel, body);
 #endif
-			n = write_ok(instance, channel);
-		}
+		channel_send(client, channel, body, len);
+	}
+}
+
+bool hm_on_frame(void *ctx, int channel, int cmd, char *body, int len)
+{
+	struct hm_client *client = ctx;
+
+	on_command(client, channel, cmd, body, len);
+	/* Every command has one response, stop while it might not fit */
+	return hm_room(&client->writer);
+}
+
+static void *worker(void *id)
+{
+	struct instance_handle *instance = id;
+	struct hm_client *client;
+	size_t off;
+	int n, erc;
+
+	assert(instance);
+	client = instance->client[0];
+	while (instance->alive) {
+		/* Take whatever arrived, frames are cut out of it */
+		n = readFromSerialPort(instance->serial, (char*)client->rx_buf,
+				S_RX_BUF);
+		if (!instance->alive)
+			return NULL;
 		if (n < 0) {
 			ax25c_log(DEBUG_LEVEL_ERROR,
-					MODULE_NAME ":worker:write_str(resp) error %i:%s",
+					MODULE_NAME ":worker:readFromSerialPort error %i:%s",
 					-n, strerror(-n));
 			continue;
 		}
+		off = 0;
+		do {
+			off += hm_decode(&client->decoder, &client->rx_buf[off], n - off,
+					hm_on_frame, client);
+			channels_transmit(instance);
+			/* The responses of the cycle go out in one write */
+			erc = hm_flush(&client->writer);
+			if (erc < 0)
+				ax25c_log(DEBUG_LEVEL_ERROR,
+						MODULE_NAME ":worker:writeToSerialPort error %i:%s",
+						-erc, strerror(-erc));
+		} while (off < (size_t)n);
 	} /* end while */
 	return NULL;
 }
@@ -384,44 +363,131 @@ static void *get_instance(const char *name,
 	return instance;
 }
 
+static bool start_serial(struct instance_handle *instance, exception_t *ex)
+{
+	struct hm_client *client;
+
+	DBG_INFO("Open serial port", instance->comport);
+	instance->serial = openSerialPort(instance->comport, instance->baudrate,
+			8, ONESTOPBIT, NOPARITY, ex);
+	if (!instance->serial)
+		return false;
+	/* Return with whatever arrived, but look for a stop once a second */
+	setSerialPortTimeouts(instance->serial, 0, 10);
+	client = calloc(1, sizeof(struct hm_client));
+	if (!client) {
+		exception_fill(ex, ENOMEM, MODULE_NAME, "start_serial",
+				"Out of memory", instance->name);
+		closeSerialPort(instance->serial);
+		instance->serial = NULL;
+		return false;
+	}
+	/* The serial port is the one client, it owns slot 0 */
+	client->instance = instance;
+	client->slot = 0;
+	client->fd = -1;
+	hm_decoder_reset(&client->decoder);
+	hm_writer_init(&client->writer, serial_write, instance);
+	instance->client[0] = client;
+	channels_attach(client);
+	return true;
+}
+
+static void stop_serial(struct instance_handle *instance)
+{
+	if (instance->client[0]) {
+		channels_detach(instance->client[0]);
+		free(instance->client[0]);
+		instance->client[0] = NULL;
+	}
+	DBG_INFO("Close serial port", instance->comport);
+	closeSerialPort(instance->serial);
+	instance->serial = NULL;
+}
+
 static bool start_instance(struct instance_handle *instance, exception_t *ex)
 {
 	pthread_attr_t thread_args;
+	bool serial;
 	int erc;
 
 	assert(instance);
 	DBG_DEBUG("hostmodeserver instance start", instance->name);
-
-	DBG_INFO("Open serial port", instance->comport);
-	instance->serial = openSerialPort(instance->comport, instance->baudrate,
-			8, ONESTOPBIT, NOPARITY, ex);
-	if (!instance->serial)
+	if ((instance->channels < 1) || (instance->channels >= HM_POLL_CHANNEL)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "start_instance",
+				"Invalid channels (1..254)", instance->name);
+		return false;
+	}
+	serial = (strcmp(instance->transport, "serial") == 0);
+	if (!serial && (strcmp(instance->transport, "tcp") != 0) &&
+			(strcmp(instance->transport, "unix") != 0)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "start_instance",
+				"Invalid transport (serial|tcp|unix)", instance->name);
 		return false;
+	}
+	if (serial)
+		instance->clients = 1;
+	/* The channel index is the client handle of the prims */
+	if ((instance->clients < 1) ||
+			(instance->clients * (instance->channels + 1) > UINT16_MAX)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "start_instance",
+				"Invalid clients", instance->name);
+		return false;
+	}
+	instance->client = calloc(instance->clients, sizeof(struct hm_client*));
+	if (!instance->client) {
+		exception_fill(ex, ENOMEM, MODULE_NAME, "start_instance",
+				"Out of memory", instance->name);
+		return false;
+	}
 
 	instance->alive = true;
+	if (!channels_start(instance, ex))
+		goto fail_channels;
+	if (serial ? !start_serial(instance, ex) : !server_start(instance, ex))
+		goto fail_transport;
 	pthread_attr_init(&thread_args);
 	pthread_attr_setdetachstate(&thread_args, PTHREAD_CREATE_JOINABLE);
-	erc = pthread_create(&instance->thread, &thread_args, worker, instance);
+	erc = pthread_create(&instance->thread, &thread_args,
+			serial ? worker : server_worker, instance);
+	pthread_attr_destroy(&thread_args);
 	if (erc != 0) {
 		exception_fill(ex, erc, MODULE_NAME, "start_instance",
 				"Error creating thread", instance->name);
-		instance->alive = false;
+		if (serial)
+			stop_serial(instance);
+		else
+			server_stop(instance);
+		goto fail_transport;
 	}
-	pthread_attr_destroy(&thread_args);
-	return instance->alive;
+	instance->thread_running = true;
+	return true;
+
+fail_transport:
+	channels_stop(instance);
+fail_channels:
+	instance->alive = false;
+	free(instance->client);
+	instance->client = NULL;
+	return false;
 }
 
 static bool stop_instance(struct instance_handle *instance, exception_t *ex) {
 	assert(instance);
 	DBG_DEBUG("hostmodeserver instance stop", instance->name);
 
-	if (instance->alive) {
-		instance->alive = false;
-		pthread_kill(instance->thread, SIGINT);
-	}
-
-	DBG_INFO("Close serial port", instance->comport);
-	closeSerialPort(instance->serial);
+	instance->alive = false;
+	if (!instance->thread_running)
+		return true;
+	pthread_join(instance->thread, NULL);
+	instance->thread_running = false;
+	if (instance->serial)
+		stop_serial(instance);
+	else
+		server_stop(instance);
+	channels_stop(instance);
+	free(instance->client);
+	instance->client = NULL;
 	return true;
 }
 
@@ -0,0 +1,347 @@
+/*
+ *  Project: ax25c - File: server.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* accept4 */
+#endif
+
+#include "../config/configuration.h"
+#include "../runtime/runtime.h"
+
+#include "_internal.h"
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+/* Max. number of events of one epoll_wait() */
+#define MAX_EVENTS 64
+
+/* Timeout of epoll_wait() to look for a stop, in ms */
+#define POLL_MS 1000
+
+/*
+ * Listener
+ */
+
+static int listen_tcp(struct instance_handle *instance, struct exception *ex)
+{
+	struct addrinfo hints, *addrinfo, *rp;
+	int fd = -1, one = 1, erc;
+
+	memset(&hints, 0x00, sizeof(hints));
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags    = AI_PASSIVE;
+	erc = getaddrinfo(instance->host, instance->port, &hints, &addrinfo);
+	if (erc != 0) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "listen_tcp",
+				gai_strerror(erc), instance->host);
+		return -1;
+	}
+	for (rp = addrinfo; rp != NULL; rp = rp->ai_next) {
+		fd = socket(rp->ai_family, rp->ai_socktype | SOCK_NONBLOCK |
+				SOCK_CLOEXEC, rp->ai_protocol);
+		if (fd == -1)
+			continue;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (bind(fd, rp->ai_addr, rp->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	} /* end for */
+	freeaddrinfo(addrinfo);
+	if (fd == -1)
+		exception_fill(ex, errno, MODULE_NAME, "listen_tcp",
+				"Unable to bind", instance->port);
+	return fd;
+}
+
+static int listen_unix(struct instance_handle *instance, struct exception *ex)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(instance->path) >= sizeof(addr.sun_path)) {
+		exception_fill(ex, ENAMETOOLONG, MODULE_NAME, "listen_unix",
+				"Path too long", instance->path);
+		return -1;
+	}
+	memset(&addr, 0x00, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, instance->path);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		exception_fill(ex, errno, MODULE_NAME, "listen_unix",
+				"Unable to create socket", instance->path);
+		return -1;
+	}
+	/* A stale socket of a previous run */
+	unlink(instance->path);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		exception_fill(ex, errno, MODULE_NAME, "listen_unix",
+				"Unable to bind", instance->path);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool server_start(struct instance_handle *instance, struct exception *ex)
+{
+	struct epoll_event ev;
+	bool tcp = (strcmp(instance->transport, "tcp") == 0);
+
+	instance->listen_fd = tcp ? listen_tcp(instance, ex) :
+			listen_unix(instance, ex);
+	if (instance->listen_fd == -1)
+		return false;
+	if (listen(instance->listen_fd, SOMAXCONN) == -1) {
+		exception_fill(ex, errno, MODULE_NAME, "server_start",
+				"Unable to listen", instance->name);
+		goto fail;
+	}
+	instance->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (instance->epfd == -1) {
+		exception_fill(ex, errno, MODULE_NAME, "server_start",
+				"Unable to create epoll", instance->name);
+		goto fail;
+	}
+	/* NULL marks the listener */
+	memset(&ev, 0x00, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(instance->epfd, EPOLL_CTL_ADD, instance->listen_fd,
+			&ev) == -1) {
+		exception_fill(ex, errno, MODULE_NAME, "server_start",
+				"Unable to add listener", instance->name);
+		close(instance->epfd);
+		goto fail;
+	}
+	if (configuration.loglevel >= DEBUG_LEVEL_INFO)
+		ax25c_log(DEBUG_LEVEL_INFO, MODULE_NAME ":%s: Listening on %s",
+				instance->name, tcp ? instance->port : instance->path);
+	return true;
+
+fail:
+	close(instance->listen_fd);
+	instance->listen_fd = -1;
+	return false;
+}
+
+/*
+ * Clients
+ */
+
+static int socket_write(void *ctx, const uint8_t *p, size_t n)
+{
+	struct hm_client *client = ctx;
+	ssize_t res;
+
+	res = send(client->fd, p, n, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (res >= 0)
+		return (int)res;
+	return (errno == EWOULDBLOCK) ? -EAGAIN : -errno;
+}
+
+static void client_close(struct instance_handle *instance,
+		struct hm_client *client)
+{
+	epoll_ctl(instance->epfd, EPOLL_CTL_DEL, client->fd, NULL);
+	close(client->fd);
+	channels_detach(client);
+	instance->client[client->slot] = NULL;
+	if (configuration.loglevel >= DEBUG_LEVEL_INFO)
+		ax25c_log(DEBUG_LEVEL_INFO, MODULE_NAME ":%s: Client %u closed",
+				instance->name, client->slot);
+	free(client);
+}
+
+/* Read while the output drains, or the other way round */
+static void client_events(struct instance_handle *instance,
+		struct hm_client *client, bool busy)
+{
+	struct epoll_event ev;
+
+	client->busy = busy;
+	memset(&ev, 0x00, sizeof(ev));
+	ev.events = busy ? EPOLLOUT : (EPOLLIN | EPOLLRDHUP);
+	ev.data.ptr = client;
+	epoll_ctl(instance->epfd, EPOLL_CTL_MOD, client->fd, &ev);
+}
+
+static void on_accept(struct instance_handle *instance)
+{
+	struct hm_client *client;
+	struct epoll_event ev;
+	unsigned int slot;
+	int fd, one = 1;
+
+	for (;;) {
+		fd = accept4(instance->listen_fd, NULL, NULL,
+				SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd == -1) {
+			if ((errno != EAGAIN) && (errno != EINTR) &&
+					(configuration.loglevel >= DEBUG_LEVEL_ERROR))
+				ax25c_log(DEBUG_LEVEL_ERROR, MODULE_NAME ":%s:accept: %s",
+						instance->name, strerror(errno));
+			return;
+		}
+		for (slot = 0; slot < instance->clients; ++slot)
+			if (!instance->client[slot])
+				break;
+		client = (slot < instance->clients) ?
+				calloc(1, sizeof(struct hm_client)) : NULL;
+		if (!client) {
+			if (configuration.loglevel >= DEBUG_LEVEL_WARNING)
+				ax25c_log(DEBUG_LEVEL_WARNING,
+						MODULE_NAME ":%s: Client rejected, no free slot",
+						instance->name);
+			close(fd);
+			continue;
+		}
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		client->instance = instance;
+		client->slot = slot;
+		client->fd = fd;
+		hm_decoder_reset(&client->decoder);
+		hm_writer_init(&client->writer, socket_write, client);
+		memset(&ev, 0x00, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = client;
+		if (epoll_ctl(instance->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+			close(fd);
+			free(client);
+			continue;
+		}
+		instance->client[slot] = client;
+		channels_attach(client);
+		if (configuration.loglevel >= DEBUG_LEVEL_INFO)
+			ax25c_log(DEBUG_LEVEL_INFO,
+					MODULE_NAME ":%s: Client %u connected, channels %u..%u",
+					instance->name, slot, client->base,
+					client->base + instance->channels);
+	} /* end for */
+}
+
+/* Decode what was received, stops while output is left over */
+static bool client_process(struct instance_handle *instance,
+		struct hm_client *client)
+{
+	int erc;
+
+	while (!client->busy && (client->rx_off < client->rx_len)) {
+		client->rx_off += hm_decode(&client->decoder,
+				&client->rx_buf[client->rx_off],
+				client->rx_len - client->rx_off, hm_on_frame, client);
+		/* The responses of the cycle go out in one write */
+		erc = hm_flush(&client->writer);
+		if (erc == -EAGAIN)
+			client_events(instance, client, true);
+		else if (erc < 0)
+			return false;
+	} /* end while */
+	if (client->rx_off == client->rx_len)
+		client->rx_off = client->rx_len = 0;
+	return true;
+}
+
+/* Returns false when the client is gone */
+static bool on_client(struct instance_handle *instance,
+		struct hm_client *client, uint32_t events)
+{
+	ssize_t n;
+	int erc;
+
+	if (events & (EPOLLERR | EPOLLHUP))
+		return false;
+	if (events & EPOLLOUT) {
+		erc = hm_flush(&client->writer);
+		if (erc == -EAGAIN)
+			return true;
+		if (erc < 0)
+			return false;
+		client_events(instance, client, false);
+		return client_process(instance, client);
+	}
+	if (client->busy)
+		return true;
+	n = recv(client->fd, &client->rx_buf[client->rx_len],
+			S_RX_BUF - client->rx_len, 0);
+	if (n < 0)
+		return (errno == EAGAIN) || (errno == EINTR);
+	if (n == 0)
+		return false;
+	client->rx_len += n;
+	return client_process(instance, client);
+}
+
+void *server_worker(void *id)
+{
+	struct instance_handle *instance = id;
+	struct epoll_event events[MAX_EVENTS];
+	struct hm_client *client;
+	int i, n;
+
+	assert(instance);
+	while (instance->alive) {
+		n = epoll_wait(instance->epfd, events, MAX_EVENTS, POLL_MS);
+		if (n < 0) {
+			if ((errno != EINTR) &&
+					(configuration.loglevel >= DEBUG_LEVEL_ERROR))
+				ax25c_log(DEBUG_LEVEL_ERROR,
+						MODULE_NAME ":server_worker:epoll_wait: %s",
+						strerror(errno));
+			continue;
+		}
+		for (i = 0; i < n; ++i) {
+			client = events[i].data.ptr;
+			if (!client)
+				on_accept(instance);
+			else if (!on_client(instance, client, events[i].events))
+				client_close(instance, client);
+		} /* end for */
+		/* Data of all clients of this round in one go */
+		channels_transmit(instance);
+	} /* end while */
+	return NULL;
+}
+
+void server_stop(struct instance_handle *instance)
+{
+	unsigned int slot;
+
+	for (slot = 0; slot < instance->clients; ++slot)
+		if (instance->client[slot])
+			client_close(instance, instance->client[slot]);
+	if (instance->listen_fd != -1) {
+		close(instance->listen_fd);
+		instance->listen_fd = -1;
+		if (strcmp(instance->transport, "unix") == 0)
+			unlink(instance->path);
+	}
+	close(instance->epfd);
+	instance->epfd = -1;
+}
@@ -0,0 +1,355 @@
+/*
+ *  Project: ax25c - File: test_load.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Load test of the socket transport: Many hostmode clients at once,
+ * each sends rounds of G polls, one per channel and one on the poll
+ * channel, and waits for all responses of a round before the next one.
+ * Runs against an ax25c with a hostmodeserver instance with transport
+ * tcp or unix and at least as many clients as given here.
+ *
+ *   make test_load
+ *   ./test_load [-n clients] [-r rounds] [-c channels] unix <path>
+ *   ./test_load [-n clients] [-r rounds] [-c channels] tcp <host> <port>
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* getopt */
+#endif
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/* Extended hostmode: G on this channel lists the channels with data */
+#define HM_POLL_CHANNEL 255
+
+/* Max. number of events of one epoll_wait() */
+#define MAX_EVENTS 64
+
+/* No response for this long fails the test, in ms */
+#define TIMEOUT_MS 10000
+
+/* Response parser states */
+enum rx_state {
+	RX_CHANNEL,
+	RX_CODE,
+	RX_TEXT,
+	RX_LEN,
+	RX_DATA
+};
+
+struct client {
+	int           fd;
+	unsigned int  round;
+	unsigned int  expected; /* Responses missing of this round */
+	uint64_t      sent;     /* Start of the round, ns */
+	enum rx_state state;
+	unsigned int  left;     /* Data octets to skip */
+	bool          done;
+};
+
+static unsigned int n_clients  = 100;
+static unsigned int n_rounds   = 1000;
+static unsigned int n_channels = 4;
+
+static uint64_t *latency; /* n_clients * n_rounds */
+static unsigned long n_latency = 0;
+static unsigned long n_responses = 0;
+static unsigned long n_errors = 0;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int connect_unix(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	memset(&addr, 0x00, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int connect_tcp(const char *host, const char *port)
+{
+	struct addrinfo hints, *addrinfo, *rp;
+	int fd = -1, one = 1;
+
+	memset(&hints, 0x00, sizeof(hints));
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &addrinfo) != 0)
+		return -1;
+	for (rp = addrinfo; rp != NULL; rp = rp->ai_next) {
+		fd = socket(rp->ai_family, rp->ai_socktype | SOCK_CLOEXEC,
+				rp->ai_protocol);
+		if (fd == -1)
+			continue;
+		if (connect(fd, rp->ai_addr, rp->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	} /* end for */
+	freeaddrinfo(addrinfo);
+	if (fd != -1)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return fd;
+}
+
+/* One round, all commands in one write */
+static bool send_round(struct client *c)
+{
+	uint8_t buf[4 * 256];
+	size_t n = 0;
+	ssize_t res;
+	unsigned int ch;
+
+	for (ch = 1; ch <= n_channels; ++ch) {
+		buf[n++] = (uint8_t)ch;
+		buf[n++] = 1;
+		buf[n++] = 0;
+		buf[n++] = 'G';
+	} /* end for */
+	buf[n++] = HM_POLL_CHANNEL;
+	buf[n++] = 1;
+	buf[n++] = 0;
+	buf[n++] = 'G';
+	c->expected = n_channels + 1;
+	c->sent = now_ns();
+	while (n > 0) {
+		res = send(c->fd, buf, n, MSG_NOSIGNAL);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		memmove(buf, &buf[res], n - res);
+		n -= res;
+	} /* end while */
+	return true;
+}
+
+/* A response is complete */
+static bool on_response(struct client *c)
+{
+	++n_responses;
+	if (--c->expected > 0)
+		return true;
+	latency[n_latency++] = now_ns() - c->sent;
+	if (++c->round == n_rounds) {
+		c->done = true;
+		return true;
+	}
+	return send_round(c);
+}
+
+/* Cut the responses out of what was received */
+static bool on_receive(struct client *c, const uint8_t *p, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		switch (c->state) {
+		case RX_CHANNEL:
+			c->state = RX_CODE;
+			break;
+		case RX_CODE:
+			if (p[i] == 2)
+				++n_errors;
+			if (p[i] == 0) {
+				c->state = RX_CHANNEL;
+				if (!on_response(c))
+					return false;
+			} else {
+				c->state = (p[i] >= 6) ? RX_LEN : RX_TEXT;
+			}
+			break;
+		case RX_TEXT:
+			if (p[i] == 0) {
+				c->state = RX_CHANNEL;
+				if (!on_response(c))
+					return false;
+			}
+			break;
+		case RX_LEN:
+			c->left = p[i] + 1;
+			c->state = RX_DATA;
+			break;
+		case RX_DATA:
+			if (--c->left == 0) {
+				c->state = RX_CHANNEL;
+				if (!on_response(c))
+					return false;
+			}
+			break;
+		} /* end switch */
+	} /* end for */
+	return true;
+}
+
+static int compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: test_load [-n clients] [-r rounds] "
+			"[-c channels] unix <path> | tcp <host> <port>\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct epoll_event ev, events[MAX_EVENTS];
+	struct client *clients, *c;
+	uint8_t buf[4096];
+	unsigned int i, n_done = 0;
+	uint64_t start, elapsed;
+	bool tcp;
+	ssize_t res;
+	int epfd, n, j, opt;
+
+	while ((opt = getopt(argc, argv, "n:r:c:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n_clients = atoi(optarg);
+			break;
+		case 'r':
+			n_rounds = atoi(optarg);
+			break;
+		case 'c':
+			n_channels = atoi(optarg);
+			break;
+		default:
+			usage();
+		} /* end switch */
+	} /* end while */
+	if ((argc - optind < 2) || !n_clients || !n_rounds ||
+			(n_channels < 1) || (n_channels > 254))
+		usage();
+	tcp = (strcmp(argv[optind], "tcp") == 0);
+	if (tcp ? (argc - optind < 3) : (strcmp(argv[optind], "unix") != 0))
+		usage();
+	clients = calloc(n_clients, sizeof(struct client));
+	latency = calloc((size_t)n_clients * n_rounds, sizeof(uint64_t));
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (!clients || !latency || (epfd == -1)) {
+		perror("test_load");
+		return 1;
+	}
+	/* All connected before the first round */
+	for (i = 0; i < n_clients; ++i) {
+		c = &clients[i];
+		c->fd = tcp ? connect_tcp(argv[optind + 1], argv[optind + 2]) :
+				connect_unix(argv[optind + 1]);
+		if (c->fd == -1) {
+			fprintf(stderr, "FAIL: Client %u: Unable to connect: %s\n",
+					i, strerror(errno));
+			return 1;
+		}
+		memset(&ev, 0x00, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = c;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+	} /* end for */
+	start = now_ns();
+	for (i = 0; i < n_clients; ++i)
+		if (!send_round(&clients[i])) {
+			fprintf(stderr, "FAIL: Client %u: send: %s\n", i,
+					strerror(errno));
+			return 1;
+		}
+	while (n_done < n_clients) {
+		n = epoll_wait(epfd, events, MAX_EVENTS, TIMEOUT_MS);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			return 1;
+		}
+		if (n == 0) {
+			fprintf(stderr, "FAIL: No response for %i ms, %u of %u clients "
+					"done\n", TIMEOUT_MS, n_done, n_clients);
+			return 1;
+		}
+		for (j = 0; j < n; ++j) {
+			c = events[j].data.ptr;
+			res = recv(c->fd, buf, sizeof(buf), 0);
+			if ((res < 0) && (errno == EINTR))
+				continue;
+			if ((res <= 0) || !on_receive(c, buf, res)) {
+				fprintf(stderr, "FAIL: Client %lu closed in round %u\n",
+						(unsigned long)(c - clients), c->round);
+				return 1;
+			}
+			if (c->done) {
+				epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+				++n_done;
+			}
+		} /* end for */
+	} /* end while */
+	elapsed = now_ns() - start;
+	qsort(latency, n_latency, sizeof(uint64_t), compare);
+	printf("%u clients, %u rounds of %u commands: %lu responses in %.3f s, "
+			"%.0f/s\n", n_clients, n_rounds, n_channels + 1, n_responses,
+			elapsed / 1e9, n_responses / (elapsed / 1e9));
+	printf("Round latency us: p50 %.1f, p99 %.1f, max %.1f\n",
+			latency[n_latency / 2] / 1e3,
+			latency[n_latency * 99 / 100] / 1e3,
+			latency[n_latency - 1] / 1e3);
+	for (i = 0; i < n_clients; ++i)
+		close(clients[i].fd);
+	close(epfd);
+	free(clients);
+	free(latency);
+	if (n_errors) {
+		printf("FAIL: %lu error responses\n", n_errors);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ *  Project: ax25c - File: _internal.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KISS__INTERNAL_H_
+#define KISS__INTERNAL_H_
+
+#include "../runtime/dlsap.h"
+#include "../runtime/primbuffer.h"
+#include "../serial/serial.h"
+#include "kiss.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define MODULE_NAME "KISS"
+
+/* Max. number of KISS ports per connection, the port is a nibble */
+#define KISS_PORT_MAX 16
+
+/* With SMACK bit 7 of the port is the CRC flag */
+#define SMACK_PORT_MAX 8
+
+/* Size of a port DLS name */
+#define KISS_NAME_SIZE 96
+
+struct instance_handle;
+
+struct plugin_handle {
+	const char  *name;
+};
+
+/* One KISS port of a TNC, served as a DLS of its own */
+struct kiss_port {
+	dls_t                   dls;
+	struct instance_handle *instance;
+	uint8_t                 i;
+	char                    name[KISS_NAME_SIZE];
+};
+
+struct instance_handle {
+	const char  *name;
+	/* Settings */
+	const char             *transport;
+	const char             *host;
+	const char             *port;
+	const char             *device;
+	unsigned int            baudrate;
+	unsigned int            ports;
+	unsigned int            smack;
+	unsigned int            reconnect;
+	unsigned int            rx_buf_size;
+	unsigned int            max_frame;
+	unsigned int            batch_size;
+	/* State */
+	volatile bool           alive;
+	struct kiss_port        kport[KISS_PORT_MAX];
+	struct primbuffer       primbuffer;
+	/* Connection, the lock serializes writes against reconnects */
+	bool                    use_serial;
+	int                     sockfd;
+	HANDLE                  serial;
+	pthread_mutex_t         conn_lock;
+	bool                    rx_thread_running;
+	pthread_t               rx_thread;
+	bool                    tx_thread_running;
+	pthread_t               tx_thread;
+	uint8_t                *rx_buf;
+	struct kiss_decoder     decoder;
+	struct kiss_writer      writer;
+};
+
+#endif /* KISS__INTERNAL_H_ */
@@ -0,0 +1,349 @@
+/*
+ *  Project: ax25c - File: kiss.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../runtime/primslice.h"
+
+#include "kiss.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+static const uint8_t fend_seq[1] = { FEND };
+static const uint8_t esc_fend[2] = { FESC, TFEND };
+static const uint8_t esc_fesc[2] = { FESC, TFESC };
+
+/* CRC-16, polynomial 0x8005 reflected */
+static const uint16_t crc16_table[256] = {
+	0x0000, 0xc0c1, 0xc181, 0x0140, 0xc301, 0x03c0, 0x0280, 0xc241,
+	0xc601, 0x06c0, 0x0780, 0xc741, 0x0500, 0xc5c1, 0xc481, 0x0440,
+	0xcc01, 0x0cc0, 0x0d80, 0xcd41, 0x0f00, 0xcfc1, 0xce81, 0x0e40,
+	0x0a00, 0xcac1, 0xcb81, 0x0b40, 0xc901, 0x09c0, 0x0880, 0xc841,
+	0xd801, 0x18c0, 0x1980, 0xd941, 0x1b00, 0xdbc1, 0xda81, 0x1a40,
+	0x1e00, 0xdec1, 0xdf81, 0x1f40, 0xdd01, 0x1dc0, 0x1c80, 0xdc41,
+	0x1400, 0xd4c1, 0xd581, 0x1540, 0xd701, 0x17c0, 0x1680, 0xd641,
+	0xd201, 0x12c0, 0x1380, 0xd341, 0x1100, 0xd1c1, 0xd081, 0x1040,
+	0xf001, 0x30c0, 0x3180, 0xf141, 0x3300, 0xf3c1, 0xf281, 0x3240,
+	0x3600, 0xf6c1, 0xf781, 0x3740, 0xf501, 0x35c0, 0x3480, 0xf441,
+	0x3c00, 0xfcc1, 0xfd81, 0x3d40, 0xff01, 0x3fc0, 0x3e80, 0xfe41,
+	0xfa01, 0x3ac0, 0x3b80, 0xfb41, 0x3900, 0xf9c1, 0xf881, 0x3840,
+	0x2800, 0xe8c1, 0xe981, 0x2940, 0xeb01, 0x2bc0, 0x2a80, 0xea41,
+	0xee01, 0x2ec0, 0x2f80, 0xef41, 0x2d00, 0xedc1, 0xec81, 0x2c40,
+	0xe401, 0x24c0, 0x2580, 0xe541, 0x2700, 0xe7c1, 0xe681, 0x2640,
+	0x2200, 0xe2c1, 0xe381, 0x2340, 0xe101, 0x21c0, 0x2080, 0xe041,
+	0xa001, 0x60c0, 0x6180, 0xa141, 0x6300, 0xa3c1, 0xa281, 0x6240,
+	0x6600, 0xa6c1, 0xa781, 0x6740, 0xa501, 0x65c0, 0x6480, 0xa441,
+	0x6c00, 0xacc1, 0xad81, 0x6d40, 0xaf01, 0x6fc0, 0x6e80, 0xae41,
+	0xaa01, 0x6ac0, 0x6b80, 0xab41, 0x6900, 0xa9c1, 0xa881, 0x6840,
+	0x7800, 0xb8c1, 0xb981, 0x7940, 0xbb01, 0x7bc0, 0x7a80, 0xba41,
+	0xbe01, 0x7ec0, 0x7f80, 0xbf41, 0x7d00, 0xbdc1, 0xbc81, 0x7c40,
+	0xb401, 0x74c0, 0x7580, 0xb541, 0x7700, 0xb7c1, 0xb681, 0x7640,
+	0x7200, 0xb2c1, 0xb381, 0x7340, 0xb101, 0x71c0, 0x7080, 0xb041,
+	0x5000, 0x90c1, 0x9181, 0x5140, 0x9301, 0x53c0, 0x5280, 0x9241,
+	0x9601, 0x56c0, 0x5780, 0x9741, 0x5500, 0x95c1, 0x9481, 0x5440,
+	0x9c01, 0x5cc0, 0x5d80, 0x9d41, 0x5f00, 0x9fc1, 0x9e81, 0x5e40,
+	0x5a00, 0x9ac1, 0x9b81, 0x5b40, 0x9901, 0x59c0, 0x5880, 0x9841,
+	0x8801, 0x48c0, 0x4980, 0x8941, 0x4b00, 0x8bc1, 0x8a81, 0x4a40,
+	0x4e00, 0x8ec1, 0x8f81, 0x4f40, 0x8d01, 0x4dc0, 0x4c80, 0x8c41,
+	0x4400, 0x84c1, 0x8581, 0x4540, 0x8701, 0x47c0, 0x4680, 0x8641,
+	0x8201, 0x42c0, 0x4380, 0x8341, 0x4100, 0x81c1, 0x8081, 0x4040
+};
+
+uint16_t kiss_crc16(uint16_t crc, const uint8_t *p, size_t n)
+{
+	while (n--)
+		crc = (crc >> 8) ^ crc16_table[(crc ^ *p++) & 0xff];
+	return crc;
+}
+
+uint16_t kiss_ax25_fcs(const uint8_t *p, size_t n)
+{
+	uint16_t crc = 0xffff;
+	uint8_t ch;
+
+	while (n--) {
+		ch = (uint8_t)(*p++ ^ (uint8_t)(crc & 0x00ff));
+		ch = (uint8_t)(ch ^ (ch << 4));
+		crc = (uint16_t)((crc >> 8) ^ (ch << 8) ^ (ch << 3) ^ (ch >> 4));
+	} /* end while */
+	return (uint16_t)~crc;
+}
+
+size_t kiss_smack_check(const uint8_t *frame, size_t len)
+{
+	if ((len < 3) || kiss_crc16(0, frame, len))
+		return 0;
+	return len - 2;
+}
+
+/*
+ * Decoder
+ */
+
+bool kiss_decoder_init(struct kiss_decoder *d, size_t max)
+{
+	assert(d);
+	memset(d, 0x00, sizeof(struct kiss_decoder));
+	d->frame = malloc(max);
+	if (!d->frame)
+		return false;
+	d->max = max;
+	return true;
+}
+
+void kiss_decoder_destroy(struct kiss_decoder *d)
+{
+	if (!d)
+		return;
+	free(d->frame);
+	memset(d, 0x00, sizeof(struct kiss_decoder));
+}
+
+void kiss_decoder_reset(struct kiss_decoder *d)
+{
+	d->len = 0;
+	d->esc = false;
+	d->bad = false;
+}
+
+static inline void append(struct kiss_decoder *d, const uint8_t *p, size_t n)
+{
+	if (d->bad)
+		return;
+	if (d->len + n > d->max) {
+		d->bad = true;
+		return;
+	}
+	memcpy(&d->frame[d->len], p, n);
+	d->len += n;
+}
+
+static inline void unescape(struct kiss_decoder *d, uint8_t c)
+{
+	switch (c) {
+	case TFEND:
+		c = FEND;
+		break;
+	case TFESC:
+		c = FESC;
+		break;
+	default:
+		d->bad = true;
+		return;
+	} /* end switch */
+	append(d, &c, 1);
+}
+
+void kiss_decode(struct kiss_decoder *d, const uint8_t *p, size_t n,
+		kiss_frame_func f, void *ctx)
+{
+	const uint8_t *end = p + n;
+	const uint8_t *fend, *fesc, *stop;
+
+	assert(d);
+	assert(f);
+	while (p < end) {
+		if (d->esc) {
+			d->esc = false;
+			if (*p != FEND) {
+				unescape(d, *p++);
+				continue;
+			}
+			d->bad = true; /* FESC FEND */
+		}
+		fend = memchr(p, FEND, end - p);
+		stop = fend ? fend : end;
+		/* Move the runs between the escapes in one piece */
+		while (p < stop) {
+			fesc = memchr(p, FESC, stop - p);
+			append(d, p, (fesc ? fesc : stop) - p);
+			if (!fesc) {
+				p = stop;
+				break;
+			}
+			p = fesc + 1;
+			if (p == stop) {
+				d->esc = true;
+				break;
+			}
+			unescape(d, *p++);
+		} /* end while */
+		if (!fend)
+			break;
+		p = fend + 1;
+		if (d->esc)
+			d->bad = true;
+		if (d->len && !d->bad)
+			f(ctx, d->frame, d->len);
+		kiss_decoder_reset(d);
+	} /* end while */
+}
+
+/*
+ * Encoder
+ */
+
+void kiss_writer_init(struct kiss_writer *w, kiss_writev_func out, void *ctx)
+{
+	assert(w);
+	assert(out);
+	w->out = out;
+	w->ctx = ctx;
+	w->n_iov = 0;
+	w->n_hold = 0;
+	w->error = false;
+}
+
+/* Write the iovec, prims stay held as a frame may continue */
+static bool write_iov(struct kiss_writer *w)
+{
+	struct iovec *iov = w->iov;
+	int cnt = w->n_iov;
+	ssize_t n;
+
+	w->n_iov = 0;
+	while (!w->error && cnt) {
+		n = w->out(w->ctx, iov, cnt);
+		if (n < 0) {
+			if (errno != EINTR)
+				w->error = true;
+			continue;
+		}
+		while (cnt && ((size_t)n >= iov->iov_len)) {
+			n -= iov->iov_len;
+			++iov;
+			--cnt;
+		} /* end while */
+		if (cnt) {
+			iov->iov_base = (uint8_t*)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	} /* end while */
+	return !w->error;
+}
+
+static inline void add_iov(struct kiss_writer *w, const void *p, size_t n)
+{
+	if (w->n_iov == KISS_IOV_MAX)
+		write_iov(w);
+	w->iov[w->n_iov].iov_base = (void*)p;
+	w->iov[w->n_iov].iov_len = n;
+	++w->n_iov;
+}
+
+static void put_escaped(struct kiss_writer *w, const uint8_t *p, size_t n)
+{
+	const uint8_t *end = p + n;
+	const uint8_t *fend = memchr(p, FEND, n);
+	const uint8_t *fesc = memchr(p, FESC, n);
+	const uint8_t *q;
+
+	while (p < end) {
+		q = (fend && (!fesc || (fend < fesc))) ? fend : fesc;
+		if (!q) {
+			add_iov(w, p, end - p);
+			break;
+		}
+		if (q > p)
+			add_iov(w, p, q - p);
+		if (q == fend) {
+			add_iov(w, esc_fend, sizeof(esc_fend));
+			fend = memchr(q + 1, FEND, end - q - 1);
+		} else {
+			add_iov(w, esc_fesc, sizeof(esc_fesc));
+			fesc = memchr(q + 1, FESC, end - q - 1);
+		}
+		p = q + 1;
+	} /* end while */
+}
+
+/* Escape one octet into p, returns the end */
+static inline uint8_t *escape(uint8_t *p, uint8_t c)
+{
+	if ((c == FEND) || (c == FESC)) {
+		*p++ = FESC;
+		*p++ = (c == FEND) ? TFEND : TFESC;
+	} else {
+		*p++ = c;
+	}
+	return p;
+}
+
+bool kiss_put(struct kiss_writer *w, uint8_t cmd, primitive_t *prim,
+		bool smack)
+{
+	struct iovec slice[KISS_IOV_MAX];
+	uint8_t *head, *tail, *p;
+	uint16_t crc;
+	size_t fcs;
+	int i, n;
+
+	assert(w);
+	assert(prim);
+	n = prim_to_iovec(prim, slice, KISS_IOV_MAX);
+	if (n < 0)
+		return !w->error; /* Too many slices, skipped */
+	/* The TNC appends its own FCS, drop the one of the prim */
+	for (fcs = 2; fcs && (n > 0); ) {
+		if (slice[n-1].iov_len > fcs) {
+			slice[n-1].iov_len -= fcs;
+			fcs = 0;
+		} else {
+			fcs -= slice[--n].iov_len;
+		}
+	} /* end for */
+	if (!n)
+		return !w->error; /* Nothing but the FCS, skipped */
+	if (w->n_hold == KISS_HOLD_MAX)
+		kiss_flush(w);
+	use_prim(prim);
+	head = w->head[w->n_hold];
+	tail = w->tail[w->n_hold];
+	w->hold[w->n_hold++] = prim;
+	if (smack)
+		cmd |= KISS_SMACK;
+	head[0] = FEND;
+	/* Port 12 data is 0xc0 */
+	add_iov(w, head, escape(&head[1], cmd) - head);
+	for (i = 0; i < n; ++i)
+		put_escaped(w, slice[i].iov_base, slice[i].iov_len);
+	if (!smack) {
+		add_iov(w, fend_seq, sizeof(fend_seq));
+		return !w->error;
+	}
+	crc = kiss_crc16(0, &cmd, 1);
+	for (i = 0; i < n; ++i)
+		crc = kiss_crc16(crc, slice[i].iov_base, slice[i].iov_len);
+	p = escape(tail, crc & 0xff);
+	p = escape(p, crc >> 8);
+	*p++ = FEND;
+	add_iov(w, tail, p - tail);
+	return !w->error;
+}
+
+bool kiss_flush(struct kiss_writer *w)
+{
+	bool res;
+
+	assert(w);
+	res = write_iov(w);
+	while (w->n_hold)
+		del_prim(w->hold[--w->n_hold]);
+	w->error = false;
+	return res;
+}
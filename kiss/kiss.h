@@ -0,0 +1,182 @@
+/*
+ *  Project: ax25c - File: kiss.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file kiss.h
+ * @brief KISS framing: Incremental decoder and vectored encoder.
+ *
+ * Both sides look for FEND and FESC with memchr() and move the runs in
+ * between in one piece. The encoder does not copy frame data at all, it
+ * builds an iovec of payload runs and escape sequences that is written
+ * with one vectored write for a whole batch of frames.
+ *
+ * SMACK frames have bit 7 of the command byte set and carry a CRC-16
+ * (polynomial 0x8005, LSB first, initial value 0) over the command byte
+ * and the data, appended low octet first.
+ */
+#ifndef KISS_KISS_H_
+#define KISS_KISS_H_
+
+#include "../runtime/primitive.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define FEND  0xc0
+#define FESC  0xdb
+#define TFEND 0xdc
+#define TFESC 0xdd
+
+/**
+ * @brief KISS commands, low nibble of the command byte. The high nibble
+ *        is the port.
+ */
+enum kiss_cmd {
+	KISS_DATA       = 0x00,
+	KISS_TXDELAY    = 0x01,
+	KISS_PERSIST    = 0x02,
+	KISS_SLOTTIME   = 0x03,
+	KISS_TXTAIL     = 0x04,
+	KISS_FULLDUPLEX = 0x05,
+	KISS_SETHW      = 0x06,
+	KISS_RETURN     = 0xff
+};
+
+/**
+ * @brief Max. number of iovec entries of one vectored write.
+ */
+#define KISS_IOV_MAX  256
+
+/**
+ * @brief Max. number of frames of one vectored write.
+ */
+#define KISS_HOLD_MAX 64
+
+/**
+ * @brief Command byte flag of a SMACK frame.
+ */
+#define KISS_SMACK    0x80
+
+/**
+ * @brief Receives a decoded frame, the command byte comes first.
+ */
+typedef void (*kiss_frame_func)(void *ctx, const uint8_t *frame, size_t len);
+
+/**
+ * @brief Writes an iovec, returns the number of octets written or -1.
+ */
+typedef ssize_t (*kiss_writev_func)(void *ctx, const struct iovec *iov,
+		int iovcnt);
+
+/**
+ * @brief Decoder state, survives between reads.
+ */
+struct kiss_decoder {
+	uint8_t *frame; /**< Frame collected so far.                      */
+	size_t   len;   /**< Length of the frame.                         */
+	size_t   max;   /**< Size of the frame buffer.                    */
+	bool     esc;   /**< Last octet was FESC.                         */
+	bool     bad;   /**< Frame too long or bad escape, is discarded.  */
+};
+
+/**
+ * @brief Encoder state, collects the frames of one vectored write.
+ */
+struct kiss_writer {
+	kiss_writev_func out;                   /**< Output function.     */
+	void            *ctx;                   /**< Its context.         */
+	struct iovec     iov[KISS_IOV_MAX];     /**< Pending output.      */
+	int              n_iov;                 /**< Entries in iov.      */
+	uint8_t          head[KISS_HOLD_MAX][3];/**< FEND, command.       */
+	uint8_t          tail[KISS_HOLD_MAX][5];/**< CRC, FEND.           */
+	primitive_t     *hold[KISS_HOLD_MAX];   /**< Prims iov points to. */
+	unsigned int     n_hold;                /**< Entries in hold.     */
+	bool             error;                 /**< Output failed.       */
+};
+
+/**
+ * @brief Initialize a decoder.
+ * @param max Max. frame length including the command byte.
+ * @return false when out of memory.
+ */
+extern bool kiss_decoder_init(struct kiss_decoder *d, size_t max);
+
+/**
+ * @brief Release a decoder.
+ */
+extern void kiss_decoder_destroy(struct kiss_decoder *d);
+
+/**
+ * @brief Discard a partial frame, i.e. after a reconnect.
+ */
+extern void kiss_decoder_reset(struct kiss_decoder *d);
+
+/**
+ * @brief Decode a chunk of received octets. Calls f for every complete
+ *        frame.
+ */
+extern void kiss_decode(struct kiss_decoder *d, const uint8_t *p, size_t n,
+		kiss_frame_func f, void *ctx);
+
+/**
+ * @brief Compute the SMACK CRC-16.
+ * @param crc 0 or the CRC of the preceding octets.
+ * @return CRC, a frame including its CRC yields 0.
+ */
+extern uint16_t kiss_crc16(uint16_t crc, const uint8_t *p, size_t n);
+
+/**
+ * @brief Compute the AX.25 FCS (CRC-CCITT) of a frame. AX25 prims carry
+ *        it low octet first behind the frame, KISS frames do not.
+ */
+extern uint16_t kiss_ax25_fcs(const uint8_t *p, size_t n);
+
+/**
+ * @brief Check and strip the CRC of a SMACK frame.
+ * @param len Frame length including command byte and CRC.
+ * @return Length without the CRC or 0 when the CRC is bad.
+ */
+extern size_t kiss_smack_check(const uint8_t *frame, size_t len);
+
+/**
+ * @brief Initialize a writer.
+ */
+extern void kiss_writer_init(struct kiss_writer *w, kiss_writev_func out,
+		void *ctx);
+
+/**
+ * @brief Append a frame. The writer takes its own reference to prim
+ *        until the next kiss_flush(). The FCS in the last two octets of
+ *        the prim is not sent. A prim of more than KISS_IOV_MAX slices
+ *        is skipped.
+ * @param cmd Command byte, port and command.
+ * @param smack Send as SMACK frame, sets KISS_SMACK in cmd and
+ *        appends the CRC.
+ * @return false when the output failed.
+ */
+extern bool kiss_put(struct kiss_writer *w, uint8_t cmd, primitive_t *prim,
+		bool smack);
+
+/**
+ * @brief Write everything appended and release the prims.
+ * @return false when the output failed since the last flush.
+ */
+extern bool kiss_flush(struct kiss_writer *w);
+
+#endif /* KISS_KISS_H_ */
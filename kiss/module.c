@@ -0,0 +1,652 @@
+/*
+ *  Project: ax25c - File: module.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../config/configuration.h"
+#include "../runtime/primbuffer.h"
+#include "../runtime/runtime.h"
+#include "../runtime/dlsap.h"
+#include "../runtime/primslice.h"
+
+#include "_internal.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+/* Timeout of the tx thread to look for a stop, in ns */
+#define TX_POLL_NS 1000000000LL
+
+/* Timeout for connect() in s */
+#define CONNECT_TIMEOUT 10
+
+/* Max. time a send may block in s, the tx thread holds conn_lock */
+#define SEND_TIMEOUT 10
+
+struct plugin_handle plugin;
+
+static struct setting_descriptor plugin_settings_descriptor[] = {
+		{ NULL }
+};
+
+static struct setting_descriptor instance_settings_descriptor[] = {
+		{ "transport",   CSTR_T, offsetof(struct instance_handle, transport),   "tcp"       },
+		{ "host",        CSTR_T, offsetof(struct instance_handle, host),        "localhost" },
+		{ "port",        CSTR_T, offsetof(struct instance_handle, port),        "8001"      },
+		{ "device",      CSTR_T, offsetof(struct instance_handle, device),      "/dev/ttyS0"},
+		{ "baudrate",    UINT_T, offsetof(struct instance_handle, baudrate),    "9600"      },
+		{ "ports",       UINT_T, offsetof(struct instance_handle, ports),       "1"         },
+		{ "smack",       UINT_T, offsetof(struct instance_handle, smack),       "0"         },
+		{ "reconnect",   UINT_T, offsetof(struct instance_handle, reconnect),   "5"         },
+		{ "rx_buf_size", UINT_T, offsetof(struct instance_handle, rx_buf_size), "4096"      },
+		{ "max_frame",   UINT_T, offsetof(struct instance_handle, max_frame),   "1024"      },
+		{ "batch_size",  UINT_T, offsetof(struct instance_handle, batch_size),  "16"        },
+		{ NULL }
+};
+
+/*
+ * Connection
+ */
+
+static int kiss_connect(struct instance_handle *instance)
+{
+	struct addrinfo hints, *addrinfo, *rp;
+	struct timeval tv = { .tv_sec = CONNECT_TIMEOUT, .tv_usec = 0 };
+	int fd = -1, one = 1, erc;
+
+	memset(&hints, 0x00, sizeof(hints));
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags    = AI_ADDRCONFIG;
+	erc = getaddrinfo(instance->host, instance->port, &hints, &addrinfo);
+	if (erc != 0) {
+		if (configuration.loglevel >= DEBUG_LEVEL_ERROR)
+			ax25c_log(DEBUG_LEVEL_ERROR, "KISS:%s:getaddrinfo(%s:%s): %s",
+					instance->name, instance->host, instance->port,
+					gai_strerror(erc));
+		return -1;
+	}
+	for (rp = addrinfo; rp != NULL; rp = rp->ai_next) {
+		fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+		if (fd == -1)
+			continue;
+		/* Bound the connect, the send timeout applies to it */
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		if (connect(fd, rp->ai_addr, rp->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	} /* end for */
+	freeaddrinfo(addrinfo);
+	if (fd == -1) {
+		if (configuration.loglevel >= DEBUG_LEVEL_WARNING)
+			ax25c_log(DEBUG_LEVEL_WARNING,
+					"KISS:%s: Unable to connect to %s:%s", instance->name,
+					instance->host, instance->port);
+		return -1;
+	}
+	/*
+	 * A slow TNC may block the writer, but not forever: stop_instance and
+	 * kiss_disconnect wait for conn_lock. A timeout fails the flush, the
+	 * connection is shut down and set up again.
+	 */
+	tv.tv_sec = SEND_TIMEOUT;
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (configuration.loglevel >= DEBUG_LEVEL_INFO)
+		ax25c_log(DEBUG_LEVEL_INFO, "KISS:%s: Connected to %s:%s",
+				instance->name, instance->host, instance->port);
+	return fd;
+}
+
+static HANDLE kiss_open_serial(struct instance_handle *instance)
+{
+	HANDLE h;
+	EXCEPTION(ex);
+
+	h = openSerialPort(instance->device, (enum Baudrate)instance->baudrate,
+			8, one, off, &ex);
+	if (!h) {
+		if (configuration.loglevel >= DEBUG_LEVEL_WARNING)
+			ax25c_log(DEBUG_LEVEL_WARNING,
+					"KISS:%s: Unable to open %s: Error no %i[%s] in %s:%s: %s",
+					instance->name, instance->device, ex.erc, strerror(ex.erc),
+					STRING_C(ex.module), STRING_C(ex.function),
+					STRING_C(ex.message));
+		return NULL;
+	}
+	/* Return with whatever arrived, but look for a stop once a second */
+	setSerialPortTimeouts(h, 0, 10);
+	if (configuration.loglevel >= DEBUG_LEVEL_INFO)
+		ax25c_log(DEBUG_LEVEL_INFO, "KISS:%s: Opened %s with %u baud",
+				instance->name, instance->device, instance->baudrate);
+	return h;
+}
+
+static inline bool kiss_connected(struct instance_handle *instance)
+{
+	return (instance->sockfd != -1) || instance->serial;
+}
+
+static bool kiss_open(struct instance_handle *instance)
+{
+	HANDLE h = NULL;
+	int fd = -1;
+
+	if (instance->use_serial) {
+		h = kiss_open_serial(instance);
+		if (!h)
+			return false;
+	} else {
+		fd = kiss_connect(instance);
+		if (fd == -1)
+			return false;
+	}
+	kiss_decoder_reset(&instance->decoder);
+	pthread_mutex_lock(&instance->conn_lock); /*-------------------------v*/
+	/* stop_instance may have missed the new connection */
+	if (instance->alive) {
+		instance->sockfd = fd;
+		instance->serial = h;
+		fd = -1;
+		h = NULL;
+	}
+	pthread_mutex_unlock(&instance->conn_lock); /*-----------------------^*/
+	if (fd != -1)
+		close(fd);
+	if (h)
+		closeSerialPort(h);
+	return true;
+}
+
+static void kiss_disconnect(struct instance_handle *instance)
+{
+	pthread_mutex_lock(&instance->conn_lock); /*-------------------------v*/
+	if (instance->sockfd != -1) {
+		close(instance->sockfd);
+		instance->sockfd = -1;
+	}
+	if (instance->serial) {
+		closeSerialPort(instance->serial);
+		instance->serial = NULL;
+	}
+	pthread_mutex_unlock(&instance->conn_lock); /*-----------------------^*/
+}
+
+/* Returns the number of octets read, 0 on timeout or -errno */
+static ssize_t kiss_read(struct instance_handle *instance)
+{
+	ssize_t n;
+
+	if (instance->use_serial)
+		return readFromSerialPort(instance->serial, (char*)instance->rx_buf,
+				(int)instance->rx_buf_size);
+	n = recv(instance->sockfd, instance->rx_buf, instance->rx_buf_size, 0);
+	if (n < 0)
+		return -errno;
+	return n ? n : -ECONNRESET;
+}
+
+/*
+ * Receive
+ */
+
+static void on_frame(void *ctx, const uint8_t *frame, size_t len)
+{
+	struct instance_handle *instance = ctx;
+	unsigned int port = frame[0] >> 4;
+	primitive_t *prim;
+	dls_t *receiver;
+	uint8_t *data, *tail;
+	uint16_t fcs;
+	EXCEPTION(ex);
+
+	if (instance->smack && (frame[0] & KISS_SMACK)) {
+		len = kiss_smack_check(frame, len);
+		if (!len) {
+			DBG_DEBUG("KISS:on_frame: Bad SMACK CRC", instance->name);
+			return;
+		}
+		port &= 0x07;
+	}
+	if ((frame[0] & 0x0f) != KISS_DATA) {
+		DBG_DEBUG("KISS:on_frame: Ignoring command", instance->name);
+		return;
+	}
+	if ((port >= instance->ports) || (len < 2))
+		return;
+	receiver = instance->kport[port].dls.peer;
+	if (!receiver)
+		return;
+	if (configuration.loglevel >= DEBUG_LEVEL_DEBUG) {
+		ax25c_log(DEBUG_LEVEL_DEBUG, "Received KISS frame on %s",
+				instance->kport[port].name);
+		dump(DEBUG_LEVEL_DEBUG, &frame[1], (uint16_t)(len - 1));
+	}
+	/*
+	 * AX25 prims carry the FCS, the TNC has checked and stripped it. The
+	 * frame goes into a slice with tailroom, the FCS is put behind it.
+	 */
+	prim = new_prim_sg(1, AX25, -1, 0, 0, &ex);
+	data = prim ? prim_sg_append_new(prim, 0, (uint16_t)(len - 1), 2, &ex)
+			: NULL;
+	if (!data) {
+		if (configuration.loglevel >= DEBUG_LEVEL_ERROR)
+			ax25c_log(DEBUG_LEVEL_ERROR,
+					"KISS:on_frame:new_prim_sg: Error no %i[%s] in %s:%s: %s[%s]",
+					ex.erc, strerror(ex.erc),
+					STRING_C(ex.module), STRING_C(ex.function),
+					STRING_C(ex.message), STRING_C(ex.param));
+		del_prim(prim);
+		return;
+	}
+	memcpy(data, &frame[1], len - 1);
+	fcs = kiss_ax25_fcs(data, len - 1);
+	tail = prim_sg_put(prim, 2);
+	if (!tail) {
+		DBG_ERROR("KISS:on_frame: No tailroom for the FCS", instance->name);
+		del_prim(prim);
+		return;
+	}
+	tail[0] = fcs % 0x0100;
+	tail[1] = fcs / 0x0100;
+	if (!dlsap_write_owned(receiver, prim, false, &ex))
+		ax25c_log(DEBUG_LEVEL_ERROR,
+				"KISS:on_frame:dlsap_write: Error no %i[%s] in %s:%s: %s[%s]",
+				ex.erc, strerror(ex.erc),
+				STRING_C(ex.module), STRING_C(ex.function),
+				STRING_C(ex.message), STRING_C(ex.param));
+}
+
+static void *rx_worker(void *id)
+{
+	struct instance_handle *instance = id;
+	unsigned int i;
+	ssize_t n;
+
+	assert(instance);
+	while (instance->alive) {
+		if (!kiss_connected(instance)) {
+			if (!kiss_open(instance))
+				for (i = 0; instance->alive && (i < instance->reconnect); ++i)
+					sleep(1);
+			continue;
+		}
+		/* One read takes whatever arrived, frames are cut out of it */
+		n = kiss_read(instance);
+		if (n > 0) {
+			kiss_decode(&instance->decoder, instance->rx_buf, n, on_frame,
+					instance);
+			continue;
+		}
+		if ((n == 0) || (n == -EINTR))
+			continue;
+		if (instance->alive && (configuration.loglevel >= DEBUG_LEVEL_WARNING))
+			ax25c_log(DEBUG_LEVEL_WARNING, "KISS:%s: Connection lost: %s",
+					instance->name, strerror((int)-n));
+		kiss_disconnect(instance);
+	} /* end while */
+	return NULL;
+}
+
+/*
+ * Transmit
+ */
+
+static ssize_t kiss_writev(void *ctx, const struct iovec *iov, int iovcnt)
+{
+	struct instance_handle *instance = ctx;
+	struct msghdr msg;
+	int n;
+
+	if (instance->use_serial) {
+		n = writevToSerialPort(instance->serial, iov, iovcnt);
+		if (n >= 0)
+			return n;
+		errno = -n;
+		return -1;
+	}
+	memset(&msg, 0x00, sizeof(msg));
+	msg.msg_iov = (struct iovec*)iov;
+	msg.msg_iovlen = iovcnt;
+	return sendmsg(instance->sockfd, &msg, MSG_NOSIGNAL);
+}
+
+static void *tx_worker(void *id)
+{
+	struct instance_handle *instance = id;
+	struct list_head list;
+	primitive_t *prim, *next;
+	const char *err;
+	bool ok;
+
+	assert(instance);
+	while (instance->alive) {
+		prim = primbuffer_read_timed(&instance->primbuffer, NULL, TX_POLL_NS);
+		if (!prim)
+			continue;
+		/* Take whatever else is queued in one go */
+		INIT_LIST_HEAD(&list);
+		list_add_tail(&prim->node, &list);
+		primbuffer_read_batch(&instance->primbuffer, &list,
+				instance->batch_size - 1, NULL);
+		pthread_mutex_lock(&instance->conn_lock); /*---------------------v*/
+		ok = kiss_connected(instance);
+		err = "not connected";
+		list_for_each_entry_safe(prim, next, &list, node) {
+			list_del_init(&prim->node);
+			if (ok && (prim->protocol == AX25))
+				ok = kiss_put(&instance->writer,
+						(uint8_t)((prim->serverHandle << 4) | KISS_DATA), prim,
+						instance->smack);
+			del_prim(prim);
+		} /* end list_for_each_entry_safe */
+		if (!kiss_flush(&instance->writer) && kiss_connected(instance)) {
+			/* Let the rx thread notice and reconnect, a serial port
+			 * fails its reads as well */
+			err = strerror(errno);
+			if (instance->sockfd != -1)
+				shutdown(instance->sockfd, SHUT_RDWR);
+			ok = false;
+		}
+		pthread_mutex_unlock(&instance->conn_lock); /*-------------------^*/
+		if (!ok && (configuration.loglevel >= DEBUG_LEVEL_WARNING))
+			ax25c_log(DEBUG_LEVEL_WARNING, "KISS:%s: Frames dropped, %s",
+					instance->name, err);
+	} /* end while */
+	return NULL;
+}
+
+/*
+ * DLS
+ */
+
+static bool dls_open(dls_t *dls, dls_t *receiver, struct exception *ex)
+{
+	struct kiss_port *port;
+
+	assert(dls);
+	port = dls->session;
+	if (receiver && port->dls.peer) {
+		exception_fill(ex, EEXIST, MODULE_NAME,
+				"dls_open", "Port already connected", port->name);
+		return false;
+	}
+	port->dls.peer = receiver;
+	return true;
+}
+
+static void dls_close(dls_t *dls)
+{
+	struct kiss_port *port;
+
+	if (!dls)
+		return;
+	port = dls->session;
+	port->dls.peer = NULL;
+}
+
+static bool dls_write(dls_t *dls, primitive_t *prim, bool expedited,
+		bool owned, struct exception *ex)
+{
+	struct kiss_port *port;
+
+	assert(dls);
+	port = dls->session;
+	if (!port->instance->alive) {
+		exception_fill(ex, EPIPE, MODULE_NAME, "on_write",
+				"Instance not running", port->name);
+		return false;
+	}
+	if (!owned)
+		use_prim(prim);
+	prim->serverHandle = port->i;
+	primbuffer_push_owned(&port->instance->primbuffer, prim, expedited);
+	return true;
+}
+
+static bool on_write(dls_t *dls, primitive_t *prim, bool expedited,
+		struct exception *ex)
+{
+	return dls_write(dls, prim, expedited, false, ex);
+}
+
+static bool on_write_owned(dls_t *dls, primitive_t *prim, bool expedited,
+		struct exception *ex)
+{
+	if (dls_write(dls, prim, expedited, true, ex))
+		return true;
+	del_prim(prim);
+	return false;
+}
+
+static void dls_queue_stats(dls_t *dls, dls_stats_t *stats)
+{
+	struct kiss_port *port;
+
+	if (!dls)
+		return;
+	port = dls->session;
+	/* The queue is shared by the ports of the connection */
+	stats->queue_size = primbuffer_size(&port->instance->primbuffer);
+	stats->queue_free = SIZE_MAX;
+}
+
+static const dls_t dls_template = {
+		.set_default_local_addr  = NULL,
+		.set_default_remote_addr = NULL,
+		.open                    = dls_open,
+		.close                   = dls_close,
+		.on_write                = on_write,
+		.on_write_owned          = on_write_owned,
+		.get_queue_stats         = dls_queue_stats,
+		.peer                    = NULL,
+		.session                 = NULL,
+};
+
+/*
+ * Plugin
+ */
+
+static void *get_plugin(const char *name,
+		configurator_func configurator, void *context, struct exception *ex)
+{
+	assert(name);
+	assert(configurator);
+	memset(&plugin, 0x00, sizeof(struct plugin_handle));
+	plugin.name = name;
+	if (!configurator(&plugin, plugin_settings_descriptor, context, ex)) {
+		return NULL;
+	}
+	return &plugin;
+}
+
+static bool start_plugin(struct plugin_handle *plugin, struct exception *ex) {
+	assert(plugin);
+	DBG_DEBUG("kiss start", plugin->name);
+	return true;
+}
+
+static bool stop_plugin(struct plugin_handle *plugin, struct exception *ex) {
+	assert(plugin);
+	DBG_DEBUG("kiss stop", plugin->name);
+	return true;
+}
+
+static void *get_instance(const char *name,
+		configurator_func configurator, void *context, struct exception *ex)
+{
+	struct instance_handle *instance;
+	struct kiss_port *port;
+	unsigned int i;
+
+	assert(name);
+	assert(configurator);
+	DBG_DEBUG("kiss instance create", name);
+	instance = (struct instance_handle*)malloc(sizeof(struct instance_handle));
+	assert(instance);
+	memset(instance, 0x00, sizeof(struct instance_handle));
+	instance->name = name;
+	if (!configurator(instance, instance_settings_descriptor, context, ex)) {
+		free(instance);
+		return NULL;
+	}
+	instance->name = name;
+	instance->sockfd = -1;
+	if ((instance->ports < 1) || (instance->ports > KISS_PORT_MAX)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "get_instance",
+				"Invalid ports (1..16)", name);
+		free(instance);
+		return NULL;
+	}
+	if (instance->smack && (instance->ports > SMACK_PORT_MAX)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "get_instance",
+				"Invalid ports with smack (1..8)", name);
+		free(instance);
+		return NULL;
+	}
+	if (strcmp(instance->transport, "serial") == 0) {
+		instance->use_serial = true;
+	} else if (strcmp(instance->transport, "tcp") != 0) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "get_instance",
+				"Invalid transport (tcp|serial)", name);
+		free(instance);
+		return NULL;
+	}
+	/* Port 0 is the instance, further ports are "<instance>/<port>" */
+	for (i = 0; i < instance->ports; ++i) {
+		port = &instance->kport[i];
+		port->instance = instance;
+		port->i = (uint8_t)i;
+		if (i == 0)
+			snprintf(port->name, KISS_NAME_SIZE, "%s", name);
+		else
+			snprintf(port->name, KISS_NAME_SIZE, "%s/%u", name, i);
+		memcpy(&port->dls, &dls_template, sizeof(struct dls));
+		port->dls.name = port->name;
+		port->dls.session = port;
+		DBG_INFO("Register Service Access Point", port->name);
+		if (!dlsap_register_dls(&port->dls, ex)) {
+			while (i--)
+				dlsap_unregister_dls(&instance->kport[i].dls, NULL);
+			free(instance);
+			return NULL;
+		}
+	} /* end for */
+	return instance;
+}
+
+/* Stop the threads first, they use everything that is freed here */
+static void teardown(struct instance_handle *instance)
+{
+	primitive_t *prim;
+
+	/* The runtime stops all instances after a failed start */
+	if (!instance->rx_buf)
+		return;
+	instance->alive = false;
+	/* Wakes up the rx thread from its read, on a serial port it times out */
+	pthread_mutex_lock(&instance->conn_lock); /*-------------------------v*/
+	if (instance->sockfd != -1)
+		shutdown(instance->sockfd, SHUT_RDWR);
+	pthread_mutex_unlock(&instance->conn_lock); /*-----------------------^*/
+	if (instance->rx_thread_running) {
+		pthread_join(instance->rx_thread, NULL);
+		instance->rx_thread_running = false;
+	}
+	if (instance->tx_thread_running) {
+		pthread_join(instance->tx_thread, NULL);
+		instance->tx_thread_running = false;
+	}
+	kiss_disconnect(instance);
+	while ((prim = primbuffer_read_nonblock(&instance->primbuffer, NULL)))
+		del_prim(prim);
+	primbuffer_destroy(&instance->primbuffer);
+	pthread_mutex_destroy(&instance->conn_lock);
+	kiss_decoder_destroy(&instance->decoder);
+	free(instance->rx_buf);
+	instance->rx_buf = NULL;
+}
+
+static bool start_instance(struct instance_handle *instance,
+		struct exception *ex)
+{
+	int erc;
+
+	assert(instance);
+	DBG_DEBUG("kiss instance start", instance->name);
+	if ((instance->batch_size < 1) || (instance->rx_buf_size < 1) ||
+			(instance->max_frame < 2) ||
+			(instance->max_frame > MAX_PAYLOAD_SIZE - 1)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "start_instance",
+				"Invalid batch_size, rx_buf_size or max_frame", instance->name);
+		return false;
+	}
+	instance->rx_buf = malloc(instance->rx_buf_size);
+	if (!instance->rx_buf ||
+			!kiss_decoder_init(&instance->decoder, instance->max_frame)) {
+		exception_fill(ex, ENOMEM, MODULE_NAME, "start_instance",
+				"Unable to allocate buffers", instance->name);
+		free(instance->rx_buf);
+		instance->rx_buf = NULL;
+		return false;
+	}
+	kiss_writer_init(&instance->writer, kiss_writev, instance);
+	primbuffer_init(&instance->primbuffer);
+	erc = pthread_mutex_init(&instance->conn_lock, NULL);
+	assert(erc == 0);
+	instance->alive = true;
+	erc = pthread_create(&instance->rx_thread, NULL, rx_worker, instance);
+	if (erc != 0) {
+		exception_fill(ex, erc, MODULE_NAME, "start_instance",
+				"Error creating rx thread", instance->name);
+		goto fail;
+	}
+	instance->rx_thread_running = true;
+	erc = pthread_create(&instance->tx_thread, NULL, tx_worker, instance);
+	if (erc != 0) {
+		exception_fill(ex, erc, MODULE_NAME, "start_instance",
+				"Error creating tx thread", instance->name);
+		goto fail;
+	}
+	instance->tx_thread_running = true;
+	return true;
+
+fail:
+	teardown(instance);
+	return false;
+}
+
+static bool stop_instance(struct instance_handle *instance,
+		struct exception *ex)
+{
+	assert(instance);
+	DBG_DEBUG("kiss instance stop", instance->name);
+	teardown(instance);
+	return true;
+}
+
+struct plugin_descriptor plugin_descriptor = {
+		get_plugin,	  (start_func)start_plugin,   (stop_func)stop_plugin,
+		get_instance, (start_func)start_instance, (stop_func)stop_instance
+};
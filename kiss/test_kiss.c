@@ -0,0 +1,300 @@
+/*
+ *  Project: ax25c - File: test_kiss.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Round trip test of the KISS framing: kiss_put/kiss_flush encode prims,
+ * kiss_decode gets the frames back, SMACK frames pass kiss_smack_check.
+ * Runs without the plugin, the prims come from a small counting memory
+ * manager, so that leaks and double releases show up as well.
+ *
+ *   make test
+ */
+
+#include "../runtime/memory.h"
+#include "../runtime/primslice.h"
+
+#include "kiss.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define N_FRAMES   2000
+#define FRAME_MAX  300
+#define OUT_SIZE   (N_FRAMES * (2 * FRAME_MAX + 16))
+
+static int failed = 0;
+
+#define CHECK(cond, msg) \
+	do { if (!(cond)) { fprintf(stderr, "FAIL %s:%i: %s\n", \
+			__FILE__, __LINE__, msg); ++failed; } } while (0)
+
+/*
+ * Memory manager
+ */
+
+struct block {
+	uint32_t refs;
+	uint32_t size;
+	uint64_t align;
+};
+
+static long n_blocks = 0;
+
+static struct block *block_of(void *mem)
+{
+	return (struct block*)mem - 1;
+}
+
+static void *t_alloc(uint32_t cb, struct exception *ex)
+{
+	struct block *b = calloc(1, sizeof(struct block) + cb);
+
+	if (!b)
+		return NULL;
+	b->refs = 1;
+	b->size = cb;
+	++n_blocks;
+	return b + 1;
+}
+
+static uint32_t t_size(void *mem)
+{
+	return block_of(mem)->size;
+}
+
+static void t_lock(void *mem)
+{
+	++block_of(mem)->refs;
+}
+
+static void t_free(void *mem)
+{
+	struct block *b;
+
+	if (!mem)
+		return;
+	b = block_of(mem);
+	if (b->refs == 0) {
+		fprintf(stderr, "FAIL: Block released twice\n");
+		exit(EXIT_FAILURE);
+	}
+	if (--b->refs == 0) {
+		free(b);
+		--n_blocks;
+	}
+}
+
+static void t_chck(void *mem)
+{
+}
+
+static uint32_t t_refs(void *mem)
+{
+	return block_of(mem)->refs;
+}
+
+static bool t_unref(void *mem)
+{
+	struct block *b = block_of(mem);
+
+	if (b->refs == 1)
+		return true;
+	--b->refs;
+	return false;
+}
+
+static struct mm_interface mmi = {
+		.mem_alloc = t_alloc,
+		.mem_size  = t_size,
+		.mem_lock  = t_lock,
+		.mem_free  = t_free,
+		.mem_chck  = t_chck,
+		.mem_refs  = t_refs,
+		.mem_unref = t_unref
+};
+
+/*
+ * Output side: Collects what the writer writes, in short writes
+ */
+
+static uint8_t out[OUT_SIZE];
+static size_t  out_len;
+
+static ssize_t t_writev(void *ctx, const struct iovec *iov, int iovcnt)
+{
+	size_t n = 0, l;
+	int i;
+
+	for (i = 0; i < iovcnt; ++i) {
+		l = iov[i].iov_len;
+		/* Now and then a partial write, the writer must go on */
+		if ((l > 1) && (rand() % 4 == 0))
+			l /= 2;
+		if (out_len + l > OUT_SIZE) {
+			errno = ENOSPC;
+			return -1;
+		}
+		memcpy(&out[out_len], iov[i].iov_base, l);
+		out_len += l;
+		n += l;
+		if (l < iov[i].iov_len)
+			break;
+	} /* end for */
+	return n;
+}
+
+/*
+ * Input side: Compares the decoded frames with the sent ones
+ */
+
+struct sent {
+	uint8_t cmd;
+	size_t  len;
+	uint8_t data[FRAME_MAX];
+};
+
+static struct sent sent[N_FRAMES];
+static int n_sent, n_got;
+static bool smack;
+
+static void t_frame(void *ctx, const uint8_t *frame, size_t len)
+{
+	struct sent *s = &sent[n_got++];
+
+	if (n_got > n_sent) {
+		CHECK(false, "More frames decoded than sent");
+		return;
+	}
+	if (smack) {
+		CHECK(frame[0] & KISS_SMACK, "SMACK flag missing");
+		len = kiss_smack_check(frame, len);
+		CHECK(len, "Bad SMACK CRC");
+		if (!len)
+			return;
+	}
+	CHECK(frame[0] == (s->cmd | (smack ? KISS_SMACK : 0)), "Command");
+	/* The FCS of the prim is not sent */
+	CHECK(len == s->len + 1, "Frame length");
+	CHECK((len != s->len + 1) || (memcmp(&frame[1], s->data, s->len) == 0),
+			"Frame data");
+}
+
+/* An AX25 prim as the rx paths make it: Frame and FCS */
+static primitive_t *make_prim(const uint8_t *data, size_t len, bool sg)
+{
+	primitive_t *prim;
+	uint8_t *p;
+	uint16_t fcs = kiss_ax25_fcs(data, len);
+
+	if (!sg) {
+		prim = new_prim(len + 2, AX25, -1, 0, 0, NULL);
+		memcpy(prim->payload, data, len);
+		prim->payload[len]     = fcs % 0x0100;
+		prim->payload[len + 1] = fcs / 0x0100;
+		return prim;
+	}
+	/* Two slices, the FCS is split between them */
+	prim = new_prim_sg(2, AX25, -1, 0, 0, NULL);
+	p = prim_sg_append_new(prim, 0, len, 1, NULL);
+	memcpy(p, data, len);
+	p = prim_sg_put(prim, 1);
+	CHECK(p, "prim_sg_put");
+	*p = fcs % 0x0100;
+	p = prim_sg_append_new(prim, 0, 1, 0, NULL);
+	*p = fcs / 0x0100;
+	return prim;
+}
+
+static void round_trip(bool with_smack)
+{
+	struct kiss_writer w;
+	struct kiss_decoder d;
+	primitive_t *prim;
+	size_t i, o, n;
+	int j, r;
+
+	smack = with_smack;
+	n_sent = n_got = 0;
+	out_len = 0;
+	kiss_writer_init(&w, t_writev, NULL);
+	CHECK(kiss_decoder_init(&d, FRAME_MAX + 3), "kiss_decoder_init");
+	for (j = 0; j < N_FRAMES; ++j) {
+		struct sent *s = &sent[n_sent++];
+		s->cmd = (uint8_t)(((j % 8) << 4) | KISS_DATA);
+		s->len = 1 + rand() % (FRAME_MAX - 1);
+		for (i = 0; i < s->len; ++i) {
+			/* Plenty of octets to escape */
+			r = rand() % 8;
+			s->data[i] = (r == 0) ? FEND : (r == 1) ? FESC : rand();
+		} /* end for */
+		prim = make_prim(s->data, s->len, j % 3 == 0);
+		CHECK(kiss_put(&w, s->cmd, prim, smack), "kiss_put");
+		del_prim(prim);
+		if (rand() % 10 == 0)
+			CHECK(kiss_flush(&w), "kiss_flush");
+	} /* end for */
+	CHECK(kiss_flush(&w), "kiss_flush");
+	/* Decode in chunks that do not care for frame boundaries */
+	for (o = 0; o < out_len; o += n) {
+		n = 1 + rand() % 700;
+		if (o + n > out_len)
+			n = out_len - o;
+		kiss_decode(&d, &out[o], n, t_frame, NULL);
+	} /* end for */
+	CHECK(n_got == n_sent, "Frames lost");
+	kiss_decoder_destroy(&d);
+}
+
+static void smack_corrupt(void)
+{
+	uint8_t frame[] = { KISS_SMACK, 'A', 'B', 'C', 0, 0 };
+	uint16_t crc = kiss_crc16(0, frame, 4);
+
+	frame[4] = crc % 0x0100;
+	frame[5] = crc / 0x0100;
+	CHECK(kiss_smack_check(frame, sizeof(frame)) == 4, "Good SMACK CRC");
+	frame[2] ^= 0x01;
+	CHECK(kiss_smack_check(frame, sizeof(frame)) == 0, "Bad SMACK CRC");
+}
+
+static void check_values(void)
+{
+	const uint8_t *s = (const uint8_t*)"123456789";
+
+	/* Check values of CRC-16/X-25 and CRC-16/ARC */
+	CHECK(kiss_ax25_fcs(s, 9) == 0x906e, "AX.25 FCS");
+	CHECK(kiss_crc16(0, s, 9) == 0xbb3d, "SMACK CRC");
+}
+
+int main(int argc, char *argv[])
+{
+	registerMemoryManager(&mmi);
+	srand(1);
+	check_values();
+	smack_corrupt();
+	round_trip(false);
+	round_trip(true);
+	CHECK(n_blocks == 0, "Blocks leaked");
+	if (failed) {
+		fprintf(stderr, "test_kiss: %i checks failed\n", failed);
+		return EXIT_FAILURE;
+	}
+	printf("test_kiss: OK\n");
+	return EXIT_SUCCESS;
+}
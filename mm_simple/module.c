@@ -111,6 +111,43 @@ static void mem_free_impl(void *ptr) {
 	pthread_mutex_unlock(&lock);
 }
 
+static uint32_t mem_refs_impl(void *ptr)
+{
+	struct mem *mem;
+	uint32_t refs;
+	int erc;
+
+	if (!ptr)
+		return 0;
+	erc = pthread_mutex_lock(&lock);
+	assert(erc == 0);
+	mem = getContainer(ptr);
+	refs = mem->c_locks;
+	erc = pthread_mutex_unlock(&lock);
+	assert(erc == 0);
+	return refs;
+}
+
+static bool mem_unref_impl(void *ptr)
+{
+	struct mem *mem;
+	bool last;
+	int erc;
+
+	if (!ptr)
+		return false;
+	erc = pthread_mutex_lock(&lock);
+	assert(erc == 0);
+	mem = getContainer(ptr);
+	assert(mem->c_locks);
+	last = (mem->c_locks == 1);
+	if (!last)
+		mem->c_locks -= 1;
+	erc = pthread_mutex_unlock(&lock);
+	assert(erc == 0);
+	return last;
+}
+
 static void mem_chck_impl(void *ptr) {
 	assert(ptr);
 	pthread_mutex_lock(&lock);
@@ -123,7 +160,9 @@ static struct mm_interface mmi = {
 		.mem_free  = mem_free_impl,
 		.mem_lock  = mem_lock_impl,
 		.mem_size  = mem_size_impl,
-		.mem_chck  = mem_chck_impl
+		.mem_chck  = mem_chck_impl,
+		.mem_refs  = mem_refs_impl,
+		.mem_unref = mem_unref_impl
 };
 
 static struct plugin_handle {
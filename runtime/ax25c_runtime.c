@@ -80,8 +80,16 @@ void runtime_initialize(void)
 
 void runtime_terminate(void)
 {
+	struct mem_stats mem_stats;
+
 	ax25c_tick_term();
 	ax25c_dlsap_term();
+	if (configuration.loglevel >= DEBUG_LEVEL_INFO) {
+		mem_get_stats(&mem_stats);
+		ax25c_log(DEBUG_LEVEL_INFO,
+				"RUNTIME: %lu mem_alloc, %lu mem_lock, %lu mem_free",
+				mem_stats.n_alloc, mem_stats.n_lock, mem_stats.n_free);
+	}
 	ax25c_log_term();
 	monitor_destroy();
 }
@@ -0,0 +1,276 @@
+/*
+ *  Project: ax25c - File: callsign.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "callsign.h"
+#include "exception.h"
+#include "_internal.h"
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <assert.h>
+
+/*
+ * Octet of a callsign character, already shifted. 0 for all characters
+ * that are not allowed in a callsign.
+ */
+static const uint8_t char2octet[256] = {
+		['0'] = 0x60, ['1'] = 0x62, ['2'] = 0x64, ['3'] = 0x66, ['4'] = 0x68, ['5'] = 0x6a,
+		['6'] = 0x6c, ['7'] = 0x6e, ['8'] = 0x70, ['9'] = 0x72, ['A'] = 0x82, ['B'] = 0x84,
+		['C'] = 0x86, ['D'] = 0x88, ['E'] = 0x8a, ['F'] = 0x8c, ['G'] = 0x8e, ['H'] = 0x90,
+		['I'] = 0x92, ['J'] = 0x94, ['K'] = 0x96, ['L'] = 0x98, ['M'] = 0x9a, ['N'] = 0x9c,
+		['O'] = 0x9e, ['P'] = 0xa0, ['Q'] = 0xa2, ['R'] = 0xa4, ['S'] = 0xa6, ['T'] = 0xa8,
+		['U'] = 0xaa, ['V'] = 0xac, ['W'] = 0xae, ['X'] = 0xb0, ['Y'] = 0xb2, ['Z'] = 0xb4,
+		['a'] = 0x82, ['b'] = 0x84, ['c'] = 0x86, ['d'] = 0x88, ['e'] = 0x8a, ['f'] = 0x8c,
+		['g'] = 0x8e, ['h'] = 0x90, ['i'] = 0x92, ['j'] = 0x94, ['k'] = 0x96, ['l'] = 0x98,
+		['m'] = 0x9a, ['n'] = 0x9c, ['o'] = 0x9e, ['p'] = 0xa0, ['q'] = 0xa2, ['r'] = 0xa4,
+		['s'] = 0xa6, ['t'] = 0xa8, ['u'] = 0xaa, ['v'] = 0xac, ['w'] = 0xae, ['x'] = 0xb0,
+		['y'] = 0xb2, ['z'] = 0xb4,
+};
+
+/*
+ * Text of the SSIDs, including the separator.
+ */
+static const char ssid2text[16][4] = {
+		"-0",  "-1",  "-2",  "-3",  "-4",  "-5",  "-6",  "-7",
+		"-8",  "-9",  "-10", "-11", "-12", "-13", "-14", "-15"
+};
+
+static const char *__skipWhitespace(const char *str)
+{
+	while ((*str) && isspace(*str))
+		++str;
+	return str;
+}
+
+callsign callsignFromString(const char *str, const char **next,
+							struct exception *ex)
+{
+	size_t i = 0;
+	uint8_t octet;
+	int _ssid = 0;
+	const char *_str = str;
+	union _callsign c;
+
+	assert(str);
+	/* Preset with blanks, the characters are overwritten below */
+	c.encoded = 0;
+	memset(c.octets, 0x40, 6);
+	while ((i < 7) && (octet = char2octet[(uint8_t)*str])) {
+		c.octets[i++] = octet;
+		++str;
+	} /* end while */
+	if (i > 6) {
+		exception_fill(ex, EXIT_FAILURE, MODULE_NAME, "callsignFromString",
+				"Callsign too long (max. 6 characters)", _str);
+		return 0;
+	}
+	if ((*str != '\0') && (*str != '-') && !isspace(*str)) {
+		exception_fill(ex, EXIT_FAILURE, MODULE_NAME, "callsignFromString",
+				"Invalid callsign character", _str);
+		return 0;
+	}
+	if (i == 0) {
+		exception_fill(ex, EXIT_FAILURE, MODULE_NAME, "callsignFromString",
+				"Callsign too short (min. 1 character)", _str);
+		return 0;
+	}
+	if (*str == '-') {
+		++str;
+		while ((*str >= '0') && (*str <= '9')) {
+			_ssid = _ssid * 10 + (*str++ - '0');
+			if (_ssid >= 16) {
+				exception_fill(ex, EXIT_FAILURE, MODULE_NAME,
+						"callsignFromString",
+						"SSID is out of range (0..15)", _str);
+				return 0;
+			}
+		} /* end while */
+	}
+	c.octets[6] = 0x60 | (_ssid << 1);
+	if (next)
+		*next = __skipWhitespace(str);
+	return c.encoded;
+}
+
+static int __tooShort(const char *func, struct exception *ex)
+{
+	assert(func);
+	exception_fill(ex, EXIT_FAILURE, MODULE_NAME, func, "Buffer too short", "");
+	return -1;
+}
+
+/*
+ * Decode a callsign into a buffer with at least CALLSIGN_TEXT_SIZE chars.
+ * Blanks are written but not counted, so they are overwritten by the
+ * next character.
+ */
+static inline size_t __decode(const union _callsign *c, char *pb)
+{
+	size_t i, n = 0;
+	const char *ssid;
+
+	for (i = 0; i < 6; ++i) {
+		pb[n] = (char)(c->octets[i] >> 1);
+		n += (pb[n] != ' ');
+	} /* end for */
+	ssid = ssid2text[(c->octets[6] & 0x1e) >> 1];
+	memcpy(&pb[n], ssid, 4);
+	return n + 2 + (ssid[2] != '\0');
+}
+
+/*
+ * Cache of decoded callsigns. The slots are protected by a sequence
+ * counter: readers never wait and retry by decoding on their own, writers
+ * that find a slot busy just do not cache.
+ */
+#define CALLSIGN_CACHE_SIZE 256
+
+struct callsign_cache_slot {
+	uint32_t seq;                        /**< Odd while written.   */
+	uint32_t len;                        /**< Length of text.      */
+	callsign key;                        /**< Cached callsign.     */
+	char     text[CALLSIGN_TEXT_SIZE];   /**< Decoded callsign.    */
+};
+
+static struct callsign_cache_slot callsign_cache[CALLSIGN_CACHE_SIZE];
+
+static inline callsign __cacheKey(callsign call)
+{
+	union _callsign c;
+
+	c.encoded = call;
+	c.octets[6] &= 0x1e;
+	return c.encoded;
+}
+
+static inline struct callsign_cache_slot *__cacheSlot(callsign key)
+{
+	return &callsign_cache[(key * 0x9e3779b97f4a7c15ULL) >> 56];
+}
+
+static bool __cacheGet(callsign key, char *pb, size_t *len)
+{
+	struct callsign_cache_slot *slot = __cacheSlot(key);
+	uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+	if (seq & 1)
+		return false;
+	if (__atomic_load_n(&slot->key, __ATOMIC_RELAXED) != key)
+		return false;
+	*len = slot->len;
+	memcpy(pb, slot->text, CALLSIGN_TEXT_SIZE);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq);
+}
+
+static void __cachePut(callsign key, const char *pb, size_t len)
+{
+	struct callsign_cache_slot *slot = __cacheSlot(key);
+	uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+	if (seq & 1)
+		return;
+	if (!__atomic_compare_exchange_n(&slot->seq, &seq, seq + 1, false,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		return;
+	__atomic_thread_fence(__ATOMIC_RELEASE); /*---v*/
+	__atomic_store_n(&slot->key, key, __ATOMIC_RELAXED);
+	slot->len = len;
+	memcpy(slot->text, pb, CALLSIGN_TEXT_SIZE);
+	__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE); /*---^*/
+}
+
+int callsignToString(callsign call, char *pb, size_t cb, struct exception *ex)
+{
+	union _callsign c;
+	char text[CALLSIGN_TEXT_SIZE];
+	size_t len;
+	callsign key;
+
+	if (!call) {
+		if (cb < 7)
+			return __tooShort("callsignToString", ex);
+		strcpy(pb, "<NULL>");
+		return 6;
+	}
+	assert(call);
+	assert(pb);
+	assert(cb);
+	key = __cacheKey(call);
+	if (!__cacheGet(key, text, &len)) {
+		c.encoded = key;
+		len = __decode(&c, text);
+		__cachePut(key, text, len);
+	}
+	if (len >= cb)
+		return __tooShort("callsignToString", ex);
+	memcpy(pb, text, len + 1);
+	return len;
+}
+
+int callsignPathFromString(const char *str, callsign *path, size_t max,
+		struct exception *ex)
+{
+	size_t n = 0;
+	const char *next;
+
+	assert(str);
+	assert(path);
+	str = __skipWhitespace(str);
+	while (*str) {
+		if (n == max) {
+			exception_fill(ex, EXIT_FAILURE, MODULE_NAME,
+					"callsignPathFromString", "Too many digipeaters", str);
+			return -1;
+		}
+		path[n] = callsignFromString(str, &next, ex);
+		if (!path[n])
+			return -1;
+		++n;
+		str = next;
+	} /* end while */
+	if (n == 0) {
+		exception_fill(ex, EXIT_FAILURE, MODULE_NAME,
+				"callsignPathFromString", "No destination", "");
+		return -1;
+	}
+	return n;
+}
+
+int callsignPathToString(const callsign *path, size_t n, char *pb,
+		size_t cb, struct exception *ex)
+{
+	size_t i;
+	int l = 0, _l;
+
+	assert(path);
+	assert(pb);
+	assert(cb);
+	pb[0] = '\0';
+	for (i = 0; i < n; ++i) {
+		if (i > 0) {
+			if (l + 1 >= cb)
+				return __tooShort("callsignPathToString", ex);
+			pb[l++] = ' ';
+		}
+		_l = callsignToString(path[i], &pb[l], cb - l, ex);
+		if (_l < 0)
+			return -1;
+		l += _l;
+	} /* end for */
+	return l;
+}
@@ -0,0 +1,113 @@
+/*
+ *  Project: ax25c - File: callsign.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file callsign.h
+ * @brief Conversion of AX.25 callsigns between text and binary notation.
+ */
+#ifndef RUNTIME_CALLSIGN_H_
+#define RUNTIME_CALLSIGN_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct exception;
+
+/**
+ * @brief Internal representation of callsigns.
+ */
+typedef uint64_t callsign;
+
+union _callsign {
+	callsign encoded;
+	uint8_t octets[7];
+};
+
+/**
+ * @brief Encode a callsign from string notation.
+ * @param str String notation to encode into a callsign.
+ * @param next Pointer to next char after the callsign. May be NULL.
+ * @param ex Exception struct, optional.
+ * @return Encoded callsign or 0, in the case of an error. Param ex will
+ *         contain detailed information about the problem otherwise.
+ */
+extern callsign callsignFromString(const char *str, const char **next,
+		struct exception *ex);
+
+/**
+ * @brief Get a callsign from a frame.
+ * @param frame Pointer into a frame.
+ * @return Callsign.
+ */
+static inline callsign callsignFromFrame(const uint8_t *frame)
+{
+	union _callsign c;
+	c.encoded = 0;
+	memcpy(c.octets, frame, 7);
+	return c.encoded;
+}
+
+/**
+ * @brief Max. size of a decoded callsign including the terminating 0,
+ *        e.g. "DF9RY-15".
+ */
+#define CALLSIGN_TEXT_SIZE 12
+
+/**
+ * @brief Decode a callsign to a string buffer. Recently decoded callsigns
+ *        are taken from a cache, so this is cheap enough to be called for
+ *        every address of every monitored frame.
+ * @param call Internal callsign representation to decode.
+ * @param pb Pointer to target char buffer.
+ * @param cb Size of the target char buffer.
+ * @param ex Exception struct, optional.
+ * @return Number of bytes used from buffer. When -1, an error happened.
+ *         Param ex will contain detailed Information about the problem.
+ */
+extern int callsignToString(callsign call, char *pb, size_t cb,
+								struct exception *ex);
+
+/**
+ * @brief Encode a path (destination followed by digipeaters) from string
+ *        notation, e.g. "DF9RY-1 DB0XYZ".
+ * @param str String notation of the path.
+ * @param path Array that receives the callsigns.
+ * @param max Size of the array.
+ * @param ex Exception struct, optional.
+ * @return Number of callsigns in the path or -1 in the case of an error.
+ *         Param ex will contain detailed information about the problem then.
+ */
+extern int callsignPathFromString(const char *str, callsign *path, size_t max,
+		struct exception *ex);
+
+/**
+ * @brief Decode a path (destination followed by digipeaters) into string
+ *        notation.
+ * @param path Array of callsigns.
+ * @param n Number of callsigns in the path.
+ * @param pb Pointer to target char buffer.
+ * @param cb Size of the target char buffer.
+ * @param ex Exception struct, optional.
+ * @return Number of bytes used from buffer. When -1, an error happened.
+ *         Param ex will contain detailed Information about the problem.
+ */
+extern int callsignPathToString(const callsign *path, size_t n, char *pb,
+		size_t cb, struct exception *ex);
+
+#endif /* RUNTIME_CALLSIGN_H_ */
@@ -17,6 +17,115 @@
 
 #include "dl_prim.h"
 #include "primitive.h"
+#include "exception.h"
+#include "_internal.h"
+
+#include <errno.h>
+
+/* Max. length of an address in string notation */
+#define S_ADDR 256
+
+static int param_cstr(prim_param_t *param, char *pb, size_t cb,
+		const char *func, struct exception *ex)
+{
+	uint16_t size;
+
+	if (!param) {
+		exception_fill(ex, EINVAL, MODULE_NAME, func, "No address", "");
+		return -1;
+	}
+	size = get_prim_param_size(param);
+	if (size >= cb) {
+		exception_fill(ex, EXIT_FAILURE, MODULE_NAME, func,
+				"Buffer too short", "");
+		return -1;
+	}
+	memcpy(pb, get_prim_param_data(param), size);
+	pb[size] = '\0';
+	return size;
+}
+
+int get_DL_dst_path(primitive_t *prim, callsign *path, size_t max,
+		struct exception *ex)
+{
+	prim_param_t *param = get_DL_dst_param(prim);
+	uint16_t size = get_prim_param_size(param);
+	char buf[S_ADDR];
+
+	assert(path);
+	if (!is_DL_binary_addr(prim)) {
+		if (param_cstr(param, buf, S_ADDR, "get_DL_dst_path", ex) < 0)
+			return -1;
+		return callsignPathFromString(buf, path, max, ex);
+	}
+	if ((size == 0) || (size % sizeof(callsign))
+			|| (size / sizeof(callsign) > max)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "get_DL_dst_path",
+				"Invalid destination path", "");
+		return -1;
+	}
+	memcpy(path, get_prim_param_data(param), size);
+	return size / sizeof(callsign);
+}
+
+callsign get_DL_src_callsign(primitive_t *prim, struct exception *ex)
+{
+	prim_param_t *param = get_DL_src_param(prim);
+	char buf[S_ADDR];
+	const char *next;
+	callsign call;
+
+	if (!is_DL_binary_addr(prim)) {
+		if (param_cstr(param, buf, S_ADDR, "get_DL_src_callsign", ex) < 0)
+			return 0;
+		call = callsignFromString(buf, &next, ex);
+		if (call && *next) {
+			exception_fill(ex, EXIT_FAILURE, MODULE_NAME,
+					"get_DL_src_callsign", "Exceeding chars after callsign",
+					buf);
+			return 0;
+		}
+		return call;
+	}
+	if (get_prim_param_size(param) != sizeof(callsign)) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "get_DL_src_callsign",
+				"Invalid source", "");
+		return 0;
+	}
+	memcpy(&call, get_prim_param_data(param), sizeof(callsign));
+	return call;
+}
+
+int get_DL_dst_cstr(primitive_t *prim, char *pb, size_t cb,
+		struct exception *ex)
+{
+	callsign path[DL_MAX_PATH];
+	int n;
+
+	assert(pb);
+	if (!is_DL_binary_addr(prim))
+		return param_cstr(get_DL_dst_param(prim), pb, cb,
+				"get_DL_dst_cstr", ex);
+	n = get_DL_dst_path(prim, path, DL_MAX_PATH, ex);
+	if (n < 0)
+		return -1;
+	return callsignPathToString(path, n, pb, cb, ex);
+}
+
+int get_DL_src_cstr(primitive_t *prim, char *pb, size_t cb,
+		struct exception *ex)
+{
+	callsign call;
+
+	assert(pb);
+	if (!is_DL_binary_addr(prim))
+		return param_cstr(get_DL_src_param(prim), pb, cb,
+				"get_DL_src_cstr", ex);
+	call = get_DL_src_callsign(prim, ex);
+	if (!call)
+		return -1;
+	return callsignToString(call, pb, cb, ex);
+}
 
 primitive_t *new_DL_CONNECT_Request(
 		uint16_t clientHandle,
@@ -24,14 +133,12 @@ primitive_t *new_DL_CONNECT_Request(
 		const uint8_t *srcAddrPtr, uint8_t srcAddrSize,
 		struct exception *ex)
 {
-	int i = 0;
-	uint32_t payloadSize = dstAddrSize + srcAddrSize + 4;
-	primitive_t *prim = new_prim(payloadSize, DL, DL_CONNECT_REQUEST,
+	const uint8_t *pp[] = { dstAddrPtr, srcAddrPtr };
+	const uint16_t cp[] = { dstAddrSize, srcAddrSize };
+	primitive_t *prim = new_prim_params(2, pp, cp, DL, DL_CONNECT_REQUEST,
 			clientHandle, 0, ex);
 	if (!prim)
 		return NULL;
-	i = put_prim_param(prim, i, dstAddrPtr, dstAddrSize);
-	i = put_prim_param(prim, i, srcAddrPtr, srcAddrSize);
 	mem_chck(prim);
 	return prim;
 }
@@ -42,14 +149,12 @@ primitive_t *new_DL_CONNECT_Indication(
 		const uint8_t *srcAddrPtr, uint8_t srcAddrSize,
 		struct exception *ex)
 {
-	int i = 0;
-	uint32_t payloadSize = dstAddrSize + srcAddrSize + 4;
-	primitive_t *prim = new_prim(payloadSize, DL, DL_CONNECT_INDICATION,
+	const uint8_t *pp[] = { dstAddrPtr, srcAddrPtr };
+	const uint16_t cp[] = { dstAddrSize, srcAddrSize };
+	primitive_t *prim = new_prim_params(2, pp, cp, DL, DL_CONNECT_INDICATION,
 			0, serverHandle, ex);
 	if (!prim)
 		return NULL;
-	i = put_prim_param(prim, i, dstAddrPtr, dstAddrSize);
-	i = put_prim_param(prim, i, srcAddrPtr, srcAddrSize);
 	mem_chck(prim);
 	return prim;
 }
@@ -59,13 +164,12 @@ primitive_t *new_DL_DATA_Request(
 		const uint8_t *pData, uint16_t sData,
 		struct exception *ex)
 {
-	int i = 0;
-	uint32_t payloadSize = sData + 2;
-	primitive_t *prim = new_prim(payloadSize, DL, DL_DATA_REQUEST,
+	const uint8_t *pp[] = { pData };
+	const uint16_t cp[] = { sData };
+	primitive_t *prim = new_prim_params(1, pp, cp, DL, DL_DATA_REQUEST,
 			clientHandle, serverHandle, ex);
 	if (!prim)
 		return NULL;
-	i = put_prim_param(prim, i, pData, sData);
 	mem_chck(prim);
 	return prim;
 }
@@ -75,13 +179,12 @@ primitive_t *new_DL_DATA_Indication(
 		const uint8_t *pData, uint16_t sData,
 		struct exception *ex)
 {
-	int i = 0;
-	uint32_t payloadSize = sData + 2;
-	primitive_t *prim = new_prim(payloadSize, DL, DL_DATA_INDICATION,
+	const uint8_t *pp[] = { pData };
+	const uint16_t cp[] = { sData };
+	primitive_t *prim = new_prim_params(1, pp, cp, DL, DL_DATA_INDICATION,
 			clientHandle, serverHandle, ex);
 	if (!prim)
 		return NULL;
-	i = put_prim_param(prim, i, pData, sData);
 	mem_chck(prim);
 	return prim;
 }
@@ -93,15 +196,12 @@ primitive_t *new_DL_UNIT_DATA_Request(
 		const uint8_t *pData, uint16_t sData,
 		struct exception *ex)
 {
-	int i = 0;
-	uint32_t payloadSize = dstAddrSize + srcAddrSize + sData + 6;
-	primitive_t *prim = new_prim(payloadSize, DL, DL_UNIT_DATA_REQUEST,
+	const uint8_t *pp[] = { dstAddrPtr, srcAddrPtr, pData };
+	const uint16_t cp[] = { dstAddrSize, srcAddrSize, sData };
+	primitive_t *prim = new_prim_params(3, pp, cp, DL, DL_UNIT_DATA_REQUEST,
 			clientHandle, 0, ex);
 	if (!prim)
 		return NULL;
-	i = put_prim_param(prim, i, dstAddrPtr, dstAddrSize);
-	i = put_prim_param(prim, i, srcAddrPtr, srcAddrSize);
-	i = put_prim_param(prim, i, pData, sData);
 	mem_chck(prim);
 	return prim;
 }
@@ -113,15 +213,12 @@ primitive_t *new_DL_UNIT_DATA_Indication(
 		const uint8_t *pData, uint16_t sData,
 		struct exception *ex)
 {
-	int i = 0;
-	uint32_t payloadSize = dstAddrSize + srcAddrSize + sData + 6;
-	primitive_t *prim = new_prim(payloadSize, DL, DL_UNIT_DATA_INDICATION,
+	const uint8_t *pp[] = { dstAddrPtr, srcAddrPtr, pData };
+	const uint16_t cp[] = { dstAddrSize, srcAddrSize, sData };
+	primitive_t *prim = new_prim_params(3, pp, cp, DL, DL_UNIT_DATA_INDICATION,
 			0, serverHandle, ex);
 	if (!prim)
 		return NULL;
-	i = put_prim_param(prim, i, dstAddrPtr, dstAddrSize);
-	i = put_prim_param(prim, i, srcAddrPtr, srcAddrSize);
-	i = put_prim_param(prim, i, pData, sData);
 	mem_chck(prim);
 	return prim;
 }
@@ -133,15 +230,12 @@ primitive_t *new_DL_TEST_Request(
 		const uint8_t *pData, uint16_t sData,
 		struct exception *ex)
 {
-	int i = 0;
-	uint32_t payloadSize = dstAddrSize + srcAddrSize + sData + 6;
-	primitive_t *prim = new_prim(payloadSize, DL, DL_TEST_REQUEST,
+	const uint8_t *pp[] = { dstAddrPtr, srcAddrPtr, pData };
+	const uint16_t cp[] = { dstAddrSize, srcAddrSize, sData };
+	primitive_t *prim = new_prim_params(3, pp, cp, DL, DL_TEST_REQUEST,
 			clientHandle, 0, ex);
 	if (!prim)
 		return NULL;
-	i = put_prim_param(prim, i, dstAddrPtr, dstAddrSize);
-	i = put_prim_param(prim, i, srcAddrPtr, srcAddrSize);
-	i = put_prim_param(prim, i, pData, sData);
 	mem_chck(prim);
 	return prim;
 }
@@ -153,15 +247,12 @@ primitive_t *new_DL_TEST_Indication(
 		const uint8_t *pData, uint16_t sData,
 		struct exception *ex)
 {
-	int i = 0;
-	uint32_t payloadSize = dstAddrSize + srcAddrSize + sData + 6;
-	primitive_t *prim = new_prim(payloadSize, DL, DL_TEST_INDICATION,
+	const uint8_t *pp[] = { dstAddrPtr, srcAddrPtr, pData };
+	const uint16_t cp[] = { dstAddrSize, srcAddrSize, sData };
+	primitive_t *prim = new_prim_params(3, pp, cp, DL, DL_TEST_INDICATION,
 			0, serverHandle, ex);
 	if (!prim)
 		return NULL;
-	i = put_prim_param(prim, i, dstAddrPtr, dstAddrSize);
-	i = put_prim_param(prim, i, srcAddrPtr, srcAddrSize);
-	i = put_prim_param(prim, i, pData, sData);
 	mem_chck(prim);
 	return prim;
 }
@@ -173,15 +264,12 @@ primitive_t *new_DL_TEST_Confirmation(
 		const uint8_t *pData, uint16_t sData,
 		struct exception *ex)
 {
-	int i = 0;
-	uint32_t payloadSize = dstAddrSize + srcAddrSize + sData + 6;
-	primitive_t *prim = new_prim(payloadSize, DL, DL_TEST_CONFIRM,
+	const uint8_t *pp[] = { dstAddrPtr, srcAddrPtr, pData };
+	const uint16_t cp[] = { dstAddrSize, srcAddrSize, sData };
+	primitive_t *prim = new_prim_params(3, pp, cp, DL, DL_TEST_CONFIRM,
 			clientHandle, serverHandle, ex);
 	if (!prim)
 		return NULL;
-	i = put_prim_param(prim, i, dstAddrPtr, dstAddrSize);
-	i = put_prim_param(prim, i, srcAddrPtr, srcAddrSize);
-	i = put_prim_param(prim, i, pData, sData);
 	mem_chck(prim);
 	return prim;
 }
@@ -19,8 +19,10 @@
 #define RUNTIME_DL_PRIM_H_
 
 #include "primitive.h"
+#include "callsign.h"
 
 #include <stdint.h>
+#include <stdbool.h>
 
 enum DL_CMD {
 	DL_CONNECT_REQUEST       =  0,
@@ -44,6 +46,31 @@ enum DL_CMD {
 	DL_TEST_CONFIRM          = 18
 };
 
+/**
+ * @brief Flag for DL primitives that carry their addresses as binary
+ *        callsigns instead of strings. The destination param is then an
+ *        array of callsigns (destination followed by the digipeaters), the
+ *        source param a single callsign.
+ */
+#define DL_FLAG_BINARY_ADDR 0x0001
+
+/**
+ * @brief Max. number of callsigns in a destination path (destination and
+ *        digipeaters).
+ */
+#define DL_MAX_PATH 9
+
+/**
+ * @brief Check if a DL primitive carries binary addresses.
+ * @param prim Pointer to DL primitive.
+ * @return True, when the addresses are binary callsigns.
+ */
+static inline bool is_DL_binary_addr(const primitive_t *prim)
+{
+	return (prim && (prim->protocol == DL)
+			&& (prim->flags & DL_FLAG_BINARY_ADDR));
+}
+
 /**
  * @brief Get destination param of a DL primitive.
  * @param Pointer to DL primitive.
@@ -77,9 +104,60 @@ static inline prim_param_t *get_DL_data_param(primitive_t *prim)
 {
 	if ((prim == NULL) || (prim->protocol != DL))
 		return NULL;
-	return get_prim_param(prim, 2);
+	switch (prim->cmd) {
+	case DL_DATA_REQUEST:
+	case DL_DATA_INDICATION:
+		return get_prim_param(prim, 0);
+	default:
+		return get_prim_param(prim, 2);
+	} /* end switch */
 }
 
+/**
+ * @brief Get the destination path of a DL primitive. Binary addresses are
+ *        copied as they are, string addresses are parsed.
+ * @param prim Pointer to DL primitive.
+ * @param path Array that receives the destination and the digipeaters.
+ * @param max Size of the array.
+ * @param ex Exception struct, optional.
+ * @return Number of callsigns in path or -1 in the case of an error.
+ */
+extern int get_DL_dst_path(primitive_t *prim, callsign *path, size_t max,
+		struct exception *ex);
+
+/**
+ * @brief Get the source callsign of a DL primitive. Binary addresses are
+ *        copied as they are, string addresses are parsed.
+ * @param prim Pointer to DL primitive.
+ * @param ex Exception struct, optional.
+ * @return Source callsign or 0 in the case of an error.
+ */
+extern callsign get_DL_src_callsign(primitive_t *prim, struct exception *ex);
+
+/**
+ * @brief Get the destination of a DL primitive in string notation,
+ *        regardless of the encoding.
+ * @param prim Pointer to DL primitive.
+ * @param pb Pointer to target char buffer.
+ * @param cb Size of the target char buffer.
+ * @param ex Exception struct, optional.
+ * @return Number of bytes used from buffer or -1 in the case of an error.
+ */
+extern int get_DL_dst_cstr(primitive_t *prim, char *pb, size_t cb,
+		struct exception *ex);
+
+/**
+ * @brief Get the source of a DL primitive in string notation, regardless
+ *        of the encoding.
+ * @param prim Pointer to DL primitive.
+ * @param pb Pointer to target char buffer.
+ * @param cb Size of the target char buffer.
+ * @param ex Exception struct, optional.
+ * @return Number of bytes used from buffer or -1 in the case of an error.
+ */
+extern int get_DL_src_cstr(primitive_t *prim, char *pb, size_t cb,
+		struct exception *ex);
+
 /**
  * @brief Create a new DL_CONNECT Request.
  * @param clientHandle Handle that will be returned in the response.
@@ -96,6 +174,32 @@ extern primitive_t *new_DL_CONNECT_Request(
 		const uint8_t *srcAddrPtr, uint8_t srcAddrSize,
 		struct exception *ex);
 
+/**
+ * @brief Create a new DL_CONNECT_Request with binary addresses.
+ * @param clientHandle Handle that will be returned in the response.
+ * @param dstPath Destination followed by the digipeaters.
+ * @param dstPathSize Number of callsigns in dstPath.
+ * @param src Source callsign.
+ * @param ex Exception struct.
+ * @return New primitive.
+ */
+static inline primitive_t *new_DL_CONNECT_Request_bin(
+		uint16_t clientHandle,
+		const callsign *dstPath, uint8_t dstPathSize,
+		callsign src,
+		struct exception *ex)
+{
+	primitive_t *prim;
+
+	assert(dstPathSize <= DL_MAX_PATH);
+	prim = new_DL_CONNECT_Request(clientHandle,
+			(const uint8_t*)dstPath, dstPathSize * sizeof(callsign),
+			(const uint8_t*)&src, sizeof(callsign), ex);
+	if (prim)
+		prim->flags |= DL_FLAG_BINARY_ADDR;
+	return prim;
+}
+
 /**
  * @brief Create a new DL_CONNECT Indication.
  * @param serverHandle Handle that will be forwarded to the client.
@@ -182,7 +286,7 @@ extern primitive_t *new_DL_DATA_Request(
  * @brief Create a new DL_DATA_Indication.
  * @param clientHandle Handle that will be returned in the response.
  * @param serverHandle Handle that will be forwarded to the client.
- * @param pData Pointer to the data.
+ * @param pData Pointer to the data. NULL reserves room for sData bytes.
  * @param sData Size of the data.
  * @param ex Exception struct.
  * @return New primitive.
@@ -211,6 +315,36 @@ extern primitive_t *new_DL_UNIT_DATA_Request(
 		const uint8_t *pData, uint16_t sData,
 		struct exception *ex);
 
+/**
+ * @brief Create a new DL_UNIT_DATA_Request with binary addresses.
+ * @param clientHandle Handle that will be returned in the response.
+ * @param dstPath Destination followed by the digipeaters.
+ * @param dstPathSize Number of callsigns in dstPath.
+ * @param src Source callsign.
+ * @param pData Pointer to the data.
+ * @param sData Size of the data.
+ * @param ex Exception struct.
+ * @return New primitive.
+ */
+static inline primitive_t *new_DL_UNIT_DATA_Request_bin(
+		uint16_t clientHandle,
+		const callsign *dstPath, uint8_t dstPathSize,
+		callsign src,
+		const uint8_t *pData, uint16_t sData,
+		struct exception *ex)
+{
+	primitive_t *prim;
+
+	assert(dstPathSize <= DL_MAX_PATH);
+	prim = new_DL_UNIT_DATA_Request(clientHandle,
+			(const uint8_t*)dstPath, dstPathSize * sizeof(callsign),
+			(const uint8_t*)&src, sizeof(callsign),
+			pData, sData, ex);
+	if (prim)
+		prim->flags |= DL_FLAG_BINARY_ADDR;
+	return prim;
+}
+
 /**
  * @brief Create a new DL_UNIT_DATA_Indication.
  * @param serverHandle Handle that will be forwarded to the client.
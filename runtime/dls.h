@@ -22,6 +22,7 @@
 
 #include <mapc/mapc.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 struct dls;
 struct exception;
@@ -29,9 +30,34 @@ struct string;
 
 typedef struct dls dls_t;
 
+/**
+ * @brief Reasons for dropping a frame, index into dls_stats.drops.
+ */
+enum dls_drop {
+	DLS_DROP_NO_PEER,    /**< No receiver or peer for the frame.   */
+	DLS_DROP_NO_MEM,     /**< Buffer allocation failed.            */
+	DLS_DROP_SEND,       /**< Send failed or was partial.          */
+	DLS_DROP_QUEUE_FULL, /**< Transmit queue full.                 */
+	DLS_DROPS
+};
+
+/*
+ * Buckets of the queue latency histogram. Bucket 0 counts frames sent
+ * in the same jiffy they were queued, bucket b waits of 2^(b-1) up to
+ * 2^b - 1 jiffies, the last bucket everything above.
+ */
+#define DLS_LATENCY_BUCKETS 16
+
 struct dls_stats {
-	size_t queue_size;
-	size_t queue_free;
+	size_t queue_size;     /**< Frames waiting for transmission.      */
+	size_t queue_free;     /**< Room left in the queue, SIZE_MAX when
+	                            it is not limited.                    */
+	unsigned long rx_frames;
+	unsigned long rx_bytes;
+	unsigned long tx_frames;
+	unsigned long tx_bytes;
+	unsigned long drops[DLS_DROPS];
+	unsigned long latency[DLS_LATENCY_BUCKETS]; /**< Queued to sent.  */
 };
 
 typedef struct dls_stats dls_stats_t;
@@ -48,9 +74,12 @@ struct dls {
 	void (*close)(dls_t *dls);
 	bool (*on_write)(dls_t *dls, primitive_t *prim, bool expedited,
 			struct exception *ex);
+	bool (*on_write_owned)(dls_t *dls, primitive_t *prim, bool expedited,
+			struct exception *ex); /* Optional, always consumes prim */
 	void (*get_queue_stats)(dls_t *dls, dls_stats_t *stats);
 	struct dls *peer;
 	void *session;
+	bool binary_addr; /* Accepts DL prims with DL_FLAG_BINARY_ADDR */
 };
 
 #endif /* RUNTIME_DLS_H_ */
@@ -229,6 +229,39 @@ bool dlsap_write(dls_t *dls, primitive_t *prim, bool expedited,
 	return dls->on_write(dls, prim, expedited, ex);
 }
 
+bool dlsap_write_owned(dls_t *dls, primitive_t *prim, bool expedited,
+		exception_t *ex)
+{
+	bool res;
+
+	if (!dls) {
+		exception_fill(ex, EXIT_FAILURE, MODULE_NAME,
+				"dlsap_write_owned",
+				"Data Link Service is NULL", NULL);
+		del_prim(prim);
+		return false;
+	}
+	if (!prim) {
+		exception_fill(ex, EXIT_FAILURE, MODULE_NAME,
+				"dlsap_write_owned",
+				"Primitive is NULL", NULL);
+		return false;
+	}
+	if (dls->on_write_owned)
+		return dls->on_write_owned(dls, prim, expedited, ex);
+	/* Fallback for services that only borrow the prim */
+	if (!dls->on_write) {
+		exception_fill(ex, EXIT_FAILURE, MODULE_NAME,
+				"dlsap_write_owned",
+				"Service not provided", dls->name);
+		del_prim(prim);
+		return false;
+	}
+	res = dls->on_write(dls, prim, expedited, ex);
+	del_prim(prim);
+	return res;
+}
+
 void get_queue_stats(dls_t *dls, dls_stats_t *stats)
 {
 	if (!stats)
@@ -101,6 +101,19 @@ extern void dlsap_close(dls_t *dls);
 extern bool dlsap_write(dls_t *dls, primitive_t *prim, bool expedited,
 		exception_t *ex);
 
+/**
+ * @brief Write a primitive to a DLS, handing over the reference of the
+ *        caller. The prim is consumed in any case, also when an error is
+ *        returned, so the caller must not call del_prim for it.
+ * @param dls Data Link Service to write to.
+ * @param prim Primitive to write.
+ * @param expedited Write expedited.
+ * @param ex Exception struct, optional.
+ * @return True when successful.
+ */
+extern bool dlsap_write_owned(dls_t *dls, primitive_t *prim, bool expedited,
+		exception_t *ex);
+
 /**
  * @brief get queue status from the peer.
  * @param dls Pointer to Data Link Service to use.
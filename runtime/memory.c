@@ -16,12 +16,20 @@
  */
 
 #include "memory.h"
+#include "runtime.h"
 
 #include <stdlib.h>
 #include <assert.h>
 
 static struct mm_interface *mm = NULL;
 
+static struct mem_stats stats;
+
+static inline void count(unsigned long *counter)
+{
+	__atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
 void registerMemoryManager(struct mm_interface *_mm)
 {
 	assert(_mm);
@@ -31,6 +39,7 @@ void registerMemoryManager(struct mm_interface *_mm)
 
 void *mem_alloc(uint32_t cb, struct exception *ex)
 {
+	count(&stats.n_alloc);
 	if (mm)
 		return mm->mem_alloc(cb, ex);
 	else
@@ -47,11 +56,13 @@ uint32_t mem_size(void *mem)
 
 void mem_lock(void *mem)
 {
+	count(&stats.n_lock);
 	if (mm)
 		mm->mem_lock(mem);
 }
 
 void mem_free(void *mem) {
+	count(&stats.n_free);
 	if (mm)
 		mm->mem_free(mem);
 }
@@ -60,3 +71,34 @@ void mem_chck(void *mem) {
 	if (mm)
 		mm->mem_chck(mem);
 }
+
+uint32_t mem_refs(void *mem)
+{
+	if (mm && mm->mem_refs)
+		return mm->mem_refs(mem);
+	else
+		return 0;
+}
+
+bool mem_unref(void *mem)
+{
+	if (mm && mm->mem_unref) {
+		if (mm->mem_unref(mem))
+			return true;
+		count(&stats.n_free);
+		return false;
+	}
+	/* Not atomic, but the best without help of the memory manager */
+	if (mem_refs(mem) <= 1)
+		return true;
+	mem_free(mem);
+	return false;
+}
+
+void mem_get_stats(struct mem_stats *_stats)
+{
+	assert(_stats);
+	_stats->n_alloc = __atomic_load_n(&stats.n_alloc, __ATOMIC_RELAXED);
+	_stats->n_lock  = __atomic_load_n(&stats.n_lock,  __ATOMIC_RELAXED);
+	_stats->n_free  = __atomic_load_n(&stats.n_free,  __ATOMIC_RELAXED);
+}
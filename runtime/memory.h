@@ -19,6 +19,7 @@
 #define RUNTIME_MEMORY_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 
 struct exception;
 
@@ -28,6 +29,8 @@ struct mm_interface {
 	void (*mem_lock)(void *mem);
 	void (*mem_free)(void *mem);
 	void (*mem_chck)(void *mem);
+	uint32_t (*mem_refs)(void *mem);
+	bool (*mem_unref)(void *mem);
 };
 
 /**
@@ -19,6 +19,7 @@
 #include "runtime.h"
 #include "primitive.h"
 #include "dl_prim.h"
+#include "primslice.h"
 #include "_internal.h"
 #include "exception.h"
 
@@ -269,10 +270,18 @@ int monitor(struct primitive *prim, char *pb, size_t cb, struct exception *ex)
 {
 	int res;
 	monitor_function *f;
+	primitive_t *flat = NULL;
 
 	assert(prim);
 	assert(pb);
 	assert(prim->protocol < PROTOCOL_UPPER);
+	/* Providers expect contiguous payload */
+	if (prim->flags & PRIM_FLAG_SEGMENTED) {
+		flat = prim_sg_flatten(prim, ex);
+		if (!flat)
+			return -ENOMEM;
+		prim = flat;
+	}
 	pthread_spin_lock(&monitor_lock);
 	f = monitor_providers[prim->protocol];
 	if (f) {
@@ -283,6 +292,7 @@ int monitor(struct primitive *prim, char *pb, size_t cb, struct exception *ex)
 		res = -ENOENT;
 	}
 	pthread_spin_unlock(&monitor_lock);
+	del_prim(flat);
 	return res;
 }
 
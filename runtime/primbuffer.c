@@ -22,7 +22,9 @@
 
 #include <uki/list.h>
 #include <uki/kernel.h>
+#include <uki/jiffies.h>
 #include <pthread.h>
+#include <time.h>
 #include <errno.h>
 #include <assert.h>
 
@@ -33,6 +35,17 @@ static inline void _cond_wait(primbuffer_t *pb)
 	pthread_mutex_unlock(&pb->cond_lock);
 }
 
+static inline bool _cond_timedwait(primbuffer_t *pb,
+		const struct timespec *abstime)
+{
+	int erc;
+
+	pthread_mutex_lock(&pb->cond_lock);
+	erc = pthread_cond_timedwait(&pb->cond, &pb->cond_lock, abstime);
+	pthread_mutex_unlock(&pb->cond_lock);
+	return (erc != ETIMEDOUT);
+}
+
 static inline void _cond_signal(primbuffer_t *pb)
 {
 	pthread_mutex_lock(&pb->cond_lock);
@@ -66,6 +79,7 @@ void primbuffer_destroy(primbuffer_t *pb)
 	while(!list_empty(&pb->routine_list))
 		list_del_init(&(list_first_entry(
 				&pb->routine_list, struct primitive, node)->node));
+	pb->size = 0;
 
 	pthread_cond_destroy(&pb->cond);
 	pthread_mutex_destroy(&pb->cond_lock);
@@ -87,17 +101,26 @@ void primbuffer_stats(primbuffer_t *pb, struct primbuffer_stats *stats)
 
 void primbuffer_write_nonblock(primbuffer_t *pb, struct primitive *prim,
 		bool expedited)
+{
+	assert(prim);
+	use_prim(prim);
+	primbuffer_push_owned(pb, prim, expedited);
+}
+
+void primbuffer_push_owned(primbuffer_t *pb, struct primitive *prim,
+		bool expedited)
 {
 	int erc;
 
 	assert(pb);
 	assert(prim);
 	mem_chck(prim);
-	use_prim(prim);
+	prim->stamp = (uint32_t)jiffies;
 	erc = pthread_spin_lock(&pb->spinlock); /*-------------------------------v*/
 	assert(erc == 0);
 	list_add_tail(&prim->node,
 			expedited ? &pb->expedited_list : &pb->routine_list);
+	__atomic_fetch_add(&pb->size, 1, __ATOMIC_RELAXED);
 	_cond_signal(pb);
 	erc = pthread_spin_unlock(&pb->spinlock); /*-----------------------------^*/
 	assert(erc == 0);
@@ -128,11 +151,44 @@ struct primitive *primbuffer_read_nonblock(primbuffer_t *pb,
 		goto exit;
 	}
 exit:
+	if (prim)
+		__atomic_fetch_sub(&pb->size, 1, __ATOMIC_RELAXED);
 	erc = pthread_spin_unlock(&pb->spinlock); /*-------------------------^*/
 	assert(erc == 0);
 	return prim;
 }
 
+size_t primbuffer_read_batch(primbuffer_t *pb, struct list_head *list,
+		size_t max, size_t *expedited)
+{
+	primitive_t *prim;
+	size_t n = 0;
+	int erc;
+
+	assert(pb);
+	assert(list);
+	erc = pthread_spin_lock(&pb->spinlock); /*---------------------------v*/
+	assert(erc == 0);
+	while ((n < max) && !list_empty(&pb->expedited_list)) {
+		prim = list_first_entry(&pb->expedited_list, struct primitive, node);
+		list_del(&prim->node);
+		list_add_tail(&prim->node, list);
+		++n;
+	} /* end while */
+	if (expedited)
+		*expedited = n;
+	while ((n < max) && !list_empty(&pb->routine_list)) {
+		prim = list_first_entry(&pb->routine_list, struct primitive, node);
+		list_del(&prim->node);
+		list_add_tail(&prim->node, list);
+		++n;
+	} /* end while */
+	__atomic_fetch_sub(&pb->size, n, __ATOMIC_RELAXED);
+	erc = pthread_spin_unlock(&pb->spinlock); /*-------------------------^*/
+	assert(erc == 0);
+	return n;
+}
+
 struct primitive *primbuffer_read_block(primbuffer_t *pb, bool *expedited)
 {
 	primitive_t *prim = NULL;
@@ -145,3 +201,26 @@ struct primitive *primbuffer_read_block(primbuffer_t *pb, bool *expedited)
 	} /* end while */
 	return prim;
 }
+
+struct primitive *primbuffer_read_timed(primbuffer_t *pb, bool *expedited,
+		int64_t timeout)
+{
+	primitive_t *prim = NULL;
+	struct timespec abstime;
+
+	assert(pb);
+	/* The condition uses the default clock */
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	abstime.tv_sec  += timeout / 1000000000;
+	abstime.tv_nsec += timeout % 1000000000;
+	if (abstime.tv_nsec >= 1000000000) {
+		abstime.tv_nsec -= 1000000000;
+		abstime.tv_sec++;
+	}
+	while (!prim) {
+		prim = primbuffer_read_nonblock(pb, expedited);
+		if (!prim && !_cond_timedwait(pb, &abstime))
+			return primbuffer_read_nonblock(pb, expedited);
+	} /* end while */
+	return prim;
+}
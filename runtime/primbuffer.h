@@ -62,6 +62,16 @@ extern void primbuffer_destroy(primbuffer_t *pb);
  */
 extern void primbuffer_stats(primbuffer_t *pb, struct primbuffer_stats *stats);
 
+/**
+ * @brief Number of prims in a primbuffer, read without the lock.
+ * @param pb Primbuffer to investigate.
+ * @return Number of prims, may be outdated as soon as it is returned.
+ */
+static inline size_t primbuffer_size(primbuffer_t *pb)
+{
+	return __atomic_load_n(&pb->size, __ATOMIC_RELAXED);
+}
+
 /**
  * @brief Write prim to primbuffer nonblocking.
  * @pb Primbuffer to write into.
@@ -71,6 +81,16 @@ extern void primbuffer_stats(primbuffer_t *pb, struct primbuffer_stats *stats);
 extern void primbuffer_write_nonblock(primbuffer_t *pb,	struct primitive *prim,
 		bool expedited);
 
+/**
+ * @brief Push prim to primbuffer nonblocking, taking over the reference of
+ *        the caller. The caller must not call del_prim for it afterwards.
+ * @pb Primbuffer to write into.
+ * @prim Prim to push.
+ * @expedited When true, this is a expedited prim.
+ */
+extern void primbuffer_push_owned(primbuffer_t *pb, struct primitive *prim,
+		bool expedited);
+
 /**
  * @brief Read prim from primbuffer, nonblocking.
  * @pb Primbuffer to read from.
@@ -81,6 +101,20 @@ extern void primbuffer_write_nonblock(primbuffer_t *pb,	struct primitive *prim,
 extern struct primitive *primbuffer_read_nonblock(primbuffer_t *pb,
 		bool *expedited);
 
+/**
+ * @brief Read a batch of prims from primbuffer, nonblocking.
+ *        Expedited prims are taken first. The spinlock is taken only once
+ *        for the whole batch.
+ * @pb Primbuffer to read from.
+ * @list List to append the prims to.
+ * @max Maximum number of prims to read.
+ * @expedited Receives the number of expedited prims, they are the first
+ *            ones appended. Optional.
+ * @return Number of prims appended to list.
+ */
+extern size_t primbuffer_read_batch(primbuffer_t *pb, struct list_head *list,
+		size_t max, size_t *expedited);
+
 /**
  * @brief Read prim from primbuffer, blocking.
  * @pb Primbuffer to read from.
@@ -90,4 +124,15 @@ extern struct primitive *primbuffer_read_nonblock(primbuffer_t *pb,
  */
 extern struct primitive *primbuffer_read_block(primbuffer_t *pb, bool *expedited);
 
+/**
+ * @brief Read prim from primbuffer, blocking for at most timeout.
+ * @pb Primbuffer to read from.
+ * @expedited. Pointer to bool that is set, when the prim is expedited.
+ *             Optional.
+ * @timeout Max. time to wait in nanoseconds.
+ * @return Prim or NULL, when the time is up.
+ */
+extern struct primitive *primbuffer_read_timed(primbuffer_t *pb,
+		bool *expedited, int64_t timeout);
+
 #endif /* RUNTIME_PRIMBUFFER_H_ */
@@ -62,6 +62,7 @@ struct primitive {
 	uint16_t    flags;        /**< Room for protocol specific flags. */
 	uint16_t    clientHandle; /**< Handle assigned by the client.    */
 	uint16_t    serverHandle; /**< Handle assigned by the server.    */
+	uint32_t    stamp;        /**< Jiffies when queued last time.    */
 	uint8_t     payload[0];   /**< Specific payload.                 */
 };
 
@@ -102,6 +103,7 @@ static inline primitive_t *new_prim(uint16_t payload_size, protocol_t protocol,
 		prim->cmd = cmd;
 		prim->clientHandle = clientHandle;
 		prim->serverHandle = serverHandle;
+		prim->stamp = 0;
 	}
 	return prim;
 }
@@ -117,6 +119,18 @@ static inline void use_prim(primitive_t *prim)
 		mem_lock(prim);
 }
 
+/**
+ * @brief Flag for scatter/gather prims, see primslice.h. This is a generic
+ *        flag, protocols must not use it for other purposes.
+ */
+#define PRIM_FLAG_SEGMENTED 0x4000
+
+/**
+ * @brief Release the payload slices of a scatter/gather prim.
+ * @param prim The prim.
+ */
+extern void prim_sg_release(primitive_t *prim);
+
 /**
  * @brief Release the prim.
  *        Please note, that this only decreases a useage counter. A real
@@ -125,12 +139,105 @@ static inline void use_prim(primitive_t *prim)
  */
 static inline void del_prim(primitive_t *prim)
 {
-	if (prim)
+	if (prim) {
+		/* The last holder of a scatter/gather prim drops the slices */
+		if (prim->flags & PRIM_FLAG_SEGMENTED) {
+			if (!mem_unref(prim))
+				return;
+			prim_sg_release(prim);
+		}
 		mem_free(prim);
+	}
+}
+
+/**
+ * @brief Flag for prims with a param index, see new_prim_params. This is
+ *        a generic flag, protocols must not use it for other purposes.
+ */
+#define PRIM_FLAG_INDEXED 0x8000
+
+/**
+ * @brief Max. number of params in an indexed prim.
+ */
+#define PRIM_MAX_PARAMS 3
+
+/**
+ * @brief Alignment of param data in an indexed prim.
+ */
+#define PRIM_PARAM_ALIGN 8
+
+/**
+ * @brief Index at the start of the payload of an indexed prim. The params
+ *        follow with the usual 2 byte size in front, placed so that the
+ *        data of every param is aligned to PRIM_PARAM_ALIGN.
+ */
+struct prim_index {
+	uint16_t n;                         /**< Number of params.       */
+	uint16_t offset[PRIM_MAX_PARAMS];   /**< Offset of every param.  */
+};
+
+/**
+ * @brief Get the offset of the next param in an indexed prim.
+ * @param o Offset behind the previous param.
+ * @return Offset of the next param.
+ */
+static inline uint32_t prim_param_offset(uint32_t o)
+{
+	return ((o + 2 + PRIM_PARAM_ALIGN - 1) & ~(PRIM_PARAM_ALIGN - 1)) - 2;
 }
 
 /**
- * @brief Get parameter from primitive.
+ * @brief Allocate a new prim with indexed params.
+ * @param n Number of params.
+ * @param pp Pointers to the param data. A NULL entry reserves room for
+ *        the param only, it is filled in by the caller later.
+ * @param cp Sizes of the params.
+ * @param protocol Protocol of the prim.
+ * @param cmd Protocol specific command.
+ * @param clientHandle Client handle.
+ * @param serverHandle Server handle.
+ * @param ex Exception structure.
+ * @return Pointer to the new prim or NULL, if the payload was too large
+ *         or no more memory is available.
+ */
+static inline primitive_t *new_prim_params(uint16_t n,
+		const uint8_t *const pp[], const uint16_t cp[],
+		protocol_t protocol, uint8_t cmd,
+		uint16_t clientHandle, uint16_t serverHandle,
+		struct exception *ex)
+{
+	struct prim_index *index;
+	primitive_t *prim;
+	uint32_t o = sizeof(struct prim_index);
+	uint16_t i;
+
+	assert(n <= PRIM_MAX_PARAMS);
+	for (i = 0; i < n; ++i)
+		o = prim_param_offset(o) + 2 + cp[i];
+	if (o > MAX_PAYLOAD_SIZE)
+		return NULL;
+	prim = new_prim(o, protocol, cmd, clientHandle, serverHandle, ex);
+	if (!prim)
+		return NULL;
+	prim->flags |= PRIM_FLAG_INDEXED;
+	index = (struct prim_index*)prim->payload;
+	index->n = n;
+	o = sizeof(struct prim_index);
+	for (i = 0; i < n; ++i) {
+		o = prim_param_offset(o);
+		index->offset[i] = o;
+		*((uint16_t*)(&prim->payload[o])) = cp[i];
+		o += 2;
+		if (pp[i])
+			memcpy(&prim->payload[o], pp[i], cp[i]);
+		o += cp[i];
+	} /* end for */
+	return prim;
+}
+
+/**
+ * @brief Get parameter from primitive. This is O(1) for indexed prims,
+ *        other prims are walked through from the start.
  * @param prim Prim to investigate.
  * @param i Parameter number.
  * @return Pointer to the parameter or NULL, when no such parameter was
@@ -139,6 +246,13 @@ static inline void del_prim(primitive_t *prim)
 static inline prim_param_t *get_prim_param(primitive_t *prim, uint16_t i)
 {
 	uint16_t o = 0, s;
+
+	if (prim->flags & PRIM_FLAG_INDEXED) {
+		const struct prim_index *index = (struct prim_index*)prim->payload;
+		if (i >= index->n)
+			return NULL;
+		return &prim->payload[index->offset[i]];
+	}
 	while (i-- > 0) {
 		if (o >= prim->size)
 			return NULL;
@@ -193,6 +307,37 @@ static inline const char *get_prim_param_cstr(prim_param_t *param,
 	return string_c(str);
 }
 
+/**
+ * @brief Shrink the last param of an indexed prim, e.g. after less data
+ *        than reserved was filled in.
+ * @param prim The indexed prim.
+ * @param size New size of the last param.
+ */
+static inline void trim_prim_param(primitive_t *prim, uint16_t size)
+{
+	const struct prim_index *index = (struct prim_index*)prim->payload;
+	uint16_t o;
+
+	assert(prim->flags & PRIM_FLAG_INDEXED);
+	assert(index->n > 0);
+	o = index->offset[index->n - 1];
+	assert(size <= *((uint16_t*)(&prim->payload[o])));
+	*((uint16_t*)(&prim->payload[o])) = size;
+	prim->size = o + 2 + size;
+}
+
+/**
+ * @brief Get writable data of a param, e.g. to fill in reserved room.
+ * @param prim The prim.
+ * @param i Parameter number.
+ * @return Pointer to the param data or NULL, if there is no such param.
+ */
+static inline uint8_t *get_prim_param_wdata(primitive_t *prim, uint16_t i)
+{
+	prim_param_t *param = get_prim_param(prim, i);
+	return param ? &prim->payload[param - prim->payload + 2] : NULL;
+}
+
 /**
  * @brief Put a param into a prim.
  * @param i Current index in prim.
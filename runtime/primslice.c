@@ -0,0 +1,290 @@
+/*
+ *  Project: ax25c - File: primslice.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "primslice.h"
+#include "runtime.h"
+#include "exception.h"
+#include "_internal.h"
+
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+primitive_t *new_prim_sg(uint16_t max_slices, protocol_t protocol,
+		uint8_t cmd, uint16_t clientHandle, uint16_t serverHandle,
+		struct exception *ex)
+{
+	primitive_t *prim;
+	struct prim_sg *sg;
+
+	prim = new_prim(sizeof(struct prim_sg)
+			+ max_slices * sizeof(struct prim_slice),
+			protocol, cmd, clientHandle, serverHandle, ex);
+	if (!prim)
+		return NULL;
+	prim->flags |= PRIM_FLAG_SEGMENTED;
+	sg = get_prim_sg(prim);
+	sg->n = 0;
+	sg->max = max_slices;
+	sg->length = 0;
+	return prim;
+}
+
+void prim_sg_release(primitive_t *prim)
+{
+	struct prim_sg *sg = get_prim_sg(prim);
+
+	while (sg->n > 0)
+		mem_free(sg->slice[--sg->n].block);
+	sg->length = 0;
+}
+
+static struct prim_slice *add_slice(primitive_t *prim, const char *func,
+		struct exception *ex)
+{
+	struct prim_sg *sg = get_prim_sg(prim);
+
+	if (sg->n >= sg->max) {
+		exception_fill(ex, ENOSPC, MODULE_NAME, func, "Too many slices", "");
+		return NULL;
+	}
+	return &sg->slice[sg->n++];
+}
+
+bool prim_sg_append(primitive_t *prim, void *block,
+		const uint8_t *data, uint16_t size, struct exception *ex)
+{
+	struct prim_slice *slice;
+
+	assert(prim);
+	assert(block);
+	assert(data >= (uint8_t*)block);
+	assert(data + size <= (uint8_t*)block + mem_size(block));
+	slice = add_slice(prim, "prim_sg_append", ex);
+	if (!slice)
+		return false;
+	mem_lock(block);
+	slice->block = block;
+	slice->offset = data - (uint8_t*)block;
+	slice->size = size;
+	get_prim_sg(prim)->length += size;
+	return true;
+}
+
+bool prim_sg_append_prim(primitive_t *prim, primitive_t *src,
+		const uint8_t *data, uint16_t size, struct exception *ex)
+{
+	assert(src);
+	if (src->flags & PRIM_FLAG_SEGMENTED) {
+		exception_fill(ex, EINVAL, MODULE_NAME, "prim_sg_append_prim",
+				"Nested scatter/gather prim", "");
+		return false;
+	}
+	assert(data >= src->payload);
+	assert(data + size <= src->payload + src->size);
+	return prim_sg_append(prim, src, data, size, ex);
+}
+
+primitive_t *prim_sg_share(primitive_t *prim, struct exception *ex)
+{
+	struct prim_sg *sg;
+	primitive_t *share;
+	uint16_t i;
+	bool ok = true;
+
+	assert(prim);
+	sg = (prim->flags & PRIM_FLAG_SEGMENTED) ? get_prim_sg(prim) : NULL;
+	share = new_prim_sg(sg ? sg->n : 1, prim->protocol, prim->cmd,
+			prim->clientHandle, prim->serverHandle, ex);
+	if (!share)
+		return NULL;
+	/* Param indices refer to a contiguous payload */
+	share->flags |= prim->flags & ~PRIM_FLAG_INDEXED;
+	if (!sg)
+		ok = prim_sg_append_prim(share, prim, prim->payload, prim->size, ex);
+	for (i = 0; sg && ok && (i < sg->n); ++i)
+		ok = prim_sg_append(share, sg->slice[i].block,
+				prim_slice_data(&sg->slice[i]), sg->slice[i].size, ex);
+	if (!ok) {
+		del_prim(share);
+		return NULL;
+	}
+	return share;
+}
+
+uint8_t *prim_sg_append_new(primitive_t *prim, uint16_t headroom,
+		uint16_t size, uint16_t tailroom, struct exception *ex)
+{
+	struct prim_slice *slice;
+	uint8_t *block;
+
+	assert(prim);
+	if ((uint32_t)headroom + size + tailroom > MAX_PAYLOAD_SIZE) {
+		exception_fill(ex, EMSGSIZE, MODULE_NAME, "prim_sg_append_new",
+				"Slice too large", "");
+		return NULL;
+	}
+	block = mem_alloc(headroom + size + tailroom, ex);
+	if (!block)
+		return NULL;
+	slice = add_slice(prim, "prim_sg_append_new", ex);
+	if (!slice) {
+		mem_free(block);
+		return NULL;
+	}
+	slice->block = block;
+	slice->offset = headroom;
+	slice->size = size;
+	get_prim_sg(prim)->length += size;
+	return &block[headroom];
+}
+
+uint8_t *prim_sg_push(primitive_t *prim, uint16_t n)
+{
+	struct prim_sg *sg = get_prim_sg(prim);
+	struct prim_slice *slice;
+
+	if (sg->n == 0)
+		return NULL;
+	slice = &sg->slice[0];
+	/* Do not write into blocks that somebody else might read */
+	if ((slice->offset < n) || (mem_refs(prim) != 1)
+			|| (mem_refs(slice->block) != 1))
+		return NULL;
+	slice->offset -= n;
+	slice->size += n;
+	sg->length += n;
+	return prim_slice_data(slice);
+}
+
+uint8_t *prim_sg_put(primitive_t *prim, uint16_t n)
+{
+	struct prim_sg *sg = get_prim_sg(prim);
+	struct prim_slice *slice;
+	uint8_t *p;
+
+	if (sg->n == 0)
+		return NULL;
+	slice = &sg->slice[sg->n - 1];
+	if ((slice->offset + slice->size + n > mem_size(slice->block))
+			|| (mem_refs(prim) != 1) || (mem_refs(slice->block) != 1))
+		return NULL;
+	p = prim_slice_data(slice) + slice->size;
+	slice->size += n;
+	sg->length += n;
+	return p;
+}
+
+bool prim_sg_pull(primitive_t *prim, uint32_t n)
+{
+	struct prim_sg *sg = get_prim_sg(prim);
+	struct prim_slice *slice;
+	uint16_t i = 0, j;
+
+	if (n > sg->length)
+		return false;
+	sg->length -= n;
+	while (n > 0) {
+		slice = &sg->slice[i];
+		if (n < slice->size) {
+			slice->offset += n;
+			slice->size -= n;
+			break;
+		}
+		n -= slice->size;
+		mem_free(slice->block);
+		++i;
+	} /* end while */
+	if (i > 0) {
+		for (j = i; j < sg->n; ++j)
+			sg->slice[j - i] = sg->slice[j];
+		sg->n -= i;
+	}
+	return true;
+}
+
+bool prim_sg_trim(primitive_t *prim, uint32_t n)
+{
+	struct prim_sg *sg = get_prim_sg(prim);
+	struct prim_slice *slice;
+
+	if (n > sg->length)
+		return false;
+	sg->length -= n;
+	while (n > 0) {
+		slice = &sg->slice[sg->n - 1];
+		if (n < slice->size) {
+			slice->size -= n;
+			break;
+		}
+		n -= slice->size;
+		mem_free(slice->block);
+		--sg->n;
+	} /* end while */
+	return true;
+}
+
+int prim_to_iovec(primitive_t *prim, struct iovec *iov, int max)
+{
+	struct prim_sg *sg;
+	int i;
+
+	assert(prim);
+	assert(iov);
+	if (!(prim->flags & PRIM_FLAG_SEGMENTED)) {
+		if (max < 1)
+			return -1;
+		iov[0].iov_base = prim->payload;
+		iov[0].iov_len = prim->size;
+		return 1;
+	}
+	sg = get_prim_sg(prim);
+	if (sg->n > max)
+		return -1;
+	for (i = 0; i < sg->n; ++i) {
+		iov[i].iov_base = prim_slice_data(&sg->slice[i]);
+		iov[i].iov_len = sg->slice[i].size;
+	} /* end for */
+	return sg->n;
+}
+
+primitive_t *prim_sg_flatten(primitive_t *prim, struct exception *ex)
+{
+	struct prim_sg *sg = get_prim_sg(prim);
+	primitive_t *flat;
+	uint32_t o = 0;
+	uint16_t i;
+
+	if (sg->length > MAX_PAYLOAD_SIZE) {
+		exception_fill(ex, EMSGSIZE, MODULE_NAME, "prim_sg_flatten",
+				"Payload too large", "");
+		return NULL;
+	}
+	flat = new_prim(sg->length, prim->protocol, prim->cmd,
+			prim->clientHandle, prim->serverHandle, ex);
+	if (!flat)
+		return NULL;
+	flat->flags = prim->flags & ~PRIM_FLAG_SEGMENTED;
+	for (i = 0; i < sg->n; ++i) {
+		memcpy(&flat->payload[o], prim_slice_data(&sg->slice[i]),
+				sg->slice[i].size);
+		o += sg->slice[i].size;
+	} /* end for */
+	assert(o == sg->length);
+	mem_chck(flat);
+	return flat;
+}
@@ -0,0 +1,209 @@
+/*
+ *  Project: ax25c - File: primslice.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file primslice.h
+ * @brief Scatter/gather primitives. The payload of such a prim is a list
+ *        of slices of refcounted memory blocks instead of one contiguous
+ *        block. Slices can have headroom and tailroom, so that protocol
+ *        layers can add or strip headers in place, and they can be handed
+ *        to sendmsg without flattening.
+ */
+#ifndef RUNTIME_PRIMSLICE_H_
+#define RUNTIME_PRIMSLICE_H_
+
+#include "primitive.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+struct exception;
+
+/**
+ * @brief One slice of payload.
+ */
+struct prim_slice {
+	uint8_t  *block;   /**< Refcounted memory block (mem_alloc).  */
+	uint16_t  offset;  /**< Start of the data in the block.       */
+	uint16_t  size;    /**< Size of the data.                     */
+};
+
+/**
+ * @brief Payload of a scatter/gather prim.
+ */
+struct prim_sg {
+	uint16_t          n;         /**< Number of slices in use.     */
+	uint16_t          max;       /**< Number of slices available.  */
+	uint32_t          length;    /**< Total size of the data.      */
+	struct prim_slice slice[0];  /**< The slices.                  */
+};
+
+/**
+ * @brief Get the slice list of a scatter/gather prim.
+ * @param prim The prim.
+ * @return Slice list.
+ */
+static inline struct prim_sg *get_prim_sg(primitive_t *prim)
+{
+	assert(prim->flags & PRIM_FLAG_SEGMENTED);
+	return (struct prim_sg*)prim->payload;
+}
+
+/**
+ * @brief Get the data of a slice.
+ * @param slice The slice.
+ * @return Pointer to the data.
+ */
+static inline uint8_t *prim_slice_data(const struct prim_slice *slice)
+{
+	return &slice->block[slice->offset];
+}
+
+/**
+ * @brief Get the total size of the data of a prim, regardless whether it
+ *        is a scatter/gather prim or not.
+ * @param prim The prim.
+ * @return Size of the data.
+ */
+static inline size_t prim_length(primitive_t *prim)
+{
+	if (prim->flags & PRIM_FLAG_SEGMENTED)
+		return get_prim_sg(prim)->length;
+	return prim->size;
+}
+
+/**
+ * @brief Allocate a new scatter/gather prim without slices.
+ * @param max_slices Max. number of slices.
+ * @param protocol Protocol of the prim.
+ * @param cmd Protocol specific command.
+ * @param clientHandle Client handle.
+ * @param serverHandle Server handle.
+ * @param ex Exception structure.
+ * @return Pointer to the new prim or NULL.
+ */
+extern primitive_t *new_prim_sg(uint16_t max_slices, protocol_t protocol,
+		uint8_t cmd, uint16_t clientHandle, uint16_t serverHandle,
+		struct exception *ex);
+
+/**
+ * @brief Append a slice of an existing memory block. The block is locked
+ *        until the prim is deleted.
+ * @param prim Scatter/gather prim.
+ * @param block Memory block allocated with mem_alloc. Use
+ *        prim_sg_append_prim for slices of another prim.
+ * @param data Start of the data inside of block.
+ * @param size Size of the data.
+ * @param ex Exception structure.
+ * @return True, when successful.
+ */
+extern bool prim_sg_append(primitive_t *prim, void *block,
+		const uint8_t *data, uint16_t size, struct exception *ex);
+
+/**
+ * @brief Append a slice of the payload of another prim. The other prim is
+ *        locked until the prim is deleted. Scatter/gather prims are refused,
+ *        because a slice release does not drop their own slices.
+ * @param prim Scatter/gather prim.
+ * @param src Contiguous prim holding the data.
+ * @param data Start of the data inside of the payload of src.
+ * @param size Size of the data.
+ * @param ex Exception structure.
+ * @return True, when successful.
+ */
+extern bool prim_sg_append_prim(primitive_t *prim, primitive_t *src,
+		const uint8_t *data, uint16_t size, struct exception *ex);
+
+/**
+ * @brief Make a scatter/gather prim that shares the data of another prim.
+ *        The new prim has a header of its own, so that it can be queued
+ *        and tagged while the other prim is still in use elsewhere.
+ *        Protocol, command, handles and flags are copied.
+ * @param prim The prim to share, scatter/gather or not.
+ * @param ex Exception structure.
+ * @return New prim or NULL.
+ */
+extern primitive_t *prim_sg_share(primitive_t *prim, struct exception *ex);
+
+/**
+ * @brief Append a new slice with room in front of and behind the data.
+ * @param prim Scatter/gather prim.
+ * @param headroom Room in front of the data.
+ * @param size Size of the data.
+ * @param tailroom Room behind the data.
+ * @param ex Exception structure.
+ * @return Pointer to the (uninitialized) data or NULL.
+ */
+extern uint8_t *prim_sg_append_new(primitive_t *prim, uint16_t headroom,
+		uint16_t size, uint16_t tailroom, struct exception *ex);
+
+/**
+ * @brief Prepend data in the headroom of the first slice.
+ * @param prim Scatter/gather prim.
+ * @param n Number of bytes to prepend.
+ * @return Pointer to the prepended bytes or NULL, when there is not enough
+ *         headroom or the prim or the block is shared with somebody else.
+ */
+extern uint8_t *prim_sg_push(primitive_t *prim, uint16_t n);
+
+/**
+ * @brief Append data in the tailroom of the last slice.
+ * @param prim Scatter/gather prim.
+ * @param n Number of bytes to append.
+ * @return Pointer to the appended bytes or NULL, when there is not enough
+ *         tailroom or the prim or the block is shared with somebody else.
+ */
+extern uint8_t *prim_sg_put(primitive_t *prim, uint16_t n);
+
+/**
+ * @brief Strip bytes from the front of the data.
+ * @param prim Scatter/gather prim.
+ * @param n Number of bytes to strip.
+ * @return False, when there are less than n bytes.
+ */
+extern bool prim_sg_pull(primitive_t *prim, uint32_t n);
+
+/**
+ * @brief Strip bytes from the end of the data.
+ * @param prim Scatter/gather prim.
+ * @param n Number of bytes to strip.
+ * @return False, when there are less than n bytes.
+ */
+extern bool prim_sg_trim(primitive_t *prim, uint32_t n);
+
+/**
+ * @brief Fill an iovec array with the data of a prim, regardless whether
+ *        it is a scatter/gather prim or not.
+ * @param prim The prim.
+ * @param iov The iovec array.
+ * @param max Size of the iovec array.
+ * @return Number of iovecs used or -1, when max was too small.
+ */
+extern int prim_to_iovec(primitive_t *prim, struct iovec *iov, int max);
+
+/**
+ * @brief Copy the data of a scatter/gather prim into a new contiguous prim
+ *        with the same protocol, command and handles.
+ * @param prim Scatter/gather prim.
+ * @param ex Exception structure.
+ * @return New prim or NULL.
+ */
+extern primitive_t *prim_sg_flatten(primitive_t *prim, struct exception *ex);
+
+#endif /* RUNTIME_PRIMSLICE_H_ */
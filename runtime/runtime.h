@@ -214,6 +214,23 @@ extern void mem_lock(void *mem);
  */
 extern void mem_free(void *mem);
 
+/**
+ * @brief Get the lock counter of a memory block.
+ * @param mem Pointer to the memory block.
+ * @return Lock counter or 0, when the memory manager does not provide it.
+ */
+extern uint32_t mem_refs(void *mem);
+
+/**
+ * @brief Drop a lock of a memory block, unless it is the last one.
+ *        Decision and decrement are atomic, so of concurrent callers
+ *        exactly one sees the last lock.
+ * @param mem Pointer to the memory block.
+ * @return true when the caller holds the last lock. The block is still
+ *         allocated then and must be released with mem_free().
+ */
+extern bool mem_unref(void *mem);
+
 /**
  * @brief Check the integrity of a memory block. Asserts, when memory block is
  *        overwritten.
@@ -221,6 +238,21 @@ extern void mem_free(void *mem);
  */
 extern void mem_chck(void *mem);
 
+/**
+ * @brief Number of calls into the memory manager.
+ */
+struct mem_stats {
+	unsigned long n_alloc;  /**< Calls of mem_alloc. */
+	unsigned long n_lock;   /**< Calls of mem_lock.  */
+	unsigned long n_free;   /**< Calls of mem_free.  */
+};
+
+/**
+ * @brief Get the number of calls into the memory manager so far.
+ * @param stats Pointer to the stats to fill in.
+ */
+extern void mem_get_stats(struct mem_stats *stats);
+
 /**
  * @brief Structure for registration of a tick listener.
  */
@@ -23,6 +23,18 @@
 #ifdef __MINGW32__
 #include <windows.h>
 #else
+/* Values as in the Windows API, serial_linux.c maps them to termios */
+#define ONESTOPBIT   0
+#define ONE5STOPBITS 1
+#define TWOSTOPBITS  2
+#define NOPARITY     0
+#define ODDPARITY    1
+#define EVENPARITY   2
+#define MARKPARITY   3
+
+struct serial_port;
+typedef struct serial_port *HANDLE;
+typedef const char *LPCSTR;
 #endif
 
 struct exception;
@@ -94,6 +106,41 @@ extern int readFromSerialPort(HANDLE hSerial, char *buffer, int buffersize);
 */
 extern int writeToSerialPort(HANDLE hSerial, char *data, int length);
 
+/**
+	@brief Set the read timeouts, semantics as VMIN and VTIME of termios:
+	       readFromSerialPort returns when vmin octets arrived or when
+	       no octet arrived for vtime tenths of a second. With vmin 0
+	       vtime bounds the wait for the first octet. The default is
+	       vmin 1, vtime 0: Return as soon as anything arrived.
+	@param hSerial	File HANDLE to the serial port
+	@param vmin		min. number of octets to read
+	@param vtime	timeout in 1/10 s
+*/
+extern void setSerialPortTimeouts(HANDLE hSerial, int vmin, int vtime);
+
+#ifndef __MINGW32__
+/**
+	@brief Get the file descriptor of a serial port, i.e. for epoll.
+	       It is non-blocking.
+	@param hSerial	File HANDLE to the serial port
+	@return			file descriptor
+*/
+extern int serialPortFd(HANDLE hSerial);
+
+struct iovec;
+
+/**
+	@brief Vectored write to the serial port. Waits until the port
+	       accepts data, then writes as much as it takes at once.
+	@param hSerial	File HANDLE to the serial port
+	@param iov		data to write
+	@param iovcnt	number of entries in iov
+	@return			amount of data that was written or negative errorcode
+*/
+extern int writevToSerialPort(HANDLE hSerial, const struct iovec *iov,
+		int iovcnt);
+#endif
+
 /**
  	@brief Close serial port
 	@param hSerial	File HANDLE to the serial port
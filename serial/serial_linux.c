@@ -15,4 +15,259 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * serial.h comes first: Its enum Baudrate uses the names of the termios
+ * speed macros, from here on B9600 etc. are the termios values.
+ */
+#include "serial.h"
+
+#include "../runtime/exception.h"
+
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+struct serial_port {
+	int fd;
+	int vmin;
+	int vtime;
+};
+
+static speed_t to_speed(int baudrate)
+{
+	switch (baudrate) {
+	case 50:      return B50;
+	case 110:     return B110;
+	case 150:     return B150;
+	case 300:     return B300;
+	case 1200:    return B1200;
+	case 2400:    return B2400;
+	case 4800:    return B4800;
+	case 9600:    return B9600;
+	case 19200:   return B19200;
+	case 38400:   return B38400;
+	case 57600:   return B57600;
+	case 115200:  return B115200;
+	case 230400:  return B230400;
+#ifdef B460800
+	case 460800:  return B460800;
+#endif
+#ifdef B500000
+	case 500000:  return B500000;
+#endif
+#ifdef B1000000
+	case 1000000: return B1000000;
+#endif
+	default:      return B0;
+	} /* end switch */
+}
+
+/* Ask the driver to deliver received octets at once, not all support it */
+static void set_low_latency(int fd)
+{
+#if defined(TIOCGSERIAL) && defined(ASYNC_LOW_LATENCY)
+	struct serial_struct ss;
+
+	if (ioctl(fd, TIOCGSERIAL, &ss) == 0) {
+		ss.flags |= ASYNC_LOW_LATENCY;
+		ioctl(fd, TIOCSSERIAL, &ss);
+	}
+#endif
+}
+
+HANDLE openSerialPort(LPCSTR portname, enum Baudrate baudrate, int databits,
+		enum Stopbits stopbits, enum Paritycheck parity, struct exception *ex)
+{
+	struct serial_port *h;
+	struct termios tio;
+	speed_t speed = to_speed(baudrate);
+
+	if (speed == B0) {
+		exception_fill(ex, EINVAL, "SERIAL", "openSerialPort",
+				"Unsupported baudrate", portname);
+		return NULL;
+	}
+	h = malloc(sizeof(struct serial_port));
+	if (!h) {
+		exception_fill(ex, ENOMEM, "SERIAL", "openSerialPort", "malloc",
+				portname);
+		return NULL;
+	}
+	h->vmin = 1;
+	h->vtime = 0;
+	/* Non-blocking, readFromSerialPort waits in poll() */
+	h->fd = open(portname, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (h->fd == -1) {
+		exception_fill(ex, errno, "SERIAL", "openSerialPort", "open",
+				portname);
+		free(h);
+		return NULL;
+	}
+	if (tcgetattr(h->fd, &tio) == -1) {
+		exception_fill(ex, errno, "SERIAL", "openSerialPort", "tcgetattr",
+				portname);
+		goto error;
+	}
+	cfmakeraw(&tio);
+	tio.c_cflag &= ~(CSIZE | CSTOPB | PARENB | PARODD | CRTSCTS);
+	tio.c_cflag |= CLOCAL | CREAD;
+	switch (databits) {
+	case 5:
+		tio.c_cflag |= CS5;
+		break;
+	case 6:
+		tio.c_cflag |= CS6;
+		break;
+	case 7:
+		tio.c_cflag |= CS7;
+		break;
+	default:
+		tio.c_cflag |= CS8;
+		break;
+	} /* end switch */
+	if (stopbits != ONESTOPBIT)
+		tio.c_cflag |= CSTOPB;
+	switch (parity) {
+	case ODDPARITY:
+		tio.c_cflag |= PARENB | PARODD;
+		break;
+	case EVENPARITY:
+		tio.c_cflag |= PARENB;
+		break;
+	case MARKPARITY:
+#ifdef CMSPAR
+		tio.c_cflag |= PARENB | PARODD | CMSPAR;
+		break;
+#else
+		exception_fill(ex, EINVAL, "SERIAL", "openSerialPort",
+				"Mark parity not supported", portname);
+		goto error;
+#endif
+	default:
+		break;
+	} /* end switch */
+	tio.c_cc[VMIN]  = 1;
+	tio.c_cc[VTIME] = 0;
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+	if (tcsetattr(h->fd, TCSANOW, &tio) == -1) {
+		exception_fill(ex, errno, "SERIAL", "openSerialPort", "tcsetattr",
+				portname);
+		goto error;
+	}
+	tcflush(h->fd, TCIOFLUSH);
+	ioctl(h->fd, TIOCEXCL);
+	set_low_latency(h->fd);
+	return h;
+
+error:
+	close(h->fd);
+	free(h);
+	return NULL;
+}
+
+static int wait_fd(int fd, short events, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = fd, .events = events, .revents = 0 };
+	int n;
+
+	n = poll(&pfd, 1, timeout_ms);
+	return (n < 0) ? -errno : n;
+}
+
+int readFromSerialPort(HANDLE hSerial, char *buffer, int buffersize)
+{
+	int want = (hSerial->vmin < buffersize) ? hSerial->vmin : buffersize;
+	int interval = hSerial->vtime ? hSerial->vtime * 100 : -1;
+	int got = 0, n;
+
+	for (;;) {
+		n = read(hSerial->fd, &buffer[got], buffersize - got);
+		if (n > 0) {
+			got += n;
+			if ((got >= want) || (got == buffersize))
+				return got;
+			continue;
+		}
+		if (n == 0)
+			return got ? got : -EIO; /* Hangup */
+		if (errno != EAGAIN)
+			return got ? got : -errno;
+		if (!hSerial->vmin && !hSerial->vtime)
+			return got;
+		/*
+		 * Before the first octet wait forever unless vmin is 0, after
+		 * it vtime is the inter octet timer.
+		 */
+		n = wait_fd(hSerial->fd, POLLIN,
+				(got || !hSerial->vmin) ? interval : -1);
+		if (n < 0)
+			return got ? got : n;
+		if (n == 0)
+			return got;
+	} /* end for */
+}
+
+int writeToSerialPort(HANDLE hSerial, char *data, int length)
+{
+	int done = 0, n;
+
+	while (done < length) {
+		n = write(hSerial->fd, &data[done], length - done);
+		if (n > 0) {
+			done += n;
+			continue;
+		}
+		if ((n < 0) && (errno != EAGAIN))
+			return done ? done : -errno;
+		n = wait_fd(hSerial->fd, POLLOUT, -1);
+		if (n < 0)
+			return done ? done : n;
+	} /* end while */
+	return done;
+}
+
+int writevToSerialPort(HANDLE hSerial, const struct iovec *iov, int iovcnt)
+{
+	ssize_t n;
+	int erc;
+
+	for (;;) {
+		n = writev(hSerial->fd, iov, iovcnt);
+		if (n >= 0)
+			return n;
+		if (errno != EAGAIN)
+			return -errno;
+		erc = wait_fd(hSerial->fd, POLLOUT, -1);
+		if (erc < 0)
+			return erc;
+	} /* end for */
+}
+
+void setSerialPortTimeouts(HANDLE hSerial, int vmin, int vtime)
+{
+	hSerial->vmin  = (vmin  < 0) ? 0 : vmin;
+	hSerial->vtime = (vtime < 0) ? 0 : vtime;
+}
+
+int serialPortFd(HANDLE hSerial)
+{
+	return hSerial->fd;
+}
 
+void closeSerialPort(HANDLE hSerial)
+{
+	if (!hSerial)
+		return;
+	close(hSerial->fd);
+	free(hSerial);
+}
@@ -82,6 +82,25 @@ int writeToSerialPort(HANDLE hSerial, char * data, int length)
 	return (int)dwBytesRead;
 }
 
+void setSerialPortTimeouts(HANDLE hSerial, int vmin, int vtime)
+{
+	COMMTIMEOUTS timeouts={0};
+	GetCommTimeouts(hSerial, &timeouts);
+	timeouts.ReadTotalTimeoutMultiplier = 0;
+	timeouts.ReadTotalTimeoutConstant   = 0;
+	if (vmin <= 0) {
+		/* Return what is there, or the first octet within vtime */
+		timeouts.ReadIntervalTimeout = MAXDWORD;
+		if (vtime > 0) {
+			timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+			timeouts.ReadTotalTimeoutConstant   = vtime * 100;
+		}
+	} else {
+		timeouts.ReadIntervalTimeout = (vtime > 0) ? vtime * 100 : 0;
+	}
+	SetCommTimeouts(hSerial, &timeouts);
+}
+
 void closeSerialPort(HANDLE hSerial)
 {
 	CloseHandle(hSerial);
@@ -0,0 +1,280 @@
+/*
+ *  Project: ax25c - File: test_serial.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loopback test of serial_linux.c over a pseudo terminal: openSerialPort
+ * opens the slave side, the test plays the device on the master side.
+ * Checks the raw mode, the VMIN/VTIME semantics of readFromSerialPort,
+ * vectored writes that have to wait for the port and the hangup.
+ *
+ *   make test
+ */
+
+#include "serial.h"
+
+#include "../runtime/exception.h"
+
+#include <pty.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/* More than a pty takes at once, writes have to wait for the reader */
+#define BULK_SIZE (256 * 1024)
+
+static int failed = 0;
+
+#define CHECK(cond, msg) \
+	do { if (!(cond)) { fprintf(stderr, "FAIL %s:%i: %s\n", \
+			__FILE__, __LINE__, msg); ++failed; } } while (0)
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void put_master(int master, const void *p, size_t n)
+{
+	const uint8_t *pb = p;
+	ssize_t res;
+
+	while (n > 0) {
+		res = write(master, pb, n);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("write");
+			exit(EXIT_FAILURE);
+		}
+		pb += res;
+		n -= res;
+	} /* end while */
+}
+
+/* Every octet value, the ones a cooked tty would eat or change included */
+static void fill(uint8_t *p, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; ++i)
+		p[i] = (i < 256) ? (uint8_t)i : (uint8_t)rand();
+}
+
+/* The device sends an octet after half a second */
+static void *put_late(void *arg)
+{
+	usleep(500000);
+	put_master(*(int*)arg, "x", 1);
+	return NULL;
+}
+
+static void read_timeouts(HANDLE h, int master)
+{
+	pthread_t thread;
+	char buf[64];
+	double t;
+	int n;
+
+	/* Default vmin 1, vtime 0: Whatever arrived */
+	put_master(master, "hello", 5);
+	n = readFromSerialPort(h, buf, sizeof(buf));
+	CHECK((n == 5) && (memcmp(buf, "hello", 5) == 0), "vmin 1");
+
+	/* vmin 0, vtime 0: Do not wait at all */
+	setSerialPortTimeouts(h, 0, 0);
+	t = now();
+	n = readFromSerialPort(h, buf, sizeof(buf));
+	CHECK((n == 0) && (now() - t < 0.05), "vmin 0, vtime 0");
+
+	/* vmin 0, vtime 3: Wait 0.3 s for the first octet */
+	setSerialPortTimeouts(h, 0, 3);
+	t = now();
+	n = readFromSerialPort(h, buf, sizeof(buf));
+	t = now() - t;
+	CHECK((n == 0) && (t >= 0.25) && (t < 1.0), "vmin 0, vtime 3");
+
+	/* vmin 10, vtime 2: Less than vmin, the inter octet timer ends it */
+	setSerialPortTimeouts(h, 10, 2);
+	put_master(master, "abc", 3);
+	t = now();
+	n = readFromSerialPort(h, buf, sizeof(buf));
+	t = now() - t;
+	CHECK((n == 3) && (t >= 0.15) && (t < 1.0), "vmin 10, vtime 2, short");
+
+	/* vmin 10: Returns as soon as vmin arrived */
+	put_master(master, "0123456789ab", 12);
+	n = readFromSerialPort(h, buf, sizeof(buf));
+	CHECK((n >= 10) && (memcmp(buf, "0123456789", 10) == 0),
+			"vmin 10, vtime 2, full");
+	if (n < 12)
+		n += readFromSerialPort(h, &buf[n], sizeof(buf) - n);
+	CHECK(n == 12, "vmin 10, vtime 2, rest");
+
+	/* vmin 1, vtime 2: The timer does not run before the first octet */
+	setSerialPortTimeouts(h, 1, 2);
+	pthread_create(&thread, NULL, put_late, &master);
+	t = now();
+	n = readFromSerialPort(h, buf, sizeof(buf));
+	t = now() - t;
+	pthread_join(thread, NULL);
+	CHECK((n == 1) && (t >= 0.4), "vmin 1, vtime 2, wait for the first");
+	setSerialPortTimeouts(h, 1, 0);
+}
+
+struct drain {
+	int      master;
+	uint8_t *buf;
+	size_t   n;
+};
+
+/* The device side reads what the port writes */
+static void *drain_master(void *arg)
+{
+	struct drain *d = arg;
+	size_t got = 0;
+	ssize_t res;
+
+	while (got < d->n) {
+		res = read(d->master, &d->buf[got], d->n - got);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		got += res;
+	} /* end while */
+	d->n = got;
+	return NULL;
+}
+
+static void bulk_write(HANDLE h, int master)
+{
+	uint8_t *out = malloc(BULK_SIZE), *in = malloc(BULK_SIZE);
+	struct drain d = { .master = master, .buf = in, .n = BULK_SIZE };
+	struct iovec iov[3];
+	pthread_t thread;
+	size_t off = 0, m;
+	int n;
+
+	if (!out || !in) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	fill(out, BULK_SIZE);
+	pthread_create(&thread, NULL, drain_master, &d);
+	/* A frame in pieces, as the KISS writer hands them over */
+	while (off < BULK_SIZE) {
+		m = BULK_SIZE - off;
+		if (m > 700)
+			m = 700;
+		iov[0].iov_base = &out[off];
+		iov[0].iov_len = m / 3;
+		iov[1].iov_base = &out[off + m / 3];
+		iov[1].iov_len = m - 2 * (m / 3);
+		iov[2].iov_base = &out[off + m - m / 3];
+		iov[2].iov_len = m / 3;
+		n = writevToSerialPort(h, iov, 3);
+		if (n <= 0) {
+			CHECK(false, "writevToSerialPort");
+			break;
+		}
+		off += n;
+	} /* end while */
+	pthread_join(thread, NULL);
+	CHECK((d.n == BULK_SIZE) && (memcmp(in, out, BULK_SIZE) == 0),
+			"Vectored writes, octets changed on the way");
+
+	/* And the other way round, all octet values arrive unchanged */
+	fill(out, 4096);
+	put_master(master, out, 4096);
+	off = 0;
+	while (off < 4096) {
+		n = readFromSerialPort(h, (char*)&in[off], 4096 - off);
+		if (n <= 0) {
+			CHECK(false, "readFromSerialPort");
+			break;
+		}
+		off += n;
+	} /* end while */
+	CHECK((off == 4096) && (memcmp(in, out, 4096) == 0),
+			"Read, octets changed on the way");
+	n = writeToSerialPort(h, (char*)out, 256);
+	CHECK(n == 256, "writeToSerialPort");
+	off = 0;
+	while (off < 256) {
+		n = read(master, &in[off], 256 - off);
+		if (n <= 0)
+			break;
+		off += n;
+	} /* end while */
+	CHECK((off == 256) && (memcmp(in, out, 256) == 0), "Write");
+	free(out);
+	free(in);
+}
+
+int main(int argc, char *argv[])
+{
+	char name[256];
+	HANDLE h;
+	int master, slave, n;
+	char c;
+	EXCEPTION(ex);
+
+	if (openpty(&master, &slave, name, NULL, NULL) == -1) {
+		perror("openpty");
+		return EXIT_FAILURE;
+	}
+	/* A port that waits for ever fails the test as well */
+	alarm(30);
+	srand(1);
+	h = openSerialPort(name, 1234, 8, one, off, &ex);
+	CHECK(!h && (ex.erc == EINVAL), "Unsupported baudrate");
+	EXCEPTION_RESET(ex);
+	ex.erc = EXIT_SUCCESS;
+	/* <pty.h> brings the termios B9600, so no names of enum Baudrate */
+	h = openSerialPort(name, 9600, 8, one, off, &ex);
+	if (!h) {
+		fprintf(stderr, "test_serial: Unable to open %s: %s\n", name,
+				strerror(ex.erc));
+		return EXIT_FAILURE;
+	}
+	/* The port has it now, the hangup below needs the last one closed */
+	close(slave);
+	read_timeouts(h, master);
+	bulk_write(h, master);
+	close(master);
+	n = readFromSerialPort(h, &c, 1);
+	CHECK(n == -EIO, "Hangup");
+	closeSerialPort(h);
+	if (failed) {
+		fprintf(stderr, "test_serial: %i checks failed\n", failed);
+		return EXIT_FAILURE;
+	}
+	printf("test_serial: OK\n");
+	return EXIT_SUCCESS;
+}
@@ -21,6 +21,7 @@
 #define MODULE_NAME "TERMINAL"
 
 #include "../runtime/primbuffer.h"
+#include "../runtime/dl_prim.h"
 
 #include <stdlib.h>
 #include <stringc/stringc.h>
@@ -33,6 +34,9 @@ struct plugin_handle {
 	size_t      line_length;
 	string_t    loc_addr;
 	string_t    rem_addr;
+	callsign    loc_call;
+	callsign    rem_path[DL_MAX_PATH];
+	uint8_t     rem_path_len;
 	const char *lead_txt;
 	const char *lead_cmd;
 	const char *lead_inf;
@@ -41,11 +45,17 @@ struct plugin_handle {
 	const char *prompt;
 };
 
-enum stdout_lock_id { NO_thread, STDIN_thread, STDOUT_thread, MONITOR_thread };
+/* Sources of console output, in the order deferred output follows */
+enum console_src {
+	CONSOLE_STDIN, CONSOLE_PRIM, CONSOLE_MONITOR, CONSOLE_SOURCES
+};
 
 struct dls;
+struct exception;
 extern struct dls  local_dls;
 extern struct dls *peerDLS(void);
+extern bool set_local_addr(const char *addr, struct exception *ex);
+extern bool set_remote_addr(const char *addr, struct exception *ex);
 extern struct plugin_handle plugin;
 extern struct primbuffer primbuffer;
 
@@ -53,8 +63,8 @@ extern void stdin_initialize(struct plugin_handle *h);
 extern void stdin_terminate(struct plugin_handle *h);
 extern void stdout_initialize(struct plugin_handle *h);
 extern void stdout_terminate(struct plugin_handle *h);
-extern void aquire_stdout_lock(enum stdout_lock_id id);
-extern void release_stdout_lock(void);
+extern void console_write(enum console_src src, const char *pb, size_t cb,
+		bool end);
 
 extern void monitor_listener(struct primitive *prim, const char *service,
 		bool tx, void *data);
@@ -0,0 +1,96 @@
+/*
+ *  Project: ax25c - File: output.c
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "output.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+void out_init(struct out_buffer *o, int fd)
+{
+	assert(o);
+	o->fd = fd;
+	o->len = 0;
+}
+
+bool out_flush(struct out_buffer *o)
+{
+	const char *pc;
+	ssize_t res;
+	size_t n;
+	bool ok = true;
+
+	assert(o);
+	pc = o->buf;
+	n = o->len;
+	while (n > 0) {
+		res = write(o->fd, pc, n);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			ok = false;
+			break;
+		}
+		pc += res;
+		n -= res;
+	} /* end while */
+	o->len = 0;
+	return ok;
+}
+
+void out_put(struct out_buffer *o, const void *p, size_t n)
+{
+	const char *pc = p;
+	size_t m;
+
+	assert(o);
+	while (n > 0) {
+		if (o->len == OUT_BUF_SIZE)
+			out_flush(o);
+		m = OUT_BUF_SIZE - o->len;
+		if (m > n)
+			m = n;
+		memcpy(&o->buf[o->len], pc, m);
+		o->len += m;
+		pc += m;
+		n -= m;
+	} /* end while */
+}
+
+size_t out_decode_ctrl(const char *ctrl, char *pb, size_t cb)
+{
+	size_t i = 0;
+	long int n;
+	char *end;
+
+	assert(ctrl);
+	while (*ctrl && (i < cb)) {
+		if (*ctrl == '\\') {
+			++ctrl;
+			n = strtol(ctrl, &end, 0);
+			ctrl = end;
+			pb[i++] = (char)n;
+		} else {
+			pb[i++] = *ctrl;
+			++ctrl;
+		}
+	} /* end while */
+	return i;
+}
@@ -0,0 +1,87 @@
+/*
+ *  Project: ax25c - File: output.h
+ *  Copyright (C) 2019 - Tania Hagn - tania@df9ry.de
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file output.h
+ * @brief Buffered terminal output.
+ *
+ * Lead-in control sequences, text and monitor lines are collected in a
+ * buffer and written with one write() per event instead of a write()
+ * per piece or even per character.
+ */
+#ifndef TERMINAL_OUTPUT_H_
+#define TERMINAL_OUTPUT_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Size of the buffer */
+#define OUT_BUF_SIZE 4096
+
+/**
+ * @brief Output buffer of the thread that owns stdout.
+ */
+struct out_buffer {
+	int          fd;                /**< Output file descriptor.        */
+	char         buf[OUT_BUF_SIZE]; /**< Pending output.                */
+	size_t       len;               /**< Octets used in buf.            */
+};
+
+/**
+ * @brief Initialize an output buffer.
+ * @param fd File descriptor to write to.
+ */
+extern void out_init(struct out_buffer *o, int fd);
+
+/**
+ * @brief Write everything collected.
+ * @return false when the output failed.
+ */
+extern bool out_flush(struct out_buffer *o);
+
+/**
+ * @brief Append a copy of octets.
+ */
+extern void out_put(struct out_buffer *o, const void *p, size_t n);
+
+/**
+ * @brief Decode a control sequence, "\nnn" is the octet nnn in C
+ *        notation.
+ * @param cb Size of pb, the rest of a longer sequence is ignored.
+ * @return Number of octets in pb.
+ */
+extern size_t out_decode_ctrl(const char *ctrl, char *pb, size_t cb);
+
+/**
+ * @brief Append a character.
+ */
+static inline void out_put_ch(struct out_buffer *o, char ch)
+{
+	if (o->len == OUT_BUF_SIZE)
+		out_flush(o);
+	o->buf[o->len++] = ch;
+}
+
+/**
+ * @brief Octets waiting for out_flush().
+ */
+static inline bool out_pending(const struct out_buffer *o)
+{
+	return o->len > 0;
+}
+
+#endif /* TERMINAL_OUTPUT_H_ */
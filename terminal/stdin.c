@@ -19,12 +19,14 @@
 #include "../runtime/dlsap.h"
 #include "../runtime/dl_prim.h"
 #include "_internal.h"
+#include "output.h"
 
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <string.h>
 #include <ctype.h>
 #include <signal.h>
 #include <assert.h>
@@ -35,6 +37,9 @@
 
 #define S_IOBUF 256
 
+/* Max. number of octets taken from stdin at once */
+#define S_INBUF 64
+
 #define STOP   3
 #define BEL    7
 #define BS     8
@@ -77,6 +82,10 @@ static size_t i_read_buf = 0;
 static bool monitor_flag = false;
 static void *monitor_handle = NULL;
 
+/* Echo and responses, handed to the output thread once per input event */
+static char out_buf[S_IOBUF];
+static size_t i_out_buf = 0;
+
 static void send_line(const char *pb, size_t cb)
 {
 	i_read_buf = 0;
@@ -97,35 +106,48 @@ static void setMonitor(bool f)
 	}
 }
 
+static void out_data(const char *pb, size_t cb)
+{
+	size_t n;
+
+	while (cb) {
+		if (i_out_buf == S_IOBUF) {
+			console_write(CONSOLE_STDIN, out_buf, i_out_buf, false);
+			i_out_buf = 0;
+		}
+		n = S_IOBUF - i_out_buf;
+		if (n > cb)
+			n = cb;
+		memcpy(&out_buf[i_out_buf], pb, n);
+		i_out_buf += n;
+		pb += n;
+		cb -= n;
+	} /* end while */
+}
+
 static void out_str(const char *str)
 {
-	aquire_stdout_lock(STDIN_thread);
-	write(STDOUT_FILENO, str, strlen(str));
+	out_data(str, strlen(str));
 }
 
 static void out_ch(char ch)
 {
-	aquire_stdout_lock(STDIN_thread);
-	write(STDOUT_FILENO, &ch, 1);
+	out_data(&ch, 1);
 }
 
 static void out_ctrl(const char *ctrl)
 {
-	long int n;
-	char *end;
-
-	assert(ctrl);
-	while (*ctrl) {
-		if (*ctrl == '\\') {
-			++ctrl;
-			n = strtol(ctrl, &end, 0);
-			ctrl = end;
-			out_ch((char)n);
-		} else {
-			out_ch(*ctrl);
-			++ctrl;
-		}
-	} /* end while */
+	char buf[S_IOBUF];
+
+	out_data(buf, out_decode_ctrl(ctrl, buf, sizeof(buf)));
+}
+
+/* Holds the terminal from the first output until the end of a text line */
+static void out_event(bool end)
+{
+	if (i_out_buf || end)
+		console_write(CONSOLE_STDIN, out_buf, i_out_buf, end);
+	i_out_buf = 0;
 }
 
 static void out_lead(void)
@@ -159,7 +181,7 @@ static void new_line(void)
 	out_ch('\n');
 	i_read_buf = 0;
 	if (state == S_TXT)
-		release_stdout_lock();
+		out_event(true);
 }
 
 static const char *getStr(bool add_nl)
@@ -242,21 +264,25 @@ static void connect(void)
 	const char *srcAddr = string_c(&plugin.loc_addr);
 	if (configuration.loglevel >= DEBUG_LEVEL_DEBUG)
 		ax25c_log(DEBUG_LEVEL_DEBUG, "TX CONNECT: %s -> %s", srcAddr, dstAddr);
-	primitive_t *prim = new_DL_CONNECT_Request(++cConnect,
-			(uint8_t*)dstAddr, strlen(dstAddr),
-			(uint8_t*)srcAddr, strlen(srcAddr), &ex);
+	primitive_t *prim;
+	if (peerDLS()->binary_addr && plugin.loc_call && plugin.rem_path_len)
+		prim = new_DL_CONNECT_Request_bin(++cConnect,
+				plugin.rem_path, plugin.rem_path_len, plugin.loc_call, &ex);
+	else
+		prim = new_DL_CONNECT_Request(++cConnect,
+				(uint8_t*)dstAddr, strlen(dstAddr),
+				(uint8_t*)srcAddr, strlen(srcAddr), &ex);
 	if (!prim) {
 		state = S_ERR;
 		new_line();
 		out_str(STRING_C(ex.message));
 		goto done;
 	}
-	if (!dlsap_write(peerDLS(), prim, false, &ex)) {
+	if (!dlsap_write_owned(peerDLS(), prim, false, &ex)) {
 		state = S_ERR;
 		new_line();
 		out_str(STRING_C(ex.message));
 	}
-	del_prim(prim);
 done:
 	EXCEPTION_RESET(ex);
 	state = S_TXT;
@@ -284,12 +310,11 @@ static void test(void)
 		out_str(STRING_C(ex.message));
 		goto done;
 	}
-	if (!dlsap_write(peerDLS(), prim, false, &ex)) {
+	if (!dlsap_write_owned(peerDLS(), prim, false, &ex)) {
 		state = S_ERR;
 		new_line();
 		out_str(STRING_C(ex.message));
 	}
-	del_prim(prim);
 done:
 	EXCEPTION_RESET(ex);
 	state = S_TXT;
@@ -307,22 +332,27 @@ static void ui(void)
 	const char *srcAddr = string_c(&plugin.loc_addr);
 	if (configuration.loglevel >= DEBUG_LEVEL_DEBUG)
 		ax25c_log(DEBUG_LEVEL_DEBUG, "TX UI: %s -> %s: %s", srcAddr, dstAddr, pc);
-	primitive_t *prim = new_DL_UNIT_DATA_Request(++cUI,
-			(uint8_t*)dstAddr, strlen(dstAddr),
-			(uint8_t*)srcAddr, strlen(srcAddr),
-			(uint8_t*)pc, strlen(pc), &ex);
+	primitive_t *prim;
+	if (peerDLS()->binary_addr && plugin.loc_call && plugin.rem_path_len)
+		prim = new_DL_UNIT_DATA_Request_bin(++cUI,
+				plugin.rem_path, plugin.rem_path_len, plugin.loc_call,
+				(uint8_t*)pc, strlen(pc), &ex);
+	else
+		prim = new_DL_UNIT_DATA_Request(++cUI,
+				(uint8_t*)dstAddr, strlen(dstAddr),
+				(uint8_t*)srcAddr, strlen(srcAddr),
+				(uint8_t*)pc, strlen(pc), &ex);
 	if (!prim) {
 		state = S_ERR;
 		new_line();
 		out_str(STRING_C(ex.message));
 		goto done;
 	}
-	if (!dlsap_write(peerDLS(), prim, false, &ex)) {
+	if (!dlsap_write_owned(peerDLS(), prim, false, &ex)) {
 		state = S_ERR;
 		new_line();
 		out_str(STRING_C(ex.message));
 	}
-	del_prim(prim);
 done:
 	EXCEPTION_RESET(ex);
 	state = S_TXT;
@@ -363,7 +393,7 @@ static void onCmdI(void)
 		out_str(pc);
 	} else {
 		EXCEPTION(ex);
-		if (dlsap_set_default_local_addr(peerDLS(), pc, &plugin.loc_addr, &ex))
+		if (set_local_addr(pc, &ex))
 		{
 			state = S_INF;
 			new_line();
@@ -395,7 +425,7 @@ static void onCmdR(void)
 		out_str(pc);
 	} else {
 		EXCEPTION(ex);
-		if (dlsap_set_default_remote_addr(peerDLS(), pc, &plugin.rem_addr, &ex))
+		if (set_remote_addr(pc, &ex))
 		{
 			state = S_INF;
 			new_line();
@@ -427,7 +457,7 @@ static void onCmdC(void)
 		out_str(pc);
 	} else {
 		EXCEPTION(ex);
-		if (dlsap_set_default_remote_addr(peerDLS(), pc, &plugin.rem_addr, &ex))
+		if (set_remote_addr(pc, &ex))
 		{
 			state = S_INF;
 			new_line();
@@ -460,7 +490,7 @@ static void onCmdT(void)
 		out_str(pc);
 	} else {
 		EXCEPTION(ex);
-		if (dlsap_set_default_remote_addr(peerDLS(), pc, &plugin.rem_addr, &ex))
+		if (set_remote_addr(pc, &ex))
 		{
 			state = S_INF;
 			new_line();
@@ -498,7 +528,7 @@ static void onCmdU(void)
 		out_str(pc);
 	} else {
 		EXCEPTION(ex);
-		if (dlsap_set_default_remote_addr(peerDLS(), pc, &plugin.rem_addr, &ex))
+		if (set_remote_addr(pc, &ex))
 		{
 			state = S_INF;
 			new_line();
@@ -1108,11 +1138,15 @@ static void input(char ch)
 
 static void *worker(void *id)
 {
+	uint8_t buf[S_INBUF];
+	int i, res;
+
 	while (initialized) {
-		uint8_t ch;
-		int res = read(STDIN_FILENO, &ch, 1);
-		if (res > 0)
-			input((char)ch);
+		/* Whatever was typed or pasted, echoed with one write */
+		res = read(STDIN_FILENO, buf, sizeof(buf));
+		for (i = 0; i < res; ++i)
+			input((char)buf[i]);
+		out_event(false);
 	} /* end while */
 	return NULL;
 }
@@ -1149,6 +1183,8 @@ void stdin_initialize(struct plugin_handle *h)
 extern void stdin_terminate(struct plugin_handle *h)
 {
 	assert(h);
+	/* The monitor must not write into the console after it is gone */
+	setMonitor(false);
 	state = S_INF;
 	substate = 0;
 	new_line();
@@ -19,84 +19,216 @@
 #include "../runtime/dl_prim.h"
 
 #include "_internal.h"
+#include "output.h"
 
 #include <stdbool.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
 #include <signal.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
 #include <assert.h>
 
-#include <ringbuffer/ringbuffer.h>
+/*
+ * Everything for stdout goes through a bounded lock free MPSC ring of
+ * slots and is written by one thread, that owns stdout. A producer
+ * claims a slot, fills it in place and publishes it, so the monitor
+ * listener formats straight into its slot on whatever thread it runs.
+ *
+ * A source holds the terminal until it writes the end of a unit, like
+ * the stdin thread during a text line. Units of other sources that
+ * arrive meanwhile are deferred by the output thread and follow when
+ * the holder is done.
+ */
+
+/* Min. number of slots of the ring */
+#define CONSOLE_MIN_SLOTS 16
+
+/* Deferred monitor output beyond this is dropped */
+#define DEFER_MAX 65536
+
+/* Max. length of a decoded lead in */
+#define S_LEAD 64
+
+struct console_slot {
+	unsigned long seq;    /* Position it is free or published for, atomic */
+	uint8_t       src;    /* enum console_src */
+	bool          end;    /* Ends a unit of the source */
+	size_t        len;
+	char         *data;   /* slot_size octets */
+};
 
-#define MONITOR_BUFFER_RESERVE 16
-static char *mon_line_buffer;
-static int i_mon_line_buffer = 0;
-static char *mon_get_buffer;
+struct deferred {
+	char   *buf;
+	size_t  len;
+	size_t  max;
+	bool    open;         /* Ends inside a unit */
+};
 
 struct primbuffer primbuffer;
 
 static volatile bool initialized = false;
 
-static ringbuffer_t  rb_monitor;
 static struct plugin_handle *plugin_handle = NULL;
-static pthread_mutex_t mutex;
-static pthread_cond_t cond;
 static pthread_attr_t thread_args;
 static pthread_t prim_thread;
-static pthread_t monitor_thread;
+static pthread_t output_thread;
+
+/* Ring */
+static struct console_slot *ring;
+static char *ring_data;
+static unsigned long ring_mask;
+static size_t slot_size;
+static unsigned long enqueue_pos;  /* Producers, atomic */
+static unsigned long dequeue_pos;  /* Output thread only */
+static unsigned long mon_drops;    /* Atomic */
+
+/* Wakeup of the output thread */
+static sem_t wakeup;
+static bool waiting;               /* Atomic */
+
+/* Output thread only */
+static struct out_buffer out;
+static int holder;                 /* Source holding the terminal or -1 */
+static struct deferred deferred[CONSOLE_SOURCES];
+static char lead_mon[S_LEAD];
+static size_t n_lead_mon;
+static char lead_txt[S_LEAD];
+static size_t n_lead_txt;
+
+/*
+ * Producers
+ */
 
-static inline void out_data(const uint8_t *po, size_t co)
+/* Returns NULL when the ring is full */
+static struct console_slot *slot_claim(unsigned long *pos)
 {
-	write(STDOUT_FILENO, po, co);
+	struct console_slot *slot;
+	unsigned long p, seq;
+	long diff;
+
+	p = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &ring[p & ring_mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (long)(seq - p);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&enqueue_pos, &p, p + 1, true,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				*pos = p;
+				return slot;
+			}
+		} else if (diff < 0) {
+			return NULL;
+		} else {
+			p = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+		}
+	} /* end for */
 }
 
-static inline void out_txt(const char *pd, size_t cd)
+static void slot_publish(struct console_slot *slot, unsigned long pos,
+		enum console_src src, size_t len, bool end)
 {
-	out_data((uint8_t*)pd, cd);
+	slot->src = src;
+	slot->len = len;
+	slot->end = end;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	if (__atomic_exchange_n(&waiting, false, __ATOMIC_SEQ_CST))
+		sem_post(&wakeup);
 }
 
-static inline void out_str(const char *s)
+void console_write(enum console_src src, const char *pb, size_t cb, bool end)
 {
-	out_txt(s, strlen(s));
+	struct console_slot *slot;
+	unsigned long pos;
+	size_t n;
+
+	assert(src < CONSOLE_SOURCES);
+	if (!initialized)
+		return;
+	do {
+		/* Only the monitor drops, everything else waits for room */
+		while (!(slot = slot_claim(&pos))) {
+			if (!initialized)
+				return;
+			sched_yield();
+		} /* end while */
+		n = (cb > slot_size) ? slot_size : cb;
+		memcpy(slot->data, pb, n);
+		pb += n;
+		cb -= n;
+		slot_publish(slot, pos, src, n, end && !cb);
+	} while (cb);
+}
+
+void monitor_listener(struct primitive *prim, const char *service, bool tx,
+		void *data)
+{
+	struct console_slot *slot;
+	unsigned long pos;
+	size_t cb = slot_size;
+	char *pb;
+	int l, m;
+
+	if (!initialized)
+		return;
+	slot = slot_claim(&pos);
+	if (!slot) {
+		__atomic_add_fetch(&mon_drops, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	/* A line per slot, formatted in place */
+	pb = slot->data;
+	l = snprintf(pb, cb, "[%s]%s:", service, (tx ? ">" : "<"));
+	if (l+1 >= cb) {
+		l = cb;
+		memcpy(&pb[cb-4], "...\n", 4);
+		goto out;
+	}
+	m = monitor(prim, &pb[l], cb-l, NULL);
+	if (m <= 0) {
+		l = 0;
+		goto out;
+	}
+	l += m;
+	if (l+1 >= cb) {
+		l = cb;
+		memcpy(&pb[cb-4], "...\n", 4);
+		goto out;
+	}
+	pb[l++] = '\n';
+out:
+	slot_publish(slot, pos, CONSOLE_MONITOR, l, true);
 }
 
 static void out_dl_prim(primitive_t *prim)
 {
 	prim_param_t *param;
+	const char *label;
 
 	switch (prim->cmd) {
 	case DL_UNIT_DATA_INDICATION:
-		aquire_stdout_lock(STDOUT_thread);
-		param = get_DL_data_param(prim);
-		out_str("UI: ");
-		out_data(get_prim_param_data(param), get_prim_param_size(param));
-		release_stdout_lock();
+		label = "UI: ";
 		break;
 	case DL_TEST_REQUEST:
-		aquire_stdout_lock(STDOUT_thread);
-		param = get_DL_data_param(prim);
-		out_str("Test REQU: ");
-		out_data(get_prim_param_data(param), get_prim_param_size(param));
-		release_stdout_lock();
+		label = "Test REQU: ";
 		break;
 	case DL_TEST_INDICATION:
-		aquire_stdout_lock(STDOUT_thread);
-		param = get_DL_data_param(prim);
-		out_str("Test INDI: ");
-		out_data(get_prim_param_data(param), get_prim_param_size(param));
-		release_stdout_lock();
+		label = "Test INDI: ";
 		break;
 	case DL_TEST_CONFIRM:
-		aquire_stdout_lock(STDOUT_thread);
-		param = get_DL_data_param(prim);
-		out_str("Test CONF: ");
-		out_data(get_prim_param_data(param), get_prim_param_size(param));
-		release_stdout_lock();
+		label = "Test CONF: ";
 		break;
 	default:
-		break;
+		return;
 	} /* end switch */
+	param = get_DL_data_param(prim);
+	console_write(CONSOLE_PRIM, label, strlen(label), false);
+	console_write(CONSOLE_PRIM, (const char*)get_prim_param_data(param),
+			get_prim_param_size(param), true);
 }
 
 static void *prim_worker(void *id)
@@ -124,187 +256,213 @@ static void *prim_worker(void *id)
 	return NULL;
 }
 
-static inline void out_ch(char ch)
-{
-	write(STDOUT_FILENO, &ch, 1);
-}
+/*
+ * Output thread
+ */
 
-static inline void out_ctrl(const char *ctrl)
+/* Monitor lines get their lead ins, the rest goes as it is */
+static void emit(struct deferred *d, enum console_src src,
+		const char *pb, size_t cb)
 {
-	long int n;
-	char *end;
-
-	assert(ctrl);
-	while (*ctrl) {
-		if (*ctrl == '\\') {
-			++ctrl;
-			n = strtol(ctrl, &end, 0);
-			ctrl = end;
-			out_ch((char)n);
+	if ((src == CONSOLE_MONITOR) && writeLeads) {
+		if (pb[cb-1] == '\n')
+			--cb;
+		if (d) {
+			if (d->len + n_lead_mon + cb + n_lead_txt + 2 > d->max) {
+				__atomic_add_fetch(&mon_drops, 1, __ATOMIC_RELAXED);
+				return;
+			}
+			memcpy(&d->buf[d->len], lead_mon, n_lead_mon);
+			d->len += n_lead_mon;
+			d->buf[d->len++] = '\n';
+			memcpy(&d->buf[d->len], pb, cb);
+			d->len += cb;
+			memcpy(&d->buf[d->len], lead_txt, n_lead_txt);
+			d->len += n_lead_txt;
+			d->buf[d->len++] = '\n';
 		} else {
-			out_ch(*ctrl);
-			++ctrl;
+			out_put(&out, lead_mon, n_lead_mon);
+			out_put_ch(&out, '\n');
+			out_put(&out, pb, cb);
+			out_put(&out, lead_txt, n_lead_txt);
+			out_put_ch(&out, '\n');
 		}
-	} /* end while */
-}
-
-static void monitor_write(struct plugin_handle *handle, char *pb, size_t cb)
-{
-	if (cb == 0)
 		return;
-	aquire_stdout_lock(MONITOR_thread);
-	if (writeLeads) {
-		out_ctrl(handle->lead_mon);
-		out_ch('\n');
-		if (pb[cb-1] == '\n')
-			cb--;
 	}
-	write(STDOUT_FILENO, pb, cb);
-	if (writeLeads) {
-		out_ctrl(handle->lead_txt);
-		out_ch('\n');
+	if (!d) {
+		out_put(&out, pb, cb);
+		return;
+	}
+	if (d->len + cb > d->max) {
+		if (src == CONSOLE_MONITOR) {
+			__atomic_add_fetch(&mon_drops, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		/* Data of the peer and of stdin is never dropped */
+		d->max = 2 * (d->len + cb);
+		d->buf = realloc(d->buf, d->max);
+		assert(d->buf);
 	}
-	release_stdout_lock();
+	memcpy(&d->buf[d->len], pb, cb);
+	d->len += cb;
 }
 
-static void *monitor_worker(void *id)
+/* The holder is done, the others follow in the order of the sources */
+static void release_deferred(void)
 {
-	struct plugin_handle *handle = id;
-	int n, m;
-	void *p;
+	struct deferred *d;
+	int src;
 
-	while (initialized) {
-		n = rb_read_block_ch(&rb_monitor, &mon_line_buffer[i_mon_line_buffer],
-				plugin.mon_length + MONITOR_BUFFER_RESERVE - i_mon_line_buffer);
-		if (!initialized)
-			return NULL;
-		if (n <= 0)
+	for (src = 0; (src < CONSOLE_SOURCES) && (holder == -1); ++src) {
+		d = &deferred[src];
+		if (!d->len && !d->open)
 			continue;
-		i_mon_line_buffer += n;
-		while (true) {
-			p = memchr(mon_line_buffer, '\n', i_mon_line_buffer);
-			if (p == NULL)
-				break;
-			m = p - (void*)mon_line_buffer + 1;
-			monitor_write(handle, mon_line_buffer, m);
-			i_mon_line_buffer -= m;
-			memmove(&mon_line_buffer[0], &mon_line_buffer[m], i_mon_line_buffer);
-		} /* end while */
-		if (i_mon_line_buffer > handle->mon_length) {
-			DBG_ERROR("Terminal monitor worker, No EOL found", "");
-			monitor_write(handle, mon_line_buffer, i_mon_line_buffer);
-			i_mon_line_buffer = 0;
-		}
-	} /* end while */
-	return NULL;
+		out_put(&out, d->buf, d->len);
+		d->len = 0;
+		if (d->open)
+			holder = src;
+		d->open = false;
+	} /* end for */
 }
 
-void monitor_listener(struct primitive *prim, const char *service, bool tx,
-		void *data)
+static void on_slot(struct console_slot *slot)
 {
-	int l = snprintf(mon_get_buffer, plugin.mon_length, "[%s]%s:", service,
-			(tx ? ">" : "<"));
-	int m;
+	struct deferred *d;
 
-	if (l+1 >= plugin.mon_length) {
-		l = plugin.mon_length;
-		strcpy(&mon_get_buffer[plugin.mon_length-5], "...\n");
-		goto out;
-	}
-	m = monitor(prim, &mon_get_buffer[l], plugin.mon_length-l, NULL);
-	if (m <= 0)
+	if ((slot->src == CONSOLE_MONITOR) && !slot->len)
+		return;
+	if ((holder == -1) || (holder == slot->src)) {
+		if (slot->len)
+			emit(NULL, slot->src, slot->data, slot->len);
+		holder = slot->end ? -1 : slot->src;
+		if (holder == -1)
+			release_deferred();
 		return;
-	l += m;
-	if (l+1 >= plugin.mon_length) {
-		l = plugin.mon_length;
-		strcpy(&mon_get_buffer[plugin.mon_length-5], "...\n");
-		goto out;
 	}
-	strcpy(&mon_get_buffer[l++], "\n");
-out:
-	if (rb_get_free(&rb_monitor) >= l)
-		rb_write_nonblock_ch(&rb_monitor, mon_get_buffer, l);
-	else
-		ax25c_log(DEBUG_LEVEL_WARNING, "Lost %i monitor bytes: buffer full", l);
+	d = &deferred[slot->src];
+	if (slot->len)
+		emit(d, slot->src, slot->data, slot->len);
+	d->open = !slot->end;
+}
+
+/* Next published slot or NULL */
+static inline struct console_slot *slot_peek(void)
+{
+	struct console_slot *slot = &ring[dequeue_pos & ring_mask];
+
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != dequeue_pos + 1)
+		return NULL;
+	return slot;
+}
+
+static inline void slot_release(struct console_slot *slot)
+{
+	__atomic_store_n(&slot->seq, dequeue_pos + ring_mask + 1,
+			__ATOMIC_RELEASE);
+	++dequeue_pos;
+}
+
+static void *output_worker(void *id)
+{
+	struct console_slot *slot;
+	unsigned long drops;
+
+	for (;;) {
+		while ((slot = slot_peek())) {
+			on_slot(slot);
+			slot_release(slot);
+		} /* end while */
+		/* Whatever the round collected in one write */
+		if (out_pending(&out))
+			out_flush(&out);
+		drops = __atomic_exchange_n(&mon_drops, 0, __ATOMIC_RELAXED);
+		if (drops)
+			ax25c_log(DEBUG_LEVEL_WARNING,
+					"Lost %lu monitor lines: buffer full", drops);
+		if (!initialized)
+			return NULL;
+		/* Sleep unless a slot was published meanwhile */
+		__atomic_store_n(&waiting, true, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (slot_peek()) {
+			__atomic_store_n(&waiting, false, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		while ((sem_wait(&wakeup) == -1) && (errno == EINTR))
+			;
+	} /* end for */
+	return NULL;
 }
 
 void stdout_initialize(struct plugin_handle *h)
 {
+	unsigned long i, n_slots;
 	int erc;
 
 	assert(h);
 	assert(!initialized);
-	initialized = true;
 	plugin_handle = h;
 	primbuffer_init(&primbuffer);
-	assert(plugin_handle->mon_length >= MONITOR_BUFFER_RESERVE);
-	i_mon_line_buffer = 0;
-	mon_line_buffer = malloc(plugin_handle->mon_length + MONITOR_BUFFER_RESERVE);
-	assert(mon_line_buffer);
-	mon_get_buffer = malloc(plugin_handle->mon_length);
-	assert(mon_get_buffer);
-	erc = rb_init(&rb_monitor, plugin_handle->mon_size);
-	assert(!erc);
-	erc = pthread_mutex_init(&mutex, NULL);
-	assert(erc == 0);
-	erc = pthread_cond_init(&cond, NULL);
+	/* A monitor line per slot, mon_size octets for the ring */
+	assert(plugin_handle->mon_length >= 8);
+	slot_size = plugin_handle->mon_length;
+	n_slots = CONSOLE_MIN_SLOTS;
+	while (n_slots * slot_size < plugin_handle->mon_size)
+		n_slots *= 2;
+	ring_mask = n_slots - 1;
+	ring = calloc(n_slots, sizeof(struct console_slot));
+	ring_data = malloc(n_slots * slot_size);
+	assert(ring && ring_data);
+	for (i = 0; i < n_slots; ++i) {
+		ring[i].seq = i;
+		ring[i].data = &ring_data[i * slot_size];
+	} /* end for */
+	enqueue_pos = dequeue_pos = 0;
+	mon_drops = 0;
+	waiting = false;
+	erc = sem_init(&wakeup, 0, 0);
 	assert(erc == 0);
+	out_init(&out, STDOUT_FILENO);
+	holder = -1;
+	for (i = 0; i < CONSOLE_SOURCES; ++i) {
+		deferred[i].len = 0;
+		deferred[i].open = false;
+		deferred[i].max = DEFER_MAX;
+		deferred[i].buf = malloc(DEFER_MAX);
+		assert(deferred[i].buf);
+	} /* end for */
+	n_lead_mon = out_decode_ctrl(h->lead_mon, lead_mon, S_LEAD);
+	n_lead_txt = out_decode_ctrl(h->lead_txt, lead_txt, S_LEAD);
+	initialized = true;
 	pthread_attr_init(&thread_args);
 	pthread_attr_setdetachstate(&thread_args, PTHREAD_CREATE_JOINABLE);
-	erc = pthread_create(&prim_thread, &thread_args, prim_worker, h);
+	erc = pthread_create(&output_thread, &thread_args, output_worker, h);
 	assert(erc == 0);
-	erc = pthread_create(&monitor_thread, &thread_args, monitor_worker, h);
+	erc = pthread_create(&prim_thread, &thread_args, prim_worker, h);
 	assert(erc == 0);
 	pthread_attr_destroy(&thread_args);
 }
 
 void stdout_terminate(struct plugin_handle *h)
 {
+	int i;
+
 	assert(h);
 	assert(initialized);
 	initialized = false;
-	plugin_handle = NULL;
-	pthread_cond_destroy(&cond);
-	pthread_mutex_destroy(&mutex);
 	pthread_kill(prim_thread, SIGINT);
-	pthread_kill(monitor_thread, SIGINT);
-	free(mon_line_buffer);
-	mon_line_buffer = NULL;
-	free(mon_get_buffer);
-	mon_get_buffer = NULL;
-	rb_destroy(&rb_monitor);
+	/* Write what is left, then the output thread ends */
+	sem_post(&wakeup);
+	pthread_join(output_thread, NULL);
+	sem_destroy(&wakeup);
+	for (i = 0; i < CONSOLE_SOURCES; ++i) {
+		free(deferred[i].buf);
+		deferred[i].buf = NULL;
+	} /* end for */
+	free(ring);
+	ring = NULL;
+	free(ring_data);
+	ring_data = NULL;
 	primbuffer_destroy(&primbuffer);
 	plugin_handle = NULL;
 }
-
-static volatile enum stdout_lock_id locked_id = NO_thread;
-
-void aquire_stdout_lock(enum stdout_lock_id id)
-{
-	bool have_lock;
-
-	pthread_mutex_lock(&mutex);
-	have_lock = (locked_id == id);
-	pthread_mutex_unlock(&mutex);
-	while (!have_lock) {
-		pthread_mutex_lock(&mutex);
-		if (locked_id != NO_thread) {
-			pthread_cond_wait(&cond, &mutex);
-		}
-		if (locked_id == NO_thread) {
-			have_lock = true;
-			locked_id = id;
-		} else {
-			have_lock = false;
-		}
-		pthread_mutex_unlock(&mutex);
-	} /* end while */
-}
-
-void release_stdout_lock(void)
-{
-	pthread_mutex_lock(&mutex);
-	locked_id = NO_thread;
-	pthread_cond_signal(&cond);
-	pthread_mutex_unlock(&mutex);
-}
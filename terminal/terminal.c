@@ -18,6 +18,7 @@
 #include "../runtime/runtime.h"
 #include "../runtime/dlsap.h"
 #include "../runtime/primbuffer.h"
+#include "../runtime/callsign.h"
 #include "terminal.h"
 #include "_internal.h"
 
@@ -35,12 +36,20 @@ static bool on_write(dls_t *dls, primitive_t *prim, bool expedited,
 	return true;
 }
 
+static bool on_write_owned(dls_t *dls, primitive_t *prim, bool expedited,
+			struct exception *ex)
+{
+	primbuffer_push_owned(&primbuffer, prim, false);
+	return true;
+}
+
 struct dls local_dls = {
 		.set_default_local_addr  = NULL,
 		.set_default_remote_addr = NULL,
 		.open                    = NULL,
 		.close                   = NULL,
 		.on_write                = on_write,
+		.on_write_owned          = on_write_owned,
 		.get_queue_stats         = NULL,
 		.name                    = NULL,
 		.peer                    = NULL,
@@ -51,6 +60,34 @@ struct dls *peerDLS(void)
 	return local_dls.peer;
 }
 
+bool set_local_addr(const char *addr, struct exception *ex)
+{
+	const char *next;
+
+	if (!dlsap_set_default_local_addr(local_dls.peer, addr, &plugin.loc_addr,
+			ex))
+		return false;
+	/* Keep the binary form, so that requests need no parsing later */
+	plugin.loc_call = callsignFromString(string_c(&plugin.loc_addr), &next,
+			NULL);
+	if (plugin.loc_call && *next)
+		plugin.loc_call = 0;
+	return true;
+}
+
+bool set_remote_addr(const char *addr, struct exception *ex)
+{
+	int n;
+
+	if (!dlsap_set_default_remote_addr(local_dls.peer, addr, &plugin.rem_addr,
+			ex))
+		return false;
+	n = callsignPathFromString(string_c(&plugin.rem_addr), plugin.rem_path,
+			DL_MAX_PATH, NULL);
+	plugin.rem_path_len = (n > 0) ? n : 0;
+	return true;
+}
+
 bool terminal_start(struct plugin_handle *h, struct exception *ex)
 {
 	assert(!initialized);
@@ -64,14 +101,12 @@ bool terminal_start(struct plugin_handle *h, struct exception *ex)
 		return false;
 	}
 
-	if (!dlsap_set_default_local_addr(local_dls.peer, string_c(&h->loc_addr),
-			&h->loc_addr, ex))
+	if (!set_local_addr(string_c(&h->loc_addr), ex))
 	{
 		return false;
 	}
 
-	if (!dlsap_set_default_remote_addr(local_dls.peer, string_c(&h->rem_addr),
-			&h->rem_addr, ex))
+	if (!set_remote_addr(string_c(&h->rem_addr), ex))
 	{
 		return false;
 	}